@@ -0,0 +1,170 @@
+/**
+ * @file aqi.c
+ * @brief Rolling statistics and US-EPA Air Quality Index, in integers only
+ */
+
+/*
+ * The window keeps its samples in a ring, along with their running sum and
+ * sum of squares. Minimum and maximum come from two monotonic queues of
+ * ring slots: a new sample first drops every queued candidate it beats,
+ * so the front of each queue is always the answer. Every slot holds one
+ * sample of the window at a time, so the front expires exactly when its
+ * slot is about to be overwritten.
+ *
+ * The AQI is the linear interpolation between the breakpoints bracketing
+ * the concentration:
+ *
+ *   I = (I_hi - I_lo) / (C_hi - C_lo) * (C - C_lo) + I_lo
+ *
+ * which is done with a single rounded division.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "aqi.h"
+
+#define AQI_Q_MASK	(AQI_WIN_MAX - 1)
+
+/// One row of a breakpoint table
+typedef struct aqi_bp_type {
+	uint16_t	c_lo;
+	uint16_t	c_hi;
+	uint16_t	i_lo;
+	uint16_t	i_hi;
+} aqi_bp_t;
+
+// PM2.5, in 0.1 ug/m^3 (2024 revision)
+static const aqi_bp_t aqi_bp_pm2_5[] = {
+	{    0,   90,   0,  50 },
+	{   91,  354,  51, 100 },
+	{  355,  554, 101, 150 },
+	{  555, 1254, 151, 200 },
+	{ 1255, 2254, 201, 300 },
+	{ 2255, 3254, 301, 500 },
+};
+
+// PM10, in ug/m^3
+static const aqi_bp_t aqi_bp_pm10[] = {
+	{   0,  54,   0,  50 },
+	{  55, 154,  51, 100 },
+	{ 155, 254, 101, 150 },
+	{ 255, 354, 151, 200 },
+	{ 355, 424, 201, 300 },
+	{ 425, 604, 301, 500 },
+};
+
+#define AQI_NR_BP(tbl)	(sizeof(tbl) / sizeof((tbl)[0]))
+
+/////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Push @p slot onto the back of a monotonic queue, after dropping every
+ * candidate that the new sample beats or ties
+ */
+static void aqi_q_push(const aqi_win_t *w, uint8_t *q, uint8_t head,
+	uint8_t *len, uint8_t slot, bool is_max)
+{
+	uint16_t v = w->val[slot];
+	uint16_t back;
+
+	while (*len > 0) {
+		back = w->val[q[(head + *len - 1) & AQI_Q_MASK]];
+		if (is_max ? back > v : back < v)
+			break;
+		--*len;
+	}
+	q[(head + *len) & AQI_Q_MASK] = slot;
+	++*len;
+}
+
+// Drop the front of a queue if it is @p slot
+static void aqi_q_expire(const uint8_t *q, uint8_t *head, uint8_t *len,
+	uint8_t slot)
+{
+	if (*len > 0 && q[*head] == slot) {
+		*head = (*head + 1) & AQI_Q_MASK;
+		--*len;
+	}
+}
+
+static uint16_t aqi_interp(const aqi_bp_t *tbl, size_t nr, uint16_t c)
+{
+	const aqi_bp_t *bp;
+	uint32_t num, den;
+	size_t x;
+
+	for (x = 0; x < nr; ++x) {
+		bp = &tbl[x];
+		if (c > bp->c_hi)
+			continue;
+
+		// Concentrations are truncated, so none fall between rows
+		num = (uint32_t)(bp->i_hi - bp->i_lo) * (c - bp->c_lo);
+		den = bp->c_hi - bp->c_lo;
+		return (uint16_t)(bp->i_lo + (2 * num + den) / (2 * den));
+	}
+	return tbl[nr - 1].i_hi;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+void aqi_win_init(aqi_win_t *w, uint8_t size)
+{
+	memset(w, 0, sizeof(*w));
+	if (size == 0)
+		size = 1;
+	w->size = size < AQI_WIN_MAX ? size : AQI_WIN_MAX;
+}
+
+void aqi_win_push(aqi_win_t *w, uint16_t v)
+{
+	uint8_t slot = w->head;
+	uint16_t old;
+
+	if (w->len == w->size) {
+		old = w->val[slot];
+		w->sum -= old;
+		w->sum_sq -= (uint32_t)old * old;
+		aqi_q_expire(w->max_q, &w->max_head, &w->max_len, slot);
+		aqi_q_expire(w->min_q, &w->min_head, &w->min_len, slot);
+	} else {
+		++w->len;
+	}
+
+	w->val[slot] = v;
+	w->sum += v;
+	w->sum_sq += (uint32_t)v * v;
+	aqi_q_push(w, w->max_q, w->max_head, &w->max_len, slot, true);
+	aqi_q_push(w, w->min_q, w->min_head, &w->min_len, slot, false);
+
+	if (++w->head == w->size)
+		w->head = 0;
+}
+
+void aqi_win_stats(const aqi_win_t *w, aqi_stats_t *stats)
+{
+	uint32_t n = w->len;
+	uint64_t s = w->sum;
+
+	memset(stats, 0, sizeof(*stats));
+	if (n == 0)
+		return;
+
+	stats->n = (uint8_t)n;
+	stats->mean = (uint16_t)((s + n / 2) / n);
+	stats->max = w->val[w->max_q[w->max_head]];
+	stats->min = w->val[w->min_q[w->min_head]];
+	stats->var = (uint32_t)((n * w->sum_sq - s * s) / (n * n));
+}
+
+uint16_t aqi_pm2_5(uint16_t c_dug)
+{
+	return aqi_interp(aqi_bp_pm2_5, AQI_NR_BP(aqi_bp_pm2_5), c_dug);
+}
+
+uint16_t aqi_pm10(uint16_t c_ug)
+{
+	return aqi_interp(aqi_bp_pm10, AQI_NR_BP(aqi_bp_pm10), c_ug);
+}
@@ -0,0 +1,96 @@
+/**
+ * @file aqi.h
+ * @brief Rolling statistics and US-EPA Air Quality Index, in integers only
+ */
+
+#if !defined(AQI_H_)
+#define AQI_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// C linkage should be maintained
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+
+/// Largest window, in samples; a power of two
+#define AQI_WIN_MAX	64
+
+/// Statistics over a window
+typedef struct aqi_stats_type {
+	/// Number of samples in the window; the rest are zero if there are none
+	uint8_t		n;
+
+	/// Mean, rounded to nearest
+	uint16_t	mean;
+
+	uint16_t	min;
+	uint16_t	max;
+
+	/// Population variance, in squared sample units
+	uint32_t	var;
+} aqi_stats_t;
+
+/**
+ * Sliding window over the last few samples
+ *
+ * Pushing a sample and getting the statistics are both O(1) (amortized, for
+ * the minimum and maximum); treat as opaque.
+ */
+typedef struct aqi_win_type {
+	uint16_t	val[AQI_WIN_MAX];
+	uint8_t		size;
+	uint8_t		len;
+	uint8_t		head;
+
+	/// Slots of candidate maxima/minima, oldest first, as rings
+	uint8_t		max_q[AQI_WIN_MAX];
+	uint8_t		min_q[AQI_WIN_MAX];
+	uint8_t		max_head, max_len;
+	uint8_t		min_head, min_len;
+
+	uint32_t	sum;
+	uint64_t	sum_sq;
+} aqi_win_t;
+
+/**
+ * Reset a window
+ *
+ * @param[in]	size	Window length, in samples; clamped to [1, AQI_WIN_MAX]
+ */
+void aqi_win_init(aqi_win_t *w, uint8_t size);
+
+/// Add a sample, dropping the oldest one if the window is full
+void aqi_win_push(aqi_win_t *w, uint16_t v);
+
+/// Get the statistics over the samples currently in the window
+void aqi_win_stats(const aqi_win_t *w, aqi_stats_t *stats);
+
+/**
+ * Get the AQI for a PM2.5 concentration, per the 2024 US-EPA breakpoints
+ *
+ * @param[in]	c_dug	Concentration, in 0.1 ug/m^3
+ *
+ * @return	AQI, rounded to nearest; 500 beyond the top breakpoint
+ */
+uint16_t aqi_pm2_5(uint16_t c_dug);
+
+/**
+ * Get the AQI for a PM10 concentration, per the US-EPA breakpoints
+ *
+ * @param[in]	c_ug	Concentration, in ug/m^3
+ *
+ * @return	AQI, rounded to nearest; 500 beyond the top breakpoint
+ */
+uint16_t aqi_pm10(uint16_t c_ug);
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifdef __cplusplus
+}
+#endif	// __cplusplus
+#endif	// !defined(AQI_H_)
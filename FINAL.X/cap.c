@@ -0,0 +1,225 @@
+/**
+ * @file cap.c
+ * @brief Capture format for raw sensor traffic
+ */
+
+/*
+ * Frame layout, before the CRC (big-endian) and COBS:
+ *
+ * --  0  header		u8: 110 L K ccc
+ * --  1  seq			u8
+ * --  2  time			u32 little-endian if K, else varint
+ * --  .  data			1 to CAP_DATA_MAX bytes
+ *
+ * ccc is the channel, K marks a keyframe, L that bytes were lost before this
+ * frame. A keyframe holds the absolute time of its first byte; other frames
+ * hold the difference from the time of the previous frame, as a zig-zag
+ * varint (as in telemetry delta records); frames on different channels
+ * overlap, and are sent as they complete, so this may be negative.
+ * Successive frames take successive sequence numbers, so the decoder can
+ * tell whether it holds the frame a delta refers to, however many frames of
+ * other kinds come in between.
+ *
+ * The CRC (CRC-16/CCITT-FALSE) and the COBS encoding are those of telemetry
+ * frames, from telem.c.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "cap.h"
+#include "telem.h"
+
+#define CAP_HDR_TAG	0xC0
+#define CAP_HDR_MASK	0xE0
+#define CAP_HDR_LOSS	0x10
+#define CAP_HDR_KEY	0x08
+#define CAP_HDR_CH	0x07
+
+/////////////////////////////////////////////////////////////////////////////
+
+// Encode the frame put together on channel @p ch, if any, and start over
+static size_t cap_encode_frame(cap_encoder_t *e, uint8_t ch, uint8_t *buf)
+{
+	cap_pending_t *c = &e->ch[ch];
+	uint8_t raw[CAP_FRAME_MAX];
+	uint8_t *p = raw;
+	int32_t delta = (int32_t)(c->first - e->prev);
+	uint32_t zz = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+	uint16_t crc;
+	size_t len;
+
+	if (c->len == 0)
+		return 0;
+
+	if (e->since_key == 0) {
+		*p++ = CAP_HDR_TAG | CAP_HDR_KEY | (e->loss ? CAP_HDR_LOSS : 0) |
+			ch;
+		*p++ = e->seq;
+		*p++ = (uint8_t)c->first;
+		*p++ = (uint8_t)(c->first >> 8);
+		*p++ = (uint8_t)(c->first >> 16);
+		*p++ = (uint8_t)(c->first >> 24);
+	} else {
+		*p++ = CAP_HDR_TAG | (e->loss ? CAP_HDR_LOSS : 0) | ch;
+		*p++ = e->seq;
+		while (zz >= 0x80) {
+			*p++ = (uint8_t)(zz | 0x80);
+			zz >>= 7;
+		}
+		*p++ = (uint8_t)zz;
+	}
+	memcpy(p, c->data, c->len);
+	p += c->len;
+	crc = telem_crc16_update(TELEM_CRC16_INIT, raw, (size_t)(p - raw));
+	*p++ = (uint8_t)(crc >> 8);
+	*p++ = (uint8_t)crc;
+
+	len = telem_cobs_encode(raw, (size_t)(p - raw), buf);
+	buf[len++] = 0;
+
+	if (++e->since_key >= e->key_interval)
+		e->since_key = 0;
+	++e->seq;
+	e->prev = c->first;
+	e->loss = false;
+	c->len = 0;
+	++e->nr_frames;
+	e->nr_bytes += len;
+	return len;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+void cap_encoder_init(cap_encoder_t *e, uint32_t gap, uint8_t key_interval)
+{
+	memset(e, 0, sizeof(*e));
+	e->gap = gap;
+	e->key_interval = key_interval;
+}
+
+size_t cap_encode_byte(cap_encoder_t *e, uint8_t ch, uint32_t when,
+	uint8_t c, uint8_t *buf)
+{
+	cap_pending_t *p = &e->ch[ch % CAP_NR_CH];
+	size_t len = 0;
+
+	if (p->len > 0 && (when - p->last > e->gap || p->len == CAP_DATA_MAX))
+		len = cap_encode_frame(e, ch % CAP_NR_CH, buf);
+	if (p->len == 0)
+		p->first = when;
+	p->data[p->len++] = c;
+	p->last = when;
+	++e->nr_data;
+	return len;
+}
+
+size_t cap_encode_idle(cap_encoder_t *e, uint32_t now, uint8_t *buf)
+{
+	size_t len = 0;
+	uint8_t ch;
+
+	for (ch = 0; ch < CAP_NR_CH; ++ch) {
+		if (now - e->ch[ch].last > e->gap)
+			len += cap_encode_frame(e, ch, &buf[len]);
+	}
+	return len;
+}
+
+size_t cap_encode_flush(cap_encoder_t *e, uint8_t *buf)
+{
+	size_t len = 0;
+	uint8_t ch;
+
+	for (ch = 0; ch < CAP_NR_CH; ++ch)
+		len += cap_encode_frame(e, ch, &buf[len]);
+	return len;
+}
+
+void cap_encoder_resync(cap_encoder_t *e)
+{
+	e->loss = true;
+	e->since_key = 0;
+}
+
+void cap_decoder_init(cap_decoder_t *d)
+{
+	memset(d, 0, sizeof(*d));
+}
+
+bool cap_feed_byte(cap_decoder_t *d, uint8_t c, cap_frame_t *f)
+{
+	const uint8_t *p = d->buf, *end;
+	uint32_t when = 0, zz = 0;
+	unsigned int shift;
+	size_t len;
+
+	if (c != 0) {
+		if (d->len < sizeof(d->buf))
+			d->buf[d->len++] = c;
+		else
+			d->overflow = true;
+		return false;
+	}
+
+	// Back-to-back delimiters are just idle fill
+	len = d->len;
+	d->len = 0;
+	if (d->overflow) {
+		d->overflow = false;
+		++d->nr_bad;
+		return false;
+	}
+	if (len == 0)
+		return false;
+
+	len = telem_cobs_decode(d->buf, len);
+	if (len < 2 + 1 + 1 + 2 || (d->buf[0] & CAP_HDR_MASK) != CAP_HDR_TAG ||
+	    telem_crc16_update(TELEM_CRC16_INIT, d->buf, len - 2) !=
+	    ((d->buf[len - 2] << 8) | d->buf[len - 1])) {
+		++d->nr_bad;
+		return false;
+	}
+	end = d->buf + len - 2;
+	p += 2;
+
+	if ((d->buf[0] & CAP_HDR_KEY) != 0) {
+		if (end - p < 4 + 1) {
+			++d->nr_bad;
+			return false;
+		}
+		when = (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+			((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+		p += 4;
+	} else {
+		for (shift = 0; shift < 35 && p < end; shift += 7) {
+			zz |= (uint32_t)(*p & 0x7F) << shift;
+			if ((*p++ & 0x80) == 0)
+				break;
+		}
+		if (p >= end || (p[-1] & 0x80) != 0) {
+			++d->nr_bad;
+			return false;
+		}
+		if (!d->have_prev || d->buf[1] != (uint8_t)(d->seq + 1)) {
+			++d->nr_lost;
+			return false;
+		}
+		when = d->prev + ((zz >> 1) ^ (0 - (zz & 1)));
+	}
+
+	d->prev = when;
+	d->seq = d->buf[1];
+	d->have_prev = true;
+	++d->nr_good;
+
+	f->ch = d->buf[0] & CAP_HDR_CH;
+	f->loss = (d->buf[0] & CAP_HDR_LOSS) != 0;
+	if (f->loss)
+		++d->nr_loss;
+	f->when = when;
+	f->len = (uint8_t)(end - p);
+	f->data = p;
+	return true;
+}
@@ -0,0 +1,191 @@
+/**
+ * @file cap.h
+ * @brief Capture format for raw sensor traffic
+ *
+ * Bytes received on the sensor USARTs are sent, with the time they came in,
+ * as frames of the same kind as telemetry (CRC-16, COBS, zero delimiter), so
+ * that they can share the downlink. Like telem.c, this codec has no
+ * dependency on the target; host tools build the same cap.c to read
+ * captures back.
+ */
+
+#if !defined(CAP_H_)
+#define CAP_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// C linkage should be maintained
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+
+/// Most bytes of traffic in a frame
+#define CAP_DATA_MAX	64
+
+/// Channels told apart
+#define CAP_NR_CH	4
+
+/// Largest frame on the wire: header, time, data, CRC, COBS and delimiter
+#define CAP_FRAME_MAX	(2 + 5 + CAP_DATA_MAX + 2 + 1 + 1)
+
+/// A run of bytes received back-to-back on one channel
+typedef struct cap_frame_type {
+	/// Channel, as platform_usart_ch_t
+	uint8_t		ch;
+
+	/// Set if bytes were lost on the device before this frame
+	bool		loss;
+
+	/// Time the first byte was received, in the units fed to the encoder
+	uint32_t	when;
+
+	/// The bytes
+	uint8_t		len;
+	const uint8_t	*data;
+} cap_frame_t;
+
+/// A frame being put together, and the times of its first and last byte
+typedef struct cap_pending_type {
+	uint8_t		data[CAP_DATA_MAX];
+	uint8_t		len;
+	uint32_t	first;
+	uint32_t	last;
+} cap_pending_t;
+
+/**
+ * Encoder state; treat as opaque, except for the counters
+ */
+typedef struct cap_encoder_type {
+	/// Frame being put together on each channel
+	cap_pending_t	ch[CAP_NR_CH];
+
+	/// Time of the previous frame, which the next one's is a delta from
+	uint32_t	prev;
+	uint8_t		seq;
+
+	/// Silence after which bytes go into a new frame
+	uint32_t	gap;
+
+	/// Frames per keyframe, and frames encoded since the last one
+	uint8_t		key_interval;
+	uint8_t		since_key;
+
+	/// Whether the next frame is to carry the loss flag
+	bool		loss;
+
+	/// Frames and bytes of traffic encoded
+	uint32_t	nr_frames;
+	uint32_t	nr_data;
+
+	/// Bytes encoded, delimiters included
+	uint32_t	nr_bytes;
+} cap_encoder_t;
+
+/**
+ * Reset an encoder, including its counters
+ *
+ * @param[in]	gap		Silence, in time units, that ends a frame; a
+ *				couple of character times keeps whole
+ *				sentences and responses together
+ * @param[in]	key_interval	Frames per keyframe (with the absolute time)
+ */
+void cap_encoder_init(cap_encoder_t *e, uint32_t gap, uint8_t key_interval);
+
+/**
+ * Add a received byte
+ *
+ * The byte goes into the frame being put together for its channel, unless
+ * it came after a gap, or the frame is full; the latter is then encoded, and
+ * the byte starts a new one. Frames go out as they are completed, so their
+ * times are not in order across channels.
+ *
+ * @param[in]	ch	Channel; below @c CAP_NR_CH
+ * @param[in]	when	Time of reception; any unit, but the same throughout
+ * @param[out]	buf	Destination; at least @c CAP_FRAME_MAX bytes
+ *
+ * @return	Size of the frame encoded into @p buf, or zero
+ */
+size_t cap_encode_byte(cap_encoder_t *e, uint8_t ch, uint32_t when,
+	uint8_t c, uint8_t *buf);
+
+/**
+ * Encode the frames being put together that nothing was added to for a gap
+ *
+ * @param[in]	now	Current time, in the units of @c cap_encode_byte()
+ * @param[out]	buf	Destination; at least @c CAP_NR_CH * @c CAP_FRAME_MAX
+ *			bytes
+ *
+ * @return	Size of the frames encoded into @p buf, if any
+ */
+size_t cap_encode_idle(cap_encoder_t *e, uint32_t now, uint8_t *buf);
+
+/**
+ * Encode all frames being put together, right away
+ *
+ * @param[out]	buf	Destination; at least @c CAP_NR_CH * @c CAP_FRAME_MAX
+ *			bytes
+ *
+ * @return	Size of the frames encoded into @p buf, if any
+ */
+size_t cap_encode_flush(cap_encoder_t *e, uint8_t *buf);
+
+/**
+ * Flag a loss: the next frame is a keyframe, and carries the loss flag
+ *
+ * If the bytes being put together came before the loss, call
+ * @c cap_encode_flush() first. Frames that were encoded but did not make
+ * it onto the link are a loss as well.
+ */
+void cap_encoder_resync(cap_encoder_t *e);
+
+/// Decoder state; treat as opaque, except for the counters
+typedef struct cap_decoder_type {
+	uint8_t		buf[CAP_FRAME_MAX];
+	uint8_t		len;
+
+	/// Whether the frame in progress is being dropped as overlong
+	bool		overflow;
+
+	/// Time and sequence number of the last frame decoded
+	uint32_t	prev;
+	uint8_t		seq;
+	bool		have_prev;
+
+	/// Frames decoded
+	uint32_t	nr_good;
+
+	/// Frames that are not (valid) capture frames
+	uint32_t	nr_bad;
+
+	/// Delta frames dropped because the frame before them was lost
+	uint32_t	nr_lost;
+
+	/// Frames decoded with the loss flag set
+	uint32_t	nr_loss;
+} cap_decoder_t;
+
+/// Reset a decoder, including its counters
+void cap_decoder_init(cap_decoder_t *d);
+
+/**
+ * Feed a single byte into the decoder
+ *
+ * Other frames on the same link (telemetry, log messages) are dropped as
+ * bad frames.
+ *
+ * @return	@c true if @p c completed a capture frame, decoded into @p f;
+ *		@p f->data points into the decoder, and is valid until the
+ *		next call
+ */
+bool cap_feed_byte(cap_decoder_t *d, uint8_t c, cap_frame_t *f);
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifdef __cplusplus
+}
+#endif	// __cplusplus
+#endif	// !defined(CAP_H_)
@@ -0,0 +1,185 @@
+/**
+ * @file fixpt.c
+ * @brief Fixed-point conversions for GPS fields, without floating point
+ */
+
+/*
+ * Magnitudes are accumulated as uint32_t and saturate at INT32_MAX, so that
+ * the sign can always be applied afterwards. Unit conversions use reduced
+ * ratios chosen to fit 32 bits over the documented ranges:
+ *
+ * -- 1 kn   = 1852 m/h  = 463/9 cm/s
+ * -- 1 km/h = 1000 m/h  = 1/36 cm/s (per m/h)
+ * -- 1e-7 degree = 6e-6 minute
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "fixpt.h"
+
+#define FIXPT_MAG_MAX	((uint32_t)INT32_MAX)
+
+/////////////////////////////////////////////////////////////////////////////
+
+static inline bool fixpt_isdigit(char c)
+{
+	return (c >= '0' && c <= '9');
+}
+
+// v * 10 + d, saturating
+static inline uint32_t fixpt_mac10(uint32_t v, uint32_t d)
+{
+	if (v > (FIXPT_MAG_MAX - d) / 10)
+		return FIXPT_MAG_MAX;
+	return v * 10 + d;
+}
+
+/*
+ * Common parser: integer digits, then exactly @p nr_dec decimals, with the
+ * digit after those used for rounding
+ */
+static uint32_t fixpt_parse_mag(const char **ps, uint32_t v, uint8_t nr_dec)
+{
+	const char *s = *ps;
+	bool round_up;
+	uint8_t n;
+
+	while (fixpt_isdigit(*s))
+		v = fixpt_mac10(v, (uint32_t)(*s++ - '0'));
+
+	if (*s == '.')
+		++s;
+	for (n = 0; n < nr_dec; ++n) {
+		if (fixpt_isdigit(*s))
+			v = fixpt_mac10(v, (uint32_t)(*s++ - '0'));
+		else
+			v = fixpt_mac10(v, 0);
+	}
+
+	round_up = (*s >= '5' && *s <= '9');
+	while (fixpt_isdigit(*s))
+		++s;
+	if (round_up && v < FIXPT_MAG_MAX)
+		++v;
+
+	*ps = s;
+	return v;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+int32_t fixpt_parse(const char *s, uint8_t nr_dec, const char **end)
+{
+	bool neg = false;
+	uint32_t v;
+
+	if (*s == '-' || *s == '+')
+		neg = (*s++ == '-');
+	v = fixpt_parse_mag(&s, 0, nr_dec);
+	if (end != NULL)
+		*end = s;
+	return neg ? -(int32_t)v : (int32_t)v;
+}
+
+size_t fixpt_fmt(char *buf, int32_t v, uint8_t nr_dec)
+{
+	char tmp[12];
+	uint32_t mag = (v < 0) ? (0U - (uint32_t)v) : (uint32_t)v;
+	size_t len = 0, x = 0;
+
+	// Least-significant digit first; at least one integer digit.
+	do {
+		tmp[x++] = (char)('0' + mag % 10);
+		mag /= 10;
+		if (x == nr_dec)
+			tmp[x++] = '.';
+	} while (mag != 0 || x < nr_dec + 1U + (nr_dec != 0));
+
+	if (v < 0)
+		buf[len++] = '-';
+	while (x > 0)
+		buf[len++] = tmp[--x];
+	buf[len] = '\0';
+	return len;
+}
+
+int32_t fixpt_ddmm_to_e7(const char *s, char hemi)
+{
+	uint32_t ip = 0, deg, min_e6;
+
+	while (fixpt_isdigit(*s))
+		ip = fixpt_mac10(ip, (uint32_t)(*s++ - '0'));
+	deg = ip / 100;
+	if (deg > 180)
+		deg = 180;
+
+	// mm.mmmmmm, as an integer
+	min_e6 = fixpt_parse_mag(&s, ip % 100, 6);
+
+	// e7 = deg * 10^7 + min_e6 / 6, rounded to nearest
+	deg = deg * 10000000 + (min_e6 + 3) / 6;
+	return (hemi == 'S' || hemi == 'W') ? -(int32_t)deg : (int32_t)deg;
+}
+
+size_t fixpt_e7_to_ddmm(char *buf, int32_t e7, bool is_lon, char *hemi)
+{
+	uint32_t mag = (e7 < 0) ? (0U - (uint32_t)e7) : (uint32_t)e7;
+	uint32_t deg = mag / 10000000;
+	uint32_t min_e6 = (mag % 10000000) * 6;
+	size_t len = 0;
+
+	if (hemi != NULL) {
+		if (is_lon)
+			*hemi = (e7 < 0) ? 'W' : 'E';
+		else
+			*hemi = (e7 < 0) ? 'S' : 'N';
+	}
+
+	if (is_lon || deg >= 100)
+		buf[len++] = (char)('0' + deg / 100);
+	buf[len++] = (char)('0' + (deg / 10) % 10);
+	buf[len++] = (char)('0' + deg % 10);
+
+	// Whole minutes always take two digits.
+	if (min_e6 < 10000000)
+		buf[len++] = '0';
+	return len + fixpt_fmt(&buf[len], (int32_t)min_e6, 6);
+}
+
+int32_t fixpt_m_to_mm(const char *s)
+{
+	return fixpt_parse(s, 3, NULL);
+}
+
+uint32_t fixpt_knots_to_cmps(const char *s)
+{
+	uint32_t v = fixpt_parse_mag(&s, 0, 3);
+
+	// Saturate rather than overflow (~9000 kn)
+	if (v > (UINT32_MAX - 4500) / 463)
+		v = (UINT32_MAX - 4500) / 463;
+	return (v * 463 + 4500) / 9000;
+}
+
+uint32_t fixpt_kmh_to_cmps(const char *s)
+{
+	uint32_t v = fixpt_parse_mag(&s, 0, 3);
+
+	return v / 36 + ((v % 36) >= 18);
+}
+
+uint32_t fixpt_cmps_to_knots_e3(uint32_t cmps)
+{
+	// Saturate rather than overflow (~4700 kn)
+	if (cmps > (UINT32_MAX - 231) / 9000)
+		cmps = (UINT32_MAX - 231) / 9000;
+	return (cmps * 9000 + 231) / 463;
+}
+
+uint32_t fixpt_cmps_to_kmh_e3(uint32_t cmps)
+{
+	if (cmps > UINT32_MAX / 36)
+		cmps = UINT32_MAX / 36;
+	return cmps * 36;
+}
@@ -0,0 +1,93 @@
+/**
+ * @file fixpt.h
+ * @brief Fixed-point conversions for GPS fields, without floating point
+ *
+ * All parsers take NUL-terminated (or otherwise delimited) ASCII fields as
+ * found in NMEA sentences, and stop at the first character that does not
+ * belong to the number. Each runs in time linear in the length of the
+ * field, with 32-bit arithmetic only; out-of-range inputs saturate.
+ */
+
+#if !defined(FIXPT_H_)
+#define FIXPT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// C linkage should be maintained
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Parse a signed decimal number into an integer scaled by 10^nr_dec
+ *
+ * Digits beyond @p nr_dec decimals are rounded half away from zero; missing
+ * ones count as zero. An empty field yields zero.
+ *
+ * @param[in]	s	Field
+ * @param[in]	nr_dec	Number of decimals to keep, up to 9
+ * @param[out]	end	If not NULL, receives a pointer past the number
+ */
+int32_t fixpt_parse(const char *s, uint8_t nr_dec, const char **end);
+
+/**
+ * Format an integer scaled by 10^nr_dec as a decimal number
+ *
+ * @param[out]	buf	Destination; at least 13 bytes, including the NUL
+ *
+ * @return	Number of characters written, excluding the NUL
+ */
+size_t fixpt_fmt(char *buf, int32_t v, uint8_t nr_dec);
+
+/**
+ * Convert an NMEA (d)ddmm.mmmm angle into 1e-7 degrees
+ *
+ * The result is correctly rounded for up to six decimals of minutes, which
+ * covers every NMEA receiver in practice.
+ *
+ * @param[in]	s	Angle field
+ * @param[in]	hemi	Hemisphere ('N', 'S', 'E' or 'W'); 'S' and 'W'
+ *			negate the result
+ */
+int32_t fixpt_ddmm_to_e7(const char *s, char hemi);
+
+/**
+ * Format 1e-7 degrees as an NMEA (d)ddmm.mmmmmm angle
+ *
+ * Six decimals of minutes represent 1e-7 degrees exactly, so this is the
+ * exact inverse of @c fixpt_ddmm_to_e7().
+ *
+ * @param[out]	buf	Destination; at least 13 bytes, including the NUL
+ * @param[in]	e7	Angle
+ * @param[in]	is_lon	Whether this is a longitude (three degree digits)
+ * @param[out]	hemi	If not NULL, receives the hemisphere character
+ *
+ * @return	Number of characters written, excluding the NUL
+ */
+size_t fixpt_e7_to_ddmm(char *buf, int32_t e7, bool is_lon, char *hemi);
+
+/// Convert an altitude in meters into millimeters
+int32_t fixpt_m_to_mm(const char *s);
+
+/// Convert a speed in knots into cm/s, rounded to nearest
+uint32_t fixpt_knots_to_cmps(const char *s);
+
+/// Convert a speed in km/h into cm/s, rounded to nearest
+uint32_t fixpt_kmh_to_cmps(const char *s);
+
+/// Convert a speed in cm/s into 0.001 knots, rounded to nearest
+uint32_t fixpt_cmps_to_knots_e3(uint32_t cmps);
+
+/// Convert a speed in cm/s into 0.001 km/h (i.e. m/h); this is exact
+uint32_t fixpt_cmps_to_kmh_e3(uint32_t cmps);
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifdef __cplusplus
+}
+#endif	// __cplusplus
+#endif	// !defined(FIXPT_H_)
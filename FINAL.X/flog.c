@@ -0,0 +1,319 @@
+/**
+ * @file flog.c
+ * @brief Append-only, wear-levelled record log in flash
+ */
+
+/*
+ * Page layout:
+ *
+ * --  0  seq			u32, little-endian
+ * --  4  CRC of seq		u16, big-endian
+ * --  6  records, each:	len u8, data, CRC of len and data u16 (BE)
+ *
+ * A length of 0xFF (erased flash) ends the page. Every page is programmed
+ * exactly once after its row is erased, and rows are used round-robin, so
+ * they all wear evenly; the row about to be written is erased right before
+ * its first page, which also drops the oldest records once the log has
+ * wrapped around.
+ *
+ * Sequence numbers go up by one per page, so in address order they rise up
+ * to the last page written, then (past a few erased pages) start over from
+ * the oldest. Taking the first good page of each row, the rows whose number
+ * is at least that of row 0 thus form a prefix, and the end of that prefix
+ * is found by a binary search. Half-programmed pages have a bad header, and
+ * are stepped over; a row holding nothing but those (which takes four power
+ * losses in a row while writing it) would throw the search off.
+ *
+ * A full page is copied out of the way and handed to the flash, so records
+ * keep coming in while it is programmed. With a flash that only starts its
+ * operations, flog_poll() moves the page on from erasing its row to being
+ * written, then to done.
+ *
+ * The CRCs are CRC-16/CCITT-FALSE, from telem.c, as for telemetry frames.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "flog.h"
+#include "telem.h"
+
+/// Sequence number of an erased page, never used for a real one
+#define FLOG_SEQ_ERASED	0xFFFFFFFFu
+
+/// What the page being programmed is waiting on
+#define FLOG_IDLE	0
+#define FLOG_ERASE	1
+#define FLOG_WRITE	2
+
+/////////////////////////////////////////////////////////////////////////////
+
+static inline const uint8_t *flog_page(const flog_t *f, uint32_t page)
+{
+	return f->flash->base + page * FLOG_PAGE_SIZE;
+}
+
+// Get the sequence number of a page, if its header is good
+static bool flog_page_seq(const flog_t *f, uint32_t page, uint32_t *seq)
+{
+	const uint8_t *p = flog_page(f, page);
+	uint32_t s;
+
+	s = (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+		((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+	if (s == FLOG_SEQ_ERASED ||
+	    telem_crc16_update(TELEM_CRC16_INIT, p, 4) !=
+	    (uint16_t)((p[4] << 8) | p[5]))
+		return false;
+	*seq = s;
+	return true;
+}
+
+static bool flog_page_erased(const flog_t *f, uint32_t page)
+{
+	const uint8_t *p = flog_page(f, page);
+	unsigned int x;
+
+	for (x = 0; x < FLOG_PAGE_SIZE; ++x) {
+		if (p[x] != 0xFF)
+			return false;
+	}
+	return true;
+}
+
+// Get the sequence number of the first good page of a row
+static bool flog_row_seq(const flog_t *f, uint32_t row, uint32_t *seq)
+{
+	unsigned int x;
+
+	for (x = 0; x < FLOG_ROW_PAGES; ++x) {
+		if (flog_page_seq(f, row * FLOG_ROW_PAGES + x, seq))
+			return true;
+	}
+	return false;
+}
+
+/*
+ * The flash is done with what the page being programmed was waiting on:
+ * start on what comes next, or finish with it
+ */
+static void flog_done(flog_t *f, bool ok)
+{
+	const flog_flash_t *fl = f->flash;
+
+	while (ok && f->state == FLOG_ERASE) {
+		f->state = FLOG_WRITE;
+		ok = fl->write_page(fl->arg, f->out_page * FLOG_PAGE_SIZE,
+			f->out);
+		if (ok && fl->busy != NULL)
+			return;
+	}
+	f->state = FLOG_IDLE;
+	if (ok) {
+		++f->nr_pages_written;
+		return;
+	}
+
+	/*
+	 * Records are not retried, so a bad page is not written forever; after
+	 * a failure, the state of the row is unknown, so the rest of it is
+	 * skipped.
+	 */
+	++f->nr_errors;
+	if (f->page / FLOG_ROW_PAGES == f->out_page / FLOG_ROW_PAGES) {
+		f->page = (f->page / FLOG_ROW_PAGES + 1) * FLOG_ROW_PAGES;
+		if (f->page >= f->nr_pages)
+			f->page = 0;
+	}
+}
+
+// Hand the page buffer over to the flash, and move on to the next page
+static void flog_flush(flog_t *f)
+{
+	const flog_flash_t *fl = f->flash;
+	uint32_t ofs = f->page * FLOG_PAGE_SIZE;
+	uint16_t crc;
+	uint8_t *p = f->buf;
+	bool ok;
+
+	p[0] = (uint8_t)f->seq;
+	p[1] = (uint8_t)(f->seq >> 8);
+	p[2] = (uint8_t)(f->seq >> 16);
+	p[3] = (uint8_t)(f->seq >> 24);
+	crc = telem_crc16_update(TELEM_CRC16_INIT, p, 4);
+	p[4] = (uint8_t)(crc >> 8);
+	p[5] = (uint8_t)crc;
+	memcpy(f->out, f->buf, sizeof(f->out));
+	f->out_page = f->page;
+
+	if (++f->page >= f->nr_pages)
+		f->page = 0;
+	++f->seq;
+	memset(f->buf, 0xFF, sizeof(f->buf));
+	f->len = FLOG_HDR_LEN;
+
+	if (f->out_page % FLOG_ROW_PAGES == 0) {
+		++f->nr_erases;
+		f->state = FLOG_ERASE;
+		ok = fl->erase_row(fl->arg, ofs);
+	} else {
+		f->state = FLOG_WRITE;
+		ok = fl->write_page(fl->arg, ofs, f->out);
+	}
+	if (!ok || fl->busy == NULL)
+		flog_done(f, ok);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+void flog_open(flog_t *f, const flog_flash_t *flash)
+{
+	uint32_t lo, hi, mid, s0, seq, row;
+	unsigned int x;
+
+	memset(f, 0, sizeof(*f));
+	f->flash = flash;
+	f->nr_pages = flash->nr_rows * FLOG_ROW_PAGES;
+	memset(f->buf, 0xFF, sizeof(f->buf));
+	f->len = FLOG_HDR_LEN;
+
+	if (flog_row_seq(f, 0, &s0)) {
+		lo = 0;
+		hi = flash->nr_rows;
+		while (hi - lo > 1) {
+			mid = lo + (hi - lo) / 2;
+			if (flog_row_seq(f, mid, &seq) && seq >= s0)
+				lo = mid;
+			else
+				hi = mid;
+		}
+		row = lo;
+	} else if (flog_row_seq(f, flash->nr_rows - 1, &seq)) {
+		// Row 0 was erased to wrap around, and nothing made it in
+		row = flash->nr_rows - 1;
+	} else {
+		return;
+	}
+
+	for (x = FLOG_ROW_PAGES; x-- > 0; ) {
+		if (flog_page_seq(f, row * FLOG_ROW_PAGES + x, &seq))
+			break;
+	}
+	f->seq = seq + 1;
+	f->page = row * FLOG_ROW_PAGES + x + 1;
+
+	// Step over whatever a power loss left behind in the rest of the row
+	while (f->page % FLOG_ROW_PAGES != 0 && !flog_page_erased(f, f->page)) {
+		++f->page;
+		++f->nr_torn;
+	}
+	if (f->page >= f->nr_pages)
+		f->page = 0;
+}
+
+bool flog_append(flog_t *f, const void *data, uint8_t len)
+{
+	uint8_t *p;
+	uint16_t crc;
+
+	if (len == 0 || len > FLOG_REC_MAX)
+		return false;
+
+	if (f->len + 1 + len + 2 > FLOG_PAGE_SIZE) {
+		flog_poll(f);
+		if (f->state != FLOG_IDLE) {
+			++f->nr_dropped;
+			return false;
+		}
+		flog_flush(f);
+	}
+
+	p = &f->buf[f->len];
+	p[0] = len;
+	memcpy(&p[1], data, len);
+	crc = telem_crc16_update(TELEM_CRC16_INIT, p, 1 + len);
+	p[1 + len] = (uint8_t)(crc >> 8);
+	p[2 + len] = (uint8_t)crc;
+	f->len += 1 + len + 2;
+	++f->nr_records;
+	return true;
+}
+
+void flog_poll(flog_t *f)
+{
+	const flog_flash_t *fl = f->flash;
+	bool ok;
+
+	if (f->state != FLOG_IDLE && !fl->busy(fl->arg, &ok))
+		flog_done(f, ok);
+}
+
+bool flog_sync(flog_t *f)
+{
+	flog_poll(f);
+	if (f->state != FLOG_IDLE)
+		return false;
+	if (f->len > FLOG_HDR_LEN)
+		flog_flush(f);
+	return f->state == FLOG_IDLE;
+}
+
+void flog_rewind(const flog_t *f, flog_cursor_t *c)
+{
+	/*
+	 * The oldest records, if any, are in the row that is erased next: the
+	 * one about to be started, or else the one after the current one
+	 */
+	c->page = f->page;
+	if (c->page % FLOG_ROW_PAGES != 0) {
+		c->page = (c->page / FLOG_ROW_PAGES + 1) * FLOG_ROW_PAGES;
+		if (c->page >= f->nr_pages)
+			c->page = 0;
+	}
+	c->left = f->nr_pages;
+	c->ofs = 0;
+	c->nr_bad = 0;
+}
+
+uint8_t flog_read(const flog_t *f, flog_cursor_t *c, const uint8_t **data)
+{
+	const uint8_t *rec;
+	uint32_t seq;
+	uint8_t len;
+
+	while (c->left > 0) {
+		rec = flog_page(f, c->page) + c->ofs;
+		if (c->ofs == 0) {
+			if (flog_page_seq(f, c->page, &seq)) {
+				c->ofs = FLOG_HDR_LEN;
+				continue;
+			}
+			len = 0;
+		} else if (c->ofs + 1 + 2 < FLOG_PAGE_SIZE) {
+			len = rec[0];
+		} else {
+			len = 0;
+		}
+
+		// Erased, or garbled: on to the next page
+		if (len == 0 || len > FLOG_REC_MAX ||
+		    c->ofs + 1 + len + 2 > FLOG_PAGE_SIZE) {
+			if (++c->page >= f->nr_pages)
+				c->page = 0;
+			--c->left;
+			c->ofs = 0;
+			continue;
+		}
+
+		c->ofs += 1 + len + 2;
+		if (telem_crc16_update(TELEM_CRC16_INIT, rec, 1 + len) !=
+		    (uint16_t)((rec[1 + len] << 8) | rec[2 + len])) {
+			++c->nr_bad;
+			continue;
+		}
+		*data = &rec[1];
+		return len;
+	}
+	return 0;
+}
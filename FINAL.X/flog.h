@@ -0,0 +1,176 @@
+/**
+ * @file flog.h
+ * @brief Append-only, wear-levelled record log in flash
+ *
+ * This module has no dependency on the target: the flash is reached through
+ * a @c flog_flash_t, so the very same flog.c runs against the NVM controller
+ * on board and against a simulated flash on the host.
+ */
+
+#if !defined(FLOG_H_)
+#define FLOG_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// C linkage should be maintained
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+
+/// Size of a flash page, the unit of programming
+#define FLOG_PAGE_SIZE	64
+
+/// Pages per flash row, the unit of erasing
+#define FLOG_ROW_PAGES	4
+
+/// Page header: sequence number and its CRC
+#define FLOG_HDR_LEN	6
+
+/// Largest record; each takes a length byte and a CRC on top of its data
+#define FLOG_REC_MAX	(FLOG_PAGE_SIZE - FLOG_HDR_LEN - 1 - 2)
+
+/// Flash area the log lives in
+typedef struct flog_flash_type {
+	/// Start of the area, readable as memory; aligned to a row
+	const uint8_t	*base;
+
+	/// Size of the area, in rows; at least two
+	uint32_t	nr_rows;
+
+	/**
+	 * Erase the row at offset @p ofs (to all ones), or program the page at
+	 * offset @p ofs with @p data
+	 *
+	 * Both return @c false on failure. Without @c busy, they return once
+	 * done; with it, once started, and @p data is left alone until then.
+	 */
+	bool (*erase_row)(void *arg, uint32_t ofs);
+	bool (*write_page)(void *arg, uint32_t ofs, const uint8_t *data);
+
+	/**
+	 * Check on the operation started last, setting @p ok once it is over
+	 *
+	 * May be NULL, if the two above only return once done.
+	 *
+	 * @return	@c true while it is still going on
+	 */
+	bool (*busy)(void *arg, bool *ok);
+
+	/// Passed to the functions above
+	void		*arg;
+} flog_flash_t;
+
+/// Log state; treat as opaque, except for the counters
+typedef struct flog_type {
+	const flog_flash_t *flash;
+	uint32_t	nr_pages;
+
+	/// Page to be written next, and its sequence number
+	uint32_t	page;
+	uint32_t	seq;
+
+	/// Records waiting for the page to fill up, header space included
+	uint8_t		buf[FLOG_PAGE_SIZE];
+	uint8_t		len;
+
+	/// Page being programmed, where to, and how far along
+	uint8_t		out[FLOG_PAGE_SIZE];
+	uint32_t	out_page;
+	uint8_t		state;
+
+	/// Records accepted by @c flog_append()
+	uint32_t	nr_records;
+
+	/// Records turned away, the page before still being programmed
+	uint32_t	nr_dropped;
+
+	/// Pages programmed, and rows erased
+	uint32_t	nr_pages_written;
+	uint32_t	nr_erases;
+
+	/// Flash operations that failed; the records involved are lost
+	uint32_t	nr_errors;
+
+	/// Partly programmed pages skipped by @c flog_open()
+	uint32_t	nr_torn;
+} flog_t;
+
+/**
+ * Open the log in @p flash, recovering where writing left off
+ *
+ * The last page written is found by a binary search over the rows, so
+ * opening takes O(log n) page reads. A page left half-programmed by a power
+ * loss is skipped, never written over.
+ */
+void flog_open(flog_t *f, const flog_flash_t *flash);
+
+/**
+ * Append a record
+ *
+ * Records are gathered into a page, which is programmed once the next
+ * record no longer fits. Once the log is full, the oldest row is erased to
+ * make room. Flash operations that fail are counted in @c nr_errors.
+ *
+ * @return	@c false if @p len is zero or above @c FLOG_REC_MAX, or if the
+ *		page is full while the one before is still being programmed
+ */
+bool flog_append(flog_t *f, const void *data, uint8_t len);
+
+/**
+ * Move the programming of a page on, if the flash is not done with it
+ *
+ * With a @c busy function, to be called often enough that a page is out
+ * before the next one fills up; @c flog_append() and @c flog_sync() also
+ * call it.
+ */
+void flog_poll(flog_t *f);
+
+/**
+ * Program the records gathered so far, even though the page is not full
+ *
+ * The rest of the page is left unused. Call again until it returns
+ * @c true; a page still being programmed has to be out first.
+ *
+ * @return	@c true once every record appended is in flash, or was lost
+ *		to a failed flash operation
+ */
+bool flog_sync(flog_t *f);
+
+/// Position of a reader within the log
+typedef struct flog_cursor_type {
+	uint32_t	page;
+	uint32_t	left;
+	uint8_t		ofs;
+
+	/// Records skipped due to a bad CRC
+	uint32_t	nr_bad;
+} flog_cursor_t;
+
+/**
+ * Point @p c at the oldest record in flash
+ *
+ * @note
+ * Records still waiting in the page buffer are not seen; call
+ * @c flog_sync() first to include them.
+ */
+void flog_rewind(const flog_t *f, flog_cursor_t *c);
+
+/**
+ * Get the next record, oldest first
+ *
+ * @param[out]	data	The record, right in flash
+ *
+ * @return	Size of the record, or zero once there are no more
+ */
+uint8_t flog_read(const flog_t *f, flog_cursor_t *c, const uint8_t **data);
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifdef __cplusplus
+}
+#endif	// __cplusplus
+#endif	// !defined(FLOG_H_)
@@ -0,0 +1,113 @@
+/**
+ * @file fuse.c
+ * @brief Timestamp-aligned assembly of sensor samples into epoch records
+ */
+
+/*
+ * Every source is triple-buffered: one bank holds the latest sample, one is
+ * being sent as part of the last epoch record, and the third is written by
+ * the producer. Committing a sample swaps the written bank with the latest
+ * one, and closing an epoch marks the latest bank of each source as being
+ * sent, so neither ever waits on the other, and samples are never copied.
+ *
+ * While no new sample came in since the last epoch, the latest bank and the
+ * one being sent are the same; the producer then has two banks to itself.
+ *
+ * NOTE: Everything here runs in the main loop; nothing may be called from
+ *       ISR context.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "platform.h"
+#include "fuse.h"
+
+static inline uint32_t fuse_ms(platform_tick_t tick)
+{
+	return (uint32_t)(tick / PLATFORM_TICKS_MS(1));
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+void fuse_init(fuse_t *f)
+{
+	memset(f, 0, sizeof(*f));
+}
+
+void fuse_src_init(fuse_t *f, fuse_src_t src, void *banks, uint8_t size,
+	platform_tick_t max_age)
+{
+	fuse_slot_t *s = &f->slot[src];
+	unsigned int x;
+
+	memset(s, 0, sizeof(*s));
+	for (x = 0; x < FUSE_NR_BANKS; ++x)
+		s->bank[x] = (uint8_t *)banks + x * size;
+	s->size = size;
+	s->max_age = max_age;
+	s->writing = 1;
+	f->hdr.size[src] = size;
+}
+
+void *fuse_begin(fuse_t *f, fuse_src_t src)
+{
+	fuse_slot_t *s = &f->slot[src];
+
+	return s->bank[s->writing];
+}
+
+void fuse_commit(fuse_t *f, fuse_src_t src, platform_tick_t captured)
+{
+	fuse_slot_t *s = &f->slot[src];
+
+	s->captured[s->writing] = captured;
+	s->latest = s->writing;
+	s->valid = true;
+
+	// The one bank that is neither the latest nor being sent
+	s->writing = (uint8_t)((0 + 1 + 2) - s->latest - s->sending);
+}
+
+const fuse_hdr_t *fuse_epoch(fuse_t *f, platform_tick_t now,
+	platform_usart_tx_bufdesc_t *desc)
+{
+	fuse_hdr_t *hdr = &f->hdr;
+	fuse_slot_t *s;
+	unsigned int x;
+	uint8_t flags = 0, fl;
+
+	++hdr->epoch;
+	hdr->time_ms = fuse_ms(now);
+
+	desc[0].buf = (const char *)hdr;
+	desc[0].len = sizeof(*hdr);
+	for (x = 0; x < FUSE_NR_SRC; ++x) {
+		s = &f->slot[x];
+		s->sending = s->latest;
+
+		fl = 0;
+		if (s->valid) {
+			fl |= FUSE_F_VALID;
+			if (now - s->captured[s->sending] > s->max_age)
+				fl |= FUSE_F_STALE;
+		}
+		flags |= fl << (2 * x);
+		hdr->captured_ms[x] = fuse_ms(s->captured[s->sending]);
+
+		desc[1 + x].buf = s->bank[s->sending];
+		desc[1 + x].len = s->size;
+	}
+	hdr->flags = flags;
+	return hdr;
+}
+
+const void *fuse_sample(const fuse_t *f, fuse_src_t src)
+{
+	const fuse_slot_t *s = &f->slot[src];
+
+	if ((FUSE_SRC_FLAGS(f->hdr.flags, src) & FUSE_F_VALID) == 0)
+		return NULL;
+	return s->bank[s->sending];
+}
@@ -0,0 +1,148 @@
+/**
+ * @file fuse.h
+ * @brief Timestamp-aligned assembly of sensor samples into epoch records
+ */
+
+#if !defined(FUSE_H_)
+#define FUSE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "platform.h"
+
+// C linkage should be maintained
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+
+/// Sample sources, in the order their samples follow the epoch header
+typedef enum fuse_src_type {
+	FUSE_SRC_CO2 = 0,	///< MH-Z19C  (mhz19_sample_t)
+	FUSE_SRC_PMS,		///< PMS5003T (pms_data_t)
+	FUSE_SRC_GPS,		///< NEO-6M   (nmea_fix_t)
+
+	/// Number of sources; not a valid source
+	FUSE_NR_SRC
+} fuse_src_t;
+
+/// Number of buffers per source: being written, latest, and being sent
+#define FUSE_NR_BANKS	3
+
+/// Number of fragments making up an epoch record
+#define FUSE_NR_DESC	(1 + FUSE_NR_SRC)
+
+/**
+ * @name Per-source flags
+ *
+ * Shifted left by twice the source number in @c fuse_hdr_t::flags.
+ * @{
+ */
+#define FUSE_F_VALID	0x01	///< A sample was ever captured
+#define FUSE_F_STALE	0x02	///< The sample is older than allowed
+/** @} */
+
+/// Get the flags of source @p src out of @c fuse_hdr_t::flags
+#define FUSE_SRC_FLAGS(flags, src)	(((flags) >> (2 * (src))) & 0x03)
+
+/// Header of an epoch record; the samples follow, one fragment each
+typedef struct __attribute__((packed)) fuse_hdr_type {
+	/// Incremented for every epoch
+	uint32_t	epoch;
+
+	/// Time of the epoch, in milliseconds since boot
+	uint32_t	time_ms;
+
+	/// When each sample was captured, in milliseconds since boot
+	uint32_t	captured_ms[FUSE_NR_SRC];
+
+	/// Size of each sample that follows
+	uint8_t		size[FUSE_NR_SRC];
+
+	/// Per-source FUSE_F_* bits
+	uint8_t		flags;
+} fuse_hdr_t;
+
+/// State of a single source; treat as opaque
+typedef struct fuse_slot_type {
+	void		*bank[FUSE_NR_BANKS];
+	uint8_t		size;
+
+	/// Samples older than this are flagged as stale
+	platform_tick_t	max_age;
+
+	/// Capture time of the sample in each bank
+	platform_tick_t	captured[FUSE_NR_BANKS];
+
+	/// Banks being written, holding the latest sample, and being sent
+	uint8_t		writing;
+	uint8_t		latest;
+	uint8_t		sending;
+
+	bool		valid;
+} fuse_slot_t;
+
+/// Assembler state; treat as opaque
+typedef struct fuse_type {
+	fuse_slot_t	slot[FUSE_NR_SRC];
+	fuse_hdr_t	hdr;
+} fuse_t;
+
+/// Reset an assembler; all sources have to be set up afterwards
+void fuse_init(fuse_t *f);
+
+/**
+ * Set up a source
+ *
+ * @param[in]	banks	Storage for @c FUSE_NR_BANKS samples of @p size
+ *			bytes each, zeroed
+ * @param[in]	max_age	Age beyond which samples are flagged as stale
+ */
+void fuse_src_init(fuse_t *f, fuse_src_t src, void *banks, uint8_t size,
+	platform_tick_t max_age);
+
+/**
+ * Get the buffer the next sample of @p src is to be written into
+ *
+ * The buffer is neither the latest sample nor one being sent, so it may be
+ * written at leisure, and even left alone if no sample turns up. The same
+ * buffer is returned until @c fuse_commit() is called.
+ */
+void *fuse_begin(fuse_t *f, fuse_src_t src);
+
+/// Make the sample written into the @c fuse_begin() buffer the latest one
+void fuse_commit(fuse_t *f, fuse_src_t src, platform_tick_t captured);
+
+/**
+ * Close an epoch, and describe its record
+ *
+ * The record is the header followed by the latest sample of every source,
+ * with no copies made: @p desc points into the sample storage, which is left
+ * alone until the next epoch is closed.
+ *
+ * @note
+ * The previous record must have been sent (or dropped) by then.
+ *
+ * @param[out]	desc	@c FUSE_NR_DESC fragments
+ *
+ * @return	The header of the record, which stays valid as long as @p desc
+ */
+const fuse_hdr_t *fuse_epoch(fuse_t *f, platform_tick_t now,
+	platform_usart_tx_bufdesc_t *desc);
+
+/**
+ * Get the sample of @p src in the record of the last epoch
+ *
+ * @return	@c NULL if there was no valid sample
+ */
+const void *fuse_sample(const fuse_t *f, fuse_src_t src);
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifdef __cplusplus
+}
+#endif	// __cplusplus
+#endif	// !defined(FUSE_H_)
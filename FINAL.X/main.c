@@ -1,293 +1,638 @@
 #include <xc.h>
 #include <string.h>
-#include <stdio.h>
 #include <stdbool.h>
 #include "platform.h"
-
-// ESP32
-#define UART (&(SERCOM0_REGS->USART_INT))
-bool co2_flag = false;
-bool pms_flag = false;
-bool gps_flag = false;
-char buffer[256];
-
-// MH-Z19C
-//#define MHZ19C_START 0xFF
-//#define MHZ19C_COMMAND 0x86
-//#define MHZ19C_CHECKSUM 0x79
-#define CO2_BUF_SIZE 9
-static char co2_buf[CO2_BUF_SIZE];
-static size_t co2_idx = 0;
+#include "nmea.h"
+#include "pms.h"
+#include "mhz19.h"
+#include "telem.h"
+#include "aqi.h"
+#include "fuse.h"
+#include "flog.h"
+#include "cap.h"
 
 // PMS5003T
 #define PMS_START_1 0x42
 #define PMS_START_2 0x4D
 #define PMS_BUF_SIZE 32
-static char pms_buf[PMS_BUF_SIZE];
-static size_t pms_idx = 0;
 
 // NEO-6M
 #define GPS_BUF_SIZE 128  // Buffer size for storing NMEA sentence
-static char gps_buf[GPS_BUF_SIZE];  // Buffer for storing the sentence
-static size_t gps_idx = 0;        // Index to keep track of buffer position
-static bool gps_sentence_flag = false;   // Flag to indicate sentence is ready
-static char latBuffer[GPS_BUF_SIZE];  // Buffer for latitude in NMEA
-static char longBuffer[GPS_BUF_SIZE];  // Buffer for longitude in NMEA
-
-//static const char banner_msg[] =
-//"\033[0m\033[2J\033[1;1H"
-//"+-----------------------------------------------------------+\r\n"
-//"| Air Quality Sensor Readings                               |\r\n"
-//"+-----------------------------------------------------------+\r\n";
-//
-//static const char ESC_SEQ_GPS_LINE[] = "\033[11;1H\033[0K";
 
-typedef struct prog_state_type {
-    uint16_t flags;
-//    
-    platform_usart_tx_bufdesc_t esp_tx_desc[4];
-    char esp_tx_buf[128];
+// Frames read out of the flash log per message
+#define DUMP_NR_REC 16
+
+// Room for capture frames in each of the pair of uplink buffers
+#define CAP_BUF_SIZE 512
 
-    platform_usart_tx_bufdesc_t co2_tx_desc;
-    char co2_tx_buf[CO2_BUF_SIZE];
+// Statistics message: channel count, 11 counters per channel, idle counters
+#define STATS_MSG_LEN (1 + PLATFORM_USART_NR_CH * 11 * 4 + 8 + 8 + 4 + 4)
 
+typedef struct prog_state_type {
+    // ESP8266 uplink; one message per producer, so none clobbers another
+    platform_usart_tx_msg_t esp_telem_msg;
+    platform_usart_tx_bufdesc_t esp_telem_desc[1];
+    uint8_t esp_telem_buf[TELEM_FRAME_MAX];
+    telem_record_t telem;
+    telem_encoder_t telem_enc;
+
+    // Epoch records, sent straight out of the samples' own storage
+    platform_usart_tx_msg_t esp_fuse_msg;
+    platform_usart_tx_bufdesc_t esp_fuse_desc[1 + FUSE_NR_DESC + 1];
+    uint8_t esp_fuse_hdr[TELEM_RAW_HDR_LEN];
+    uint8_t esp_fuse_end[TELEM_RAW_END_LEN];
+    fuse_t fuse;
+    mhz19_sample_t co2_banks[FUSE_NR_BANKS];
+    pms_data_t pms_banks[FUSE_NR_BANKS];
+    nmea_fix_t gps_banks[FUSE_NR_BANKS];
+
+    // USART and idle counters, sent (and reset) every STATS_PERIOD_MS
+    platform_usart_tx_msg_t esp_stats_msg;
+    platform_usart_tx_bufdesc_t esp_stats_desc[1];
+    uint8_t esp_stats_buf[TELEM_MSG_FRAME_LEN(STATS_MSG_LEN)];
+    platform_usart_stats_t usart_stats;
+    platform_idle_stats_t idle_stats;
+
+    // Commands from the ground, one per line
     platform_usart_rx_async_desc_t esp_rx_desc;
     char esp_rx_buf[128];
 
-    platform_usart_rx_async_desc_t co2_rx_desc;
-    char co2_rx_buf[CO2_BUF_SIZE];
+    // Telemetry frames kept in the data flash, and their read-out
+    flog_flash_t flog_flash;
+    flog_t flog;
+    uint32_t flog_nr_errors;
+    flog_cursor_t dump_cur;
+    bool dumping;
+    bool dump_synced;
+    platform_usart_tx_msg_t esp_dump_msg;
+    platform_usart_tx_bufdesc_t esp_dump_desc[DUMP_NR_REC];
+
+    // Raw sensor traffic, captured on command; esp_cap_cur is sent next
+    bool capturing;
+    cap_encoder_t cap_enc;
+    platform_usart_tx_msg_t esp_cap_msg[2];
+    platform_usart_tx_bufdesc_t esp_cap_desc[2];
+    uint8_t esp_cap_buf[2][CAP_BUF_SIZE];
+    unsigned int esp_cap_cur;
+
+    // MH-Z19C driver
+    mhz19_t co2;
+
+    // Rolling windows the AQI and the telemetry means are taken over
+    aqi_win_t pm2_5_win;
+    aqi_win_t pm10_win;
+    aqi_win_t co2_win;
+    uint32_t co2_seq;
+
+    // Ping-pong pair; pms_rx_cur is the one that completes next
+    platform_usart_rx_async_desc_t pms_rx_desc[2];
+    char pms_rx_buf[2][PMS_BUF_SIZE];
+    unsigned int pms_rx_cur;
+    pms_decoder_t pms;
+
+    // Ping-pong pair of line buffers; gps_rx_cur completes next
+    platform_usart_rx_async_desc_t gps_rx_desc[2];
+    char gps_rx_buf[2][GPS_BUF_SIZE];
+    unsigned int gps_rx_cur;
+    nmea_parser_t nmea;
+
+    // One task per sensor, plus the uplink telemetry and statistics
+    platform_task_t task_pms;
+    platform_task_t task_gps;
+    platform_task_t task_telem;
+    platform_task_t task_stats;
+    platform_task_t task_cmd;
+    platform_task_t task_cap;
+
+} prog_state_t;
+
+// Task periods
+#define GPS_PERIOD_MS   20
+#define PMS_PERIOD_MS   20      // Under one frame time at 9600 baud
+#define CO2_PERIOD_MS   2000
+#define TELEM_PERIOD_MS 1000
+#define CMD_PERIOD_MS   50
+#define CAP_PERIOD_MS   20
+
+// Samples older than this are flagged as stale in the epoch records
+#define CO2_MAX_AGE_MS  (2 * CO2_PERIOD_MS + 500)
+#define PMS_MAX_AGE_MS  3000
+#define GPS_MAX_AGE_MS  2000
+
+// Rolling windows, in samples: about a minute each
+#define PM_WINDOW   60
+#define CO2_WINDOW  30
+
+// Records per telemetry keyframe; deltas in between, and 1 sends no deltas
+#define TELEM_KEY_INTERVAL 10
+#define STATS_PERIOD_MS 10000
+#define LOG_PERIOD_MS 500
+
+// Capture frames end after 3 character times of silence (as the idle timeout)
+#define CAP_GAP_MS 3
+#define CAP_KEY_INTERVAL 32
+
+// Channels captured: all but the uplink itself
+#define CAP_CH_MASK ((1 << PLATFORM_USART_CO2) | (1 << PLATFORM_USART_PMS) | \
+                     (1 << PLATFORM_USART_GPS))
+
+static void GPS_Read(platform_task_t *task, void *arg);
+static void PMS_Read(platform_task_t *task, void *arg);
+static void Telem_Send(platform_task_t *task, void *arg);
+static void Stats_Report(platform_task_t *task, void *arg);
+static void Cmd_Poll(platform_task_t *task, void *arg);
+static void Cap_Drain(platform_task_t *task, void *arg);
+
+static bool flog_erase_row(void *arg, uint32_t ofs) {
+    return platform_nvm_erase_row(PLATFORM_NVM_DATA_ADDR + ofs);
+}
 
-    platform_usart_rx_async_desc_t pms_rx_desc;
-    char pms_rx_buf[PMS_BUF_SIZE];
+static bool flog_write_page(void *arg, uint32_t ofs, const uint8_t *data) {
+    return platform_nvm_write_page(PLATFORM_NVM_DATA_ADDR + ofs, data);
+}
 
-    platform_usart_rx_async_desc_t gps_rx_desc;
-    char gps_rx_buf[GPS_BUF_SIZE];
+static bool flog_busy(void *arg, bool *ok) {
+    return platform_nvm_busy(ok);
+}
 
-} prog_state_t;
+static void prog_task_start(platform_task_t *task, const char *name,
+        platform_task_fn_t fn, void *arg, uint32_t delay_ms, uint32_t period_ms) {
+    task->name = name;
+    task->fn = fn;
+    task->arg = arg;
+    platform_task_start(task, PLATFORM_TICKS_MS(delay_ms),
+        PLATFORM_TICKS_MS(period_ms));
+}
 
 static void prog_setup(prog_state_t *ps) {
-    platform_init();
+    // Descriptors rely on zero defaults (e.g. PLATFORM_USART_RX_MODE_RAW)
+    memset(ps, 0, sizeof(*ps));
 
-    // Send the banner message
-//    ps->esp_tx_desc[0].buf = banner_msg;
-//    ps->esp_tx_desc[0].len = sizeof(banner_msg) - 1;
-//    platform_usart_esp_tx_async(&ps->esp_tx_desc[0], 1);
+    platform_init();
 
-    ps->co2_rx_desc.buf = ps->co2_rx_buf;
-    ps->co2_rx_desc.max_len = 9;
-    platform_usart_co2_rx_async(&ps->co2_rx_desc);
+    // PMS5003T frames: 42 4D, then a length word counting what follows it
+    for (unsigned int i = 0; i < 2; ++i) {
+        ps->pms_rx_desc[i].buf = ps->pms_rx_buf[i];
+        ps->pms_rx_desc[i].max_len = PMS_BUF_SIZE;
+        ps->pms_rx_desc[i].mode = PLATFORM_USART_RX_MODE_HDRLEN;
+        ps->pms_rx_desc[i].mode_cfg.nr_sync = 2;
+        ps->pms_rx_desc[i].mode_cfg.sync[0] = PMS_START_1;
+        ps->pms_rx_desc[i].mode_cfg.sync[1] = PMS_START_2;
+        ps->pms_rx_desc[i].mode_cfg.len_ofs = 2;
+        ps->pms_rx_desc[i].mode_cfg.len_adj = 4;
+        platform_usart_rx_queue(PLATFORM_USART_PMS, &ps->pms_rx_desc[i]);
+    }
+    ps->pms_rx_cur = 0;
+    pms_init(&ps->pms);
+    aqi_win_init(&ps->pm2_5_win, PM_WINDOW);
+    aqi_win_init(&ps->pm10_win, PM_WINDOW);
+    aqi_win_init(&ps->co2_win, CO2_WINDOW);
+
+    fuse_init(&ps->fuse);
+    fuse_src_init(&ps->fuse, FUSE_SRC_CO2, ps->co2_banks,
+        sizeof(ps->co2_banks[0]), PLATFORM_TICKS_MS(CO2_MAX_AGE_MS));
+    fuse_src_init(&ps->fuse, FUSE_SRC_PMS, ps->pms_banks,
+        sizeof(ps->pms_banks[0]), PLATFORM_TICKS_MS(PMS_MAX_AGE_MS));
+    fuse_src_init(&ps->fuse, FUSE_SRC_GPS, ps->gps_banks,
+        sizeof(ps->gps_banks[0]), PLATFORM_TICKS_MS(GPS_MAX_AGE_MS));
+
+    // NMEA sentences, one per line; leave room for a terminating NUL
+    for (unsigned int i = 0; i < 2; ++i) {
+        ps->gps_rx_desc[i].buf = ps->gps_rx_buf[i];
+        ps->gps_rx_desc[i].max_len = GPS_BUF_SIZE - 1;
+        ps->gps_rx_desc[i].mode = PLATFORM_USART_RX_MODE_MATCH;
+        ps->gps_rx_desc[i].mode_cfg.match = '\n';
+        platform_usart_rx_queue(PLATFORM_USART_GPS, &ps->gps_rx_desc[i]);
+    }
+    ps->gps_rx_cur = 0;
+    nmea_init(&ps->nmea);
+
+    /*
+     * Polling periods are short enough for the ping-pong pairs never to
+     * run dry: an NMEA line takes ~80 ms at 9600 baud, and the PMS5003T
+     * sends a frame about once a second.
+     */
+    prog_task_start(&ps->task_gps, "gps", GPS_Read, ps, 0, GPS_PERIOD_MS);
+    prog_task_start(&ps->task_pms, "pms", PMS_Read, ps, 5, PMS_PERIOD_MS);
+    ps->co2.task.name = "mhz19";
+    mhz19_start(&ps->co2, PLATFORM_TICKS_MS(CO2_PERIOD_MS));
+    telem_encoder_init(&ps->telem_enc, TELEM_KEY_INTERVAL);
+
+    // Pick up the flash log where it left off, past any torn page
+    ps->flog_flash.base = (const uint8_t *)PLATFORM_NVM_DATA_ADDR;
+    ps->flog_flash.nr_rows = PLATFORM_NVM_DATA_SIZE / PLATFORM_NVM_ROW_SIZE;
+    ps->flog_flash.erase_row = flog_erase_row;
+    ps->flog_flash.write_page = flog_write_page;
+    ps->flog_flash.busy = flog_busy;
+    flog_open(&ps->flog, &ps->flog_flash);
+    if (ps->flog.nr_torn > 0)
+        PLATFORM_LOG("flog: %u torn pages skipped", ps->flog.nr_torn);
+
+    ps->esp_rx_desc.buf = ps->esp_rx_buf;
+    ps->esp_rx_desc.max_len = sizeof(ps->esp_rx_buf);
+    ps->esp_rx_desc.mode = PLATFORM_USART_RX_MODE_MATCH;
+    ps->esp_rx_desc.mode_cfg.match = '\n';
+    platform_usart_rx_queue(PLATFORM_USART_ESP, &ps->esp_rx_desc);
+    prog_task_start(&ps->task_telem, "telem", Telem_Send, ps,
+        TELEM_PERIOD_MS, TELEM_PERIOD_MS);
+    prog_task_start(&ps->task_stats, "stats", Stats_Report, ps,
+        STATS_PERIOD_MS, STATS_PERIOD_MS);
+    prog_task_start(&ps->task_cmd, "cmd", Cmd_Poll, ps,
+        CMD_PERIOD_MS, CMD_PERIOD_MS);
+    platform_log_start(PLATFORM_USART_ESP, PLATFORM_TICKS_MS(LOG_PERIOD_MS));
+}
 
-    ps->pms_rx_desc.buf = ps->pms_rx_buf;
-    ps->pms_rx_desc.max_len = 32;
-    platform_usart_pms_rx_async(&ps->pms_rx_desc);
+static uint8_t *stats_put32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+    return p + 4;
+}
 
-    ps->gps_rx_desc.buf = ps->gps_rx_buf;
-    ps->gps_rx_desc.max_len = sizeof(ps->gps_rx_buf);
-    platform_usart_gps_rx_async(&ps->gps_rx_desc);
+static uint8_t *stats_put64(uint8_t *p, uint64_t v) {
+    p = stats_put32(p, (uint32_t)v);
+    return stats_put32(p, (uint32_t)(v >> 32));
 }
 
-int read_count(){
-    TCC1_REGS->TCC_CTRLBSET = (0x80);
-    return TCC1_REGS->TCC_COUNT; // Return back the counter value 
+/*
+ * Periodically send a snapshot of the USART and idle counters over the
+ * uplink, as a TELEM_TYPE_STATS message
+ */
+static void Stats_Report(platform_task_t *task, void *arg) {
+    prog_state_t *ps = arg;
+    const platform_usart_stats_t *st = &ps->usart_stats;
+    uint8_t msg[STATS_MSG_LEN];
+    uint8_t *p = msg;
+
+    // Skip this period rather than overwrite a snapshot still being sent
+    if (ps->capturing || PLATFORM_USART_TX_MSG_BUSY(&ps->esp_stats_msg))
+        return;
+
+    *p++ = PLATFORM_USART_NR_CH;
+    for (unsigned int ch = 0; ch < PLATFORM_USART_NR_CH; ++ch) {
+        platform_usart_stats((platform_usart_ch_t)ch, &ps->usart_stats, true);
+        p = stats_put32(p, st->nr_rx_bytes);
+        p = stats_put32(p, st->nr_tx_bytes);
+        p = stats_put32(p, st->nr_rx_dropped);
+        p = stats_put32(p, st->nr_err_frame);
+        p = stats_put32(p, st->nr_err_parity);
+        p = stats_put32(p, st->nr_err_overflow);
+        p = stats_put32(p, st->nr_err_dma);
+        p = stats_put32(p, st->nr_compl_idle);
+        p = stats_put32(p, st->nr_compl_full);
+        p = stats_put32(p, st->nr_compl_frame);
+        p = stats_put32(p, st->isr_time_peak);
+    }
+    platform_idle_stats(&ps->idle_stats, true);
+    p = stats_put64(p, ps->idle_stats.nr_ticks_total);
+    p = stats_put64(p, ps->idle_stats.nr_ticks_asleep);
+    p = stats_put32(p, ps->idle_stats.nr_sleeps);
+    p = stats_put32(p, ps->idle_stats.nr_restarts);
+
+    ps->esp_stats_desc[0].buf = (const char *)ps->esp_stats_buf;
+    ps->esp_stats_desc[0].len = (uint16_t)telem_encode_msg(TELEM_TYPE_STATS,
+        msg, (size_t)(p - msg), ps->esp_stats_buf);
+    ps->esp_stats_msg.desc = ps->esp_stats_desc;
+    ps->esp_stats_msg.nr_desc = 1;
+    platform_usart_tx_submit(PLATFORM_USART_ESP, &ps->esp_stats_msg);
 }
 
-static void CO2_Read(prog_state_t *ps) {
-    // Send to MH-Z19C
-    if (!platform_usart_co2_tx_busy()) {
-        static const uint8_t cmd[8] = {0xFF, 0x01, 0x86, 0x00, 0x00, 0x00, 0x00, 0x00};
-        memcpy(ps->co2_tx_buf, cmd, 8);
-        uint8_t checksum = 0;
-        for (int i = 1; i < 8; i++) {
-            checksum += ps->co2_tx_buf[i];
-        }
-        ps->co2_tx_buf[8] = 0xFF - checksum + 0x1;
-        ps->co2_tx_desc.buf = ps->co2_tx_buf;
-        ps->co2_tx_desc.len = 9;
-        platform_usart_co2_tx_async(&ps->co2_tx_desc, 1);
+/*
+ * Frame a raw message made up of the @p nr fragments from desc[1] on: its
+ * header frame goes in front, into desc[0], and its trailer after them
+ */
+static void raw_frame(uint8_t type, platform_usart_tx_bufdesc_t *desc,
+                      unsigned int nr, uint8_t *hdr, uint8_t *end) {
+    uint16_t crc = TELEM_CRC16_INIT;
+    uint16_t len = 0;
+
+    for (unsigned int x = 1; x <= nr; ++x) {
+        crc = telem_crc16_update(crc, desc[x].buf, desc[x].len);
+        len += desc[x].len;
     }
-    delay(1000);
+    desc[0].buf = (const char *)hdr;
+    desc[0].len = (uint16_t)telem_encode_raw(type, len, hdr);
+    desc[nr + 1].buf = (const char *)end;
+    desc[nr + 1].len = (uint16_t)telem_encode_raw_end(crc, end);
+}
 
-    if (!platform_usart_co2_rx_busy()) {
-        char *rx = (uint8_t *)ps->co2_rx_buf[0];
-        char debug[128];
+// Pick up a new MH-Z19C reading, if any, for the epoch about to be closed
+static void co2_collect(prog_state_t *ps) {
+    mhz19_sample_t *sample = fuse_begin(&ps->fuse, FUSE_SRC_CO2);
 
-        if (co2_idx < GPS_BUF_SIZE - 1) {
-            co2_buf[co2_idx++] = data;
-        }
-        // Print raw RX for debugging
-        int pos = 0;
-        pos += sprintf(&debug[pos], "MH-Z19C RX: ");
-        for (int i = 0; i < 9; ++i) {
-            pos += sprintf(&debug[pos], "%02X ", rx[i]);
-        }
-        pos += sprintf(&debug[pos], "\r\n");
-
-        // Check header
-        if (rx[0] == 0xFF && rx[1] == 0x86) {
-            // Verify checksum
-            uint8_t sum = 0;
-            for (int i = 1; i < 8; ++i) sum += rx[i];
-            uint8_t expected = 0xFF - sum + 1;
-
-            uint16_t co2 = (rx[2] << 8) | rx[3];
-            if (expected == rx[8]) {
-                pos += sprintf(&debug[pos], "CO2: %u ppm\r\n", co2);
-            } else {
-                pos += sprintf(&debug[pos], "Checksum error (expected %02X, got %02X)\r\n", expected, rx[8]);
-                pos += sprintf(&debug[pos], "CO2: %u ppm\r\n", co2);
-            }
-        } else {
-            pos += sprintf(&debug[pos], "Invalid MH-Z19C header\r\n");
-        }
+    if (!mhz19_latest(&ps->co2, sample) || sample->seq == ps->co2_seq)
+        return;
+    ps->co2_seq = sample->seq;
+    aqi_win_push(&ps->co2_win, sample->co2_ppm);
+    fuse_commit(&ps->fuse, FUSE_SRC_CO2, sample->when);
+}
 
-        // Send to CDC serial output
-        ps->esp_tx_desc[0].buf = debug;
-        ps->esp_tx_desc[0].len = strlen(debug);
-        platform_usart_esp_tx_async(&ps->esp_tx_desc[0], 1);
+/*
+ * Close an epoch: send its record, which points straight into the latest
+ * sample of every sensor, framed as a raw message, and a telemetry record
+ * built from the same samples
+ */
+static void Telem_Send(platform_task_t *task, void *arg) {
+    prog_state_t *ps = arg;
+    telem_record_t *rec = &ps->telem;
+    const fuse_hdr_t *hdr;
+    const mhz19_sample_t *co2;
+    const pms_data_t *pms;
+    const nmea_fix_t *fix;
+    aqi_stats_t st;
+    uint16_t seq;
+    size_t len;
+
+    /*
+     * Skip this period rather than overwrite records still being sent;
+     * nothing goes out during a read-out either, so that live delta
+     * records do not get mixed up with logged ones.
+     */
+    if (ps->dumping ||
+        PLATFORM_USART_TX_MSG_BUSY(&ps->esp_telem_msg) ||
+        PLATFORM_USART_TX_MSG_BUSY(&ps->esp_fuse_msg))
+        return;
+
+    co2_collect(ps);
+    hdr = fuse_epoch(&ps->fuse, platform_tick_get(), &ps->esp_fuse_desc[1]);
+    raw_frame(TELEM_TYPE_EPOCH, ps->esp_fuse_desc, FUSE_NR_DESC,
+              ps->esp_fuse_hdr, ps->esp_fuse_end);
+    ps->esp_fuse_msg.desc = ps->esp_fuse_desc;
+    ps->esp_fuse_msg.nr_desc = 1 + FUSE_NR_DESC + 1;
+
+    // Epoch records would take up much of the link while capturing
+    if (!ps->capturing)
+        platform_usart_tx_submit(PLATFORM_USART_ESP, &ps->esp_fuse_msg);
+
+    seq = rec->seq;
+    memset(rec, 0, sizeof(*rec));
+    rec->seq = seq;
+    rec->time_ms = hdr->time_ms;
+    co2 = fuse_sample(&ps->fuse, FUSE_SRC_CO2);
+    if (co2 != NULL) {
+        aqi_win_stats(&ps->co2_win, &st);
+        rec->flags |= TELEM_F_CO2;
+        if (FUSE_SRC_FLAGS(hdr->flags, FUSE_SRC_CO2) & FUSE_F_STALE)
+            rec->flags |= TELEM_F_CO2_STALE;
+        rec->co2_ppm = co2->co2_ppm;
+        rec->co2_mean = st.mean;
+    }
+    pms = fuse_sample(&ps->fuse, FUSE_SRC_PMS);
+    if (pms != NULL) {
+        rec->flags |= TELEM_F_PMS;
+        if (FUSE_SRC_FLAGS(hdr->flags, FUSE_SRC_PMS) & FUSE_F_STALE)
+            rec->flags |= TELEM_F_PMS_STALE;
+        rec->pm1_0 = pms->pm1_0_atm;
+        rec->pm2_5 = pms->pm2_5_atm;
+        rec->pm10 = pms->pm10_atm;
+        rec->temp_dc = pms->temp_dc;
+        rec->rh_pm = pms->rh_pm;
+
+        // The AQI is the worse of the two pollutants' sub-indices
+        aqi_win_stats(&ps->pm2_5_win, &st);
+        rec->pm2_5_mean_d = st.mean;
+        rec->aqi = aqi_pm2_5(st.mean);
+        aqi_win_stats(&ps->pm10_win, &st);
+        rec->pm10_mean = st.mean;
+        if (aqi_pm10(st.mean) > rec->aqi)
+            rec->aqi = aqi_pm10(st.mean);
+    }
+    fix = fuse_sample(&ps->fuse, FUSE_SRC_GPS);
+    if (fix != NULL && fix->quality != 0) {
+        rec->flags |= TELEM_F_GPS;
+        if (FUSE_SRC_FLAGS(hdr->flags, FUSE_SRC_GPS) & FUSE_F_STALE)
+            rec->flags |= TELEM_F_GPS_STALE;
+        rec->lat_e7 = fix->lat_e7;
+        rec->lon_e7 = fix->lon_e7;
+        rec->alt_mm = fix->alt_mm;
+        rec->gps_time_ms = fix->time_ms;
+        rec->speed_cmps = fix->speed_cmps;
+        rec->nr_sats = fix->nr_sats;
+        rec->quality = fix->quality;
+    }
 
-        memset(ps->co2_rx_buf, 0, sizeof(ps->co2_rx_buf)); // Clear buffer before next read
-        platform_usart_co2_rx_async(&ps->co2_rx_desc);
+    /*
+     * Keep every frame in flash, whether or not it makes it over the
+     * radio; a record that does not go out forces a keyframe next, so
+     * the frames in flash still decode in sequence.
+     */
+    len = telem_encode_next(&ps->telem_enc, rec, ps->esp_telem_buf);
+    if (!flog_append(&ps->flog, ps->esp_telem_buf, (uint8_t)len))
+        PLATFORM_LOG("flog: record dropped, flash still busy");
+
+    // Send to ESP8266
+    ps->esp_telem_desc[0].buf = (const char *)ps->esp_telem_buf;
+    ps->esp_telem_desc[0].len = (uint16_t)len;
+    ps->esp_telem_msg.desc = ps->esp_telem_desc;
+    ps->esp_telem_msg.nr_desc = 1;
+    if (platform_usart_tx_submit(PLATFORM_USART_ESP, &ps->esp_telem_msg)) {
+        ++rec->seq;
+    } else {
+        PLATFORM_LOG("telem: record %u not sent", rec->seq);
+        telem_encoder_resync(&ps->telem_enc);
     }
 }
 
-static void PMS_Read(prog_state_t *ps) {
-    if (!platform_usart_pms_rx_busy()) {
-        uint8_t *data = (uint8_t *)ps->pms_rx_buf;
-
-        if (data[0] == PMS_START_1 && data[1] == PMS_START_2) {  
-            pms_buf[0] = data[12];
-            pms_buf[1] = data[13];
-            pms_buf[2] = data[14];
-            pms_buf[3] = data[15];
-            pms_buf[4] = data[24];
-            pms_buf[5] = data[25];
-            pms_buf[6] = data[26];
-            pms_buf[7] = data[27];
-        }
-
-        // Send to ESP8266
-        ps->esp_tx_desc[2].buf = pms_buf;
-        ps->esp_tx_desc[2].len = 8;
-        platform_usart_esp_tx_async(&ps->esp_tx_desc[2], 1);
+// Send the next batch of frames out of the flash log, straight from flash
+static void dump_next(prog_state_t *ps) {
+    flog_cursor_t cur = ps->dump_cur;
+    const uint8_t *rec;
+    unsigned int n = 0;
+    uint8_t len;
+
+    if (PLATFORM_USART_TX_MSG_BUSY(&ps->esp_dump_msg))
+        return;
+
+    // Whatever is in the page buffer goes to flash first, to be read out
+    if (!ps->dump_synced) {
+        if (!flog_sync(&ps->flog))
+            return;
+        flog_rewind(&ps->flog, &ps->dump_cur);
+        cur = ps->dump_cur;
+        ps->dump_synced = true;
+    }
 
-        // Restart reception
-        memset(ps->pms_rx_buf, 0, sizeof(ps->pms_rx_buf)); // Clear buffer before next read
-        platform_usart_pms_rx_async(&ps->pms_rx_desc);
+    while (n < DUMP_NR_REC &&
+            (len = flog_read(&ps->flog, &ps->dump_cur, &rec)) > 0) {
+        ps->esp_dump_desc[n].buf = (const char *)rec;
+        ps->esp_dump_desc[n].len = len;
+        ++n;
+    }
+    if (n == 0) {
+        PLATFORM_LOG("flog: read out, %u bad records", ps->dump_cur.nr_bad);
+        ps->dumping = false;
+        return;
     }
+
+    ps->esp_dump_msg.desc = ps->esp_dump_desc;
+    ps->esp_dump_msg.nr_desc = n;
+    if (!platform_usart_tx_submit(PLATFORM_USART_ESP, &ps->esp_dump_msg))
+        ps->dump_cur = cur;
 }
 
-//static void PMS_Read(prog_state_t *ps) {
-//    if (!platform_usart_pms_rx_busy()) {
-//        uint8_t data = ps->pms_rx_buf;
-//
-//        if (data[0] == PMS_START_1 && data[1] == PMS_START_2) {
-//            uint16_t pm2_5 = ((uint16_t)data[12] << 8) | data[13];
-//            uint16_t pm10  = ((uint16_t)data[14] << 8) | data[15];
-//            int16_t  temp  = ((int16_t)data[24] << 8) | data[25];
-//            uint16_t rhum  = ((uint16_t)data[26] << 8) | data[27];
-//
-//            // Format: "PM25=123;PM10=456;T=25.3;RH=45.6\n"
-//            // Note: temp and rhum are sent as integers ×10, divide to get decimal
-//            snprintf(pms_buf, sizeof(pms_buf),
-//                     "PM25=%u;PM10=%u;T=%i;RH=%u\n",
-//                     pm2_5,
-//                     pm10,
-//                     temp / 10,
-//                     rhum / 10);
-//
-//            ps->esp_tx_desc[0].buf = pms_buf;
-//            ps->esp_tx_desc[0].len = strnlen(pms_buf, sizeof(pms_buf));
-//            platform_usart_esp_tx_async(&ps->esp_tx_desc[0], 1);
-//        }
-//
-//        memset(ps->pms_rx_buf, 0, sizeof(ps->pms_rx_buf));
-//        platform_usart_pms_rx_async(&ps->pms_rx_desc);
-//    }
-//}
-
-static void GPS_Read(prog_state_t *ps) {
-    if (!platform_usart_gps_rx_busy()) {
-        // Store received byte in the buffer
-        char data = ps->gps_rx_buf[0];
-
-        // Store received byte in gpsBuffer if there's space
-        if (gps_idx < GPS_BUF_SIZE - 1) {
-            gps_buf[gps_idx++] = data;
-
-            // Check if sentence is complete (NMEA sentences end with '\n')
-            if (data == '\n') {
-                gps_buf[gps_idx] = '\0';  // Null-terminate the string
-                gps_sentence_flag = true;        // Mark sentence as ready
-//                gps_idx = 0;                // Reset buffer for the next sentence
-            }
-        } else {
-            // Buffer overflow: Reset buffer
-            gps_idx = 0;
+/*
+ * Send the sensor traffic captured since the last run, as cap.h frames; the
+ * bytes are left in the capture ring while both buffers are on the wire.
+ * Once capture is stopped, whatever is left goes out, and the task stops.
+ */
+static void Cap_Drain(platform_task_t *task, void *arg) {
+    prog_state_t *ps = arg;
+    unsigned int i = ps->esp_cap_cur;
+    uint8_t *out = ps->esp_cap_buf[i];
+    platform_usart_cap_t ent;
+    unsigned int n = 0;
+    size_t len = 0;
+    uint32_t now;
+
+    if (PLATFORM_USART_TX_MSG_BUSY(&ps->esp_cap_msg[i]))
+        return;
+
+    // A byte may complete a frame, and a loss before it flush all of them
+    while (CAP_BUF_SIZE - len >= (CAP_NR_CH + 1) * CAP_FRAME_MAX &&
+            (n = platform_usart_capture_read(&ent, 1)) > 0) {
+        if (ent.lost) {
+            len += cap_encode_flush(&ps->cap_enc, &out[len]);
+            cap_encoder_resync(&ps->cap_enc);
         }
+        len += cap_encode_byte(&ps->cap_enc, ent.ch, ent.when, ent.data,
+            &out[len]);
+    }
 
-        // Check if a complete GPGGA sentence is received
-        if (gps_sentence_flag) {
-            // Check if the sentence contains "$GPGGA"
-            if (strstr(gps_buf, "$GPGGA") != NULL) {
-//                memcpy(ps->esp_tx_buf, gps_buf, strnlen(gps_buf, GPS_BUF_SIZE));
-                strcat(buffer, gps_buf);
-                // Send to ESP8266
-                ps->esp_tx_desc[0].buf = buffer;
-                ps->esp_tx_desc[0].len = strnlen(buffer, GPS_BUF_SIZE);
-                platform_usart_esp_tx_async(&ps->esp_tx_desc[0], 1);
-//                gps_flag = true;
-            }
-        // Clear the buffer and reset flags for the next sentence
-            memset(gps_buf, 0, sizeof(gps_buf));
-            gps_sentence_flag = false;
-            gps_idx = 0;
+    if (CAP_BUF_SIZE - len >= CAP_NR_CH * CAP_FRAME_MAX) {
+        if (ps->capturing) {
+            now = (uint32_t)(platform_tick_get() >>
+                PLATFORM_USART_CAP_TIME_SHIFT);
+            len += cap_encode_idle(&ps->cap_enc, now, &out[len]);
+        } else if (n == 0) {
+            len += cap_encode_flush(&ps->cap_enc, &out[len]);
+            platform_task_stop(task);
+            PLATFORM_LOG("cap: %u bytes in %u frames, %u dropped",
+                ps->cap_enc.nr_data, ps->cap_enc.nr_frames,
+                platform_usart_capture_dropped());
         }
-
-        // Restart reception for the next byte
-        memset(ps->gps_rx_buf, 0, sizeof(ps->gps_rx_buf));
-        platform_usart_gps_rx_async(&ps->gps_rx_desc);
     }
+    if (len == 0)
+        return;
+
+    ps->esp_cap_desc[i].buf = (const char *)out;
+    ps->esp_cap_desc[i].len = (uint16_t)len;
+    ps->esp_cap_msg[i].desc = &ps->esp_cap_desc[i];
+    ps->esp_cap_msg[i].nr_desc = 1;
+    if (platform_usart_tx_submit(PLATFORM_USART_ESP, &ps->esp_cap_msg[i]))
+        ps->esp_cap_cur = i ^ 1;
+    else
+        cap_encoder_resync(&ps->cap_enc);
 }
 
-// USART1 = transmitter
-char receiveChar(){
-    while ((UART->SERCOM_INTFLAG & (1 << 2)) == 0);
-    return (char)(UART->SERCOM_DATA);
+/*
+ * Handle commands from the ground; "DUMP" reads the flash log out, as the
+ * same telemetry frames that went over the radio, oldest first. "CAPTURE"
+ * sends the raw traffic of the sensors from then on, and "STOP" ends that.
+ */
+static void Cmd_Poll(platform_task_t *task, void *arg) {
+    prog_state_t *ps = arg;
+    platform_usart_rx_async_desc_t *desc = &ps->esp_rx_desc;
+
+    flog_poll(&ps->flog);
+    if (ps->flog.nr_errors != ps->flog_nr_errors) {
+        ps->flog_nr_errors = ps->flog.nr_errors;
+        PLATFORM_LOG("flog: flash failed, %u errors", ps->flog_nr_errors);
+    }
+    if (ps->dumping)
+        dump_next(ps);
+
+    if (desc->compl_type == PLATFORM_USART_RX_COMPL_NONE)
+        return;
+    if (!ps->dumping && desc->compl_info.data_len >= 4 &&
+            memcmp(desc->buf, "DUMP", 4) == 0) {
+        ps->dumping = true;
+        ps->dump_synced = false;
+    } else if (!ps->capturing && !ps->task_cap.armed &&
+            desc->compl_info.data_len >= 7 &&
+            memcmp(desc->buf, "CAPTURE", 7) == 0) {
+        cap_encoder_init(&ps->cap_enc,
+            PLATFORM_TICKS_MS(CAP_GAP_MS) >> PLATFORM_USART_CAP_TIME_SHIFT,
+            CAP_KEY_INTERVAL);
+        platform_usart_capture_start(CAP_CH_MASK);
+        ps->capturing = true;
+        prog_task_start(&ps->task_cap, "cap", Cap_Drain, ps,
+            CAP_PERIOD_MS, CAP_PERIOD_MS);
+    } else if (ps->capturing && desc->compl_info.data_len >= 4 &&
+            memcmp(desc->buf, "STOP", 4) == 0) {
+        platform_usart_capture_stop();
+        ps->capturing = false;
+    }
+    platform_usart_rx_queue(PLATFORM_USART_ESP, desc);
 }
 
-void write(char data) {
-    while ((UART->SERCOM_INTFLAG & (1 << 0)) == 0);
-    UART->SERCOM_DATA = data;
+static void PMS_Read(platform_task_t *task, void *arg) {
+    prog_state_t *ps = arg;
+    unsigned int cur = ps->pms_rx_cur;
+
+    /*
+     * Both buffers may have completed since the last run; each is handed
+     * back as soon as it is read, so that the driver is never left with
+     * none to receive into.
+     */
+    while (ps->pms_rx_desc[cur].compl_type != PLATFORM_USART_RX_COMPL_NONE) {
+        /*
+         * Whatever came in goes through the decoder, which checks the
+         * length word and checksum, and picks up frames split across
+         * buffers by an idle or full completion. The latest frame goes
+         * out with the next epoch; the AQI is computed over the rolling
+         * windows.
+         */
+        pms_data_t *d = fuse_begin(&ps->fuse, FUSE_SRC_PMS);
+
+        if (pms_feed(&ps->pms, (const uint8_t *)ps->pms_rx_buf[cur],
+                ps->pms_rx_desc[cur].compl_info.data_len, d) > 0) {
+            aqi_win_push(&ps->pm2_5_win, (uint16_t)(d->pm2_5_atm * 10));
+            aqi_win_push(&ps->pm10_win, d->pm10_atm);
+            fuse_commit(&ps->fuse, FUSE_SRC_PMS,
+                ps->pms_rx_desc[cur].compl_tick);
+        }
+
+        // Requeue behind the other buffer, which is already receiving
+        platform_usart_rx_queue(PLATFORM_USART_PMS, &ps->pms_rx_desc[cur]);
+        cur ^= 1;
+    }
+    ps->pms_rx_cur = cur;
 }
 
-void sendString(const char* str) {
-    while (*str) {
-       write(*str++);
-    }   
-    crude_delay_ms(1000);
+static void GPS_Read(platform_task_t *task, void *arg) {
+    prog_state_t *ps = arg;
+    unsigned int cur = ps->gps_rx_cur;
+    platform_usart_rx_async_desc_t *desc = &ps->gps_rx_desc[cur];
+
+    // A burst of short sentences can complete both lines in one period
+    while (desc->compl_type != PLATFORM_USART_RX_COMPL_NONE) {
+        /*
+         * The parser copes with sentences split across buffers, so
+         * overlong lines are fed as well; the fix goes out with the next
+         * epoch.
+         */
+        if (nmea_feed(&ps->nmea, desc->buf, desc->compl_info.data_len) &
+                (NMEA_SENT_GGA | NMEA_SENT_RMC)) {
+            nmea_take_fix(&ps->nmea, fuse_begin(&ps->fuse, FUSE_SRC_GPS));
+            fuse_commit(&ps->fuse, FUSE_SRC_GPS, desc->compl_tick);
+        }
+
+        // Requeue behind the other buffer, which is already receiving
+        platform_usart_rx_queue(PLATFORM_USART_GPS, desc);
+        cur ^= 1;
+        desc = &ps->gps_rx_desc[cur];
+    }
+    ps->gps_rx_cur = cur;
 }
 
 static void prog_loop_one(prog_state_t *ps) {
+    // The sensor tasks are run from here
     platform_do_loop_one();
-
-//    if (read_count() < 1000) {
-//        while(read_count() < 1000);
-        GPS_Read(ps);
-//    }
-
-//    if (read_count() < 2000) {
-//        while(read_count() < 2000);
-//        PMS_Read(ps);
-//    }
-
-//    if (read_count() < 3000) {
-//        while(read_count() < 3000);
-//        CO2_Read(ps);
-//    }
 }
 
 int main(void) {
-    prog_state_t ps;
+    static prog_state_t ps;
 
     // Initialization time
     prog_setup(&ps);
@@ -295,12 +640,6 @@ int main(void) {
     // Infinite loop
     for (;;) {
         prog_loop_one(&ps);
-        if (co2_flag == true && pms_flag == true && gps_flag == true){
-//            strcat(buffer, co2_buf);
-//            strcat(buffer, pms_buf);
-            strcat(buffer, gps_buf);
-        }
-//        sendString("Hello World!");
     }
     return 1;
 }
\ No newline at end of file
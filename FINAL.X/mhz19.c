@@ -0,0 +1,274 @@
+/**
+ * @file mhz19.c
+ * @brief Non-blocking request/response driver for the MH-Z19C
+ */
+
+/*
+ * Frame layout, both ways:
+ *
+ * -- 0xFF
+ * -- Sensor number (0x01) in commands, command byte in responses
+ * -- Command byte in commands, then arguments/data
+ * -- Checksum: two's complement of the sum of bytes 1 to 7
+ *
+ * Only reads (0x86) get a response: FF 86 HH LL ..., with the concentration
+ * in HH LL. Responses carry nothing to tell which request they answer, so a
+ * read that timed out is only retried once the line has been left alone for
+ * MHZ19_LATE_MS; a response that comes in meanwhile is counted and dropped.
+ * The receiver is re-armed right before each request goes out, so a late
+ * response is never taken for the current one unless it is later still.
+ *
+ * The driver runs as a task. In IDLE, it sends whatever commands are pending
+ * and then, on a periodic run, starts a read; in WAIT, it polls for the
+ * response until the deadline, retrying a few times before giving up until
+ * the next period; in LATE, it waits out a late response before a retry.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "platform.h"
+#include "mhz19.h"
+
+#define MHZ19_STATE_IDLE	0
+#define MHZ19_STATE_WAIT	1
+#define MHZ19_STATE_LATE	2
+
+// How often the response is polled for; a frame takes ~10 ms at 9600 baud
+#define MHZ19_POLL_MS	5
+
+// How long a response is waited for past the timeout, to be thrown away
+#define MHZ19_LATE_MS	50
+
+#define MHZ19_CMD_ZERO		0x01
+#define MHZ19_CMD_SPAN		0x02
+#define MHZ19_CMD_ABC_ON	0x04
+#define MHZ19_CMD_ABC_OFF	0x08
+
+// Fixed command frames, checksums included
+static const char mhz19_read_cmd[MHZ19_FRAME_LEN] = {
+	0xFF, 0x01, 0x86, 0x00, 0x00, 0x00, 0x00, 0x00, 0x79
+};
+static const char mhz19_zero_cmd[MHZ19_FRAME_LEN] = {
+	0xFF, 0x01, 0x87, 0x00, 0x00, 0x00, 0x00, 0x00, 0x78
+};
+static const char mhz19_abc_on_cmd[MHZ19_FRAME_LEN] = {
+	0xFF, 0x01, 0x79, 0xA0, 0x00, 0x00, 0x00, 0x00, 0xE6
+};
+static const char mhz19_abc_off_cmd[MHZ19_FRAME_LEN] = {
+	0xFF, 0x01, 0x79, 0x00, 0x00, 0x00, 0x00, 0x00, 0x86
+};
+
+/////////////////////////////////////////////////////////////////////////////
+
+static uint8_t mhz19_checksum(const char *frame)
+{
+	uint8_t sum = 0;
+	unsigned int x;
+
+	for (x = 1; x < MHZ19_FRAME_LEN - 1; ++x)
+		sum += (uint8_t)frame[x];
+	return (uint8_t)-sum;
+}
+
+static bool mhz19_send(mhz19_t *m, const char *frame)
+{
+	m->tx_desc.buf = frame;
+	m->tx_desc.len = MHZ19_FRAME_LEN;
+	return platform_usart_co2_tx_async(&m->tx_desc, 1);
+}
+
+// Send the first pending command, if any; returns false if none is pending
+static bool mhz19_send_cmd(mhz19_t *m)
+{
+	uint8_t bit = m->cmd_pending & -m->cmd_pending;
+	const char *frame;
+
+	switch (bit) {
+	case MHZ19_CMD_ZERO:
+		frame = mhz19_zero_cmd;
+		break;
+	case MHZ19_CMD_SPAN:
+		frame = m->span_cmd;
+		break;
+	case MHZ19_CMD_ABC_ON:
+		frame = mhz19_abc_on_cmd;
+		break;
+	case MHZ19_CMD_ABC_OFF:
+		frame = mhz19_abc_off_cmd;
+		break;
+	default:
+		return false;
+	}
+	if (mhz19_send(m, frame)) {
+		m->cmd_pending &= ~bit;
+		++m->stats.nr_commands;
+	}
+	return true;
+}
+
+static void mhz19_send_read(mhz19_t *m)
+{
+	platform_usart_co2_rx_abort();
+	platform_usart_co2_rx_async(&m->rx_desc);
+	if (mhz19_send(m, mhz19_read_cmd))
+		++m->stats.nr_requests;
+	m->deadline = platform_tick_get() +
+		PLATFORM_TICKS_MS(MHZ19_RESPONSE_TIMEOUT_MS);
+	m->task.state = MHZ19_STATE_WAIT;
+	platform_task_defer(&m->task, PLATFORM_TICKS_MS(MHZ19_POLL_MS));
+}
+
+static bool mhz19_response_ok(const mhz19_t *m)
+{
+	const char *rx = m->rx_buf;
+
+	return m->rx_desc.compl_type == PLATFORM_USART_RX_COMPL_FRAME &&
+		(uint8_t)rx[MHZ19_FRAME_LEN - 1] == mhz19_checksum(rx);
+}
+
+// Back to IDLE; commands that came in meanwhile go out right away
+static void mhz19_idle(mhz19_t *m)
+{
+	m->task.state = MHZ19_STATE_IDLE;
+	if (m->cmd_pending != 0)
+		platform_task_defer(&m->task, PLATFORM_TICKS_MS(MHZ19_POLL_MS));
+}
+
+static void mhz19_task(platform_task_t *task, void *arg)
+{
+	mhz19_t *m = arg;
+	const uint8_t *rx = (const uint8_t *)m->rx_buf;
+
+	if (task->state == MHZ19_STATE_IDLE) {
+		if (platform_usart_co2_tx_busy()) {
+			platform_task_defer(task, PLATFORM_TICKS_MS(MHZ19_POLL_MS));
+			return;
+		}
+		if (mhz19_send_cmd(m)) {
+			// Each command waits for the previous one to go out
+			platform_task_defer(task, PLATFORM_TICKS_MS(MHZ19_POLL_MS));
+			return;
+		}
+
+		// Runs deferred for commands alone read nothing
+		if (task->phase == m->read_phase)
+			return;
+		m->read_phase = task->phase;
+		m->retries = MHZ19_NR_RETRIES;
+		mhz19_send_read(m);
+		return;
+	}
+
+	if (task->state == MHZ19_STATE_LATE) {
+		// Whatever came in answers the request that timed out
+		if (m->rx_desc.compl_type != PLATFORM_USART_RX_COMPL_NONE)
+			++m->stats.nr_late;
+		--m->retries;
+		mhz19_send_read(m);
+		return;
+	}
+
+	if (m->rx_desc.compl_type == PLATFORM_USART_RX_COMPL_NONE) {
+		if (!platform_tick_expired(platform_tick_get(), m->deadline)) {
+			platform_task_defer(task, PLATFORM_TICKS_MS(MHZ19_POLL_MS));
+			return;
+		}
+		++m->stats.nr_timeout;
+		if (m->retries > 0) {
+			task->state = MHZ19_STATE_LATE;
+			platform_task_defer(task, PLATFORM_TICKS_MS(MHZ19_LATE_MS));
+			return;
+		}
+	} else if (mhz19_response_ok(m)) {
+		m->latest.co2_ppm = (uint16_t)((rx[2] << 8) | rx[3]);
+		m->latest.when = platform_tick_get();
+		++m->latest.seq;
+		++m->stats.nr_good;
+		mhz19_idle(m);
+		return;
+	} else {
+		++m->stats.nr_bad;
+		PLATFORM_LOG("mhz19: bad response %02x %02x, sum %02x",
+			rx[0], rx[1], rx[MHZ19_FRAME_LEN - 1]);
+	}
+
+	if (m->retries > 0) {
+		--m->retries;
+		mhz19_send_read(m);
+		return;
+	}
+	++m->stats.nr_failed;
+	PLATFORM_LOG("mhz19: no reading after %u tries", MHZ19_NR_RETRIES + 1);
+	platform_usart_co2_rx_abort();
+	mhz19_idle(m);
+}
+
+// Queue a command, and get the task to send it unless a read is in flight
+static void mhz19_queue_cmd(mhz19_t *m, uint8_t bit)
+{
+	m->cmd_pending |= bit;
+	if (m->task.state == MHZ19_STATE_IDLE)
+		platform_task_defer(&m->task, 0);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+void mhz19_start(mhz19_t *m, platform_tick_t period)
+{
+	const char *name = m->task.name;
+
+	memset(m, 0, sizeof(*m));
+
+	// Responses to reads: 9 bytes, starting with FF 86
+	m->rx_desc.buf = m->rx_buf;
+	m->rx_desc.max_len = MHZ19_FRAME_LEN;
+	m->rx_desc.mode = PLATFORM_USART_RX_MODE_FIXED;
+	m->rx_desc.mode_cfg.nr_sync = 2;
+	m->rx_desc.mode_cfg.sync[0] = 0xFF;
+	m->rx_desc.mode_cfg.sync[1] = 0x86;
+
+	m->task.name = name;
+	m->task.fn = mhz19_task;
+	m->task.arg = m;
+	platform_task_start(&m->task, 0, period);
+}
+
+void mhz19_calibrate_zero(mhz19_t *m)
+{
+	mhz19_queue_cmd(m, MHZ19_CMD_ZERO);
+}
+
+bool mhz19_calibrate_span(mhz19_t *m, uint16_t ppm)
+{
+	// The frame must not change under the transmitter
+	if (m->tx_desc.buf == m->span_cmd && platform_usart_co2_tx_busy())
+		return false;
+
+	memcpy(m->span_cmd, mhz19_zero_cmd, MHZ19_FRAME_LEN);
+	m->span_cmd[2] = (char)0x88;
+	m->span_cmd[3] = (char)(ppm >> 8);
+	m->span_cmd[4] = (char)ppm;
+	m->span_cmd[MHZ19_FRAME_LEN - 1] = (char)mhz19_checksum(m->span_cmd);
+	mhz19_queue_cmd(m, MHZ19_CMD_SPAN);
+	return true;
+}
+
+void mhz19_set_abc(mhz19_t *m, bool on)
+{
+	// The later request wins
+	m->cmd_pending &= ~(MHZ19_CMD_ABC_ON | MHZ19_CMD_ABC_OFF);
+	mhz19_queue_cmd(m, on ? MHZ19_CMD_ABC_ON : MHZ19_CMD_ABC_OFF);
+}
+
+bool mhz19_latest(const mhz19_t *m, mhz19_sample_t *sample)
+{
+	*sample = m->latest;
+	return sample->seq != 0;
+}
+
+void mhz19_stats(const mhz19_t *m, mhz19_stats_t *stats)
+{
+	*stats = m->stats;
+}
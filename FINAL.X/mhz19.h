@@ -0,0 +1,139 @@
+/**
+ * @file mhz19.h
+ * @brief Non-blocking request/response driver for the MH-Z19C
+ */
+
+#if !defined(MHZ19_H_)
+#define MHZ19_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "platform.h"
+
+// C linkage should be maintained
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+
+/// Size of a command or response frame
+#define MHZ19_FRAME_LEN	9
+
+/// Time allowed for a response, counted from the request being sent
+#define MHZ19_RESPONSE_TIMEOUT_MS	100
+
+/// Number of times a read is retried after a timeout or bad response
+#define MHZ19_NR_RETRIES	2
+
+/// One CO2 reading
+typedef struct mhz19_sample_type {
+	/// CO2 concentration, in ppm
+	uint16_t	co2_ppm;
+
+	/// When the response carrying it was received
+	platform_tick_t	when;
+
+	/// Incremented for every new reading; zero if there was none yet
+	uint32_t	seq;
+} mhz19_sample_t;
+
+/// Driver counters
+typedef struct mhz19_stats_type {
+	/// Read requests sent, including retries
+	uint32_t	nr_requests;
+
+	/// Valid responses
+	uint32_t	nr_good;
+
+	/// Responses dropped due to a bad checksum
+	uint32_t	nr_bad;
+
+	/// Requests that got no (complete) response in time
+	uint32_t	nr_timeout;
+
+	/// Responses that came in after their request timed out, and were dropped
+	uint32_t	nr_late;
+
+	/// Readings given up on after the last retry
+	uint32_t	nr_failed;
+
+	/// Calibration and ABC commands sent
+	uint32_t	nr_commands;
+} mhz19_stats_t;
+
+/**
+ * Driver state; treat as opaque, except for @c task
+ *
+ * @c task may be given a name before @c mhz19_start() is called.
+ */
+typedef struct mhz19_type {
+	platform_task_t	task;
+
+	platform_usart_tx_bufdesc_t	tx_desc;
+	platform_usart_rx_async_desc_t	rx_desc;
+	char		rx_buf[MHZ19_FRAME_LEN];
+
+	/// Frame for the span calibration, which takes an argument
+	char		span_cmd[MHZ19_FRAME_LEN];
+
+	/// Commands waiting to be sent, as a bitmask
+	uint8_t		cmd_pending;
+
+	/// Retries left for the read in flight
+	uint8_t		retries;
+
+	/// When the read in flight times out
+	platform_tick_t	deadline;
+
+	/// Periodic run the last read was started for
+	platform_tick_t	read_phase;
+
+	mhz19_sample_t	latest;
+	mhz19_stats_t	stats;
+} mhz19_t;
+
+/**
+ * Set up the driver and start reading every @p period
+ *
+ * Reads, and the commands below, are sent from @c platform_do_loop_one();
+ * nothing here ever waits for the sensor.
+ */
+void mhz19_start(mhz19_t *m, platform_tick_t period);
+
+/**
+ * Calibrate the zero point, i.e. the current reading becomes 400 ppm
+ *
+ * @note
+ * The sensor must have been in clean air for at least 20 minutes.
+ */
+void mhz19_calibrate_zero(mhz19_t *m);
+
+/**
+ * Calibrate the span against a reference gas of @p ppm
+ *
+ * @return	@c false if the previous span command is still being sent
+ */
+bool mhz19_calibrate_span(mhz19_t *m, uint16_t ppm);
+
+/// Turn the automatic baseline correction (ABC) on or off
+void mhz19_set_abc(mhz19_t *m, bool on);
+
+/**
+ * Get the latest reading
+ *
+ * @return	@c false if there was no valid reading yet
+ */
+bool mhz19_latest(const mhz19_t *m, mhz19_sample_t *sample);
+
+/// Get the driver counters
+void mhz19_stats(const mhz19_t *m, mhz19_stats_t *stats);
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifdef __cplusplus
+}
+#endif	// __cplusplus
+#endif	// !defined(MHZ19_H_)
@@ -51,17 +51,17 @@ OBJECTDIR=build/${CND_CONF}/${IMAGE_TYPE}
 DISTDIR=dist/${CND_CONF}/${IMAGE_TYPE}
 
 # Source Files Quoted if spaced
-SOURCEFILES_QUOTED_IF_SPACED=platform/gpio.c platform/systick.c platform/usart.c main.c
+SOURCEFILES_QUOTED_IF_SPACED=platform/gpio.c platform/systick.c platform/usart.c main.c platform/dmac.c platform/sched.c nmea.c fixpt.c pms.c mhz19.c telem.c aqi.c fuse.c platform/log.c flog.c platform/nvm.c cap.c
 
 # Object Files Quoted if spaced
-OBJECTFILES_QUOTED_IF_SPACED=${OBJECTDIR}/platform/gpio.o ${OBJECTDIR}/platform/systick.o ${OBJECTDIR}/platform/usart.o ${OBJECTDIR}/main.o
-POSSIBLE_DEPFILES=${OBJECTDIR}/platform/gpio.o.d ${OBJECTDIR}/platform/systick.o.d ${OBJECTDIR}/platform/usart.o.d ${OBJECTDIR}/main.o.d
+OBJECTFILES_QUOTED_IF_SPACED=${OBJECTDIR}/platform/gpio.o ${OBJECTDIR}/platform/systick.o ${OBJECTDIR}/platform/usart.o ${OBJECTDIR}/main.o ${OBJECTDIR}/platform/dmac.o ${OBJECTDIR}/platform/sched.o ${OBJECTDIR}/nmea.o ${OBJECTDIR}/fixpt.o ${OBJECTDIR}/pms.o ${OBJECTDIR}/mhz19.o ${OBJECTDIR}/telem.o ${OBJECTDIR}/aqi.o ${OBJECTDIR}/fuse.o ${OBJECTDIR}/platform/log.o ${OBJECTDIR}/flog.o ${OBJECTDIR}/platform/nvm.o ${OBJECTDIR}/cap.o
+POSSIBLE_DEPFILES=${OBJECTDIR}/platform/gpio.o.d ${OBJECTDIR}/platform/systick.o.d ${OBJECTDIR}/platform/usart.o.d ${OBJECTDIR}/main.o.d ${OBJECTDIR}/platform/dmac.o.d ${OBJECTDIR}/platform/sched.o.d ${OBJECTDIR}/nmea.o.d ${OBJECTDIR}/fixpt.o.d ${OBJECTDIR}/pms.o.d ${OBJECTDIR}/mhz19.o.d ${OBJECTDIR}/telem.o.d ${OBJECTDIR}/aqi.o.d ${OBJECTDIR}/fuse.o.d ${OBJECTDIR}/platform/log.o.d ${OBJECTDIR}/flog.o.d ${OBJECTDIR}/platform/nvm.o.d ${OBJECTDIR}/cap.o.d
 
 # Object Files
-OBJECTFILES=${OBJECTDIR}/platform/gpio.o ${OBJECTDIR}/platform/systick.o ${OBJECTDIR}/platform/usart.o ${OBJECTDIR}/main.o
+OBJECTFILES=${OBJECTDIR}/platform/gpio.o ${OBJECTDIR}/platform/systick.o ${OBJECTDIR}/platform/usart.o ${OBJECTDIR}/main.o ${OBJECTDIR}/platform/dmac.o ${OBJECTDIR}/platform/sched.o ${OBJECTDIR}/nmea.o ${OBJECTDIR}/fixpt.o ${OBJECTDIR}/pms.o ${OBJECTDIR}/mhz19.o ${OBJECTDIR}/telem.o ${OBJECTDIR}/aqi.o ${OBJECTDIR}/fuse.o ${OBJECTDIR}/platform/log.o ${OBJECTDIR}/flog.o ${OBJECTDIR}/platform/nvm.o ${OBJECTDIR}/cap.o
 
 # Source Files
-SOURCEFILES=platform/gpio.c platform/systick.c platform/usart.c main.c
+SOURCEFILES=platform/gpio.c platform/systick.c platform/usart.c main.c platform/dmac.c platform/sched.c nmea.c fixpt.c pms.c mhz19.c telem.c aqi.c fuse.c platform/log.c flog.c platform/nvm.c cap.c
 
 # Pack Options 
 PACK_COMMON_OPTIONS=-I "${CMSIS_DIR}/CMSIS/Core/Include"
@@ -128,6 +128,84 @@ ${OBJECTDIR}/main.o: main.c  .generated_files/flags/default/3f50e19477fd3cbf5210
 	@${RM} ${OBJECTDIR}/main.o 
 	${MP_CC}  $(MP_EXTRA_CC_PRE) -g -D__DEBUG   -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/main.o.d" -o ${OBJECTDIR}/main.o main.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
 	
+${OBJECTDIR}/platform/dmac.o: platform/dmac.c  .generated_files/flags/default/cdb6b9d15760bb62c67a5698cd9fe2b16147684e .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}/platform" 
+	@${RM} ${OBJECTDIR}/platform/dmac.o.d 
+	@${RM} ${OBJECTDIR}/platform/dmac.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -D__DEBUG   -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/platform/dmac.o.d" -o ${OBJECTDIR}/platform/dmac.o platform/dmac.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
+	
+${OBJECTDIR}/platform/sched.o: platform/sched.c  .generated_files/flags/default/ff44077a1f5f7fb62d619d34cdcc23842be06fc4 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}/platform" 
+	@${RM} ${OBJECTDIR}/platform/sched.o.d 
+	@${RM} ${OBJECTDIR}/platform/sched.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -D__DEBUG   -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/platform/sched.o.d" -o ${OBJECTDIR}/platform/sched.o platform/sched.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
+	
+${OBJECTDIR}/platform/log.o: platform/log.c  .generated_files/flags/default/f404ed6efedc3e4488b7abbe53451a7d42c78a2f .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}/platform" 
+	@${RM} ${OBJECTDIR}/platform/log.o.d 
+	@${RM} ${OBJECTDIR}/platform/log.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -D__DEBUG   -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/platform/log.o.d" -o ${OBJECTDIR}/platform/log.o platform/log.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
+	
+${OBJECTDIR}/platform/nvm.o: platform/nvm.c  .generated_files/flags/default/1de0d998f239ffa50d6135bc7a66c355a8acf4d8 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}/platform" 
+	@${RM} ${OBJECTDIR}/platform/nvm.o.d 
+	@${RM} ${OBJECTDIR}/platform/nvm.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -D__DEBUG   -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/platform/nvm.o.d" -o ${OBJECTDIR}/platform/nvm.o platform/nvm.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
+	
+${OBJECTDIR}/nmea.o: nmea.c  .generated_files/flags/default/5c566f728b9b27f2b461b957743e842c297f6569 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/nmea.o.d 
+	@${RM} ${OBJECTDIR}/nmea.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -D__DEBUG   -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/nmea.o.d" -o ${OBJECTDIR}/nmea.o nmea.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
+	
+${OBJECTDIR}/fixpt.o: fixpt.c  .generated_files/flags/default/346e44dedcb859ced6630fef49e00b61df0b6f70 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/fixpt.o.d 
+	@${RM} ${OBJECTDIR}/fixpt.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -D__DEBUG   -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/fixpt.o.d" -o ${OBJECTDIR}/fixpt.o fixpt.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
+	
+${OBJECTDIR}/pms.o: pms.c  .generated_files/flags/default/143421da75de99f20a7bf927b8088086545eee83 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/pms.o.d 
+	@${RM} ${OBJECTDIR}/pms.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -D__DEBUG   -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/pms.o.d" -o ${OBJECTDIR}/pms.o pms.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
+	
+${OBJECTDIR}/mhz19.o: mhz19.c  .generated_files/flags/default/a40388caa07e66335b469238dea7015226e222e3 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/mhz19.o.d 
+	@${RM} ${OBJECTDIR}/mhz19.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -D__DEBUG   -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/mhz19.o.d" -o ${OBJECTDIR}/mhz19.o mhz19.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
+	
+${OBJECTDIR}/telem.o: telem.c  .generated_files/flags/default/749a6721aa9e94b6a02d682af56df1935a90dc87 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/telem.o.d 
+	@${RM} ${OBJECTDIR}/telem.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -D__DEBUG   -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/telem.o.d" -o ${OBJECTDIR}/telem.o telem.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
+	
+${OBJECTDIR}/aqi.o: aqi.c  .generated_files/flags/default/31b45b58e5ec00fe9f2fdfcf5e412c70c5816f80 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/aqi.o.d 
+	@${RM} ${OBJECTDIR}/aqi.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -D__DEBUG   -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/aqi.o.d" -o ${OBJECTDIR}/aqi.o aqi.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
+	
+${OBJECTDIR}/fuse.o: fuse.c  .generated_files/flags/default/47568a42540fad9a9d92f4614d3d8872a654d0df .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/fuse.o.d 
+	@${RM} ${OBJECTDIR}/fuse.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -D__DEBUG   -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/fuse.o.d" -o ${OBJECTDIR}/fuse.o fuse.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
+	
+${OBJECTDIR}/flog.o: flog.c  .generated_files/flags/default/f83db8318236fa9bdc555fb6319c65697682191d .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/flog.o.d 
+	@${RM} ${OBJECTDIR}/flog.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -D__DEBUG   -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/flog.o.d" -o ${OBJECTDIR}/flog.o flog.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
+	
+${OBJECTDIR}/cap.o: cap.c  .generated_files/flags/default/3ad049ebf45fbe6a779f6ae33d604722f4d2c864 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/cap.o.d 
+	@${RM} ${OBJECTDIR}/cap.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -D__DEBUG   -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/cap.o.d" -o ${OBJECTDIR}/cap.o cap.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
+	
 else
 ${OBJECTDIR}/platform/gpio.o: platform/gpio.c  .generated_files/flags/default/4cb9325fe6fb9f94ae4905ed1c059a07c9afdfc9 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
 	@${MKDIR} "${OBJECTDIR}/platform" 
@@ -153,6 +231,84 @@ ${OBJECTDIR}/main.o: main.c  .generated_files/flags/default/f407e691c1c46a1b649f
 	@${RM} ${OBJECTDIR}/main.o 
 	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/main.o.d" -o ${OBJECTDIR}/main.o main.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
 	
+${OBJECTDIR}/platform/dmac.o: platform/dmac.c  .generated_files/flags/default/3c44ddd8af0b1ff2c7c50fec3356d839b62d2780 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}/platform" 
+	@${RM} ${OBJECTDIR}/platform/dmac.o.d 
+	@${RM} ${OBJECTDIR}/platform/dmac.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)   -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/platform/dmac.o.d" -o ${OBJECTDIR}/platform/dmac.o platform/dmac.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
+	
+${OBJECTDIR}/platform/sched.o: platform/sched.c  .generated_files/flags/default/70b5ac612b5ad5ff3daa8b889b13dd5556a89114 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}/platform" 
+	@${RM} ${OBJECTDIR}/platform/sched.o.d 
+	@${RM} ${OBJECTDIR}/platform/sched.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)   -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/platform/sched.o.d" -o ${OBJECTDIR}/platform/sched.o platform/sched.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
+	
+${OBJECTDIR}/platform/log.o: platform/log.c  .generated_files/flags/default/f4f1b5fb935f19c3ed564c873a77041e633a2260 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}/platform" 
+	@${RM} ${OBJECTDIR}/platform/log.o.d 
+	@${RM} ${OBJECTDIR}/platform/log.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)   -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/platform/log.o.d" -o ${OBJECTDIR}/platform/log.o platform/log.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
+	
+${OBJECTDIR}/platform/nvm.o: platform/nvm.c  .generated_files/flags/default/c49a213bd7f28ca4bd0d7a162028768e93067508 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}/platform" 
+	@${RM} ${OBJECTDIR}/platform/nvm.o.d 
+	@${RM} ${OBJECTDIR}/platform/nvm.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)   -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/platform/nvm.o.d" -o ${OBJECTDIR}/platform/nvm.o platform/nvm.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
+	
+${OBJECTDIR}/nmea.o: nmea.c  .generated_files/flags/default/1040a705a6e4e411d1f087743c761d6756c6aa39 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/nmea.o.d 
+	@${RM} ${OBJECTDIR}/nmea.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)   -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/nmea.o.d" -o ${OBJECTDIR}/nmea.o nmea.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
+	
+${OBJECTDIR}/fixpt.o: fixpt.c  .generated_files/flags/default/c435d334dd4b8be5f73eb0dae3b9a39fc810fc3d .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/fixpt.o.d 
+	@${RM} ${OBJECTDIR}/fixpt.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)   -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/fixpt.o.d" -o ${OBJECTDIR}/fixpt.o fixpt.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
+	
+${OBJECTDIR}/pms.o: pms.c  .generated_files/flags/default/4b41bdb86e7453474b366ea4cf3328068a972f28 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/pms.o.d 
+	@${RM} ${OBJECTDIR}/pms.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)   -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/pms.o.d" -o ${OBJECTDIR}/pms.o pms.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
+	
+${OBJECTDIR}/mhz19.o: mhz19.c  .generated_files/flags/default/4ca7cabd67e42192298179694b6b78811a5285ac .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/mhz19.o.d 
+	@${RM} ${OBJECTDIR}/mhz19.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)   -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/mhz19.o.d" -o ${OBJECTDIR}/mhz19.o mhz19.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
+	
+${OBJECTDIR}/telem.o: telem.c  .generated_files/flags/default/a22bbb30dc7e2debbd14c50723ffe6ca9b2bd896 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/telem.o.d 
+	@${RM} ${OBJECTDIR}/telem.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)   -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/telem.o.d" -o ${OBJECTDIR}/telem.o telem.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
+	
+${OBJECTDIR}/aqi.o: aqi.c  .generated_files/flags/default/984b0f316c4f0e983f29291165cf3965482ce8f8 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/aqi.o.d 
+	@${RM} ${OBJECTDIR}/aqi.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)   -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/aqi.o.d" -o ${OBJECTDIR}/aqi.o aqi.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
+	
+${OBJECTDIR}/fuse.o: fuse.c  .generated_files/flags/default/e8bbc5a60f04239f7081a715c6ba6273d2ff1375 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/fuse.o.d 
+	@${RM} ${OBJECTDIR}/fuse.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)   -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/fuse.o.d" -o ${OBJECTDIR}/fuse.o fuse.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
+	
+${OBJECTDIR}/flog.o: flog.c  .generated_files/flags/default/c95003d40e98f03b729cfc1382e3518582916210 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/flog.o.d 
+	@${RM} ${OBJECTDIR}/flog.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)   -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/flog.o.d" -o ${OBJECTDIR}/flog.o flog.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
+	
+${OBJECTDIR}/cap.o: cap.c  .generated_files/flags/default/2dd2f125ccdd7aa8c63a61d19d9aa4058e38c2e9 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/cap.o.d 
+	@${RM} ${OBJECTDIR}/cap.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)   -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/cap.o.d" -o ${OBJECTDIR}/cap.o cap.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}/PIC32CM-LS00" ${PACK_COMMON_OPTIONS} 
+	
 endif
 
 # ------------------------------------------------------------------------------------
@@ -0,0 +1,261 @@
+/**
+ * @file nmea.c
+ * @brief Incremental NMEA 0183 parser for the NEO-6M
+ */
+
+/*
+ * Bytes are consumed one at a time; each field is decoded as soon as its
+ * terminating ',' or '*' comes in, straight into a scratch copy of the fix.
+ * That copy only replaces the published fix once the checksum checks out,
+ * so a corrupted sentence never leaks half-decoded fields.
+ *
+ * Numbers are decoded with the fixed-point routines of fixpt.c.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "fixpt.h"
+#include "nmea.h"
+
+// Parser states
+#define ST_IDLE		0	// Waiting for '$'
+#define ST_BODY		1	// Between '$' and '*'
+#define ST_CKSUM_HI	2
+#define ST_CKSUM_LO	3
+
+/////////////////////////////////////////////////////////////////////////////
+
+// Decimal digits to integer, stopping at the first non-digit
+static uint32_t nmea_uint(const char *s)
+{
+	uint32_t v = 0;
+
+	while (*s >= '0' && *s <= '9')
+		v = v * 10 + (uint32_t)(*s++ - '0');
+	return v;
+}
+
+// hhmmss.sss to milliseconds since midnight
+static uint32_t nmea_time(const char *s)
+{
+	uint32_t t = (uint32_t)fixpt_parse(s, 3, NULL);	// hhmmss * 1000 + ms
+	uint32_t ms = t % 100000;			// ss * 1000 + ms
+
+	t /= 100000;					// hhmm
+	return ((t / 100) * 3600 + (t % 100) * 60) * 1000 + ms;
+}
+
+// Sentence type from the address field, e.g. "GPGGA"
+static uint8_t nmea_type(const char *s, uint8_t len)
+{
+	if (len != 5)
+		return NMEA_SENT_NONE;
+	s += 2;
+	if (memcmp(s, "GGA", 3) == 0)
+		return NMEA_SENT_GGA;
+	if (memcmp(s, "RMC", 3) == 0)
+		return NMEA_SENT_RMC;
+	if (memcmp(s, "VTG", 3) == 0)
+		return NMEA_SENT_VTG;
+	if (memcmp(s, "GSA", 3) == 0)
+		return NMEA_SENT_GSA;
+	return NMEA_SENT_NONE;
+}
+
+// Decode the field just completed
+static void nmea_field(nmea_parser_t *p)
+{
+	nmea_fix_t *f = &p->work;
+	const char *s = p->field;
+	uint32_t v;
+
+	switch (p->type) {
+	case NMEA_SENT_GGA:
+		switch (p->field_idx) {
+		case 1:  f->time_ms = nmea_time(s); break;
+		case 2:  f->lat_e7 = fixpt_ddmm_to_e7(s, 0); break;
+		case 3:  if (*s == 'S') f->lat_e7 = -f->lat_e7; break;
+		case 4:  f->lon_e7 = fixpt_ddmm_to_e7(s, 0); break;
+		case 5:  if (*s == 'W') f->lon_e7 = -f->lon_e7; break;
+		case 6:  f->quality = (uint8_t)nmea_uint(s); break;
+		case 7:  f->nr_sats = (uint8_t)nmea_uint(s); break;
+		case 8:  f->hdop_c = (uint16_t)fixpt_parse(s, 2, NULL); break;
+		case 9:  f->alt_mm = fixpt_m_to_mm(s); break;
+		default: break;
+		}
+		break;
+
+	case NMEA_SENT_RMC:
+		switch (p->field_idx) {
+		case 1:  f->time_ms = nmea_time(s); break;
+		case 2:  f->valid = (*s == 'A'); break;
+		case 3:  f->lat_e7 = fixpt_ddmm_to_e7(s, 0); break;
+		case 4:  if (*s == 'S') f->lat_e7 = -f->lat_e7; break;
+		case 5:  f->lon_e7 = fixpt_ddmm_to_e7(s, 0); break;
+		case 6:  if (*s == 'W') f->lon_e7 = -f->lon_e7; break;
+		case 7:  f->speed_cmps = (uint16_t)fixpt_knots_to_cmps(s); break;
+		case 8:  f->course_cdeg = (uint16_t)fixpt_parse(s, 2, NULL); break;
+		case 9:
+			v = nmea_uint(s);		// ddmmyy
+			f->day = (uint8_t)(v / 10000);
+			f->month = (uint8_t)((v / 100) % 100);
+			f->year = (uint8_t)(v % 100);
+			break;
+		default: break;
+		}
+		break;
+
+	case NMEA_SENT_VTG:
+		switch (p->field_idx) {
+		case 1:  f->course_cdeg = (uint16_t)fixpt_parse(s, 2, NULL); break;
+		case 7:  f->speed_cmps = (uint16_t)fixpt_kmh_to_cmps(s); break;
+		default: break;
+		}
+		break;
+
+	case NMEA_SENT_GSA:
+		switch (p->field_idx) {
+		case 2:  f->mode = (uint8_t)nmea_uint(s); break;
+		case 15: f->pdop_c = (uint16_t)fixpt_parse(s, 2, NULL); break;
+		case 16: f->hdop_c = (uint16_t)fixpt_parse(s, 2, NULL); break;
+		case 17: f->vdop_c = (uint16_t)fixpt_parse(s, 2, NULL); break;
+		default: break;
+		}
+		break;
+
+	default:
+		break;
+	}
+}
+
+// Hex digit to value, or -1
+static int nmea_hex(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	return -1;
+}
+
+// End of a field; returns false if the sentence should be dropped
+static bool nmea_field_end(nmea_parser_t *p)
+{
+	p->field[p->field_len] = '\0';
+	if (p->field_idx == 0) {
+		p->type = nmea_type(p->field, p->field_len);
+		if (p->type == NMEA_SENT_NONE)
+			return false;
+	} else {
+		nmea_field(p);
+	}
+	++p->field_idx;
+	p->field_len = 0;
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+void nmea_init(nmea_parser_t *p)
+{
+	memset(p, 0, sizeof(*p));
+	p->state = ST_IDLE;
+}
+
+uint8_t nmea_feed_byte(nmea_parser_t *p, char c)
+{
+	int x;
+
+	// A '$' always starts over, even in the middle of a sentence.
+	if (c == '$') {
+		if (p->state != ST_IDLE)
+			++p->nr_bad_cksum;
+		p->work = p->fix;
+		p->state = ST_BODY;
+		p->cksum = 0;
+		p->field_len = 0;
+		p->field_idx = 0;
+		p->type = NMEA_SENT_NONE;
+		return NMEA_SENT_NONE;
+	}
+
+	switch (p->state) {
+	case ST_BODY:
+		if (c == '*') {
+			if (!nmea_field_end(p))
+				break;
+			p->state = ST_CKSUM_HI;
+			return NMEA_SENT_NONE;
+		}
+		if (c == '\r' || c == '\n') {
+			// No checksum; NEO-6M always sends one.
+			++p->nr_bad_cksum;
+			p->state = ST_IDLE;
+			return NMEA_SENT_NONE;
+		}
+		p->cksum ^= (uint8_t)c;
+		if (c == ',') {
+			if (!nmea_field_end(p))
+				break;
+		} else if (p->field_len < sizeof(p->field) - 1) {
+			p->field[p->field_len++] = c;
+		} else {
+			break;
+		}
+		return NMEA_SENT_NONE;
+
+	case ST_CKSUM_HI:
+		x = nmea_hex(c);
+		if (x < 0) {
+			++p->nr_bad_cksum;
+			p->state = ST_IDLE;
+			return NMEA_SENT_NONE;
+		}
+		p->cksum_rx = (uint8_t)(x << 4);
+		p->state = ST_CKSUM_LO;
+		return NMEA_SENT_NONE;
+
+	case ST_CKSUM_LO:
+		x = nmea_hex(c);
+		p->state = ST_IDLE;
+		if (x < 0 || (p->cksum_rx | (uint8_t)x) != p->cksum) {
+			++p->nr_bad_cksum;
+			return NMEA_SENT_NONE;
+		}
+		p->work.updated |= p->type;
+		p->fix = p->work;
+		++p->nr_ok;
+		return p->type;
+
+	default:
+		return NMEA_SENT_NONE;
+	}
+
+	// Unknown sentence type or overlong field; skip to the next '$'
+	++p->nr_dropped;
+	p->state = ST_IDLE;
+	return NMEA_SENT_NONE;
+}
+
+uint8_t nmea_feed(nmea_parser_t *p, const char *buf, size_t len)
+{
+	uint8_t done = NMEA_SENT_NONE;
+
+	while (len-- > 0)
+		done |= nmea_feed_byte(p, *buf++);
+	return done;
+}
+
+uint8_t nmea_take_fix(nmea_parser_t *p, nmea_fix_t *fix)
+{
+	uint8_t updated = p->fix.updated;
+
+	*fix = p->fix;
+	p->fix.updated = NMEA_SENT_NONE;
+	p->work.updated = NMEA_SENT_NONE;
+	return updated;
+}
@@ -0,0 +1,149 @@
+/**
+ * @file nmea.h
+ * @brief Incremental NMEA 0183 parser for the NEO-6M
+ */
+
+#if !defined(NMEA_H_)
+#define NMEA_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// C linkage should be maintained
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @name Sentence types
+ *
+ * These are bits, so that sets of them can be reported at once. Any talker
+ * ID (GP, GN, GL, ...) is accepted.
+ * @{
+ */
+#define NMEA_SENT_NONE	0x00
+#define NMEA_SENT_GGA	0x01
+#define NMEA_SENT_RMC	0x02
+#define NMEA_SENT_VTG	0x04
+#define NMEA_SENT_GSA	0x08
+/** @} */
+
+/**
+ * Navigation fix, in integer units
+ *
+ * Fields are only as recent as the last valid sentence carrying them; see
+ * @c updated. Empty NMEA fields decode as zero.
+ */
+typedef struct __attribute__((packed)) nmea_fix_type {
+	/// Latitude, in 1e-7 degrees; north is positive
+	int32_t		lat_e7;
+
+	/// Longitude, in 1e-7 degrees; east is positive
+	int32_t		lon_e7;
+
+	/// Altitude above mean sea level, in millimeters (GGA)
+	int32_t		alt_mm;
+
+	/// UTC time of day, in milliseconds (GGA, RMC)
+	uint32_t	time_ms;
+
+	/// Speed over ground, in cm/s (RMC, VTG)
+	uint16_t	speed_cmps;
+
+	/// Course over ground, in 0.01 degrees (RMC, VTG)
+	uint16_t	course_cdeg;
+
+	/// Dilutions of precision, in 0.01 units (HDOP from GGA/GSA)
+	uint16_t	pdop_c;
+	uint16_t	hdop_c;
+	uint16_t	vdop_c;
+
+	/// UTC date (RMC); @c year counts from 2000
+	uint8_t		day;
+	uint8_t		month;
+	uint8_t		year;
+
+	/// Fix quality (GGA); zero if there is no fix
+	uint8_t		quality;
+
+	/// Fix mode (GSA); 1 = none, 2 = 2D, 3 = 3D
+	uint8_t		mode;
+
+	/// Number of satellites used (GGA)
+	uint8_t		nr_sats;
+
+	/// Whether RMC reported the data as valid ('A')
+	uint8_t		valid;
+
+	/// NMEA_SENT_* bits of the sentences decoded since the fix was last
+	/// taken with @c nmea_take_fix()
+	uint8_t		updated;
+} nmea_fix_t;
+
+/// Parser state; treat as opaque, except for the counters
+typedef struct nmea_parser_type {
+	/// Latest fix, updated only by sentences with a valid checksum
+	nmea_fix_t	fix;
+
+	/// Fix being assembled from the sentence in progress
+	nmea_fix_t	work;
+
+	/// Current field, and where in the sentence it is
+	char		field[16];
+	uint8_t		field_len;
+	uint8_t		field_idx;
+
+	uint8_t		state;
+	uint8_t		type;
+	uint8_t		cksum;
+	uint8_t		cksum_rx;
+
+	/// Sentences decoded
+	uint32_t	nr_ok;
+
+	/// Sentences dropped due to a bad or missing checksum
+	uint32_t	nr_bad_cksum;
+
+	/// Sentences dropped due to an overlong field, or skipped as unknown
+	uint32_t	nr_dropped;
+} nmea_parser_t;
+
+/// Reset a parser, including its fix and counters
+void nmea_init(nmea_parser_t *p);
+
+/**
+ * Feed a single byte into the parser
+ *
+ * @return	The NMEA_SENT_* bit of the sentence completed by @p c, if it
+ *		was valid and of a known type; NMEA_SENT_NONE otherwise
+ */
+uint8_t nmea_feed_byte(nmea_parser_t *p, char c);
+
+/**
+ * Feed a buffer into the parser
+ *
+ * Sentences may be split across calls at any point.
+ *
+ * @return	NMEA_SENT_* bits of all sentences completed within @p buf
+ */
+uint8_t nmea_feed(nmea_parser_t *p, const char *buf, size_t len);
+
+/**
+ * Copy out the latest fix, and clear its @c updated bits
+ *
+ * The next fix taken only reports the sentences decoded after this call,
+ * including one in progress now.
+ *
+ * @return	The @c updated bits of the fix taken
+ */
+uint8_t nmea_take_fix(nmea_parser_t *p, nmea_fix_t *fix);
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifdef __cplusplus
+}
+#endif	// __cplusplus
+#endif	// !defined(NMEA_H_)
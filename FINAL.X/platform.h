@@ -17,11 +17,45 @@ void platform_init(void);
 /**
  * Do one loop of events processing for the platform
  * 
+ * Due tasks are run from here. If nothing is left to do afterwards, the CPU
+ * is put to sleep until the next task is due, a timer expires, or an
+ * interrupt comes in; see @c platform_idle_stats().
+ * 
  * @note
  * This is expected to be called within the main application infinite loop.
  */
 void platform_do_loop_one(void);
 
+/// Time spent sleeping in @c platform_do_loop_one()
+typedef struct platform_idle_stats_type {
+	/// Time covered by these statistics, in @c platform_tick_t units
+	uint64_t nr_ticks_total;
+	
+	/// Time spent asleep, in @c platform_tick_t units
+	uint64_t nr_ticks_asleep;
+	
+	/// Number of times the CPU was put to sleep
+	uint32_t nr_sleeps;
+	
+	/**
+	 * Number of times SysTick was stopped and restarted, to sleep across
+	 * jiffies; each time, a calibrated number of clocks is taken to have
+	 * gone by uncounted (see platform/systick.c)
+	 */
+	uint32_t nr_restarts;
+} platform_idle_stats_t;
+
+/**
+ * Take a snapshot of the idle statistics
+ * 
+ * The fraction of time spent asleep is
+ * @c nr_ticks_asleep / @c nr_ticks_total.
+ * 
+ * @param[out]	stats	Snapshot
+ * @param[in]	reset	If @c true, start over from now on
+ */
+void platform_idle_stats(platform_idle_stats_t *stats, bool reset);
+
 //////////////////////////////////////////////////////////////////////////////
 
 /**
@@ -60,25 +94,77 @@ typedef struct platform_timespec_type {
 int platform_timespec_compare(const platform_timespec_t *lhs,
 	const platform_timespec_t *rhs);
 
+/**
+ * Add two timespec instances
+ * 
+ * @param[out]	sum	Sum; may alias either input
+ * @param[in]	lhs	Left-hand side
+ * @param[in]	rhs	Right-hand side
+ * 
+ * @note
+ * Both inputs must be normalized. Seconds wrap around, as with
+ * @c platform_tick_delta().
+ */
+void platform_timespec_add(platform_timespec_t *sum,
+	const platform_timespec_t *lhs, const platform_timespec_t *rhs);
+
+/**
+ * Bring @c nr_nsec back onto [0, 999999999], carrying into @c nr_sec
+ * 
+ * @note
+ * Saturates at the largest representable value instead of wrapping.
+ */
+void platform_timespec_normalize(platform_timespec_t *ts);
+
 /// Number of microseconds for a single tick
-#define	PLATFORM_TICK_PERIOD_US	5000
+#define	PLATFORM_TICK_PERIOD_US	1000
 
-/// Return the number of ticks since @c platform_init() was called
-void platform_tick_count(platform_timespec_t *tick);
+/**
+ * Monotonic time, in SysTick clocks since @c platform_init() was called
+ * 
+ * Compare and subtract these with plain unsigned arithmetic; differences
+ * are meaningful as long as they fit in an @c int64_t.
+ */
+typedef uint64_t platform_tick_t;
+
+/// Number of @c platform_tick_t units per microsecond
+#define PLATFORM_TICKS_PER_US	12
+
+/// Convert microseconds into @c platform_tick_t units
+#define PLATFORM_TICKS_US(us)	((platform_tick_t)(us) * PLATFORM_TICKS_PER_US)
+
+/// Convert milliseconds into @c platform_tick_t units
+#define PLATFORM_TICKS_MS(ms)	PLATFORM_TICKS_US((uint64_t)(ms) * 1000)
+
+/// Get the current time, at full resolution
+platform_tick_t platform_tick_get(void);
+
+/// Check whether @p deadline has been reached at time @p now
+static inline bool platform_tick_expired(platform_tick_t now,
+	platform_tick_t deadline)
+{
+	return (int64_t)(now - deadline) >= 0;
+}
 
 /**
- * A higher-resolution version of @c platform_tick_count(), if available
+ * Return the time elapsed since @c platform_init() was called, at tick
+ * (@c PLATFORM_TICK_PERIOD_US) resolution
  * 
  * @note
- * If unavailable, this function is equivalent to @c platform_tick_count().
+ * This and @c platform_tick_hrcount() are derived from
+ * @c platform_tick_get(), which is cheaper; prefer the latter for timing.
  */
+void platform_tick_count(platform_timespec_t *tick);
+
+/// A full-resolution version of @c platform_tick_count()
 void platform_tick_hrcount(platform_timespec_t *tick);
 
 /**
  * Get the difference between two ticks
  * 
  * @note
- * This routine accounts for wrap-arounds, but only once.
+ * This routine accounts for wrap-arounds, but only once. Both inputs must
+ * be normalized; @p diff may alias either of them.
  * 
  * @param[out]	diff	Difference
  * @param[in]	lhs	Left-hand side
@@ -94,6 +180,152 @@ void delay(uint32_t delay);
 
 //////////////////////////////////////////////////////////////////////////////
 
+typedef struct platform_timer_type platform_timer_t;
+
+/**
+ * Timer callback
+ * 
+ * @note
+ * Callbacks run in SysTick ISR context, so they should be short; the usual
+ * thing to do is to update some state and/or re-arm the timer.
+ */
+typedef void (*platform_timer_fn_t)(platform_timer_t *timer, void *arg);
+
+/**
+ * A software timer
+ * 
+ * Set @c fn and @c arg; the remaining fields are managed by the timer wheel.
+ * Zero-initialized timers are unarmed.
+ */
+struct platform_timer_type {
+	platform_timer_fn_t fn;
+	void *arg;
+	
+	// Managed by the timer wheel
+	uint32_t expires;
+	platform_timer_t *next;
+	platform_timer_t **pprev;
+};
+
+/**
+ * Arm (or re-arm) a timer to expire after @p delay
+ * 
+ * Timers have a resolution of @c PLATFORM_TICK_PERIOD_US; @p delay is
+ * rounded up to it, and clamped to 2^24 - 1 periods. This is O(1), and may
+ * be called from any context, including timer callbacks.
+ */
+void platform_timer_arm(platform_timer_t *timer, platform_tick_t delay);
+
+/// Disarm a timer, if it is armed; this is O(1)
+void platform_timer_cancel(platform_timer_t *timer);
+
+/// Check whether a timer is armed
+bool platform_timer_armed(const platform_timer_t *timer);
+
+//////////////////////////////////////////////////////////////////////////////
+
+typedef struct platform_task_type platform_task_t;
+
+/**
+ * Task body
+ * 
+ * Tasks are run to completion from @c platform_do_loop_one(), so they must
+ * never block; anything that takes a while is written as a state machine
+ * that keeps its state in @c platform_task_t::state (or in @p arg) and uses
+ * @c platform_task_defer() to be called back later.
+ */
+typedef void (*platform_task_fn_t)(platform_task_t *task, void *arg);
+
+/// Per-task statistics
+typedef struct platform_task_stats_type {
+	/// Number of times the task was run
+	uint32_t nr_runs;
+	
+	/// Number of times a whole period elapsed before the task could run
+	uint32_t nr_missed;
+	
+	/// Longest single run, in @c platform_tick_t units
+	uint32_t runtime_peak;
+	
+	/// Total time spent running, in @c platform_tick_t units
+	uint64_t runtime_total;
+} platform_task_stats_t;
+
+/**
+ * A scheduled task
+ * 
+ * Set @c fn and @c arg (and optionally @c name); the remaining fields are
+ * managed by the scheduler, except @c state, which is the task's own.
+ */
+struct platform_task_type {
+	const char *name;
+	platform_task_fn_t fn;
+	void *arg;
+	
+	/// State of the task's state machine; starts out as zero
+	unsigned int state;
+	
+	/// Period, or zero for one-shot tasks
+	platform_tick_t period;
+	
+	/// When the task is due next
+	platform_tick_t due;
+	
+	/// When the next periodic run is due; later than @c due after a defer
+	platform_tick_t phase;
+	
+	/// Whether the task will be run at @c due
+	bool armed;
+	
+	platform_task_stats_t stats;
+	
+	// Managed by the scheduler
+	platform_task_t *next;
+};
+
+/**
+ * Start a task
+ * 
+ * @param[in]	task	Task; must stay valid for as long as the program runs
+ * @param[in]	delay	Time until the first run
+ * @param[in]	period	Time between runs, or zero for a one-shot task
+ */
+void platform_task_start(platform_task_t *task, platform_tick_t delay,
+	platform_tick_t period);
+
+/// Stop a task; it can be restarted with @c platform_task_start()
+void platform_task_stop(platform_task_t *task);
+
+/**
+ * Run a task once after @p delay, instead of when it would be due next
+ * 
+ * Periodic tasks keep their phase: after that run, they are due at the
+ * next multiple of their period, as if never deferred. A run deferred to
+ * the time of the periodic one, or past it, takes its place. When called
+ * from the task body, this is the way to wait without blocking.
+ */
+void platform_task_defer(platform_task_t *task, platform_tick_t delay);
+
+/**
+ * Get the time at which the earliest task is due
+ * 
+ * @return	@c false if no task is armed
+ */
+bool platform_sched_next_due(platform_tick_t *due);
+
+//////////////////////////////////////////////////////////////////////////////
+
+/// USART channels, for the APIs that take one as an argument
+typedef enum platform_usart_ch_type {
+	PLATFORM_USART_ESP = 0,	///< ESP8266  (SERCOM0)
+	PLATFORM_USART_CO2,	///< MH-Z19C  (SERCOM1)
+	PLATFORM_USART_PMS,	///< PMS5003T (SERCOM3)
+	PLATFORM_USART_GPS,	///< NEO-6M   (SERCOM5)
+	
+	/// Number of channels; not a valid channel
+	PLATFORM_USART_NR_CH
+} platform_usart_ch_t;
+
 /// Descriptor for reception via USART
 typedef struct platform_usart_rx_desc_type
 {
@@ -120,16 +352,91 @@ typedef struct platform_usart_rx_desc_type
  */
 #define PLATFORM_USART_RX_COMPL_BREAK	0x0002
 
+/// Reception completed on the match byte (which is included in the data)
+#define PLATFORM_USART_RX_COMPL_MATCH	0x0003
+
+/// Reception completed with a whole frame, per the descriptor's mode
+#define PLATFORM_USART_RX_COMPL_FRAME	0x0004
+
 	/// Extra information about a completion event, if applicable
 	volatile union {
 		/**
 		 * Number of bytes that were received
 		 * 
 		 * @note
-		 * This member is valid only if @code compl_type == PLATFORM_USART_RX_COMPL_DATA @endcode.
+		 * This member is valid only if @code compl_type != PLATFORM_USART_RX_COMPL_NONE @endcode.
 		 */
 		uint16_t data_len;
 	} compl_info;
+	
+	/**
+	 * When the last byte was received (or, if none was, when reception was
+	 * aborted)
+	 * 
+	 * @note
+	 * This member is valid only if @code compl_type != PLATFORM_USART_RX_COMPL_NONE @endcode.
+	 */
+	volatile platform_tick_t compl_tick;
+	
+	/**
+	 * How reception is to be completed
+	 * 
+	 * Regardless of the mode, reception also completes (with
+	 * @c PLATFORM_USART_RX_COMPL_DATA) once @c max_len bytes are stored.
+	 */
+	uint8_t mode;
+	
+/// Complete on an idle line (the default, as zero)
+#define PLATFORM_USART_RX_MODE_RAW	0x00
+
+/// Complete with @c PLATFORM_USART_RX_COMPL_MATCH on @c mode_cfg.match
+#define PLATFORM_USART_RX_MODE_MATCH	0x01
+
+/**
+ * Hunt for @c mode_cfg.sync, then complete with
+ * @c PLATFORM_USART_RX_COMPL_FRAME once as many bytes as given by the
+ * big-endian 16-bit length field at @c mode_cfg.len_ofs (plus
+ * @c mode_cfg.len_adj) have been received
+ * 
+ * @note
+ * Frames whose length does not fit @c max_len are dropped, and hunting
+ * starts over.
+ */
+#define PLATFORM_USART_RX_MODE_HDRLEN	0x02
+
+/**
+ * Hunt for @c mode_cfg.sync, then complete with
+ * @c PLATFORM_USART_RX_COMPL_FRAME once @c max_len bytes have been received
+ */
+#define PLATFORM_USART_RX_MODE_FIXED	0x03
+
+	/**
+	 * Parameters for the completion mode
+	 * 
+	 * @note
+	 * The idle timeout does not apply to any mode except
+	 * @c PLATFORM_USART_RX_MODE_RAW; partial frames are dealt with by
+	 * sync-byte hunting instead.
+	 */
+	struct {
+		/// Byte that completes reception (MATCH)
+		uint8_t match;
+		
+		/**
+		 * Number of valid bytes in @c sync, one or two (HDRLEN,
+		 * FIXED); descriptors with any other are refused
+		 */
+		uint8_t nr_sync;
+		
+		/// Bytes that start every frame (HDRLEN, FIXED)
+		uint8_t sync[2];
+		
+		/// Offset of the length field from the start of the frame (HDRLEN)
+		uint8_t len_ofs;
+		
+		/// Added to the length field to get the frame length (HDRLEN)
+		uint8_t len_adj;
+	} mode_cfg;
 } platform_usart_rx_async_desc_t;
 
 /// Descriptor for a transmission fragment
@@ -176,6 +483,88 @@ void platform_usart_co2_tx_abort(void);
 /// Check whether a transmission is on-going
 bool platform_usart_co2_tx_busy(void);
 
+/**
+ * A message for the per-channel TX submission queue
+ * 
+ * Unlike @c platform_usart_*_tx_async(), which fail while the link is busy,
+ * up to eight messages may be queued per channel. Each stays owned by the
+ * driver, together with its fragments and buffers, until it is handed back
+ * (from within @c platform_do_loop_one()).
+ */
+typedef struct platform_usart_tx_msg_type
+{
+	/// Fragments to transmit
+	const platform_usart_tx_bufdesc_t *desc;
+	
+	/// Number of fragments
+	unsigned int nr_desc;
+	
+	/**
+	 * Called once the message is handed back, if not @c NULL
+	 * 
+	 * @p sent is @c false if the message was dropped by an abort. The
+	 * message may be resubmitted from within the callback.
+	 */
+	void (*compl_cb)(struct platform_usart_tx_msg_type *msg, bool sent);
+	
+	/// For use by the owner of the message
+	void *arg;
+	
+	/// Ownership state; must be zero-initialized
+	volatile uint8_t state;
+	
+/// Owned by the application
+#define PLATFORM_USART_TX_MSG_IDLE	0x00
+
+/// Owned by the driver: waiting or in flight
+#define PLATFORM_USART_TX_MSG_QUEUED	0x01
+
+/// Owned by the driver: sent, about to be handed back
+#define PLATFORM_USART_TX_MSG_SENT	0x02
+
+/// Owned by the driver: dropped by an abort, about to be handed back
+#define PLATFORM_USART_TX_MSG_ABORTED	0x03
+} platform_usart_tx_msg_t;
+
+/// Check whether a message is still owned by the driver
+#define PLATFORM_USART_TX_MSG_BUSY(msg) \
+	((msg)->state != PLATFORM_USART_TX_MSG_IDLE)
+
+/// Counters for a TX submission queue
+typedef struct platform_usart_txq_stats_type
+{
+	/// Messages accepted by @c platform_usart_tx_submit()
+	uint32_t nr_enqueued;
+	
+	/// Messages completely sent
+	uint32_t nr_sent;
+	
+	/// Messages refused (queue full, still busy, or invalid)
+	uint32_t nr_rejected;
+	
+	/// Messages currently owned by the driver
+	uint8_t depth;
+	
+	/// Highest value of @c depth seen so far
+	uint8_t depth_peak;
+} platform_usart_txq_stats_t;
+
+/**
+ * Submit a message to the TX queue of a channel
+ * 
+ * @note
+ * Only the channels with a transmitter (ESP8266, MH-Z19C) have a queue.
+ * Aborting a channel also drops everything queued on it.
+ * 
+ * @return	@c true if the message was queued, @c false otherwise
+ */
+bool platform_usart_tx_submit(platform_usart_ch_t ch,
+			      platform_usart_tx_msg_t *msg);
+
+/// Get the counters of the TX queue of a channel
+void platform_usart_txq_stats(platform_usart_ch_t ch,
+			      platform_usart_txq_stats_t *stats);
+
 /**
  * Enqueue a request for data reception
  * 
@@ -225,6 +614,307 @@ void platform_usart_gps_rx_abort(void);
 /// Check whether a reception is on-going
 bool platform_usart_gps_rx_busy(void);
 
+/**
+ * Queue a descriptor behind the one currently being received into
+ * 
+ * When the current descriptor completes, reception switches over to the
+ * queued one atomically, so back-to-back frames are not lost while the
+ * application re-arms. If nothing is armed, @p desc is armed right away.
+ * 
+ * @note
+ * Only one descriptor may be queued at a time. Completion is signalled
+ * through @c desc->compl_type as usual; @c platform_usart_*_rx_busy() stays
+ * @c true while either slot is in use. Aborting releases the queued
+ * descriptor without completing it.
+ * 
+ * @return	@c true if @p desc was armed or queued, @c false otherwise
+ */
+bool platform_usart_rx_queue(platform_usart_ch_t ch,
+			     platform_usart_rx_async_desc_t *desc);
+
+/**
+ * Get the number of received bytes dropped because no buffer was armed (or,
+ * when streaming, because the ring was full)
+ * 
+ * @note
+ * This is @c nr_rx_dropped of @c platform_usart_stats(), and is likewise
+ * zeroed by a reset of the latter.
+ */
+uint32_t platform_usart_rx_dropped(platform_usart_ch_t ch);
+
+/**
+ * Change the baud rate of a channel
+ * 
+ * The BAUD value is computed from the actual frequency of the SERCOM clock,
+ * and the idle timeout is rescaled to the same number of character times.
+ * All channels come up at 9600 baud.
+ * 
+ * @return	@c true if successful, @c false if the rate cannot be generated
+ *		from the SERCOM clock, or if a transmission is on-going or queued
+ * 
+ * @note
+ * A byte being received while the SERCOM is reconfigured is lost.
+ */
+bool platform_usart_set_baud(platform_usart_ch_t ch, uint32_t baud);
+
+/// Get the current baud rate of a channel
+uint32_t platform_usart_get_baud(platform_usart_ch_t ch);
+
+/// Per-channel USART counters
+typedef struct platform_usart_stats_type
+{
+	/// Bytes received and accepted into a buffer or ring
+	uint32_t nr_rx_bytes;
+	
+	/// Bytes handed over to the transmitter (by the CPU or the DMAC)
+	uint32_t nr_tx_bytes;
+	
+	/// Bytes dropped because no buffer was armed, or the ring was full
+	uint32_t nr_rx_dropped;
+	
+	/// Bytes dropped due to framing errors
+	uint32_t nr_err_frame;
+	
+	/// Bytes dropped due to parity errors
+	uint32_t nr_err_parity;
+	
+	/// Receiver overflows (at least one byte lost in hardware each)
+	uint32_t nr_err_overflow;
+	
+	/// Transmissions cut short by a DMAC transfer error, and aborted
+	uint32_t nr_err_dma;
+	
+	/// Receptions completed by the idle timeout
+	uint32_t nr_compl_idle;
+	
+	/// Receptions completed by filling the buffer
+	uint32_t nr_compl_full;
+	
+	/// Receptions completed on a match byte or a whole frame
+	uint32_t nr_compl_frame;
+	
+	/// Longest time spent in one of the channel's handlers, in SysTick counts
+	uint32_t isr_time_peak;
+} platform_usart_stats_t;
+
+/**
+ * Take a snapshot of the counters of a channel
+ * 
+ * @param[in]	ch	Channel
+ * @param[out]	stats	Snapshot
+ * @param[in]	reset	If @c true, zero the counters in the same step
+ */
+void platform_usart_stats(platform_usart_ch_t ch,
+			  platform_usart_stats_t *stats, bool reset);
+
+/**
+ * Switch a channel to streaming reception
+ * 
+ * Received bytes are placed into @p buf, used as a single-producer/
+ * single-consumer ring, until @c platform_usart_rx_stream_stop() is called.
+ * No descriptor needs to be re-armed in between; bytes arriving while the
+ * ring is full are dropped.
+ * 
+ * @note
+ * Streaming reception and descriptor-based reception are mutually exclusive
+ * on the same channel. @p buf must remain valid while streaming is on-going.
+ * 
+ * @param[in]	ch	Channel
+ * @param[in]	buf	Ring storage
+ * @param[in]	size	Size of @p buf; must be a power of two, up to 32768
+ * 
+ * @return	@c true if streaming was started, @c false otherwise
+ */
+bool platform_usart_rx_stream_start(platform_usart_ch_t ch,
+				    char *buf, uint16_t size);
+
+/// Stop streaming reception, discarding any unread bytes
+void platform_usart_rx_stream_stop(platform_usart_ch_t ch);
+
+/**
+ * Peek at received bytes without consuming them
+ * 
+ * @param[in]	ch	Channel
+ * @param[out]	data	Set to the oldest unread byte
+ * 
+ * @return	Number of unread bytes that are contiguous from @p data; this
+ *		may be less than the total if the ring wraps around
+ */
+uint16_t platform_usart_rx_stream_peek(platform_usart_ch_t ch,
+				       const char **data);
+
+/// Mark @p len bytes (as returned by a previous peek) as read
+void platform_usart_rx_stream_consume(platform_usart_ch_t ch, uint16_t len);
+
+/**
+ * Copy out and consume up to @p max_len received bytes
+ * 
+ * @return	Number of bytes copied into @p buf
+ */
+uint16_t platform_usart_rx_stream_read(platform_usart_ch_t ch,
+				       char *buf, uint16_t max_len);
+
+/// Capture time stamps are in units of 2^PLATFORM_USART_CAP_TIME_SHIFT ticks
+#define PLATFORM_USART_CAP_TIME_SHIFT	10
+
+/// A captured byte
+typedef struct platform_usart_cap_type {
+	/// Time of reception, in units of 2^PLATFORM_USART_CAP_TIME_SHIFT ticks
+	uint32_t when;
+
+	/// Channel it was received on
+	uint8_t ch;
+
+	/// The byte
+	uint8_t data;
+
+	/// Set if bytes were dropped just before this one
+	bool lost;
+} platform_usart_cap_t;
+
+/**
+ * Start capturing received bytes
+ * 
+ * Every byte received on a channel of @p ch_mask is time-stamped and put
+ * into a ring shared by all channels, besides being handled as usual; bytes
+ * with parity or framing errors are not. Bytes arriving while the ring is
+ * full are dropped, and counted.
+ * 
+ * Any previous capture is discarded, and the drop counter is zeroed.
+ * 
+ * @param[in]	ch_mask	Bit n set to capture channel n
+ */
+void platform_usart_capture_start(uint8_t ch_mask);
+
+/// Stop capturing; bytes already captured may still be read
+void platform_usart_capture_stop(void);
+
+/**
+ * Take captured bytes out of the ring, oldest first
+ * 
+ * @return	Number of bytes written to @p buf, up to @p max_nr
+ */
+unsigned int platform_usart_capture_read(platform_usart_cap_t *buf,
+					 unsigned int max_nr);
+
+/// Get the number of bytes dropped since capture was started
+uint32_t platform_usart_capture_dropped(void);
+
+//////////////////////////////////////////////////////////////////////////////
+
+/// Largest number of arguments to @c PLATFORM_LOG()
+#define PLATFORM_LOG_MAX_ARGS	15
+
+/**
+ * Log a message, leaving the formatting to the host
+ * 
+ * Only the offset of @p fmt in its section and the arguments, as 32-bit
+ * words, are put into a ring; the format string itself stays in the
+ * "logfmt" section of the ELF file, where the host tool picks it up. This
+ * is safe to use from any context, including ISRs.
+ * 
+ * @note
+ * @p fmt must be a string literal, and may only use conversions that take
+ * an @c int (d, i, u, x, X, o, c). Arguments beyond
+ * @c PLATFORM_LOG_MAX_ARGS are dropped.
+ */
+#define PLATFORM_LOG(fmt, ...) do {					\
+	static const char platform_log_fmt_[]				\
+		__attribute__((section("logfmt"), used)) = fmt;	\
+	const uint32_t platform_log_args_[] = { 0, ##__VA_ARGS__ };	\
+	platform_log_write(platform_log_fmt_, &platform_log_args_[1],	\
+		sizeof(platform_log_args_) / sizeof(uint32_t) - 1);	\
+} while (0)
+
+/// Backend of @c PLATFORM_LOG()
+void platform_log_write(const char *fmt, const uint32_t *args,
+			unsigned int nr_args);
+
+/**
+ * Start shipping the log over a USART channel
+ * 
+ * Every @p period, whatever was logged meanwhile is sent straight out of the
+ * ring, as a single raw message of type @c TELEM_TYPE_LOGS (see telem.h):
+ * the number of 32-bit words and the number of messages dropped since the
+ * previous one (both as 16-bit values), then the words. Each message takes
+ * the offset of its format string in the "logfmt" section, a word with the
+ * number of arguments in the top four bits and the time in units of 1024
+ * ticks (modulo 2^28) in the rest, then its arguments.
+ * 
+ * @note
+ * Only the channels with a transmitter (ESP8266, MH-Z19C) can be used.
+ */
+void platform_log_start(platform_usart_ch_t ch, platform_tick_t period);
+
+/// Counters of the log
+typedef struct platform_log_stats_type {
+	/// Messages put into the ring
+	uint32_t nr_logged;
+	
+	/// Messages dropped because the ring was full
+	uint32_t nr_dropped;
+	
+	/// Words handed over to the USART
+	uint32_t nr_words_sent;
+	
+	/// Highest number of words waiting in the ring
+	uint16_t depth_peak;
+} platform_log_stats_t;
+
+/// Get the counters of the log
+void platform_log_stats(platform_log_stats_t *stats);
+
+//////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Start of the data flash
+ * 
+ * Unlike the main flash, the data flash can be erased and programmed while
+ * code keeps running, so ISRs are not held off meanwhile.
+ */
+#define PLATFORM_NVM_DATA_ADDR	0x00400000u
+
+/// Size of the data flash that may be written by the application
+#define PLATFORM_NVM_DATA_SIZE	(8u * 1024)
+
+/// Size of a flash page (the unit of programming) and row (of erasing)
+#define PLATFORM_NVM_PAGE_SIZE	64u
+#define PLATFORM_NVM_ROW_SIZE	256u
+
+/**
+ * Start erasing a row of the data flash, setting all its bits
+ * 
+ * @note
+ * Returns right away; erasing takes a few milliseconds, over which
+ * @c platform_nvm_busy() is to be polled.
+ * 
+ * @return	@c false if @p addr is not a row of the data flash, or if an
+ *		operation is still going on
+ */
+bool platform_nvm_erase_row(uint32_t addr);
+
+/**
+ * Start programming a page of the data flash, which must have been erased
+ * 
+ * @note
+ * Returns right away; programming takes a few milliseconds, over which
+ * @c platform_nvm_busy() is to be polled. @p data must stay as it is until
+ * then.
+ * 
+ * @return	@c false if @p addr is not a page of the data flash, or if an
+ *		operation is still going on
+ */
+bool platform_nvm_write_page(uint32_t addr, const void *data);
+
+/**
+ * Move the operation started last on, and check whether it is over
+ * 
+ * @param[out]	ok	Once it is over, whether it succeeded
+ * 
+ * @return	@c true while the operation is still going on
+ */
+bool platform_nvm_busy(bool *ok);
+
 //////////////////////////////////////////////////////////////////////////////
 
 #ifdef __cplusplus
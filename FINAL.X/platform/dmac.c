@@ -0,0 +1,256 @@
+/**
+ * @file platform/dmac.c
+ * @brief Platform-support routines, DMAC component
+ */
+
+/*
+ * Only memory-to-peripheral transfers of chained byte buffers are supported,
+ * as this is all the USART transmitters need. Each DMAC channel in use owns
+ * one entry of the base/write-back tables plus a pool of linked descriptors,
+ * so that a whole array of TX fragments can be described up-front.
+ *
+ * NOTE: The CHID-indexed channel registers are shared by all channels, so
+ *       every access to them is done with interrupts masked.
+ */
+
+// Common include for the XC32 compiler
+#include <xc.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../platform.h"
+
+// Functions "exported" by this file
+void platform_dmac_init(void);
+bool platform_dmac_tx_setup(unsigned int ch, uint8_t trigsrc,
+	void (*done)(void *arg, bool ok), void *arg);
+bool platform_dmac_tx_start(unsigned int ch, volatile void *dst,
+	const platform_usart_tx_bufdesc_t *desc, unsigned int nr_desc);
+bool platform_dmac_busy(unsigned int ch);
+void platform_dmac_abort(unsigned int ch);
+
+/////////////////////////////////////////////////////////////////////////////
+
+/// Number of DMAC channels managed here (channels 0 .. N-1)
+#define NR_DMAC_CH		(2)
+
+/// Maximum number of linked descriptors per transfer, including the first
+#define NR_DMAC_DESC_MAX	(32)
+
+// BTCTRL fields
+#define DMAC_BTCTRL_VALID	(1 << 0)
+#define DMAC_BTCTRL_BLOCKACT_INT (1 << 3)
+#define DMAC_BTCTRL_BEATSIZE_BYTE (0 << 8)
+#define DMAC_BTCTRL_SRCINC	(1 << 10)
+
+// CHCTRLB fields
+#define DMAC_CHCTRLB_TRIGSRC(x)	(((uint32_t)(x) & 0x3F) << 8)
+#define DMAC_CHCTRLB_TRIGACT_BEAT (2 << 22)
+
+// CHINTFLAG bits
+#define DMAC_CHINT_TERR		(1 << 0)
+#define DMAC_CHINT_TCMPL	(1 << 1)
+
+/*
+ * Base and write-back descriptor tables
+ *
+ * Both must be 128-bit aligned, and have one entry per channel starting from
+ * channel 0.
+ */
+static dmac_descriptor_registers_t dmac_desc_base[NR_DMAC_CH]
+	__attribute__((aligned(16)));
+static dmac_descriptor_registers_t dmac_desc_wrb[NR_DMAC_CH]
+	__attribute__((aligned(16)));
+
+/// Linked descriptors following the one in the base table
+static dmac_descriptor_registers_t dmac_desc_pool[NR_DMAC_CH][NR_DMAC_DESC_MAX - 1]
+	__attribute__((aligned(16)));
+
+/// Per-channel state
+static struct {
+	void (*done)(void *arg, bool ok);
+	void *arg;
+	volatile bool busy;
+} dmac_ch_state[NR_DMAC_CH];
+
+/////////////////////////////////////////////////////////////////////////////
+
+// Initialize the DMAC; channels are set up separately
+void platform_dmac_init(void)
+{
+	/*
+	 * Enable the AHB clock for this peripheral
+	 *
+	 * NOTE: The chip resets with it enabled; hence, commented-out.
+	 */
+	// MCLK_REGS->MCLK_AHBMASK |= (1 << 3);
+
+	memset(dmac_desc_base, 0, sizeof(dmac_desc_base));
+	memset(dmac_desc_wrb, 0, sizeof(dmac_desc_wrb));
+	memset(dmac_ch_state, 0, sizeof(dmac_ch_state));
+
+	// Reset; the tables may only be programmed while disabled.
+	DMAC_SEC_REGS->DMAC_CTRL = 0x0001;
+	while ((DMAC_SEC_REGS->DMAC_CTRL & 0x0001) != 0)
+		asm("nop");
+
+	DMAC_SEC_REGS->DMAC_BASEADDR = (uint32_t)(uintptr_t)dmac_desc_base;
+	DMAC_SEC_REGS->DMAC_WRBADDR  = (uint32_t)(uintptr_t)dmac_desc_wrb;
+
+	// Enable, with all priority levels enabled.
+	DMAC_SEC_REGS->DMAC_CTRL = (0x0F << 8) | (1 << 1);
+	return;
+}
+
+/**
+ * Configure a channel for memory-to-peripheral byte transfers
+ *
+ * @param[in]	ch	Channel
+ * @param[in]	trigsrc	Trigger source (usually the peripheral's TX trigger)
+ * @param[in]	done	Called in ISR context whenever a transfer completes,
+ *			with @p ok set, or is terminated due to an error
+ *			(TERR), with @p ok clear; may be NULL
+ * @param[in]	arg	Argument to pass to @p done
+ */
+bool platform_dmac_tx_setup(unsigned int ch, uint8_t trigsrc,
+	void (*done)(void *arg, bool ok), void *arg)
+{
+	uint32_t primask;
+
+	if (ch >= NR_DMAC_CH)
+		return false;
+
+	dmac_ch_state[ch].done = done;
+	dmac_ch_state[ch].arg = arg;
+	dmac_ch_state[ch].busy = false;
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+	DMAC_SEC_REGS->DMAC_CHID = ch;
+	DMAC_SEC_REGS->DMAC_CHCTRLA = 0x01;
+	while ((DMAC_SEC_REGS->DMAC_CHCTRLA & 0x01) != 0)
+		asm("nop");
+	DMAC_SEC_REGS->DMAC_CHCTRLB = DMAC_CHCTRLB_TRIGSRC(trigsrc) |
+		DMAC_CHCTRLB_TRIGACT_BEAT;
+	DMAC_SEC_REGS->DMAC_CHINTENSET = DMAC_CHINT_TERR | DMAC_CHINT_TCMPL;
+	__set_PRIMASK(primask);
+	return true;
+}
+
+/**
+ * Start a chained transfer of the given fragments into @p dst
+ *
+ * Empty fragments are skipped. The fragment array itself is no longer needed
+ * once this returns, but the buffers it refers to are.
+ *
+ * @return	@c true if a transfer was started, @c false if the channel is
+ *		busy or there was nothing to transfer
+ */
+bool platform_dmac_tx_start(unsigned int ch, volatile void *dst,
+	const platform_usart_tx_bufdesc_t *desc, unsigned int nr_desc)
+{
+	dmac_descriptor_registers_t *d = NULL;
+	dmac_descriptor_registers_t *next;
+	unsigned int x, nr_used = 0;
+	uint32_t primask;
+
+	if (ch >= NR_DMAC_CH || dmac_ch_state[ch].busy ||
+	    nr_desc > NR_DMAC_DESC_MAX)
+		return false;
+
+	for (x = 0; x < nr_desc; ++x) {
+		if (desc[x].buf == NULL || desc[x].len == 0)
+			continue;
+
+		next = (nr_used == 0) ? &dmac_desc_base[ch] :
+			&dmac_desc_pool[ch][nr_used - 1];
+		if (d != NULL)
+			d->DMAC_DESCADDR = (uint32_t)(uintptr_t)next;
+		d = next;
+
+		/*
+		 * With SRCINC set, SRCADDR must point just past the end of
+		 * the block rather than at its start.
+		 */
+		d->DMAC_BTCTRL = DMAC_BTCTRL_VALID | DMAC_BTCTRL_BEATSIZE_BYTE |
+			DMAC_BTCTRL_SRCINC;
+		d->DMAC_BTCNT = desc[x].len;
+		d->DMAC_SRCADDR = (uint32_t)(uintptr_t)(desc[x].buf + desc[x].len);
+		d->DMAC_DSTADDR = (uint32_t)(uintptr_t)dst;
+		++nr_used;
+	}
+	if (d == NULL)
+		return false;
+
+	// Only the last block raises an interrupt, and ends the chain.
+	d->DMAC_BTCTRL |= DMAC_BTCTRL_BLOCKACT_INT;
+	d->DMAC_DESCADDR = 0;
+
+	dmac_ch_state[ch].busy = true;
+	__DMB();
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+	DMAC_SEC_REGS->DMAC_CHID = ch;
+	DMAC_SEC_REGS->DMAC_CHINTFLAG = DMAC_CHINT_TERR | DMAC_CHINT_TCMPL;
+	DMAC_SEC_REGS->DMAC_CHCTRLA |= (1 << 1);
+	__set_PRIMASK(primask);
+	return true;
+}
+
+// Check whether a transfer is on-going
+bool platform_dmac_busy(unsigned int ch)
+{
+	return (ch < NR_DMAC_CH) && dmac_ch_state[ch].busy;
+}
+
+// Abort an on-going transfer; the completion callback is not invoked.
+void platform_dmac_abort(unsigned int ch)
+{
+	uint32_t primask;
+
+	if (ch >= NR_DMAC_CH)
+		return;
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+	DMAC_SEC_REGS->DMAC_CHID = ch;
+	DMAC_SEC_REGS->DMAC_CHCTRLA &= ~(1 << 1);
+	while ((DMAC_SEC_REGS->DMAC_CHCTRLA & (1 << 1)) != 0)
+		asm("nop");
+	DMAC_SEC_REGS->DMAC_CHINTFLAG = DMAC_CHINT_TERR | DMAC_CHINT_TCMPL;
+	dmac_ch_state[ch].busy = false;
+	__set_PRIMASK(primask);
+	return;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+// Common channel interrupt handling
+static void dmac_isr_common(unsigned int ch)
+{
+	uint8_t flags;
+
+	DMAC_SEC_REGS->DMAC_CHID = ch;
+	flags = DMAC_SEC_REGS->DMAC_CHINTFLAG & (DMAC_CHINT_TERR | DMAC_CHINT_TCMPL);
+	DMAC_SEC_REGS->DMAC_CHINTFLAG = flags;
+
+	if ((flags & (DMAC_CHINT_TERR | DMAC_CHINT_TCMPL)) == 0)
+		return;
+
+	// On a transfer error, the channel has stopped short of the end
+	dmac_ch_state[ch].busy = false;
+	if (dmac_ch_state[ch].done != NULL)
+		dmac_ch_state[ch].done(dmac_ch_state[ch].arg,
+			(flags & DMAC_CHINT_TERR) == 0);
+	return;
+}
+void __attribute__((used, interrupt())) DMAC_0_Handler(void)
+{
+	dmac_isr_common(0);
+}
+void __attribute__((used, interrupt())) DMAC_1_Handler(void)
+{
+	dmac_isr_common(1);
+}
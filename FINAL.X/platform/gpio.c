@@ -33,11 +33,15 @@
 
 // Initializers defined in other platform/*.c files
 extern void platform_systick_init(void);
+extern void platform_dmac_init(void);
 extern void platform_usart_esp_init(void);
 extern void platform_usart_co2_init(void);
 extern void platform_usart_pms_init(void);
 extern void platform_usart_gps_init(void);
-extern void platform_usart_tick_handler(const platform_timespec_t *tick);
+extern void platform_usart_tick_handler(platform_tick_t tick);
+extern void platform_sched_run(platform_tick_t now);
+extern bool platform_usart_work_pending(void);
+extern void platform_systick_idle(const platform_tick_t *deadline);
 
 /////////////////////////////////////////////////////////////////////////////
 
@@ -250,12 +254,30 @@ static void NVIC_init(void)
 	 * Unlike AHB/APB peripherals, the NVIC is part of the Arm v8-M
 	 * architecture core proper. Hence, it is always enabled.
 	 */
+	static const IRQn_Type usart_irqs[] = {
+		SERCOM0_0_IRQn, SERCOM0_1_IRQn, SERCOM0_2_IRQn,	// ESP8266
+		SERCOM1_0_IRQn, SERCOM1_1_IRQn, SERCOM1_2_IRQn,	// MH-Z19C
+		SERCOM3_0_IRQn, SERCOM3_1_IRQn, SERCOM3_2_IRQn,	// PMS5003T
+		SERCOM5_0_IRQn, SERCOM5_1_IRQn, SERCOM5_2_IRQn,	// NEO-6M
+		DMAC_0_IRQn, DMAC_1_IRQn,			// USART TX DMA
+	};
+	unsigned int x;
+
 	__DMB();
 	__enable_irq();
 	NVIC_SetPriority(EIC_EXTINT_2_IRQn, 3);
 	NVIC_SetPriority(SysTick_IRQn, 3);
 	NVIC_EnableIRQ(EIC_EXTINT_2_IRQn);
 	NVIC_EnableIRQ(SysTick_IRQn);
+
+	/*
+	 * The USART (and USART DMA) handlers share the SysTick priority, so
+	 * that they never preempt it mid-update (and vice versa).
+	 */
+	for (x = 0; x < sizeof(usart_irqs)/sizeof(usart_irqs[0]); ++x) {
+		NVIC_SetPriority(usart_irqs[x], 3);
+		NVIC_EnableIRQ(usart_irqs[x]);
+	}
 	return;
 }
 
@@ -267,11 +289,18 @@ void platform_init(void)
 	// Raise the power level
 	raise_perf_level();
 	
+	/*
+	 * Sleep in IDLE, which only stops the CPU clock; the SERCOMs, the
+	 * DMAC and SysTick keep running, so any of them can wake us up.
+	 */
+	PM_REGS->PM_SLEEPCFG = 0x02;
+	
 	// Early initialization
 	EVSYS_init();
 	EIC_init_early();
 	
 	// Regular initialization
+	platform_dmac_init();
 	platform_usart_esp_init();
     platform_usart_co2_init();
     platform_usart_pms_init();
@@ -288,12 +317,26 @@ void platform_init(void)
 // Do a single event loop
 void platform_do_loop_one(void)
 {
-	platform_timespec_t tick;
+	platform_tick_t due;
+	uint32_t primask;
 	
 	/*
 	 * Some routines must be serviced as quickly as is practicable. Do so
 	 * now.
 	 */
-	platform_tick_hrcount(&tick);
-	platform_usart_tick_handler(&tick);
+	platform_usart_tick_handler(platform_tick_get());
+	
+	// Then, whatever tasks are due.
+	platform_sched_run(platform_tick_get());
+	
+	/*
+	 * Finally, sleep if there's nothing left to do. Interrupts are masked
+	 * from the check on, so one coming in late still ends the sleep right
+	 * away; it's serviced once they're unmasked.
+	 */
+	primask = __get_PRIMASK();
+	__disable_irq();
+	if (!platform_usart_work_pending())
+		platform_systick_idle(platform_sched_next_due(&due) ? &due : NULL);
+	__set_PRIMASK(primask);
 }
@@ -0,0 +1,185 @@
+/**
+ * @file platform/log.c
+ * @brief Platform-support routines, deferred logging component
+ */
+
+/*
+ * Messages are appended to a ring of 32-bit words, indexed by free-running
+ * head and tail counters. Writers (from any context) reserve and fill their
+ * words with interrupts masked, which on a single core is all that is
+ * needed; only a handful of stores happen in there, so the masked window
+ * stays short. The drain task is the only reader, and needs no lock at all:
+ * it hands the words between tail and head to the USART as they lie in the
+ * ring, framed as a raw telemetry message, and only moves the tail once they
+ * are out. Whatever is logged while the ring is full is counted and dropped.
+ *
+ * Format strings are logged as their offset from the start of their section,
+ * which fits a word whatever the size of a pointer, and which the host tool
+ * looks up in the section as it is in the ELF file.
+ */
+
+// Common include for the XC32 compiler
+#include <xc.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../platform.h"
+#include "../telem.h"
+
+/// Size of the ring, in words; a power of two
+#define LOG_RING_LEN	256
+
+/// Time stamps are taken in units of 2^LOG_TIME_SHIFT ticks
+#define LOG_TIME_SHIFT	10
+
+/// Start of the format strings, as set by the linker
+extern const char __start_logfmt[];
+
+// Keeps the section there, and its start defined, with nothing logged
+static const char log_fmt_none[] __attribute__((section("logfmt"), used)) = "";
+
+/// Header of a drained batch
+typedef struct __attribute__((packed)) log_hdr_type {
+	/// Number of words that follow
+	uint16_t	nr_words;
+
+	/// Messages dropped since the previous batch
+	uint16_t	nr_dropped;
+} log_hdr_t;
+
+static struct {
+	uint32_t ring[LOG_RING_LEN];
+	volatile uint32_t head;
+	volatile uint32_t tail;
+
+	/// Words handed over with @c msg, freed once it comes back
+	uint32_t in_flight;
+
+	/// Value of @c stats.nr_dropped as of the last batch
+	uint32_t dropped_sent;
+
+	platform_usart_ch_t ch;
+	platform_task_t task;
+	platform_usart_tx_msg_t msg;
+	platform_usart_tx_bufdesc_t desc[5];
+	uint8_t frame_hdr[TELEM_RAW_HDR_LEN];
+	uint8_t frame_end[TELEM_RAW_END_LEN];
+	log_hdr_t hdr;
+
+	platform_log_stats_t stats;
+} log_ctx;
+
+static void log_drain(platform_task_t *task, void *arg)
+{
+	uint32_t tail, nr, first, dropped;
+	unsigned int nr_desc = 3, x;
+	uint16_t crc = TELEM_CRC16_INIT;
+
+	(void)task;
+	(void)arg;
+
+	if (PLATFORM_USART_TX_MSG_BUSY(&log_ctx.msg))
+		return;
+
+	// The previous batch is out (or was dropped), so its words are free
+	log_ctx.tail += log_ctx.in_flight;
+	log_ctx.in_flight = 0;
+
+	tail = log_ctx.tail;
+	nr = log_ctx.head - tail;
+	if (nr == 0)
+		return;
+
+	dropped = log_ctx.stats.nr_dropped;
+	log_ctx.hdr.nr_words = (uint16_t)nr;
+	log_ctx.hdr.nr_dropped = (uint16_t)(dropped - log_ctx.dropped_sent);
+
+	// At most two spans, if the words wrap around the end of the ring
+	first = tail & (LOG_RING_LEN - 1);
+	log_ctx.desc[1].buf = (const char *)&log_ctx.hdr;
+	log_ctx.desc[1].len = sizeof(log_ctx.hdr);
+	log_ctx.desc[2].buf = (const char *)&log_ctx.ring[first];
+	if (first + nr > LOG_RING_LEN) {
+		log_ctx.desc[2].len = (uint16_t)((LOG_RING_LEN - first) * 4);
+		log_ctx.desc[3].buf = (const char *)&log_ctx.ring[0];
+		log_ctx.desc[3].len =
+			(uint16_t)((first + nr - LOG_RING_LEN) * 4);
+		nr_desc = 4;
+	} else {
+		log_ctx.desc[2].len = (uint16_t)(nr * 4);
+	}
+
+	// Framed around the spans, as they are
+	for (x = 1; x < nr_desc; ++x)
+		crc = telem_crc16_update(crc, log_ctx.desc[x].buf,
+			log_ctx.desc[x].len);
+	log_ctx.desc[0].buf = (const char *)log_ctx.frame_hdr;
+	log_ctx.desc[0].len = (uint16_t)telem_encode_raw(TELEM_TYPE_LOGS,
+		(uint16_t)(sizeof(log_ctx.hdr) + nr * 4), log_ctx.frame_hdr);
+	log_ctx.desc[nr_desc].buf = (const char *)log_ctx.frame_end;
+	log_ctx.desc[nr_desc].len =
+		(uint16_t)telem_encode_raw_end(crc, log_ctx.frame_end);
+	++nr_desc;
+	log_ctx.msg.desc = log_ctx.desc;
+	log_ctx.msg.nr_desc = nr_desc;
+
+	if (!platform_usart_tx_submit(log_ctx.ch, &log_ctx.msg))
+		return;
+	log_ctx.in_flight = nr;
+	log_ctx.dropped_sent = dropped;
+	log_ctx.stats.nr_words_sent += nr;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+void platform_log_write(const char *fmt, const uint32_t *args,
+			unsigned int nr_args)
+{
+	uint32_t primask, head, used, stamp;
+	unsigned int x;
+
+	if (nr_args > PLATFORM_LOG_MAX_ARGS)
+		nr_args = PLATFORM_LOG_MAX_ARGS;
+	stamp = (uint32_t)(platform_tick_get() >> LOG_TIME_SHIFT) & 0x0FFFFFFF;
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+	head = log_ctx.head;
+	used = head - log_ctx.tail;
+	if (used + 2 + nr_args > LOG_RING_LEN) {
+		++log_ctx.stats.nr_dropped;
+		__set_PRIMASK(primask);
+		return;
+	}
+
+	log_ctx.ring[head++ & (LOG_RING_LEN - 1)] =
+		(uint32_t)(fmt - __start_logfmt);
+	log_ctx.ring[head++ & (LOG_RING_LEN - 1)] =
+		((uint32_t)nr_args << 28) | stamp;
+	for (x = 0; x < nr_args; ++x)
+		log_ctx.ring[head++ & (LOG_RING_LEN - 1)] = args[x];
+	log_ctx.head = head;
+
+	++log_ctx.stats.nr_logged;
+	used += 2 + nr_args;
+	if (used > log_ctx.stats.depth_peak)
+		log_ctx.stats.depth_peak = (uint16_t)used;
+	__set_PRIMASK(primask);
+}
+
+void platform_log_start(platform_usart_ch_t ch, platform_tick_t period)
+{
+	log_ctx.ch = ch;
+	log_ctx.task.name = "log";
+	log_ctx.task.fn = log_drain;
+	platform_task_start(&log_ctx.task, period, period);
+}
+
+void platform_log_stats(platform_log_stats_t *stats)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	*stats = log_ctx.stats;
+	__set_PRIMASK(primask);
+}
@@ -0,0 +1,146 @@
+/**
+ * @file platform/nvm.c
+ * @brief Platform-support routines, data flash (NVMCTRL) component
+ */
+
+/*
+ * Programming goes through the page buffer: it is cleared, filled by plain
+ * word writes to the page itself, then written out. Depending on CTRLB.MANW,
+ * the last word may already start the write on its own; STATUS.LOAD tells
+ * whether the buffer still has to be written with a command.
+ *
+ * Nothing here waits on the controller. Starting an operation issues its
+ * first command, and platform_nvm_busy() moves it on from there as the
+ * controller gets ready: a page write goes from clearing the buffer to
+ * filling it and writing it out. Erasing a row and writing a page take
+ * milliseconds, so the caller is expected to poll from a task.
+ *
+ * Only the data flash is ever touched here, so neither the code nor the
+ * configuration can be clobbered by a stray address.
+ *
+ * NOTE: Everything here runs in the main loop; nothing may be called from
+ *       ISR context.
+ */
+
+// Common include for the XC32 compiler
+#include <xc.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../platform.h"
+
+// Errors a command may end with
+#define NVM_INTFLAG_ERRORS	(NVMCTRL_INTFLAG_PROGE_Msk | \
+	NVMCTRL_INTFLAG_LOCKE_Msk | NVMCTRL_INTFLAG_NVME_Msk | \
+	NVMCTRL_INTFLAG_KEYE_Msk | NVMCTRL_INTFLAG_NSCHK_Msk)
+
+/// What the controller is busy with
+typedef enum nvm_state_type {
+	NVM_IDLE = 0,
+	NVM_ERASE,	///< Erasing a row
+	NVM_CLEAR,	///< Clearing the page buffer, which is filled next
+	NVM_WRITE	///< Writing a page
+} nvm_state_t;
+
+static struct {
+	nvm_state_t state;
+
+	/// Page being written, and what goes into it
+	uint32_t addr;
+	const uint8_t *data;
+} nvm_ctx;
+
+/////////////////////////////////////////////////////////////////////////////
+
+static inline bool nvm_ready(void)
+{
+	return (NVMCTRL_SEC_REGS->NVMCTRL_STATUS &
+		NVMCTRL_STATUS_READY_Msk) != 0;
+}
+
+// Collect the errors of the last command, clearing its flags
+static bool nvm_ok(void)
+{
+	uint16_t flags = NVMCTRL_SEC_REGS->NVMCTRL_INTFLAG;
+
+	NVMCTRL_SEC_REGS->NVMCTRL_INTFLAG = NVMCTRL_INTFLAG_Msk;
+	return (flags & NVM_INTFLAG_ERRORS) == 0;
+}
+
+static void nvm_cmd(uint32_t addr, uint16_t cmd)
+{
+	NVMCTRL_SEC_REGS->NVMCTRL_ADDR = addr;
+	NVMCTRL_SEC_REGS->NVMCTRL_CTRLA = (uint16_t)(NVMCTRL_CTRLA_CMDEX_KEY |
+		cmd);
+}
+
+// Fill the page buffer, and have it written out if that did not do it
+static void nvm_load(void)
+{
+	volatile uint32_t *dst = (volatile uint32_t *)(uintptr_t)nvm_ctx.addr;
+	uint32_t word;
+	unsigned int x;
+
+	// Only whole words may go into the page buffer
+	for (x = 0; x < PLATFORM_NVM_PAGE_SIZE / 4; ++x) {
+		memcpy(&word, &nvm_ctx.data[4 * x], sizeof(word));
+		dst[x] = word;
+	}
+	if ((NVMCTRL_SEC_REGS->NVMCTRL_STATUS & NVMCTRL_STATUS_LOAD_Msk) != 0)
+		nvm_cmd(nvm_ctx.addr, NVMCTRL_CTRLA_CMD_WP);
+}
+
+static bool nvm_in_range(uint32_t addr, uint32_t align)
+{
+	return (addr % align) == 0 && addr >= PLATFORM_NVM_DATA_ADDR &&
+		addr - PLATFORM_NVM_DATA_ADDR < PLATFORM_NVM_DATA_SIZE;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+bool platform_nvm_erase_row(uint32_t addr)
+{
+	if (!nvm_in_range(addr, PLATFORM_NVM_ROW_SIZE) ||
+	    nvm_ctx.state != NVM_IDLE || !nvm_ready())
+		return false;
+
+	// Errors of an earlier command are not ours to report
+	(void)nvm_ok();
+	nvm_cmd(addr, NVMCTRL_CTRLA_CMD_ER);
+	nvm_ctx.state = NVM_ERASE;
+	return true;
+}
+
+bool platform_nvm_write_page(uint32_t addr, const void *data)
+{
+	if (!nvm_in_range(addr, PLATFORM_NVM_PAGE_SIZE) || data == NULL ||
+	    nvm_ctx.state != NVM_IDLE || !nvm_ready())
+		return false;
+
+	(void)nvm_ok();
+	nvm_ctx.addr = addr;
+	nvm_ctx.data = data;
+	nvm_cmd(addr, NVMCTRL_CTRLA_CMD_PBC);
+	nvm_ctx.state = NVM_CLEAR;
+	return true;
+}
+
+bool platform_nvm_busy(bool *ok)
+{
+	if (nvm_ctx.state == NVM_IDLE) {
+		*ok = true;
+		return false;
+	}
+	if (!nvm_ready())
+		return true;
+
+	*ok = nvm_ok();
+	if (*ok && nvm_ctx.state == NVM_CLEAR) {
+		nvm_load();
+		nvm_ctx.state = NVM_WRITE;
+		return true;
+	}
+	nvm_ctx.state = NVM_IDLE;
+	return false;
+}
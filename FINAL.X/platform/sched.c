@@ -0,0 +1,132 @@
+/**
+ * @file platform/sched.c
+ * @brief Platform-support routines, cooperative scheduler component
+ */
+
+/*
+ * Tasks are kept on a singly-linked list in registration order, which is
+ * also the order in which due tasks are run within a single pass. There are
+ * only a handful of tasks, so a linear scan per loop is cheaper than keeping
+ * the list sorted.
+ *
+ * NOTE: Everything here runs in the main loop; nothing may be called from
+ *       ISR context.
+ */
+
+// Common include for the XC32 compiler
+#include <xc.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../platform.h"
+
+// Functions "exported" by this file
+void platform_sched_run(platform_tick_t now);
+
+/////////////////////////////////////////////////////////////////////////////
+
+/// Registered tasks
+static platform_task_t *sched_tasks = NULL;
+
+// Add @p task to the list, unless it is there already
+static void sched_link(platform_task_t *task)
+{
+	platform_task_t *t;
+
+	for (t = sched_tasks; t != NULL; t = t->next) {
+		if (t == task)
+			return;
+	}
+	task->next = sched_tasks;
+	sched_tasks = task;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+void platform_task_start(platform_task_t *task, platform_tick_t delay,
+	platform_tick_t period)
+{
+	if (task == NULL || task->fn == NULL)
+		return;
+
+	task->period = period;
+	task->due = platform_tick_get() + delay;
+	task->phase = task->due;
+	task->armed = true;
+	sched_link(task);
+}
+
+void platform_task_stop(platform_task_t *task)
+{
+	if (task != NULL)
+		task->armed = false;
+}
+
+void platform_task_defer(platform_task_t *task, platform_tick_t delay)
+{
+	if (task == NULL)
+		return;
+
+	task->due = platform_tick_get() + delay;
+	task->armed = true;
+}
+
+bool platform_sched_next_due(platform_tick_t *due)
+{
+	const platform_task_t *t;
+	bool found = false;
+
+	for (t = sched_tasks; t != NULL; t = t->next) {
+		if (!t->armed)
+			continue;
+		if (!found || (int64_t)(t->due - *due) < 0)
+			*due = t->due;
+		found = true;
+	}
+	return found;
+}
+
+/*
+ * Run every task that is due at @p now
+ *
+ * Periodic tasks keep their phase; if a whole period went by before a task
+ * got to run, that's a deadline miss, and the phase is re-established from
+ * @p now instead of running the task several times in a row. A deferred run
+ * that comes before the periodic one leaves the phase alone; one that comes
+ * at or after it takes its place.
+ */
+void platform_sched_run(platform_tick_t now)
+{
+	platform_task_t *t;
+	platform_tick_t t0;
+	uint32_t dt;
+
+	for (t = sched_tasks; t != NULL; t = t->next) {
+		if (!t->armed || !platform_tick_expired(now, t->due))
+			continue;
+
+		// Set up the next run first; the task may override it.
+		if (t->period != 0) {
+			if (platform_tick_expired(now, t->phase)) {
+				t->phase += t->period;
+				if (platform_tick_expired(now, t->phase)) {
+					++t->stats.nr_missed;
+					t->phase = now + t->period;
+				}
+			}
+			t->due = t->phase;
+		} else {
+			t->armed = false;
+		}
+
+		t0 = platform_tick_get();
+		t->fn(t, t->arg);
+		dt = (uint32_t)(platform_tick_get() - t0);
+
+		++t->stats.nr_runs;
+		t->stats.runtime_total += dt;
+		if (dt > t->stats.runtime_peak)
+			t->stats.runtime_peak = dt;
+	}
+	return;
+}
@@ -21,17 +21,19 @@
 
 /////////////////////////////////////////////////////////////////////////////
 
-// Normalize a timespec
+#define NSEC_PER_SEC	(1000000000UL)
+
+// Normalize a timespec, saturating at the largest representable value
 void platform_timespec_normalize(platform_timespec_t *ts)
 {
-	while (ts->nr_nsec >= 1000000000) {
-		ts->nr_nsec -= 1000000000;
-		if (ts->nr_sec < UINT32_MAX) {
-			++ts->nr_sec;
-		} else {
-			ts->nr_nsec = (1000000000 - 1);
-			break;
-		}
+	uint32_t carry = ts->nr_nsec / NSEC_PER_SEC;
+	
+	if (ts->nr_sec > UINT32_MAX - carry) {
+		ts->nr_sec = UINT32_MAX;
+		ts->nr_nsec = NSEC_PER_SEC - 1;
+	} else {
+		ts->nr_sec += carry;
+		ts->nr_nsec -= carry * NSEC_PER_SEC;
 	}
 }
 
@@ -39,42 +41,50 @@ void platform_timespec_normalize(platform_timespec_t *ts)
 int platform_timespec_compare(const platform_timespec_t *lhs,
 	const platform_timespec_t *rhs)
 {
-	if (lhs->nr_sec < rhs->nr_sec)
-		return -1;
-	else if (lhs->nr_sec > rhs->nr_sec)
-		return +1;
-	else if (lhs->nr_nsec < rhs->nr_nsec)
-		return -1;
-	else if (lhs->nr_nsec > rhs->nr_nsec)
-		return +1;
-	else
-		return 0;
+	int c_sec = (lhs->nr_sec > rhs->nr_sec) - (lhs->nr_sec < rhs->nr_sec);
+	int c_nsec = (lhs->nr_nsec > rhs->nr_nsec) - (lhs->nr_nsec < rhs->nr_nsec);
+	
+	return (c_sec != 0) ? c_sec : c_nsec;
+}
+
+// Sum of two timestamps; seconds wrap around
+void platform_timespec_add(platform_timespec_t *sum,
+	const platform_timespec_t *lhs, const platform_timespec_t *rhs)
+{
+	// Both are below 10^9, so this cannot overflow 32 bits.
+	uint32_t nsec = lhs->nr_nsec + rhs->nr_nsec;
+	uint32_t carry = (nsec >= NSEC_PER_SEC);
+	
+	sum->nr_sec = lhs->nr_sec + rhs->nr_sec + carry;
+	sum->nr_nsec = nsec - carry * NSEC_PER_SEC;
 }
 
 /////////////////////////////////////////////////////////////////////////////
 
-// SysTick handling
-static volatile platform_timespec_t ts_wall = PLATFORM_TIMESPEC_ZERO;
-static volatile uint32_t ts_wall_cookie = 0;
+/*
+ * SysTick handling
+ * 
+ * Time is kept as a single 64-bit count of SysTick clocks; tick_base holds
+ * the count at the last reload, and the current value of the down-counter
+ * supplies the rest. At 12 MHz, the count does not wrap for ~48000 years.
+ */
+#define SYSTICK_RELOAD_VAL (PLATFORM_TICKS_US(PLATFORM_TICK_PERIOD_US) - 1)
+static volatile platform_tick_t tick_base = 0;
+static volatile uint32_t tick_base_cookie = 0;
+static void timer_wheel_run(void);
 void __attribute__((used, interrupt())) SysTick_Handler(void)
 {
-	platform_timespec_t t = ts_wall;
-	
-	t.nr_nsec += (PLATFORM_TICK_PERIOD_US * 1000);
-	while (t.nr_nsec >= 1000000000) {
-		t.nr_nsec -= 1000000000;
-		++t.nr_sec;	// Wrap-around intentional
-	}
+	++tick_base_cookie;	// Wrap-around intentional
+	tick_base += (SYSTICK_RELOAD_VAL + 1);
+	++tick_base_cookie;	// Wrap-around intentional
 	
-	++ts_wall_cookie;	// Wrap-around intentional
-	ts_wall = t;
-	++ts_wall_cookie;	// Wrap-around intentional
-	
-	// Reset before returning.
-	SysTick->VAL  = 0x00158158;	// Any value will clear
+	/*
+	 * The counter reloads by itself; writing VAL here would only lose
+	 * the clocks elapsed since the reload.
+	 */
+	timer_wheel_run();
 	return;
 }
-#define SYSTICK_RELOAD_VAL ((24/2)*PLATFORM_TICK_PERIOD_US)
 void platform_systick_init(void)
 {
 	/*
@@ -90,76 +100,466 @@ void platform_systick_init(void)
 	SysTick->CTRL = 0x00000007;
 	return;
 }
+platform_tick_t platform_tick_get(void)
+{
+	platform_tick_t base;
+	uint32_t cookie, val;
+	
+	/*
+	 * A cookie is used to make sure we get coherent data. If the counter
+	 * has reloaded but the handler could not run yet (e.g. we're called
+	 * with interrupts masked), account for the reload here; VAL is read
+	 * again, as it might have been sampled just before the reload.
+	 */
+	do {
+		cookie = tick_base_cookie;
+		base = tick_base;
+		val = SysTick->VAL;
+		if ((SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) != 0) {
+			val = SysTick->VAL;
+			base += (SYSTICK_RELOAD_VAL + 1);
+		}
+	} while (tick_base_cookie != cookie);
+	
+	return base + (SYSTICK_RELOAD_VAL - val);
+}
+
+// Convert a tick count into a timespec
+static void tick_to_timespec(platform_timespec_t *ts, platform_tick_t t)
+{
+	uint64_t nr_us = t / PLATFORM_TICKS_PER_US;
+	
+	ts->nr_sec = (uint32_t)(nr_us / 1000000);	// Wrap-around intentional
+	ts->nr_nsec = (uint32_t)(nr_us % 1000000) * 1000 +
+		((uint32_t)(t % PLATFORM_TICKS_PER_US) * 1000) /
+		PLATFORM_TICKS_PER_US;
+}
 void platform_tick_count(platform_timespec_t *tick)
 {
 	uint32_t cookie;
+	platform_tick_t t;
 	
-	// A cookie is used to make sure we get coherent data.
 	do {
-		cookie = ts_wall_cookie;
-		*tick = ts_wall;
-	} while (ts_wall_cookie != cookie);
+		cookie = tick_base_cookie;
+		t = tick_base;
+	} while (tick_base_cookie != cookie);
+	tick_to_timespec(tick, t);
 }
 void platform_tick_hrcount(platform_timespec_t *tick)
 {
-	platform_timespec_t t;
-	uint32_t s = SYSTICK_RELOAD_VAL - SysTick->VAL;
-	
-	platform_tick_count(&t);
-	t.nr_nsec += (1000 * s)/12;
-	while (t.nr_nsec >= 1000000000) {
-		t.nr_nsec -= 1000000000;
-		++t.nr_sec;	// Wrap-around intentional
-	}
-	
-	*tick = t;
+	tick_to_timespec(tick, platform_tick_get());
 }
 
-// Difference between two ticks
+/*
+ * Difference between two ticks
+ * 
+ * Seconds are subtracted modulo 2^32, so a single wrap-around of @p lhs
+ * past @p rhs is handled without any special-casing.
+ */
 void platform_tick_delta(
 	platform_timespec_t *diff,
 	const platform_timespec_t *lhs, const platform_timespec_t *rhs
 	)
 {
-	platform_timespec_t d = PLATFORM_TIMESPEC_ZERO;
-	uint32_t c = 0;
+	uint32_t borrow = (lhs->nr_nsec < rhs->nr_nsec);
 	
-	// Seconds...
-	if (lhs->nr_sec < rhs->nr_sec) {
-		// Wrap-around
-		d.nr_sec = (UINT32_MAX - rhs->nr_sec) + lhs->nr_sec + 1;
+	diff->nr_sec = lhs->nr_sec - rhs->nr_sec - borrow;
+	diff->nr_nsec = lhs->nr_nsec - rhs->nr_nsec + borrow * NSEC_PER_SEC;
+	return;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Timer wheel
+ * 
+ * Time is counted in jiffies of PLATFORM_TICK_PERIOD_US each. There are
+ * TW_LEVELS wheels of TW_SIZE slots; a slot of level N spans TW_SIZE^N
+ * jiffies. A timer goes into the coarsest level it needs, and is cascaded
+ * one level down whenever the wheel below it wraps around, so that by the
+ * time it expires it sits in level 0. Slots are doubly-linked lists, so
+ * arming and cancelling are O(1).
+ * 
+ * NOTE: Callbacks run from SysTick_Handler(). All list manipulation is done
+ *       with interrupts masked, as timers may be armed from any context.
+ */
+#define TW_BITS		6
+#define TW_SIZE		(1 << TW_BITS)
+#define TW_MASK		(TW_SIZE - 1)
+#define TW_LEVELS	4
+#define TW_SPAN_MAX	((1UL << (TW_BITS * TW_LEVELS)) - 1)
+
+static platform_timer_t *tw_slot[TW_LEVELS][TW_SIZE];
+
+/// Jiffies elapsed, as counted by SysTick_Handler()
+static volatile uint32_t tw_jiffies = 0;
+
+/// Next jiffy to be processed by the wheel
+static uint32_t tw_next = 0;
+
+static void tw_insert(platform_timer_t *timer)
+{
+	uint32_t expires = timer->expires;
+	uint32_t delta = expires - tw_next;
+	platform_timer_t **slot;
+	
+	if ((int32_t)delta < 0) {
+		// Already expired; run at the next opportunity.
+		slot = &tw_slot[0][tw_next & TW_MASK];
+	} else if (delta < (1UL << TW_BITS)) {
+		slot = &tw_slot[0][expires & TW_MASK];
+	} else if (delta < (1UL << (2 * TW_BITS))) {
+		slot = &tw_slot[1][(expires >> TW_BITS) & TW_MASK];
+	} else if (delta < (1UL << (3 * TW_BITS))) {
+		slot = &tw_slot[2][(expires >> (2 * TW_BITS)) & TW_MASK];
 	} else {
-		// No wrap-around
-		d.nr_sec = lhs->nr_sec - rhs->nr_sec;
+		if (delta > TW_SPAN_MAX) {
+			expires = tw_next + TW_SPAN_MAX;
+			timer->expires = expires;
+		}
+		slot = &tw_slot[3][(expires >> (3 * TW_BITS)) & TW_MASK];
+	}
+	
+	timer->next = *slot;
+	if (*slot != NULL)
+		(*slot)->pprev = &timer->next;
+	timer->pprev = slot;
+	*slot = timer;
+}
+
+static void tw_remove(platform_timer_t *timer)
+{
+	*timer->pprev = timer->next;
+	if (timer->next != NULL)
+		timer->next->pprev = timer->pprev;
+	timer->next = NULL;
+	timer->pprev = NULL;
+}
+
+// Re-insert all timers of a slot of @p level, returning the slot index
+static unsigned int tw_cascade(unsigned int level)
+{
+	unsigned int idx = (tw_next >> (level * TW_BITS)) & TW_MASK;
+	platform_timer_t *t = tw_slot[level][idx];
+	platform_timer_t *next;
+	
+	tw_slot[level][idx] = NULL;
+	for (; t != NULL; t = next) {
+		next = t->next;
+		tw_insert(t);
 	}
+	return idx;
+}
+
+// Process all jiffies up to the current one
+static void timer_wheel_run(void)
+{
+	platform_timer_t *expired, *t;
+	unsigned int idx, level;
+	uint32_t primask;
 	
-	// Nano-seconds...
-	if (lhs->nr_sec < rhs->nr_sec) {
-		// Wrap-around
-		c = rhs->nr_sec - lhs->nr_sec;
-		while (c >= 1000000000) {
-			c -= 1000000000;
-			if (d.nr_sec == 0) {
-				d.nr_sec = UINT32_MAX;
-			} else {
-				--d.nr_sec;
+	++tw_jiffies;	// Wrap-around intentional
+	
+	primask = __get_PRIMASK();
+	__disable_irq();
+	while ((int32_t)(tw_jiffies - tw_next) >= 0) {
+		idx = tw_next & TW_MASK;
+		if (idx == 0) {
+			for (level = 1; level < TW_LEVELS; ++level) {
+				if (tw_cascade(level) != 0)
+					break;
 			}
 		}
-		if (d.nr_sec == 0) {
-			d.nr_sec = UINT32_MAX;
-		} else {
-			--d.nr_sec;
+		++tw_next;	// Wrap-around intentional
+		
+		/*
+		 * Detach the slot first: a callback re-arming its timer for
+		 * a full turn of level 0 would otherwise land right back in
+		 * it. Timers on the detached list can still be cancelled.
+		 */
+		expired = tw_slot[0][idx];
+		tw_slot[0][idx] = NULL;
+		if (expired != NULL)
+			expired->pprev = &expired;
+		while ((t = expired) != NULL) {
+			tw_remove(t);
+			__set_PRIMASK(primask);
+			t->fn(t, t->arg);
+			__disable_irq();
 		}
-	} else {
-		// No wrap-around
-		d.nr_nsec = lhs->nr_nsec - rhs->nr_nsec;
 	}
+	__set_PRIMASK(primask);
+}
+
+void platform_timer_arm(platform_timer_t *timer, platform_tick_t delay)
+{
+	const platform_tick_t per_jiffy =
+		PLATFORM_TICKS_US(PLATFORM_TICK_PERIOD_US);
+	uint32_t nr_jiffies;
+	uint32_t primask;
+	
+	if (timer == NULL || timer->fn == NULL)
+		return;
+	
+	// Round up, so as to never expire early
+	if (delay > (platform_tick_t)TW_SPAN_MAX * per_jiffy)
+		nr_jiffies = TW_SPAN_MAX;
+	else
+		nr_jiffies = (uint32_t)((delay + per_jiffy - 1) / per_jiffy);
+	
+	primask = __get_PRIMASK();
+	__disable_irq();
+	if (timer->pprev != NULL)
+		tw_remove(timer);
+	
+	/*
+	 * The jiffy in progress is partially elapsed; counting from the
+	 * next one keeps the rounding up. If SysTick has reloaded, but its
+	 * handler has yet to run (we're called with interrupts masked), the
+	 * jiffy in progress is one further on than tw_jiffies says.
+	 */
+	timer->expires = tw_jiffies + nr_jiffies + 1 +
+		((SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) != 0);
+	tw_insert(timer);
+	__set_PRIMASK(primask);
+}
+
+void platform_timer_cancel(platform_timer_t *timer)
+{
+	uint32_t primask;
 	
-	// Normalize...
-	*diff = d;
+	if (timer == NULL)
+		return;
+	
+	primask = __get_PRIMASK();
+	__disable_irq();
+	if (timer->pprev != NULL)
+		tw_remove(timer);
+	__set_PRIMASK(primask);
+}
+
+bool platform_timer_armed(const platform_timer_t *timer)
+{
+	return (timer != NULL) && (timer->pprev != NULL);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Number of jiffies the wheel can go without being run
+ * 
+ * Level 0 is scanned for the first armed slot. Timers on the upper levels
+ * are only known to expire no earlier than the next cascade, so that is as
+ * far as we can go if there are any.
+ */
+static uint32_t tw_idle_jiffies(uint32_t nr_max)
+{
+	unsigned int x, level;
+	uint32_t nr = nr_max;
+	
+	for (level = 1; level < TW_LEVELS; ++level) {
+		for (x = 0; x < TW_SIZE; ++x) {
+			if (tw_slot[level][x] != NULL)
+				break;
+		}
+		if (x < TW_SIZE) {
+			nr = ((TW_SIZE - (tw_next & TW_MASK)) & TW_MASK) + 1;
+			break;
+		}
+	}
+	
+	for (x = 0; x < TW_SIZE && x + 1 < nr; ++x) {
+		if (tw_slot[0][(tw_next + x) & TW_MASK] != NULL)
+			return x + 1;
+	}
+	return (nr < nr_max) ? nr : nr_max;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Tickless idle
+ * 
+ * To sleep across several jiffies, SysTick is stopped, and restarted so
+ * that it next reaches zero on a jiffy boundary that many jiffies ahead. On
+ * wake-up, it is stopped again; the clocks it counted are added up into
+ * whole jiffies, which are accounted for in tick_base and the wheel, and it
+ * is restarted with a shortened first period, putting it back in phase. The
+ * last jiffy is left to SysTick_Handler() (by pending it), so the wheel is
+ * run as usual once interrupts are unmasked again.
+ * 
+ * SysTick does not count from the write that stops it to the one that
+ * restarts it, nor on the clock on which it then loads LOAD. The code in
+ * between is a fixed run (systick_stop(), then systick_start()), so the
+ * clocks missed are added back each time, as SYSTICK_STOPPED_CLOCKS.
+ * 
+ * That is a calibration, not something the code can know: the default
+ * counts the six register accesses and the load at a clock each, which is
+ * only the simulator's model. On the board, the instructions in between,
+ * and the bus timing of the accesses, add to it, by an amount that depends
+ * on the compiler and its options. Every clock it is off by shifts the
+ * tick by a clock per restart, which is twice per sleep across jiffies
+ * (once if there was no time left to sleep): 2 clocks, or 0.17 us, per
+ * sleep. At the ~650 sleeps a second fwsim sees, that is up to 110 ppm of
+ * drift per clock, slow if the true count is higher.
+ * 
+ * To calibrate a build, run it idle for a while against an outside
+ * reference, and take the clocks the tick fell behind, divided by
+ * nr_restarts of platform_idle_stats() over the same time (it is in the
+ * statistics message); add that to the value below, e.g. with
+ * -DSYSTICK_STOPPED_CLOCKS=n in the project's preprocessor macros.
+ */
+#define SYSTICK_IDLE_JIFFIES_MAX \
+	((0x00FFFFFF - SYSTICK_RELOAD_VAL) / (SYSTICK_RELOAD_VAL + 1) + 1)
+
+/// Clocks missed per stop, for this build; see above
+#if !defined(SYSTICK_STOPPED_CLOCKS)
+#define SYSTICK_STOPPED_CLOCKS	7
+#endif
+
+/// Shortest first period to restart with, to put LOAD back in time
+#define SYSTICK_RESTART_MIN	16
+
+static platform_idle_stats_t idle_stats;
+static platform_tick_t idle_stats_since = 0;
+
+/*
+ * Stop SysTick, and get the clocks counted since it last loaded @p load
+ * (at a jiffy boundary, for SYSTICK_RELOAD_VAL); a pending exception is
+ * taken over, as it means the counter has reached zero, and, unless it
+ * stands there still, reloaded and started over
+ */
+static uint32_t systick_stop(uint32_t load)
+{
+	uint32_t val;
+	bool pend;
+	
+	SysTick->CTRL = 0x00000006;
+	val = SysTick->VAL;
+	pend = (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) != 0;
+	SCB->ICSR = SCB_ICSR_PENDSTCLR_Msk;
+	
+	return load - val + ((pend && val != 0) ? load + 1 : 0);
+}
+
+// Start SysTick again; it loads @p load on the next clock
+static void systick_start(uint32_t load)
+{
+	SysTick->LOAD = load;
+	SysTick->VAL  = 0x00158158;	// Any value will clear
+	SysTick->CTRL = 0x00000007;
+	++idle_stats.nr_restarts;
+}
+
+/*
+ * Restart SysTick in phase, after a stop @p nr_clocks past the last jiffy
+ * boundary accounted for
+ */
+static void systick_resync(uint32_t nr_clocks)
+{
+	const uint32_t period = SYSTICK_RELOAD_VAL + 1;
+	uint32_t nr_jiffies, rem;
+	
+	nr_clocks += SYSTICK_STOPPED_CLOCKS;
+	rem = nr_clocks % period;
+	
+	/*
+	 * Too close to a boundary to put LOAD back before the first reload
+	 * (or to raise the exception at all, from a LOAD of zero): hold off
+	 * the restart with a few more accesses, right up to the boundary.
+	 */
+	if (SYSTICK_RELOAD_VAL - rem < SYSTICK_RESTART_MIN) {
+		for (; rem < period; ++rem, ++nr_clocks)
+			(void)SysTick->VAL;
+		rem = 0;
+	}
+	systick_start(SYSTICK_RELOAD_VAL - rem);
+	
+	nr_jiffies = nr_clocks / period;
+	if (nr_jiffies > 0) {
+		++tick_base_cookie;	// Wrap-around intentional
+		tick_base += (platform_tick_t)(nr_jiffies - 1) * period;
+		++tick_base_cookie;	// Wrap-around intentional
+		tw_jiffies += nr_jiffies - 1;
+		SCB->ICSR = SCB_ICSR_PENDSTSET_Msk;
+	}
+	
+	// LOAD only applies from the next reload on.
+	while (SysTick->VAL == 0)
+		asm("nop");
+	SysTick->LOAD = SYSTICK_RELOAD_VAL;
+}
+
+void platform_systick_idle(const platform_tick_t *deadline)
+{
+	const uint32_t period = SYSTICK_RELOAD_VAL + 1;
+	platform_tick_t now = platform_tick_get();
+	uint32_t nr_jiffies = SYSTICK_IDLE_JIFFIES_MAX;
+	uint32_t nr_clocks, start, load, slept;
+	
+	if (deadline != NULL) {
+		if (platform_tick_expired(now, *deadline))
+			return;
+		if (*deadline - now < (platform_tick_t)nr_jiffies * period)
+			nr_jiffies = (uint32_t)
+				((*deadline - now + period - 1) / period);
+	}
+	nr_jiffies = tw_idle_jiffies(nr_jiffies);
+	++idle_stats.nr_sleeps;
+	
+	// Not worth reprogramming SysTick for; it wakes us up anyway.
+	if (nr_jiffies <= 1) {
+		__DSB();
+		__WFI();
+		idle_stats.nr_ticks_asleep += platform_tick_get() - now;
+		return;
+	}
+	
+	/*
+	 * Clocks into the current jiffy, as of the restart. If the stop ran
+	 * into the jiffy before the one to wake up at, there is no sleeping
+	 * left to do; restarting with less than a full period would also
+	 * risk the counter wrapping around twice before it is looked at.
+	 */
+	nr_clocks = systick_stop(SYSTICK_RELOAD_VAL);
+	start = nr_clocks + SYSTICK_STOPPED_CLOCKS;
+	if (start + period <= nr_jiffies * period) {
+		load = nr_jiffies * period - 1 - start;
+		systick_start(load);
+		
+		__DSB();
+		__WFI();
+		
+		slept = systick_stop(load);
+		idle_stats.nr_ticks_asleep += slept;
+		nr_clocks = start + slept;
+	}
+	systick_resync(nr_clocks);
 	return;
 }
 
+void platform_idle_stats(platform_idle_stats_t *stats, bool reset)
+{
+	platform_tick_t now;
+	uint32_t primask;
+	
+	if (stats == NULL)
+		return;
+	
+	primask = __get_PRIMASK();
+	__disable_irq();
+	now = platform_tick_get();
+	*stats = idle_stats;
+	stats->nr_ticks_total = now - idle_stats_since;
+	if (reset) {
+		memset(&idle_stats, 0, sizeof(idle_stats));
+		idle_stats_since = now;
+	}
+	__set_PRIMASK(primask);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
 // Set a delay
 void crude_delay_ms(uint32_t delay){
     uint32_t i;
@@ -169,24 +569,9 @@ void crude_delay_ms(uint32_t delay){
 }
 void delay(uint32_t milliseconds)
 {
-    // Convert milliseconds to microseconds (1000 microseconds per millisecond)
-    uint32_t delay_ticks = milliseconds * 1000;
-
-    // Store the start time
-    platform_timespec_t start_time;
-    platform_tick_count(&start_time);
-
-    // Wait until the specified delay has passed
-    platform_timespec_t current_time;
-    do {
-        platform_tick_count(&current_time);
+    platform_tick_t deadline = platform_tick_get() +
+        PLATFORM_TICKS_MS(milliseconds);
 
-        platform_timespec_t delta;
-        platform_tick_delta(&delta, &current_time, &start_time);
-
-        // Compare the elapsed time in ticks
-        if (delta.nr_sec * 1000000000 + delta.nr_nsec >= delay_ticks) {
-            break;
-        }
-    } while (1);
-}
\ No newline at end of file
+    while (!platform_tick_expired(platform_tick_get(), deadline))
+        asm("nop");
+}
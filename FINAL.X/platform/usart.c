@@ -7,14 +7,45 @@
 // Functions "exported" by this file
 void platform_usart_pms_init(void);
 void platform_usart_esp_init(void);
-void platform_usart_tick_handler(const platform_timespec_t *tick);
+void platform_usart_tick_handler(platform_tick_t tick);
+bool platform_usart_work_pending(void);
+
+// Functions defined in platform/dmac.c
+extern bool platform_dmac_tx_setup(unsigned int ch, uint8_t trigsrc,
+    void (*done)(void *arg, bool ok), void *arg);
+extern bool platform_dmac_tx_start(unsigned int ch, volatile void *dst,
+    const platform_usart_tx_bufdesc_t *desc, unsigned int nr_desc);
+extern void platform_dmac_abort(unsigned int ch);
+
+/// DMAC channels used for USART TX
+#define USART_DMAC_CH_ESP   (0)
+#define USART_DMAC_CH_CO2   (1)
+
+/// DMAC trigger sources (CHCTRLB.TRIGSRC) for the SERCOM transmitters
+#define DMAC_TRIGSRC_SERCOM0_TX (0x05)
+#define DMAC_TRIGSRC_SERCOM1_TX (0x07)
 
 /////////////////////////////////////////////////////////////////////////////
 
+/// Baud rate all channels come up with
+#define USART_BAUD_DEFAULT  (9600)
+
+/// Idle timeout in character times (of 10 bits each, as in 8N1)
+#define NR_USART_IDLE_CHARS (3)
+
+/// Length of the per-channel TX submission queue; must be a power of two
+#define NR_USART_TXQ_LEN    (8)
+
+/// Length of the capture ring, in bytes; must be a power of two
+#define NR_USART_CAP_LEN    (256)
+
+/// Capture time stamps are kept to this many bits in the ring
+#define USART_CAP_TIME_BITS (21)
+
 /**
  * State variables for UART
  * 
- * Separate contexts for PMS7003 (SERCOM0) and Laptop (SERCOM3)
+ * Separate contexts for each SERCOM in use; see the list below.
  */
 typedef struct ctx_usart_type {
     /// Pointer to the underlying register set
@@ -22,22 +53,73 @@ typedef struct ctx_usart_type {
 
     /// State variables for the transmitter
     struct {
-        volatile platform_usart_tx_bufdesc_t *desc;
+        const platform_usart_tx_bufdesc_t *volatile desc;
         volatile uint16_t nr_desc;
-        volatile const char *buf;
+        const char *volatile buf;
         volatile uint16_t len;
+
+        /// Set until TXC signals that the last byte has left the wire
+        volatile bool active;
+
+        /*
+         * Submission queue
+         * 
+         * Messages in [done, head) have been started; the one at
+         * head - 1 is in flight while @c cur is set. Messages in
+         * [head, tail) are waiting. All indices are free-running.
+         */
+        struct {
+            platform_usart_tx_msg_t *volatile msg[NR_USART_TXQ_LEN];
+            platform_usart_tx_msg_t *volatile cur;
+            volatile uint8_t done;
+            volatile uint8_t head;
+            volatile uint8_t tail;
+            platform_usart_txq_stats_t stats;
+        } q;
     } tx;
 
     /// State variables for the receiver
     struct {
         volatile platform_usart_rx_async_desc_t *volatile desc;
-        volatile platform_timespec_t ts_idle;
+        volatile platform_tick_t ts_idle;
+
+        /// Fires some time after the idle timeout; see usart_rx_idle_expired()
+        platform_timer_t idle_timer;
         volatile uint16_t idx;
+
+        /// Queued descriptor, switched to as soon as @c desc completes
+        volatile platform_usart_rx_async_desc_t *volatile next;
+
+        /*
+         * Streaming reception; active iff ring.buf != NULL
+         * 
+         * Both indices are free-running: the RXC handler only writes
+         * head, the application only writes tail.
+         */
+        struct {
+            char *volatile buf;
+            uint16_t mask;
+            volatile uint16_t head;
+            volatile uint16_t tail;
+        } ring;
     } rx;
 
+    /// Counters; only ever modified with interrupts masked or in ISR context
+    platform_usart_stats_t stats;
+
     /// Configuration items
     struct {
-        platform_timespec_t ts_idle_timeout;
+        /// Time without reception after which RAW-mode buffers complete
+        platform_tick_t idle_timeout;
+
+        /// DMAC channel used for TX, or negative if TX is interrupt-driven
+        int8_t dma_ch;
+
+        /// Frequency of the SERCOM core clock (GCLK_SERCOMx_CORE), in Hz
+        uint32_t fref;
+
+        /// Current baud rate
+        uint32_t baud;
     } cfg;
 
 } ctx_usart_t;
@@ -47,6 +129,125 @@ static ctx_usart_t ctx_uart_co2;    // Context for MH-Z19C  (SERCOM1)
 static ctx_usart_t ctx_uart_pms;    // Context for PMS5003T (SERCOM3)
 static ctx_usart_t ctx_uart_gps;    // Context for NEO-6M   (SERCOM5)
 
+/*
+ * Capture of received bytes, shared by all channels so that their order is
+ * kept; active iff mask != 0
+ * 
+ * Each entry packs the channel (bits 31:30), the byte (29:22), whether bytes
+ * were dropped just before it (21) and the low bits of the time stamp
+ * (20:0). As with the streaming rings, the RXC handlers only write head,
+ * the application only writes tail.
+ */
+static struct {
+    uint32_t ent[NR_USART_CAP_LEN];
+    volatile uint8_t mask;
+    bool lost;
+    volatile uint16_t head;
+    volatile uint16_t tail;
+    volatile uint32_t nr_dropped;
+} usart_cap;
+
+static void usart_dma_done(void *arg, bool ok);
+static void usart_rx_idle_expired(platform_timer_t *timer, void *arg);
+static void usart_txq_kick(ctx_usart_t *ctx);
+static void usart_txq_retire(ctx_usart_t *ctx);
+
+// Lookup table for the channel-indexed APIs
+static ctx_usart_t *const ctx_uart_tbl[PLATFORM_USART_NR_CH] = {
+    [PLATFORM_USART_ESP] = &ctx_uart_esp,
+    [PLATFORM_USART_CO2] = &ctx_uart_co2,
+    [PLATFORM_USART_PMS] = &ctx_uart_pms,
+    [PLATFORM_USART_GPS] = &ctx_uart_gps,
+};
+static ctx_usart_t *usart_ctx_get(platform_usart_ch_t ch)
+{
+    if ((unsigned int)ch >= PLATFORM_USART_NR_CH)
+        return NULL;
+    return ctx_uart_tbl[ch];
+}
+
+/*
+ * Work out the frequency of the generator feeding peripheral channel @p pch
+ * 
+ * Only the sources used by platform_init() are known; anything else yields 0.
+ */
+static uint32_t usart_gclk_hz(unsigned int pch)
+{
+    static const uint32_t osc16m_hz[4] = {
+        4000000, 8000000, 12000000, 16000000
+    };
+    uint32_t genctrl, div, hz;
+
+    genctrl = GCLK_REGS->GCLK_GENCTRL[GCLK_REGS->GCLK_PCHCTRL[pch] & 0x0F];
+    switch (genctrl & 0x1F) {
+    case 0x05:  // OSC16M
+        hz = osc16m_hz[(OSCCTRL_REGS->OSCCTRL_OSC16MCTRL >> 2) & 0x03];
+        break;
+    case 0x07:  // DFLL48M
+        hz = 48000000;
+        break;
+    default:
+        return 0;
+    }
+
+    div = genctrl >> 16;
+    if ((genctrl & (1 << 12)) != 0)
+        return hz >> (div + 1);
+    return (div > 1) ? (hz / div) : hz;
+}
+
+/*
+ * Compute BAUD and CTRLA.SAMPR for @p baud, with arithmetic baud generation
+ * 
+ * BAUD = 65536 * (1 - S * f_baud / f_ref), rounded to nearest; S is 16
+ * wherever possible, for the better noise immunity, and 8 otherwise.
+ */
+static bool usart_baud_calc(uint32_t fref, uint32_t baud,
+    uint16_t *baudreg, uint8_t *sampr)
+{
+    uint64_t scaled;
+    unsigned int nr_samples;
+
+    if (fref == 0 || baud == 0)
+        return false;
+
+    if ((uint64_t)baud * 16 <= fref) {
+        nr_samples = 16;
+        *sampr = 0x0;
+    } else if ((uint64_t)baud * 8 <= fref) {
+        nr_samples = 8;
+        *sampr = 0x2;
+    } else {
+        return false;
+    }
+
+    scaled = ((uint64_t)baud * nr_samples * 65536 + (fref / 2)) / fref;
+    *baudreg = (scaled >= 65536) ? 0 : (uint16_t)(65536 - scaled);
+    return true;
+}
+
+/*
+ * Program BAUD/SAMPR and rescale the idle timeout; the SERCOM must be
+ * disabled, as both registers are enable-protected.
+ */
+static bool usart_baud_apply(ctx_usart_t *ctx, uint32_t baud)
+{
+    uint16_t baudreg;
+    uint8_t sampr;
+
+    if (!usart_baud_calc(ctx->cfg.fref, baud, &baudreg, &sampr))
+        return false;
+
+    ctx->regs->SERCOM_CTRLA = (ctx->regs->SERCOM_CTRLA & ~(0x7 << 13)) |
+        ((uint32_t)sampr << 13);
+    ctx->regs->SERCOM_BAUD = baudreg;
+    ctx->cfg.baud = baud;
+
+    ctx->cfg.idle_timeout = (NR_USART_IDLE_CHARS * 10ULL *
+        PLATFORM_TICKS_US(1000000)) / baud;
+    return true;
+}
+
 // Configure ESP8266 UART (SERCOM0)
 void platform_usart_esp_init(void) {
     #define UART0_REGS (&(SERCOM0_REGS->USART_INT))
@@ -56,17 +257,20 @@ void platform_usart_esp_init(void) {
     while ((GCLK_REGS->GCLK_PCHCTRL[17] & 0x00000040) == 0) asm("nop");
 
     memset(&ctx_uart_esp, 0, sizeof(ctx_uart_esp));
+    ctx_uart_esp.rx.idle_timer.fn = usart_rx_idle_expired;
+    ctx_uart_esp.rx.idle_timer.arg = &ctx_uart_esp;
     ctx_uart_esp.regs = UART0_REGS;
+    ctx_uart_esp.cfg.dma_ch = USART_DMAC_CH_ESP;
+    platform_dmac_tx_setup(USART_DMAC_CH_ESP, DMAC_TRIGSRC_SERCOM0_TX,
+        usart_dma_done, &ctx_uart_esp);
 
     UART0_REGS->SERCOM_CTRLA = 0x01;
     while ((UART0_REGS->SERCOM_SYNCBUSY & 0x01) != 0) asm("nop");
     UART0_REGS->SERCOM_CTRLA = (uint32_t)(0x4);
     
     UART0_REGS->SERCOM_CTRLA |= (0 << 16) | (1 << 20) | (0 << 24) | (1 << 30);
-    UART0_REGS->SERCOM_BAUD = 63019;
-    
-    ctx_uart_esp.cfg.ts_idle_timeout.nr_sec = 0;
-    ctx_uart_esp.cfg.ts_idle_timeout.nr_nsec = 468750;
+    ctx_uart_esp.cfg.fref = usart_gclk_hz(17);
+    usart_baud_apply(&ctx_uart_esp, USART_BAUD_DEFAULT);
     
     UART0_REGS->SERCOM_CTRLB |= (1 << 16) | (1 << 17);
     while ((UART0_REGS->SERCOM_SYNCBUSY & (1<<2)) != 0) asm("nop");
@@ -79,6 +283,9 @@ void platform_usart_esp_init(void) {
     PORT_SEC_REGS->GROUP[0].PORT_PINCFG[5] = 0x3;
     PORT_SEC_REGS->GROUP[0].PORT_PMUX[2] |= (0x03 << 4);
     
+    // Bytes are received in ISR context; see usart_isr_rxc()
+    UART0_REGS->SERCOM_INTENSET = (1 << 2);
+
     UART0_REGS->SERCOM_CTRLA |= (1<<1);
     while ((UART0_REGS->SERCOM_SYNCBUSY & (1 << 1)) != 0) asm("nop");
     return;
@@ -130,17 +337,20 @@ void platform_usart_co2_init(void) {
     
     // Initialize the peripheral's context structure
     memset(&ctx_uart_co2, 0, sizeof(ctx_uart_co2));
+    ctx_uart_co2.rx.idle_timer.fn = usart_rx_idle_expired;
+    ctx_uart_co2.rx.idle_timer.arg = &ctx_uart_co2;
     ctx_uart_co2.regs = UART1_REGS;
+    ctx_uart_co2.cfg.dma_ch = USART_DMAC_CH_CO2;
+    platform_dmac_tx_setup(USART_DMAC_CH_CO2, DMAC_TRIGSRC_SERCOM1_TX,
+        usart_dma_done, &ctx_uart_co2);
     
     UART1_REGS->SERCOM_CTRLA = 0x01;
     while ((UART1_REGS->SERCOM_SYNCBUSY & 0x01) != 0) asm("nop");
     UART1_REGS->SERCOM_CTRLA = (uint32_t)(0x4);
     
     UART1_REGS->SERCOM_CTRLA |= (0 << 16) | (1 << 20) | (0 << 24) | (1 << 30);
-    UART1_REGS->SERCOM_BAUD = 63019;
-    
-    ctx_uart_co2.cfg.ts_idle_timeout.nr_sec = 0;
-    ctx_uart_co2.cfg.ts_idle_timeout.nr_nsec = 468750;
+    ctx_uart_co2.cfg.fref = usart_gclk_hz(18);
+    usart_baud_apply(&ctx_uart_co2, USART_BAUD_DEFAULT);
     
     UART1_REGS->SERCOM_CTRLB |= (1 << 16) | (1 << 17) | (1 << 22) | (1 << 23);
     while ((UART1_REGS->SERCOM_SYNCBUSY & (1 << 2)) != 0) asm("nop");
@@ -153,6 +363,9 @@ void platform_usart_co2_init(void) {
     PORT_SEC_REGS->GROUP[0].PORT_PINCFG[17] = 0x3;
     PORT_SEC_REGS->GROUP[0].PORT_PMUX[8] |= (0x02 << 4);
     
+    // Bytes are received in ISR context; see usart_isr_rxc()
+    UART1_REGS->SERCOM_INTENSET = (1 << 2);
+
     UART1_REGS->SERCOM_CTRLA |= (1 << 1);
     while ((UART1_REGS->SERCOM_SYNCBUSY & (1 << 1)) != 0) asm("nop");
     return;
@@ -167,17 +380,18 @@ void platform_usart_pms_init(void) {
     while ((GCLK_REGS->GCLK_PCHCTRL[20] & 0x00000040) == 0) asm("nop");
 
     memset(&ctx_uart_pms, 0, sizeof(ctx_uart_pms));
-    ctx_uart_esp.regs = UART3_REGS;
+    ctx_uart_pms.rx.idle_timer.fn = usart_rx_idle_expired;
+    ctx_uart_pms.rx.idle_timer.arg = &ctx_uart_pms;
+    ctx_uart_pms.regs = UART3_REGS;
+    ctx_uart_pms.cfg.dma_ch = -1;
 
     UART3_REGS->SERCOM_CTRLA = 0x01;
     while ((UART3_REGS->SERCOM_SYNCBUSY & 0x01) != 0) asm("nop");
     UART3_REGS->SERCOM_CTRLA = (uint32_t)(0x4);
     
     UART3_REGS->SERCOM_CTRLA |= (0 << 16) | (0 << 20) | (0 << 24) | (1 << 30);
-    UART3_REGS->SERCOM_BAUD = 63019;
-    
-    ctx_uart_pms.cfg.ts_idle_timeout.nr_sec = 0;
-    ctx_uart_pms.cfg.ts_idle_timeout.nr_nsec = 468750;
+    ctx_uart_pms.cfg.fref = usart_gclk_hz(20);
+    usart_baud_apply(&ctx_uart_pms, USART_BAUD_DEFAULT);
     
     UART3_REGS->SERCOM_CTRLB |= (0 << 16) | (1 << 17) | (1 << 22) | (1 << 23);
     while ((UART3_REGS->SERCOM_SYNCBUSY & (1 << 2)) != 0) asm("nop");
@@ -186,6 +400,9 @@ void platform_usart_pms_init(void) {
     PORT_SEC_REGS->GROUP[1].PORT_PINCFG[2] = 0x3;
     PORT_SEC_REGS->GROUP[1].PORT_PMUX[1] |= 0x02;
     
+    // Bytes are received in ISR context; see usart_isr_rxc()
+    UART3_REGS->SERCOM_INTENSET = (1 << 2);
+
     UART3_REGS->SERCOM_CTRLA |= (1 << 1);
     while ((UART3_REGS->SERCOM_SYNCBUSY & (1 << 1)) != 0) asm("nop");
     return;
@@ -236,17 +453,18 @@ void platform_usart_gps_init(void) {
     while ((GCLK_REGS->GCLK_PCHCTRL[22] & 0x00000040) == 0) asm("nop");
 
     memset(&ctx_uart_gps, 0, sizeof(ctx_uart_gps));
+    ctx_uart_gps.rx.idle_timer.fn = usart_rx_idle_expired;
+    ctx_uart_gps.rx.idle_timer.arg = &ctx_uart_gps;
     ctx_uart_gps.regs = UART5_REGS;
+    ctx_uart_gps.cfg.dma_ch = -1;
 
     UART5_REGS->SERCOM_CTRLA = 0x01;
     while ((UART5_REGS->SERCOM_SYNCBUSY & 0x01) != 0) asm("nop");
     UART5_REGS->SERCOM_CTRLA = (uint32_t)(0x4);
     
     UART5_REGS->SERCOM_CTRLA |= (0 << 16) | (1 << 20) | (0 << 24) | (1 << 30);
-    UART5_REGS->SERCOM_BAUD = 63019;
-    
-    ctx_uart_gps.cfg.ts_idle_timeout.nr_sec = 0;
-    ctx_uart_gps.cfg.ts_idle_timeout.nr_nsec = 468750;
+    ctx_uart_gps.cfg.fref = usart_gclk_hz(22);
+    usart_baud_apply(&ctx_uart_gps, USART_BAUD_DEFAULT);
     
     UART5_REGS->SERCOM_CTRLB |= (0 << 16) | (1 << 17) | (1 << 22) | (1 << 23);
     while ((UART5_REGS->SERCOM_SYNCBUSY & (1 << 2)) != 0) asm("nop");
@@ -255,130 +473,434 @@ void platform_usart_gps_init(void) {
     PORT_SEC_REGS->GROUP[1].PORT_PINCFG[3] = 0x3;
     PORT_SEC_REGS->GROUP[1].PORT_PMUX[1] |= (0x03 << 4);
     
+    // Bytes are received in ISR context; see usart_isr_rxc()
+    UART5_REGS->SERCOM_INTENSET = (1 << 2);
+
     UART5_REGS->SERCOM_CTRLA |= (1 << 1);
     while ((UART5_REGS->SERCOM_SYNCBUSY & (1 << 1)) != 0) asm("nop");
     return;
 }
 
-// Helper abort routine for USART reception
-static void usart_rx_abort_helper(ctx_usart_t *ctx)
+/*
+ * Interrupt masking for code shared with the SERCOM handlers
+ * 
+ * PRIMASK is saved and restored (instead of blindly re-enabling) so that
+ * these may also be used from within an ISR.
+ */
+static inline uint32_t usart_irq_save(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    
+    __disable_irq();
+    return primask;
+}
+static inline void usart_irq_restore(uint32_t primask)
+{
+    __set_PRIMASK(primask);
+}
+
+/*
+ * Helper abort routine for USART reception
+ * 
+ * Completes the current descriptor, and switches over to the queued one (if
+ * any) in the same step so that no byte finds the receiver unarmed.
+ */
+static void usart_rx_abort_helper(ctx_usart_t *ctx, uint16_t compl_type)
 {
     if (ctx->rx.desc != NULL) {
-        ctx->rx.desc->compl_type = PLATFORM_USART_RX_COMPL_DATA;
+        ctx->rx.desc->compl_type = compl_type;
         ctx->rx.desc->compl_info.data_len = ctx->rx.idx;
-        ctx->rx.desc = NULL;
+        ctx->rx.desc->compl_tick = (ctx->rx.idx != 0) ? ctx->rx.ts_idle :
+            platform_tick_get();
+        ctx->rx.desc = ctx->rx.next;
+        ctx->rx.next = NULL;
     }
-    ctx->rx.ts_idle.nr_sec = 0;
-    ctx->rx.ts_idle.nr_nsec = 0;
+    ctx->rx.ts_idle = 0;
     ctx->rx.idx = 0;
     return;
 }
 
-static void usart_tick_handler_common(
-    ctx_usart_t *ctx, const platform_timespec_t *tick)
+/*
+ * DRE (data register empty) handler
+ * 
+ * Feeds the next byte of the current fragment into DATA. Once everything has
+ * been handed over, DRE is masked and TXC is unmasked so that the end of the
+ * transmission is only reported once the shift register has drained.
+ */
+static void usart_isr_dre(ctx_usart_t *ctx)
 {
-    uint16_t status = 0x0000;
-    uint8_t data = 0x00;
-    platform_timespec_t ts_delta;
+    /*
+     * Load the next non-empty descriptor, if the working copy of the
+     * current one has been used up.
+     */
+    while (ctx->tx.len == 0 && ctx->tx.nr_desc > 0) {
+        ctx->tx.buf = ctx->tx.desc->buf;
+        ctx->tx.len = ctx->tx.desc->len;
 
-    // TX handling
-    if ((ctx->regs->SERCOM_INTFLAG & (1 << 0)) != 0) {
-        if (ctx->tx.len > 0) {
-            /*
-             * There is still something to transmit in the working
-             * copy of the current descriptor.
-             */
-            ctx->regs->SERCOM_DATA = *(ctx->tx.buf++);
-            --ctx->tx.len;
-        }
-        if (ctx->tx.len == 0) {
-            // Load a new descriptor
-            ctx->tx.buf = NULL;
-            if (ctx->tx.nr_desc > 0) {
-                /*
-                 * There's at least one descriptor left to
-                 * transmit
-                 * 
-                 * If either ->buf or ->len of the candidate
-                 * descriptor refer to an empty buffer, the
-                 * next invocation of this routine will cause
-                 * the next descriptor to be evaluated.
-                 */
-                ctx->tx.buf = ctx->tx.desc->buf;
-                ctx->tx.len = ctx->tx.desc->len;
-
-                ++ctx->tx.desc;
-                --ctx->tx.nr_desc;
-
-                if (ctx->tx.buf == NULL || ctx->tx.len == 0) {
-                    ctx->tx.buf = NULL;
-                    ctx->tx.len = 0;
-                }
-            } else {
-                /*
-                 * No more descriptors available
-                 * 
-                 * Clean up the corresponding context data so
-                 * that we don't trip over them on the next
-                 * invocation.
-                 */
-                ctx->regs->SERCOM_INTENCLR = 0x01;
-                ctx->tx.desc = NULL;
-                ctx->tx.buf = NULL;
-            }
-        }
+        ++ctx->tx.desc;
+        --ctx->tx.nr_desc;
+
+        if (ctx->tx.buf == NULL)
+            ctx->tx.len = 0;
     }
     
-    // RX handling
-    if ((ctx->regs->SERCOM_INTFLAG & (1 << 2)) != 0) {
-        /*
-         * There are unread data
-         * 
-         * To enable readout of error conditions, STATUS must be read
-         * before reading DATA.
-         * 
-         * NOTE: Piggyback on Bit 15, as it is undefined for this
-         *       platform.
-         */
-        status = ctx->regs->SERCOM_STATUS | 0x8000;
-        data = (uint8_t)(ctx->regs->SERCOM_DATA);
+    if (ctx->tx.len > 0) {
+        // Unsigned, or bytes above 0x7F spill into the reserved bits
+        ctx->regs->SERCOM_DATA = (uint8_t)*(ctx->tx.buf++);
+        --ctx->tx.len;
+        ++ctx->stats.nr_tx_bytes;
+        return;
     }
     
-    do {
-        if (ctx->rx.desc == NULL) {
+    /*
+     * No more descriptors available
+     * 
+     * Clean up the corresponding context data so that we don't trip over
+     * them on the next transmission.
+     */
+    ctx->tx.desc = NULL;
+    ctx->tx.buf = NULL;
+    ctx->regs->SERCOM_INTENCLR = (1 << 0);
+    ctx->regs->SERCOM_INTENSET = (1 << 1);
+    return;
+}
+
+/*
+ * DMAC completion callback (ISR context)
+ * 
+ * The last byte has only been handed over to DATA; let TXC report the end
+ * of the transmission as in the interrupt-driven case.
+ * 
+ * After a transfer error, the message is cut short, and TXC may never come
+ * if no byte made it to DATA; it is aborted, and the queue moves on.
+ */
+static void usart_dma_done(void *arg, bool ok)
+{
+    ctx_usart_t *ctx = arg;
+    uint32_t primask;
+
+    if (ok) {
+        ctx->regs->SERCOM_INTENSET = (1 << 1);
+        return;
+    }
+
+    primask = usart_irq_save();
+    ++ctx->stats.nr_err_dma;
+    if (ctx->tx.q.cur != NULL) {
+        ctx->tx.q.cur->state = PLATFORM_USART_TX_MSG_ABORTED;
+        ctx->tx.q.cur = NULL;
+    }
+    ctx->tx.active = false;
+    usart_txq_kick(ctx);
+    usart_irq_restore(primask);
+    return;
+}
+
+// TXC (transmit complete) handler
+static void usart_isr_txc(ctx_usart_t *ctx)
+{
+    ctx->regs->SERCOM_INTENCLR = (1 << 1);
+    ctx->regs->SERCOM_INTFLAG = (1 << 1);
+    ctx->tx.active = false;
+
+    // Keep the line busy with whatever has been queued up
+    usart_txq_kick(ctx);
+    return;
+}
+
+// Append a byte to the streaming ring (RXC handler only)
+static void usart_rx_ring_put(ctx_usart_t *ctx, uint8_t data)
+{
+    uint16_t head = ctx->rx.ring.head;
+
+    if ((uint16_t)(head - ctx->rx.ring.tail) > ctx->rx.ring.mask) {
+        // Full; the byte is lost
+        ++ctx->stats.nr_rx_dropped;
+        return;
+    }
+    ctx->rx.ring.buf[head & ctx->rx.ring.mask] = (char)data;
+    ++ctx->stats.nr_rx_bytes;
+
+    // The byte must be visible before the new head is.
+    __DMB();
+    ctx->rx.ring.head = head + 1;
+    return;
+}
+
+// Append a byte to the capture ring (RXC handler only)
+static void usart_cap_put(ctx_usart_t *ctx, uint8_t data)
+{
+    uint16_t head = usart_cap.head;
+    uint32_t stamp;
+    unsigned int ch;
+
+    for (ch = 0; ch < PLATFORM_USART_NR_CH && ctx_uart_tbl[ch] != ctx; ++ch)
+        ;
+    if (ch == PLATFORM_USART_NR_CH || (usart_cap.mask & (1u << ch)) == 0)
+        return;
+
+    if ((uint16_t)(head - usart_cap.tail) >= NR_USART_CAP_LEN) {
+        ++usart_cap.nr_dropped;
+        usart_cap.lost = true;
+        return;
+    }
+    stamp = (uint32_t)(platform_tick_get() >> PLATFORM_USART_CAP_TIME_SHIFT);
+    usart_cap.ent[head & (NR_USART_CAP_LEN - 1)] = ((uint32_t)ch << 30) |
+        ((uint32_t)data << 22) | ((uint32_t)usart_cap.lost << 21) |
+        (stamp & ((1u << USART_CAP_TIME_BITS) - 1));
+    usart_cap.lost = false;
+
+    // The entry must be visible before the new head is.
+    __DMB();
+    usart_cap.head = head + 1;
+    return;
+}
+
+/*
+ * Apply the completion mode of the current descriptor to the byte that has
+ * just been stored
+ * 
+ * This may also rewind the write index, while hunting for sync bytes or
+ * after an implausible length field.
+ * 
+ * @return  Completion type, or PLATFORM_USART_RX_COMPL_NONE if the frame is
+ *          not complete yet
+ */
+static uint16_t usart_rx_mode_check(ctx_usart_t *ctx, uint8_t data)
+{
+    volatile platform_usart_rx_async_desc_t *desc = ctx->rx.desc;
+    uint16_t idx = ctx->rx.idx;
+    uint16_t ofs, len;
+
+    switch (desc->mode) {
+    case PLATFORM_USART_RX_MODE_MATCH:
+        if (data == desc->mode_cfg.match)
+            return PLATFORM_USART_RX_COMPL_MATCH;
+        break;
+
+    case PLATFORM_USART_RX_MODE_HDRLEN:
+    case PLATFORM_USART_RX_MODE_FIXED:
+        if (idx <= desc->mode_cfg.nr_sync) {
+            if (data != desc->mode_cfg.sync[idx - 1]) {
+                // Start over; this byte may itself begin a frame.
+                idx = 0;
+                if (data == desc->mode_cfg.sync[0])
+                    desc->buf[idx++] = data;
+                ctx->rx.idx = idx;
+            }
             break;
         }
 
-        if ((status & 0x8003) == 0x8000) {
-            ctx->rx.desc->buf[ctx->rx.idx++] = data;
-            ctx->rx.ts_idle = *tick;
+        if (desc->mode == PLATFORM_USART_RX_MODE_FIXED) {
+            if (idx >= desc->max_len)
+                return PLATFORM_USART_RX_COMPL_FRAME;
+            break;
         }
-        ctx->regs->SERCOM_STATUS |= (status & 0x00F7);
 
-        // Some housekeeping
-        if (ctx->rx.idx >= ctx->rx.desc->max_len) {
-            // Buffer completely filled
-            usart_rx_abort_helper(ctx);
+        ofs = desc->mode_cfg.len_ofs;
+        if (idx < ofs + 2)
+            break;
+
+        len = (((uint16_t)(uint8_t)desc->buf[ofs] << 8) |
+            (uint8_t)desc->buf[ofs + 1]) + desc->mode_cfg.len_adj;
+        if (len > desc->max_len || len < ofs + 2) {
+            // Implausible; must have synced on payload bytes.
+            ctx->rx.idx = 0;
+            break;
+        }
+        if (idx >= len)
+            return PLATFORM_USART_RX_COMPL_FRAME;
+        break;
+
+    default:
+        break;
+    }
+    return PLATFORM_USART_RX_COMPL_NONE;
+}
+
+// RXC (receive complete) handler
+static void usart_isr_rxc(ctx_usart_t *ctx)
+{
+    uint16_t status;
+    uint16_t compl_type;
+    uint8_t data;
+
+    /*
+     * To enable readout of error conditions, STATUS must be read before
+     * reading DATA. Reading DATA also clears RXC.
+     */
+    status = ctx->regs->SERCOM_STATUS;
+    data = (uint8_t)(ctx->regs->SERCOM_DATA);
+    ctx->regs->SERCOM_STATUS |= (status & 0x00F7);
+
+    if ((status & (1 << 2)) != 0)
+        ++ctx->stats.nr_err_overflow;
+
+    // Drop bytes with parity/framing errors
+    if ((status & 0x0003) != 0) {
+        if ((status & (1 << 0)) != 0)
+            ++ctx->stats.nr_err_parity;
+        if ((status & (1 << 1)) != 0)
+            ++ctx->stats.nr_err_frame;
+        return;
+    }
+
+    // Captured as received, whether or not anything is ready to take it
+    if (usart_cap.mask != 0)
+        usart_cap_put(ctx, data);
+
+    if (ctx->rx.ring.buf != NULL) {
+        usart_rx_ring_put(ctx, data);
+        return;
+    }
+
+    if (ctx->rx.desc == NULL) {
+        ++ctx->stats.nr_rx_dropped;
+        return;
+    }
+
+    ctx->rx.desc->buf[ctx->rx.idx++] = data;
+    ++ctx->stats.nr_rx_bytes;
+    ctx->rx.ts_idle = platform_tick_get();
+    if (ctx->rx.desc->mode == PLATFORM_USART_RX_MODE_RAW &&
+        !platform_timer_armed(&ctx->rx.idle_timer))
+        platform_timer_arm(&ctx->rx.idle_timer, ctx->cfg.idle_timeout);
+
+    compl_type = usart_rx_mode_check(ctx, data);
+    if (compl_type != PLATFORM_USART_RX_COMPL_NONE) {
+        usart_rx_abort_helper(ctx, compl_type);
+        ++ctx->stats.nr_compl_frame;
+    } else if (ctx->rx.idx >= ctx->rx.desc->max_len) {
+        // Buffer completely filled
+        usart_rx_abort_helper(ctx, PLATFORM_USART_RX_COMPL_DATA);
+        ++ctx->stats.nr_compl_full;
+    }
+    return;
+}
+
+/*
+ * Idle-timeout handling
+ * 
+ * The timer is armed by the first byte into a RAW-mode buffer, and is not
+ * pushed back by the bytes that follow; instead, on expiry, it is re-armed
+ * for whatever is left of the timeout since the last byte. This keeps the
+ * RXC handler down to a single check per byte.
+ */
+static void usart_rx_idle_expired(platform_timer_t *timer, void *arg)
+{
+    ctx_usart_t *ctx = arg;
+    platform_tick_t deadline;
+    platform_tick_t now;
+    uint32_t primask;
+
+    primask = usart_irq_save();
+    do {
+        if (ctx->rx.desc == NULL || ctx->rx.idx == 0 ||
+            ctx->rx.desc->mode != PLATFORM_USART_RX_MODE_RAW)
+            break;
+
+        deadline = ctx->rx.ts_idle + ctx->cfg.idle_timeout;
+        now = platform_tick_get();
+        if (!platform_tick_expired(now, deadline)) {
+            platform_timer_arm(timer, deadline - now);
             break;
-        } else if (ctx->rx.idx > 0) {
-            platform_tick_delta(&ts_delta, tick, &ctx->rx.ts_idle);
-            if (platform_timespec_compare(&ts_delta, &ctx->cfg.ts_idle_timeout) >= 0) {
-                // IDLE timeout
-                usart_rx_abort_helper(ctx);
-                break;
-            }
         }
+
+        // IDLE timeout
+        usart_rx_abort_helper(ctx, PLATFORM_USART_RX_COMPL_DATA);
+        ++ctx->stats.nr_compl_idle;
     } while (0);
+    usart_irq_restore(primask);
+    return;
+}
+// Check whether platform_usart_tick_handler() has anything to do
+static bool usart_txq_pending(const ctx_usart_t *ctx)
+{
+    const platform_usart_tx_msg_t *msg;
 
-    // Done
+    if (ctx->tx.q.done == ctx->tx.q.head)
+        return false;
+    msg = ctx->tx.q.msg[ctx->tx.q.done & (NR_USART_TXQ_LEN - 1)];
+    return msg->state != PLATFORM_USART_TX_MSG_QUEUED;
+}
+bool platform_usart_work_pending(void)
+{
+    return usart_txq_pending(&ctx_uart_esp) ||
+        usart_txq_pending(&ctx_uart_co2);
+}
+void platform_usart_tick_handler(platform_tick_t tick)
+{
+    (void)tick;
+
+    // Only the transmitters have submission queues
+    usart_txq_retire(&ctx_uart_esp);
+    usart_txq_retire(&ctx_uart_co2);
+}
+
+/*
+ * Run a handler, keeping track of the longest time spent in one
+ */
+static void usart_isr_timed(ctx_usart_t *ctx, void (*isr)(ctx_usart_t *ctx))
+{
+    platform_tick_t t0 = platform_tick_get();
+    uint32_t dt;
+
+    isr(ctx);
+
+    dt = (uint32_t)(platform_tick_get() - t0);
+    if (dt > ctx->stats.isr_time_peak)
+        ctx->stats.isr_time_peak = dt;
     return;
 }
-void platform_usart_tick_handler(const platform_timespec_t *tick)
+
+// Interrupt handlers; _0 is DRE, _1 is TXC and _2 is RXC for each SERCOM
+void __attribute__((used, interrupt())) SERCOM0_0_Handler(void)
+{
+    usart_isr_timed(&ctx_uart_esp, usart_isr_dre);
+}
+void __attribute__((used, interrupt())) SERCOM0_1_Handler(void)
+{
+    usart_isr_timed(&ctx_uart_esp, usart_isr_txc);
+}
+void __attribute__((used, interrupt())) SERCOM0_2_Handler(void)
+{
+    usart_isr_timed(&ctx_uart_esp, usart_isr_rxc);
+}
+void __attribute__((used, interrupt())) SERCOM1_0_Handler(void)
+{
+    usart_isr_timed(&ctx_uart_co2, usart_isr_dre);
+}
+void __attribute__((used, interrupt())) SERCOM1_1_Handler(void)
+{
+    usart_isr_timed(&ctx_uart_co2, usart_isr_txc);
+}
+void __attribute__((used, interrupt())) SERCOM1_2_Handler(void)
+{
+    usart_isr_timed(&ctx_uart_co2, usart_isr_rxc);
+}
+void __attribute__((used, interrupt())) SERCOM3_0_Handler(void)
+{
+    usart_isr_timed(&ctx_uart_pms, usart_isr_dre);
+}
+void __attribute__((used, interrupt())) SERCOM3_1_Handler(void)
+{
+    usart_isr_timed(&ctx_uart_pms, usart_isr_txc);
+}
+void __attribute__((used, interrupt())) SERCOM3_2_Handler(void)
+{
+    usart_isr_timed(&ctx_uart_pms, usart_isr_rxc);
+}
+void __attribute__((used, interrupt())) SERCOM5_0_Handler(void)
+{
+    usart_isr_timed(&ctx_uart_gps, usart_isr_dre);
+}
+void __attribute__((used, interrupt())) SERCOM5_1_Handler(void)
+{
+    usart_isr_timed(&ctx_uart_gps, usart_isr_txc);
+}
+void __attribute__((used, interrupt())) SERCOM5_2_Handler(void)
 {
-    usart_tick_handler_common(&ctx_uart_esp, tick);
-    usart_tick_handler_common(&ctx_uart_co2, tick);
-    usart_tick_handler_common(&ctx_uart_pms, tick);
-    usart_tick_handler_common(&ctx_uart_gps, tick);
+    usart_isr_timed(&ctx_uart_gps, usart_isr_rxc);
 }
 
 /// Maximum number of bytes that may be sent (or received) in one transaction
@@ -390,45 +912,188 @@ void platform_usart_tick_handler(const platform_timespec_t *tick)
 // Enqueue a buffer for transmission
 static bool usart_tx_busy(ctx_usart_t *ctx)
 {
-    return (ctx->tx.len > 0) || (ctx->tx.nr_desc > 0) ||
-        ((ctx->regs->SERCOM_INTFLAG & (1 << 0)) == 0);
+    return ctx->tx.active;
 }
-static bool usart_tx_async(ctx_usart_t *ctx,
-    const platform_usart_tx_bufdesc_t *desc,
+static bool usart_tx_valid(const platform_usart_tx_bufdesc_t *desc,
     unsigned int nr_desc)
 {
     uint16_t avail = NR_USART_CHARS_MAX;
-    unsigned int x, y;
+    unsigned int x;
 
-    if (!desc || nr_desc == 0)
-        return true;
-    else if (nr_desc > NR_USART_TX_FRAG_MAX)
+    if (nr_desc > NR_USART_TX_FRAG_MAX)
         return false;
 
-    if (usart_tx_busy(ctx))
-        return false;
-
-    for (x = 0, y = 0; x < nr_desc; ++x) {
+    for (x = 0; x < nr_desc; ++x) {
         if (desc[x].len > avail) {
             // IF the message is too long, don't enqueue.
             return false;
         }
 
         avail -= desc[x].len;
-        ++y;
     }
+    return true;
+}
+
+/*
+ * Start a transmission; must be called with interrupts masked
+ * 
+ * Returns @c false if the transmitter, or its DMAC channel, is still busy.
+ */
+static bool usart_tx_start(ctx_usart_t *ctx,
+    const platform_usart_tx_bufdesc_t *desc,
+    unsigned int nr_desc)
+{
+    if (usart_tx_busy(ctx))
+        return false;
+
+    /*
+     * With nothing but empty fragments, TXC would never come and the
+     * channel would stay busy for good.
+     */
+    while (nr_desc > 0 && (desc->buf == NULL || desc->len == 0)) {
+        ++desc;
+        --nr_desc;
+    }
+    if (nr_desc == 0)
+        return true;
 
-    // The tick will trigger the transfer
+    /*
+     * TXC is left over from the previous transmission and must be cleared
+     * first.
+     */
+    ctx->tx.active = true;
+    ctx->regs->SERCOM_INTFLAG = (1 << 1);
+
+    if (ctx->cfg.dma_ch >= 0) {
+        /*
+         * The fragment array becomes a chain of DMAC descriptors, and
+         * the whole chain goes out with no further CPU involvement.
+         * The channel is only busy until its completion is handled,
+         * which starts the next transmission.
+         */
+        if (!platform_dmac_tx_start(ctx->cfg.dma_ch,
+            &ctx->regs->SERCOM_DATA, desc, nr_desc)) {
+            ctx->tx.active = false;
+            return false;
+        }
+        for (; nr_desc > 0; --nr_desc, ++desc) {
+            if (desc->buf != NULL)
+                ctx->stats.nr_tx_bytes += desc->len;
+        }
+        return true;
+    }
+
+    /*
+     * DRE is already set whenever the transmitter is idle, so unmasking
+     * it triggers the transfer.
+     */
     ctx->tx.desc = desc;
     ctx->tx.nr_desc = nr_desc;
+    ctx->regs->SERCOM_INTENSET = (1 << 0);
     return true;
 }
+static bool usart_tx_async(ctx_usart_t *ctx,
+    const platform_usart_tx_bufdesc_t *desc,
+    unsigned int nr_desc)
+{
+    uint32_t primask;
+    bool ok;
+
+    if (!desc || nr_desc == 0)
+        return true;
+    else if (!usart_tx_valid(desc, nr_desc))
+        return false;
+
+    // The TXC handler may start a queued message at any time.
+    primask = usart_irq_save();
+    ok = usart_tx_start(ctx, desc, nr_desc);
+    usart_irq_restore(primask);
+    return ok;
+}
 static void usart_tx_abort(ctx_usart_t *ctx)
 {
+    uint32_t primask = usart_irq_save();
+    uint8_t x;
+    
+    if (ctx->cfg.dma_ch >= 0)
+        platform_dmac_abort(ctx->cfg.dma_ch);
+    ctx->regs->SERCOM_INTENCLR = (1 << 0) | (1 << 1);
     ctx->tx.nr_desc = 0;
     ctx->tx.desc = NULL;
     ctx->tx.len = 0;
     ctx->tx.buf = NULL;
+    ctx->tx.active = false;
+
+    // Everything queued is dropped; owners are told on retirement.
+    if (ctx->tx.q.cur != NULL) {
+        ctx->tx.q.cur->state = PLATFORM_USART_TX_MSG_ABORTED;
+        ctx->tx.q.cur = NULL;
+    }
+    for (x = ctx->tx.q.head; x != ctx->tx.q.tail; ++x)
+        ctx->tx.q.msg[x & (NR_USART_TXQ_LEN - 1)]->state = PLATFORM_USART_TX_MSG_ABORTED;
+    ctx->tx.q.head = ctx->tx.q.tail;
+    usart_irq_restore(primask);
+    return;
+}
+
+/*
+ * Start the next queued message, if the transmitter is idle
+ * 
+ * Called from the TXC handler, and on submission; must be called with
+ * interrupts masked.
+ */
+static void usart_txq_kick(ctx_usart_t *ctx)
+{
+    platform_usart_tx_msg_t *msg;
+
+    if (ctx->tx.q.cur != NULL && !ctx->tx.active) {
+        ctx->tx.q.cur->state = PLATFORM_USART_TX_MSG_SENT;
+        ctx->tx.q.cur = NULL;
+    }
+
+    while (!ctx->tx.active && ctx->tx.q.head != ctx->tx.q.tail) {
+        msg = ctx->tx.q.msg[ctx->tx.q.head & (NR_USART_TXQ_LEN - 1)];
+
+        // Left queued until the DMAC channel is done
+        if (!usart_tx_start(ctx, msg->desc, msg->nr_desc))
+            break;
+        ++ctx->tx.q.head;
+        if (ctx->tx.active) {
+            ctx->tx.q.cur = msg;
+        } else {
+            // Nothing but empty fragments
+            msg->state = PLATFORM_USART_TX_MSG_SENT;
+        }
+    }
+    return;
+}
+
+/*
+ * Hand finished messages back to their owners
+ * 
+ * Called from the main loop, so that completion callbacks never run in ISR
+ * context.
+ */
+static void usart_txq_retire(ctx_usart_t *ctx)
+{
+    platform_usart_tx_msg_t *msg;
+    uint8_t state;
+
+    while (ctx->tx.q.done != ctx->tx.q.head) {
+        msg = ctx->tx.q.msg[ctx->tx.q.done & (NR_USART_TXQ_LEN - 1)];
+        state = msg->state;
+        if (state == PLATFORM_USART_TX_MSG_QUEUED)
+            break;
+
+        ++ctx->tx.q.done;
+        if (state == PLATFORM_USART_TX_MSG_SENT)
+            ++ctx->tx.q.stats.nr_sent;
+
+        // The owner may resubmit from within the callback.
+        msg->state = PLATFORM_USART_TX_MSG_IDLE;
+        if (msg->compl_cb != NULL)
+            msg->compl_cb(msg, state == PLATFORM_USART_TX_MSG_SENT);
+    }
     return;
 }
 
@@ -468,24 +1133,57 @@ static bool usart_rx_busy(ctx_usart_t *ctx)
 {
     return (ctx->rx.desc) != NULL;
 }
+static bool usart_rx_valid(const platform_usart_rx_async_desc_t *desc)
+{
+    if (!desc || !desc->buf || desc->max_len == 0 ||
+        desc->max_len > NR_USART_CHARS_MAX)
+        return false;
+
+    // The RXC handler indexes sync[] by the number of bytes received so far
+    switch (desc->mode) {
+    case PLATFORM_USART_RX_MODE_HDRLEN:
+    case PLATFORM_USART_RX_MODE_FIXED:
+        return desc->mode_cfg.nr_sync >= 1 &&
+            desc->mode_cfg.nr_sync <= sizeof(desc->mode_cfg.sync);
+    default:
+        return true;
+    }
+}
 static bool usart_rx_async(ctx_usart_t *ctx, platform_usart_rx_async_desc_t *desc)
 {
+    platform_tick_t tick;
+    uint32_t primask;
+    
     // Check some items first
-    if (!desc|| !desc->buf || desc->max_len == 0 || desc->max_len > NR_USART_CHARS_MAX)
+    if (!usart_rx_valid(desc))
         return false;
 
     // Invalid descriptor
-    if ((ctx->rx.desc) != NULL)
+    if ((ctx->rx.desc) != NULL || (ctx->rx.ring.buf) != NULL)
         // Don't clobber an existing buffer
         return false;
 
     desc->compl_type = PLATFORM_USART_RX_COMPL_NONE;
     desc->compl_info.data_len = 0;
+    tick = platform_tick_get();
+    
+    // Publish the descriptor last; the RXC handler may fire at any time.
+    primask = usart_irq_save();
     ctx->rx.idx = 0;
-    platform_tick_hrcount(&ctx->rx.ts_idle);
+    ctx->rx.ts_idle = tick;
     ctx->rx.desc = desc;
+    usart_irq_restore(primask);
     return true;
 }
+static void usart_rx_abort(ctx_usart_t *ctx)
+{
+    uint32_t primask = usart_irq_save();
+    
+    // The queued descriptor is released untouched (still COMPL_NONE).
+    ctx->rx.next = NULL;
+    usart_rx_abort_helper(ctx, PLATFORM_USART_RX_COMPL_DATA);
+    usart_irq_restore(primask);
+}
 
 // API-visible items
 bool platform_usart_esp_rx_async(platform_usart_rx_async_desc_t *desc)
@@ -498,7 +1196,7 @@ bool platform_usart_esp_rx_busy(void)
 }
 void platform_usart_esp_rx_abort(void)
 {
-    usart_rx_abort_helper(&ctx_uart_esp);
+    usart_rx_abort(&ctx_uart_esp);
 }
 
 bool platform_usart_co2_rx_async(platform_usart_rx_async_desc_t *desc)
@@ -511,7 +1209,7 @@ bool platform_usart_co2_rx_busy(void)
 }
 void platform_usart_co2_rx_abort(void)
 {
-    usart_rx_abort_helper(&ctx_uart_co2);
+    usart_rx_abort(&ctx_uart_co2);
 }
 
 bool platform_usart_pms_rx_async(platform_usart_rx_async_desc_t *desc)
@@ -524,7 +1222,7 @@ bool platform_usart_pms_rx_busy(void)
 }
 void platform_usart_pms_rx_abort(void)
 {
-    usart_rx_abort_helper(&ctx_uart_pms);
+    usart_rx_abort(&ctx_uart_pms);
 }
 
 bool platform_usart_gps_rx_async(platform_usart_rx_async_desc_t *desc)
@@ -537,5 +1235,302 @@ bool platform_usart_gps_rx_busy(void)
 }
 void platform_usart_gps_rx_abort(void)
 {
-    usart_rx_abort_helper(&ctx_uart_gps);
-}
\ No newline at end of file
+    usart_rx_abort(&ctx_uart_gps);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+bool platform_usart_rx_queue(platform_usart_ch_t ch,
+    platform_usart_rx_async_desc_t *desc)
+{
+    ctx_usart_t *ctx = usart_ctx_get(ch);
+    platform_tick_t tick;
+    uint32_t primask;
+    bool ok = false;
+
+    if (!ctx || !usart_rx_valid(desc))
+        return false;
+
+    desc->compl_type = PLATFORM_USART_RX_COMPL_NONE;
+    desc->compl_info.data_len = 0;
+    tick = platform_tick_get();
+
+    primask = usart_irq_save();
+    if (ctx->rx.ring.buf == NULL && ctx->rx.next == NULL) {
+        if (ctx->rx.desc == NULL) {
+            // Nothing armed; behave as usart_rx_async()
+            ctx->rx.idx = 0;
+            ctx->rx.ts_idle = tick;
+            ctx->rx.desc = desc;
+        } else if (ctx->rx.desc != desc) {
+            ctx->rx.next = desc;
+        }
+        ok = (ctx->rx.desc == desc || ctx->rx.next == desc);
+    }
+    usart_irq_restore(primask);
+    return ok;
+}
+uint32_t platform_usart_rx_dropped(platform_usart_ch_t ch)
+{
+    ctx_usart_t *ctx = usart_ctx_get(ch);
+
+    return (ctx != NULL) ? ctx->stats.nr_rx_dropped : 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+bool platform_usart_rx_stream_start(platform_usart_ch_t ch,
+    char *buf, uint16_t size)
+{
+    ctx_usart_t *ctx = usart_ctx_get(ch);
+    uint32_t primask;
+    bool ok = false;
+
+    if (!ctx || !buf || size == 0 || size > 32768 || (size & (size - 1)) != 0)
+        return false;
+
+    primask = usart_irq_save();
+    if (ctx->rx.desc == NULL && ctx->rx.next == NULL &&
+        ctx->rx.ring.buf == NULL) {
+        ctx->rx.ring.mask = size - 1;
+        ctx->rx.ring.head = 0;
+        ctx->rx.ring.tail = 0;
+        ctx->rx.ring.buf = buf;
+        ok = true;
+    }
+    usart_irq_restore(primask);
+    return ok;
+}
+void platform_usart_rx_stream_stop(platform_usart_ch_t ch)
+{
+    ctx_usart_t *ctx = usart_ctx_get(ch);
+    uint32_t primask;
+
+    if (!ctx)
+        return;
+
+    primask = usart_irq_save();
+    ctx->rx.ring.buf = NULL;
+    ctx->rx.ring.head = 0;
+    ctx->rx.ring.tail = 0;
+    usart_irq_restore(primask);
+    return;
+}
+uint16_t platform_usart_rx_stream_peek(platform_usart_ch_t ch,
+    const char **data)
+{
+    ctx_usart_t *ctx = usart_ctx_get(ch);
+    uint16_t tail, avail, contig;
+
+    if (!ctx || !data || ctx->rx.ring.buf == NULL)
+        return 0;
+
+    tail = ctx->rx.ring.tail;
+    avail = (uint16_t)(ctx->rx.ring.head - tail);
+
+    // Pairs with the barrier in usart_rx_ring_put()
+    __DMB();
+
+    contig = (ctx->rx.ring.mask + 1) - (tail & ctx->rx.ring.mask);
+    *data = &ctx->rx.ring.buf[tail & ctx->rx.ring.mask];
+    return (avail < contig) ? avail : contig;
+}
+void platform_usart_rx_stream_consume(platform_usart_ch_t ch, uint16_t len)
+{
+    ctx_usart_t *ctx = usart_ctx_get(ch);
+    uint16_t avail;
+
+    if (!ctx || ctx->rx.ring.buf == NULL)
+        return;
+
+    avail = (uint16_t)(ctx->rx.ring.head - ctx->rx.ring.tail);
+    if (len > avail)
+        len = avail;
+
+    // Reads of the consumed bytes must complete before they are released.
+    __DMB();
+    ctx->rx.ring.tail += len;
+    return;
+}
+uint16_t platform_usart_rx_stream_read(platform_usart_ch_t ch,
+    char *buf, uint16_t max_len)
+{
+    const char *src;
+    uint16_t done = 0;
+    uint16_t len;
+
+    // At most two passes are needed: up to the end of the ring, then the rest.
+    while (done < max_len) {
+        len = platform_usart_rx_stream_peek(ch, &src);
+        if (len == 0)
+            break;
+        if (len > max_len - done)
+            len = max_len - done;
+
+        memcpy(&buf[done], src, len);
+        platform_usart_rx_stream_consume(ch, len);
+        done += len;
+    }
+    return done;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+void platform_usart_capture_start(uint8_t ch_mask)
+{
+    uint32_t primask = usart_irq_save();
+
+    usart_cap.head = 0;
+    usart_cap.tail = 0;
+    usart_cap.nr_dropped = 0;
+    usart_cap.lost = false;
+    usart_cap.mask = ch_mask & ((1u << PLATFORM_USART_NR_CH) - 1);
+    usart_irq_restore(primask);
+    return;
+}
+void platform_usart_capture_stop(void)
+{
+    usart_cap.mask = 0;
+    return;
+}
+unsigned int platform_usart_capture_read(platform_usart_cap_t *buf,
+    unsigned int max_nr)
+{
+    uint16_t tail = usart_cap.tail;
+    uint16_t avail = (uint16_t)(usart_cap.head - tail);
+    uint32_t now, ent, age;
+    unsigned int x;
+
+    // Pairs with the barrier in usart_cap_put()
+    __DMB();
+
+    /*
+     * Stamps are unwrapped against the current time; the ring cannot hold
+     * anything nearly as old as 2^21 units (about three minutes).
+     */
+    now = (uint32_t)(platform_tick_get() >> PLATFORM_USART_CAP_TIME_SHIFT);
+    if (avail > max_nr)
+        avail = (uint16_t)max_nr;
+    for (x = 0; x < avail; ++x) {
+        ent = usart_cap.ent[(tail + x) & (NR_USART_CAP_LEN - 1)];
+        age = (now - ent) & ((1u << USART_CAP_TIME_BITS) - 1);
+        buf[x].when = now - age;
+        buf[x].ch = (uint8_t)(ent >> 30);
+        buf[x].data = (uint8_t)(ent >> 22);
+        buf[x].lost = (ent & (1u << 21)) != 0;
+    }
+
+    // Reads of the consumed entries must complete before they are released.
+    __DMB();
+    usart_cap.tail = tail + avail;
+    return avail;
+}
+uint32_t platform_usart_capture_dropped(void)
+{
+    return usart_cap.nr_dropped;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+bool platform_usart_tx_submit(platform_usart_ch_t ch,
+    platform_usart_tx_msg_t *msg)
+{
+    ctx_usart_t *ctx = usart_ctx_get(ch);
+    uint32_t primask;
+    uint8_t depth;
+
+    // Only meaningful with the transmitter enabled (CTRLB.TXEN)
+    if (!ctx || (ctx->regs->SERCOM_CTRLB & (1 << 16)) == 0 || !msg)
+        return false;
+
+    if (msg->state != PLATFORM_USART_TX_MSG_IDLE ||
+        (msg->nr_desc > 0 && !msg->desc) ||
+        !usart_tx_valid(msg->desc, msg->nr_desc) ||
+        (uint8_t)(ctx->tx.q.tail - ctx->tx.q.done) >= NR_USART_TXQ_LEN) {
+        ++ctx->tx.q.stats.nr_rejected;
+        return false;
+    }
+
+    msg->state = PLATFORM_USART_TX_MSG_QUEUED;
+
+    primask = usart_irq_save();
+    ctx->tx.q.msg[ctx->tx.q.tail & (NR_USART_TXQ_LEN - 1)] = msg;
+    ++ctx->tx.q.tail;
+    usart_txq_kick(ctx);
+    usart_irq_restore(primask);
+
+    ++ctx->tx.q.stats.nr_enqueued;
+    depth = (uint8_t)(ctx->tx.q.tail - ctx->tx.q.done);
+    if (depth > ctx->tx.q.stats.depth_peak)
+        ctx->tx.q.stats.depth_peak = depth;
+    return true;
+}
+void platform_usart_txq_stats(platform_usart_ch_t ch,
+    platform_usart_txq_stats_t *stats)
+{
+    ctx_usart_t *ctx = usart_ctx_get(ch);
+
+    if (!ctx || !stats)
+        return;
+
+    *stats = ctx->tx.q.stats;
+    stats->depth = (uint8_t)(ctx->tx.q.tail - ctx->tx.q.done);
+    return;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+void platform_usart_stats(platform_usart_ch_t ch,
+    platform_usart_stats_t *stats, bool reset)
+{
+    ctx_usart_t *ctx = usart_ctx_get(ch);
+    uint32_t primask;
+
+    if (!ctx || !stats)
+        return;
+
+    primask = usart_irq_save();
+    *stats = ctx->stats;
+    if (reset)
+        memset(&ctx->stats, 0, sizeof(ctx->stats));
+    usart_irq_restore(primask);
+    return;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+bool platform_usart_set_baud(platform_usart_ch_t ch, uint32_t baud)
+{
+    ctx_usart_t *ctx = usart_ctx_get(ch);
+    uint16_t baudreg;
+    uint8_t sampr;
+    uint32_t primask;
+    bool ok = false;
+
+    if (!ctx || !usart_baud_calc(ctx->cfg.fref, baud, &baudreg, &sampr))
+        return false;
+
+    primask = usart_irq_save();
+    do {
+        // Don't pull the rug from under a frame being shifted out
+        if (ctx->tx.active || ctx->tx.q.head != ctx->tx.q.tail)
+            break;
+
+        ctx->regs->SERCOM_CTRLA &= ~(1 << 1);
+        while ((ctx->regs->SERCOM_SYNCBUSY & (1 << 1)) != 0) asm("nop");
+
+        ok = usart_baud_apply(ctx, baud);
+
+        ctx->regs->SERCOM_CTRLA |= (1 << 1);
+        while ((ctx->regs->SERCOM_SYNCBUSY & (1 << 1)) != 0) asm("nop");
+    } while (0);
+    usart_irq_restore(primask);
+    return ok;
+}
+
+uint32_t platform_usart_get_baud(platform_usart_ch_t ch)
+{
+    ctx_usart_t *ctx = usart_ctx_get(ch);
+
+    return (ctx != NULL) ? ctx->cfg.baud : 0;
+}
@@ -0,0 +1,144 @@
+/**
+ * @file pms.c
+ * @brief Streaming frame decoder for the PMS5003T
+ */
+
+/*
+ * Frame layout (all words big-endian):
+ *
+ * -- 0x42 0x4D
+ * -- Length of what follows, always 2 * 13 + 2 = 28
+ * -- Data 1..6:   PM1.0/2.5/10, CF=1, then atmospheric
+ * -- Data 7..10:  Particle counts beyond 0.3/0.5/1.0/2.5 um
+ * -- Data 11..12: Temperature and humidity, times 10 (PMS5003T only)
+ * -- Data 13:     Firmware version (high byte) and error code (low byte)
+ * -- Checksum:    Sum of all the bytes before it
+ *
+ * On a bad frame, the bytes after its first are searched for another
+ * header, so that a false header in the middle of a frame costs at most
+ * that frame.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "pms.h"
+
+#define PMS_START_1	0x42
+#define PMS_START_2	0x4D
+#define PMS_BODY_LEN	(PMS_FRAME_LEN - 4)
+
+/////////////////////////////////////////////////////////////////////////////
+
+static inline uint16_t pms_word(const uint8_t *buf, unsigned int ofs)
+{
+	return (uint16_t)((buf[ofs] << 8) | buf[ofs + 1]);
+}
+
+static void pms_decode(const uint8_t *buf, pms_data_t *out)
+{
+	out->pm1_0_cf1 = pms_word(buf, 4);
+	out->pm2_5_cf1 = pms_word(buf, 6);
+	out->pm10_cf1  = pms_word(buf, 8);
+	out->pm1_0_atm = pms_word(buf, 10);
+	out->pm2_5_atm = pms_word(buf, 12);
+	out->pm10_atm  = pms_word(buf, 14);
+	out->nr_0_3    = pms_word(buf, 16);
+	out->nr_0_5    = pms_word(buf, 18);
+	out->nr_1_0    = pms_word(buf, 20);
+	out->nr_2_5    = pms_word(buf, 22);
+	out->temp_dc   = (int16_t)pms_word(buf, 24);
+	out->rh_pm     = pms_word(buf, 26);
+	out->version   = buf[28];
+	out->error     = buf[29];
+}
+
+static bool pms_frame_ok(const uint8_t *buf)
+{
+	uint16_t sum = 0;
+	unsigned int x;
+
+	for (x = 0; x < PMS_FRAME_LEN - 2; ++x)
+		sum += buf[x];
+	return sum == pms_word(buf, PMS_FRAME_LEN - 2);
+}
+
+// Check the first @p n bytes buffered; returns false if they cannot start a frame
+static bool pms_check(const uint8_t *buf, uint8_t n)
+{
+	switch (n) {
+	case 1:
+		return buf[0] == PMS_START_1;
+	case 2:
+		return buf[1] == PMS_START_2;
+	case 4:
+		return pms_word(buf, 2) == PMS_BODY_LEN;
+	case PMS_FRAME_LEN:
+		return pms_frame_ok(buf);
+	default:
+		return true;
+	}
+}
+
+/*
+ * Drop the first byte buffered, and everything up to the next byte that may
+ * start a header
+ */
+static void pms_resync(pms_decoder_t *d)
+{
+	uint8_t x;
+
+	for (x = 1; x < d->idx; ++x) {
+		if (d->buf[x] == PMS_START_1)
+			break;
+	}
+	d->idx -= x;
+	memmove(d->buf, &d->buf[x], d->idx);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+void pms_init(pms_decoder_t *d)
+{
+	memset(d, 0, sizeof(*d));
+}
+
+unsigned int pms_feed(pms_decoder_t *d, const uint8_t *buf, size_t len,
+	pms_data_t *out)
+{
+	unsigned int nr_frames = 0;
+	uint8_t n;
+
+	while (len-- > 0) {
+		d->buf[d->idx++] = *buf++;
+
+		/*
+		 * Only the newest byte needs checking, unless a resync shifted
+		 * bytes down; those then have to be checked again from the start.
+		 */
+		for (n = d->idx; n <= d->idx; ) {
+			if (pms_check(d->buf, n)) {
+				++n;
+				continue;
+			}
+			if (n > 2)
+				++d->nr_bad;
+			if (!d->hunting)
+				++d->nr_resync;
+			d->hunting = true;
+			pms_resync(d);
+			n = 1;
+		}
+
+		if (d->idx == PMS_FRAME_LEN) {
+			d->hunting = false;
+			++d->nr_good;
+			++nr_frames;
+			if (out != NULL)
+				pms_decode(d->buf, out);
+			d->idx = 0;
+		}
+	}
+	return nr_frames;
+}
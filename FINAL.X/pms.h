@@ -0,0 +1,91 @@
+/**
+ * @file pms.h
+ * @brief Streaming frame decoder for the PMS5003T
+ */
+
+#if !defined(PMS_H_)
+#define PMS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// C linkage should be maintained
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+
+/// Size of a whole frame, including header, length word and checksum
+#define PMS_FRAME_LEN	32
+
+/// One decoded frame
+typedef struct pms_data_type {
+	/// PM concentrations in ug/m^3, CF=1 (factory calibration)
+	uint16_t	pm1_0_cf1;
+	uint16_t	pm2_5_cf1;
+	uint16_t	pm10_cf1;
+
+	/// PM concentrations in ug/m^3, atmospheric environment
+	uint16_t	pm1_0_atm;
+	uint16_t	pm2_5_atm;
+	uint16_t	pm10_atm;
+
+	/// Particles beyond 0.3/0.5/1.0/2.5 um, per 0.1 L of air
+	uint16_t	nr_0_3;
+	uint16_t	nr_0_5;
+	uint16_t	nr_1_0;
+	uint16_t	nr_2_5;
+
+	/// Temperature, in 0.1 degrees Celsius
+	int16_t		temp_dc;
+
+	/// Relative humidity, in 0.1 %
+	uint16_t	rh_pm;
+
+	uint8_t		version;
+	uint8_t		error;
+} pms_data_t;
+
+/// Decoder state; treat as opaque, except for the counters
+typedef struct pms_decoder_type {
+	uint8_t		buf[PMS_FRAME_LEN];
+	uint8_t		idx;
+
+	/// Whether bytes are being skipped in search of a header
+	bool		hunting;
+
+	/// Frames with a valid length and checksum
+	uint32_t	nr_good;
+
+	/// Frames dropped due to a bad length word or checksum
+	uint32_t	nr_bad;
+
+	/// Times bytes had to be skipped to find a header
+	uint32_t	nr_resync;
+} pms_decoder_t;
+
+/// Reset a decoder, including its counters
+void pms_init(pms_decoder_t *d);
+
+/**
+ * Feed bytes into the decoder
+ *
+ * Frames may be split across calls at any point. Reception may start
+ * anywhere within a frame; the decoder hunts for the next header, also
+ * within the bytes of a frame that turned out to be bad.
+ *
+ * @param[out]	out	Receives the last good frame within @p buf, if any
+ *
+ * @return	Number of good frames completed within @p buf
+ */
+unsigned int pms_feed(pms_decoder_t *d, const uint8_t *buf, size_t len,
+	pms_data_t *out);
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifdef __cplusplus
+}
+#endif	// __cplusplus
+#endif	// !defined(PMS_H_)
@@ -0,0 +1,612 @@
+/**
+ * @file telem.c
+ * @brief Binary telemetry records for the ESP8266 downlink
+ */
+
+/*
+ * Record layout (v2), little-endian:
+ *
+ * --  0  version		u8
+ * --  1  flags			u8
+ * --  2  seq			u16
+ * --  4  time_ms		u32
+ * --  8  co2_ppm		u16
+ * -- 10  pm1_0, pm2_5, pm10	u16 x 3
+ * -- 16  temp_dc		i16
+ * -- 18  rh_pm			u16
+ * -- 20  lat_e7, lon_e7	i32 x 2
+ * -- 28  alt_mm		i32
+ * -- 32  gps_time_ms		u32
+ * -- 36  speed_cmps		u16
+ * -- 38  nr_sats, quality	u8 x 2
+ * -- 40  aqi			u16
+ * -- 42  pm2_5_mean_d		u16
+ * -- 44  pm10_mean		u16
+ * -- 46  co2_mean		u16
+ *
+ * The CRC follows, big-endian. COBS replaces every zero byte with the
+ * distance to the next one, so zero only ever appears as the delimiter and
+ * the ground side can pick up at any frame boundary. Records are well under
+ * 254 bytes, so the overhead is a single byte.
+ *
+ * Decoders drop records of any version other than their own.
+ *
+ * Other messages are framed the same way, with a type byte of
+ * TELEM_TYPE_MSG or above in place of the version; decoders hand them back
+ * as they are. Their layouts, little-endian:
+ *
+ * TELEM_TYPE_STATS, the USART and idle counters:
+ *
+ * --  0  nr_ch			u8
+ * --  1  the counters of platform_usart_stats_t, in order, for each channel
+ *				u32 x 11 x nr_ch
+ * --  .  nr_ticks_total	u64
+ * --  .  nr_ticks_asleep	u64
+ * --  .  nr_sleeps		u32
+ * --  .  nr_restarts		u32
+ *
+ * Raw messages, of a type of TELEM_TYPE_RAW or above, are sent straight out
+ * of memory rather than copied and encoded: a header frame, holding the type
+ * and the u16 length of the message, is followed by the message as it is,
+ * zeros and all, then by its CRC (big-endian) and a delimiter. Decoders take
+ * the bytes following the header as they come, by count; one that does not
+ * know about raw messages sees a bad frame, and picks up again at that last
+ * delimiter. Their layouts:
+ *
+ * TELEM_TYPE_EPOCH, the epoch record of fuse.h: the fuse_hdr_t, then the
+ * sample of every source as laid out in memory by the target.
+ *
+ * TELEM_TYPE_LOGS, a batch of the deferred log, as in platform.h:
+ *
+ * --  0  nr_words		u16
+ * --  2  nr_dropped		u16
+ * --  4  words			u32 x nr_words
+ *
+ * Delta records share the first four bytes, with TELEM_F_DELTA set in the
+ * flags, followed by one zig-zag varint per field (in the order above, from
+ * time_ms on) holding its difference from the previous record, modulo 2^32.
+ * A varint is 7 bits per byte, low bits first, with the top bit set on all
+ * bytes but the last; zig-zag maps 0, -1, 1, -2, ... onto 0, 1, 2, 3, ...
+ * so small differences of either sign take a single byte. The full seq lets
+ * the decoder tell whether it holds the record a delta refers to.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "telem.h"
+
+#define TELEM_NR_FIELDS	18
+
+// Largest delta record: header, worst-case varints and CRC
+#define TELEM_DELTA_MAX	(4 + 5 * TELEM_NR_FIELDS + 2)
+
+/////////////////////////////////////////////////////////////////////////////
+
+uint16_t telem_crc16_update(uint16_t crc, const void *data, size_t len)
+{
+	const uint8_t *buf = data;
+	static const uint16_t tbl[16] = {
+		0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+		0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+	};
+
+	while (len-- > 0) {
+		crc = (uint16_t)(crc << 4) ^ tbl[(crc >> 12) ^ (*buf >> 4)];
+		crc = (uint16_t)(crc << 4) ^ tbl[(crc >> 12) ^ (*buf & 0x0F)];
+		++buf;
+	}
+	return crc;
+}
+
+static inline uint16_t telem_crc16(const uint8_t *buf, size_t len)
+{
+	return telem_crc16_update(TELEM_CRC16_INIT, buf, len);
+}
+
+static inline uint8_t *telem_put16(uint8_t *p, uint16_t v)
+{
+	p[0] = (uint8_t)v;
+	p[1] = (uint8_t)(v >> 8);
+	return p + 2;
+}
+
+static inline uint8_t *telem_put32(uint8_t *p, uint32_t v)
+{
+	p[0] = (uint8_t)v;
+	p[1] = (uint8_t)(v >> 8);
+	p[2] = (uint8_t)(v >> 16);
+	p[3] = (uint8_t)(v >> 24);
+	return p + 4;
+}
+
+static inline uint16_t telem_get16(const uint8_t *p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t telem_get32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+		((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Fields of a record that deltas are taken of, as 32-bit values
+static void telem_fields_get(const telem_record_t *rec, uint32_t *v)
+{
+	v[0] = rec->time_ms;
+	v[1] = rec->co2_ppm;
+	v[2] = rec->pm1_0;
+	v[3] = rec->pm2_5;
+	v[4] = rec->pm10;
+	v[5] = (uint32_t)(int32_t)rec->temp_dc;
+	v[6] = rec->rh_pm;
+	v[7] = (uint32_t)rec->lat_e7;
+	v[8] = (uint32_t)rec->lon_e7;
+	v[9] = (uint32_t)rec->alt_mm;
+	v[10] = rec->gps_time_ms;
+	v[11] = rec->speed_cmps;
+	v[12] = rec->nr_sats;
+	v[13] = rec->quality;
+	v[14] = rec->aqi;
+	v[15] = rec->pm2_5_mean_d;
+	v[16] = rec->pm10_mean;
+	v[17] = rec->co2_mean;
+}
+
+static void telem_fields_set(telem_record_t *rec, const uint32_t *v)
+{
+	rec->time_ms = v[0];
+	rec->co2_ppm = (uint16_t)v[1];
+	rec->pm1_0 = (uint16_t)v[2];
+	rec->pm2_5 = (uint16_t)v[3];
+	rec->pm10 = (uint16_t)v[4];
+	rec->temp_dc = (int16_t)v[5];
+	rec->rh_pm = (uint16_t)v[6];
+	rec->lat_e7 = (int32_t)v[7];
+	rec->lon_e7 = (int32_t)v[8];
+	rec->alt_mm = (int32_t)v[9];
+	rec->gps_time_ms = v[10];
+	rec->speed_cmps = (uint16_t)v[11];
+	rec->nr_sats = (uint8_t)v[12];
+	rec->quality = (uint8_t)v[13];
+	rec->aqi = (uint16_t)v[14];
+	rec->pm2_5_mean_d = (uint16_t)v[15];
+	rec->pm10_mean = (uint16_t)v[16];
+	rec->co2_mean = (uint16_t)v[17];
+}
+
+static uint8_t *telem_put_varint(uint8_t *p, uint32_t v)
+{
+	while (v >= 0x80) {
+		*p++ = (uint8_t)(v | 0x80);
+		v >>= 7;
+	}
+	*p++ = (uint8_t)v;
+	return p;
+}
+
+// Returns NULL if the varint runs past @p end, or is longer than 5 bytes
+static const uint8_t *telem_get_varint(const uint8_t *p, const uint8_t *end,
+	uint32_t *v)
+{
+	unsigned int shift;
+
+	*v = 0;
+	for (shift = 0; shift < 35 && p < end; shift += 7) {
+		*v |= (uint32_t)(*p & 0x7F) << shift;
+		if ((*p++ & 0x80) == 0)
+			return p;
+	}
+	return NULL;
+}
+
+static inline uint32_t telem_zigzag(uint32_t delta)
+{
+	return (delta << 1) ^ (uint32_t)-(delta >> 31);
+}
+
+static inline uint32_t telem_unzigzag(uint32_t v)
+{
+	return (v >> 1) ^ (uint32_t)-(v & 1);
+}
+
+// COBS encoder, fed a byte at a time
+typedef struct telem_cobs_type {
+	uint8_t		*dst;
+
+	/// Code byte of the block being filled, and where its next byte goes
+	uint8_t		*code;
+	uint8_t		*p;
+} telem_cobs_t;
+
+static void telem_cobs_begin(telem_cobs_t *c, uint8_t *dst)
+{
+	c->dst = dst;
+	c->code = dst;
+	c->p = dst + 1;
+	*c->code = 1;
+}
+
+static void telem_cobs_put(telem_cobs_t *c, uint8_t b)
+{
+	// A full block ends without a zero; the next one is only opened once
+	// there is something to put in it, so none stays empty at the end
+	if (*c->code == 0xFF) {
+		c->code = c->p++;
+		*c->code = 1;
+	}
+	if (b == 0) {
+		c->code = c->p++;
+		*c->code = 1;
+	} else {
+		*c->p++ = b;
+		++*c->code;
+	}
+}
+
+// Returns the encoded size, excluding any delimiter
+static inline size_t telem_cobs_end(const telem_cobs_t *c)
+{
+	return (size_t)(c->p - c->dst);
+}
+
+size_t telem_cobs_encode(const uint8_t *src, size_t len, uint8_t *dst)
+{
+	telem_cobs_t c;
+
+	telem_cobs_begin(&c, dst);
+	while (len-- > 0)
+		telem_cobs_put(&c, *src++);
+	return telem_cobs_end(&c);
+}
+
+size_t telem_cobs_decode(uint8_t *buf, size_t len)
+{
+	size_t in = 0, out = 0;
+	uint8_t code, x;
+
+	while (in < len) {
+		code = buf[in++];
+		if (code == 0 || in + code - 1 > len)
+			return 0;
+		for (x = 1; x < code; ++x) {
+			if (buf[in] == 0)
+				return 0;
+			buf[out++] = buf[in++];
+		}
+		if (code != 0xFF && in < len)
+			buf[out++] = 0;
+	}
+	return out;
+}
+
+/*
+ * Append the CRC to the @p len bytes of @p raw (which must have room for
+ * it), then COBS-encode them into a frame at @p buf
+ */
+static size_t telem_frame(uint8_t *raw, size_t len, uint8_t *buf)
+{
+	uint16_t crc = telem_crc16(raw, len);
+
+	raw[len++] = (uint8_t)(crc >> 8);
+	raw[len++] = (uint8_t)crc;
+	len = telem_cobs_encode(raw, len, buf);
+	buf[len++] = 0;
+	return len;
+}
+
+/*
+ * Check the CRC of the @p len bytes of a COBS-decoded frame
+ *
+ * Returns their size without the CRC, or zero if it does not match.
+ */
+static size_t telem_check_crc(const uint8_t *raw, size_t len)
+{
+	if (len < 1 + 2 ||
+	    telem_crc16(raw, len - 2) != ((raw[len - 2] << 8) | raw[len - 1]))
+		return 0;
+	return len - 2;
+}
+
+// Apply a delta record of @p len bytes (CRC excluded) onto d->prev
+static bool telem_decode_delta(telem_decoder_t *d, const uint8_t *raw,
+	size_t len, telem_record_t *rec)
+{
+	const uint8_t *p = raw + 4, *end = raw + len;
+	uint32_t v[TELEM_NR_FIELDS], delta;
+	unsigned int x;
+
+	if (!d->have_prev || telem_get16(raw + 2) != (uint16_t)(d->prev.seq + 1)) {
+		++d->nr_lost;
+		return false;
+	}
+	telem_fields_get(&d->prev, v);
+	for (x = 0; x < TELEM_NR_FIELDS; ++x) {
+		p = telem_get_varint(p, end, &delta);
+		if (p == NULL) {
+			++d->nr_bad;
+			return false;
+		}
+		v[x] += telem_unzigzag(delta);
+	}
+	if (p != end) {
+		++d->nr_bad;
+		return false;
+	}
+	*rec = d->prev;
+	telem_fields_set(rec, v);
+	rec->flags = raw[1] & ~TELEM_F_DELTA;
+	rec->seq = telem_get16(raw + 2);
+	return true;
+}
+
+// Decode a record of @p len bytes of @p raw, CRC checked and excluded
+static bool telem_decode_record(telem_decoder_t *d, const uint8_t *raw,
+	size_t len, telem_record_t *rec)
+{
+	const uint8_t *p = raw;
+
+	if (len < 4) {
+		++d->nr_bad;
+		return false;
+	}
+
+	if ((raw[1] & TELEM_F_DELTA) != 0) {
+		if (!telem_decode_delta(d, raw, len, rec))
+			return false;
+		d->prev = *rec;
+		++d->nr_good;
+		return true;
+	}
+	if (len != TELEM_RECORD_LEN) {
+		++d->nr_bad;
+		return false;
+	}
+
+	p += 1;
+	rec->flags = *p++;
+	rec->seq = telem_get16(p);
+	rec->time_ms = telem_get32(p + 2);
+	rec->co2_ppm = telem_get16(p + 6);
+	rec->pm1_0 = telem_get16(p + 8);
+	rec->pm2_5 = telem_get16(p + 10);
+	rec->pm10 = telem_get16(p + 12);
+	rec->temp_dc = (int16_t)telem_get16(p + 14);
+	rec->rh_pm = telem_get16(p + 16);
+	rec->lat_e7 = (int32_t)telem_get32(p + 18);
+	rec->lon_e7 = (int32_t)telem_get32(p + 22);
+	rec->alt_mm = (int32_t)telem_get32(p + 26);
+	rec->gps_time_ms = telem_get32(p + 30);
+	rec->speed_cmps = telem_get16(p + 34);
+	rec->nr_sats = p[36];
+	rec->quality = p[37];
+	rec->aqi = telem_get16(p + 38);
+	rec->pm2_5_mean_d = telem_get16(p + 40);
+	rec->pm10_mean = telem_get16(p + 42);
+	rec->co2_mean = telem_get16(p + 44);
+	d->prev = *rec;
+	d->have_prev = true;
+	++d->nr_good;
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+size_t telem_encode(const telem_record_t *rec, uint8_t *buf)
+{
+	uint8_t raw[TELEM_RECORD_LEN + 2];
+	uint8_t *p = raw;
+
+	*p++ = TELEM_VERSION;
+	*p++ = rec->flags;
+	p = telem_put16(p, rec->seq);
+	p = telem_put32(p, rec->time_ms);
+	p = telem_put16(p, rec->co2_ppm);
+	p = telem_put16(p, rec->pm1_0);
+	p = telem_put16(p, rec->pm2_5);
+	p = telem_put16(p, rec->pm10);
+	p = telem_put16(p, (uint16_t)rec->temp_dc);
+	p = telem_put16(p, rec->rh_pm);
+	p = telem_put32(p, (uint32_t)rec->lat_e7);
+	p = telem_put32(p, (uint32_t)rec->lon_e7);
+	p = telem_put32(p, (uint32_t)rec->alt_mm);
+	p = telem_put32(p, rec->gps_time_ms);
+	p = telem_put16(p, rec->speed_cmps);
+	*p++ = rec->nr_sats;
+	*p++ = rec->quality;
+	p = telem_put16(p, rec->aqi);
+	p = telem_put16(p, rec->pm2_5_mean_d);
+	p = telem_put16(p, rec->pm10_mean);
+	p = telem_put16(p, rec->co2_mean);
+
+	return telem_frame(raw, TELEM_RECORD_LEN, buf);
+}
+
+void telem_encoder_init(telem_encoder_t *e, uint8_t key_interval)
+{
+	memset(e, 0, sizeof(*e));
+	e->key_interval = key_interval;
+}
+
+void telem_encoder_resync(telem_encoder_t *e)
+{
+	e->since_key = 0;
+}
+
+size_t telem_encode_next(telem_encoder_t *e, const telem_record_t *rec,
+	uint8_t *buf)
+{
+	uint8_t raw[TELEM_DELTA_MAX];
+	uint8_t *p = raw;
+	uint32_t cur[TELEM_NR_FIELDS], prev[TELEM_NR_FIELDS];
+	unsigned int x;
+	size_t len;
+
+	if (e->since_key != 0) {
+		telem_fields_get(rec, cur);
+		telem_fields_get(&e->prev, prev);
+		*p++ = TELEM_VERSION;
+		*p++ = rec->flags | TELEM_F_DELTA;
+		p = telem_put16(p, rec->seq);
+		for (x = 0; x < TELEM_NR_FIELDS; ++x)
+			p = telem_put_varint(p, telem_zigzag(cur[x] - prev[x]));
+	}
+
+	// Fall back onto a keyframe if a delta would not be any shorter
+	if (e->since_key == 0 || p - raw >= TELEM_RECORD_LEN) {
+		len = telem_encode(rec, buf);
+		e->since_key = 0;
+		++e->nr_key;
+	} else {
+		len = telem_frame(raw, (size_t)(p - raw), buf);
+		++e->nr_delta;
+	}
+	if (++e->since_key >= e->key_interval)
+		e->since_key = 0;
+	e->prev = *rec;
+	e->nr_bytes += len;
+	return len;
+}
+
+size_t telem_encode_msg(uint8_t type, const void *data, size_t len,
+	uint8_t *buf)
+{
+	const uint8_t *p = data;
+	telem_cobs_t c;
+	uint16_t crc;
+	size_t x;
+
+	crc = telem_crc16_update(telem_crc16(&type, 1), p, len);
+	telem_cobs_begin(&c, buf);
+	telem_cobs_put(&c, type);
+	for (x = 0; x < len; ++x)
+		telem_cobs_put(&c, p[x]);
+	telem_cobs_put(&c, (uint8_t)(crc >> 8));
+	telem_cobs_put(&c, (uint8_t)crc);
+	len = telem_cobs_end(&c);
+	buf[len++] = 0;
+	return len;
+}
+
+size_t telem_encode_raw(uint8_t type, uint16_t len, uint8_t *buf)
+{
+	uint8_t raw[2];
+
+	telem_put16(raw, len);
+	return telem_encode_msg(type, raw, sizeof(raw), buf);
+}
+
+size_t telem_encode_raw_end(uint16_t crc, uint8_t *buf)
+{
+	buf[0] = (uint8_t)(crc >> 8);
+	buf[1] = (uint8_t)crc;
+	buf[2] = 0;
+	return TELEM_RAW_END_LEN;
+}
+
+void telem_decoder_init(telem_decoder_t *d)
+{
+	memset(d, 0, sizeof(*d));
+}
+
+bool telem_decode(telem_decoder_t *d, const uint8_t *frame, size_t len,
+	telem_record_t *rec)
+{
+	uint8_t raw[TELEM_FRAME_MAX];
+
+	if (len > sizeof(raw)) {
+		++d->nr_bad;
+		return false;
+	}
+	memcpy(raw, frame, len);
+	len = telem_check_crc(raw, telem_cobs_decode(raw, len));
+	if (len == 0) {
+		++d->nr_bad;
+		return false;
+	}
+	if (raw[0] != TELEM_VERSION) {
+		++d->nr_version;
+		return false;
+	}
+	return telem_decode_record(d, raw, len, rec);
+}
+
+telem_feed_t telem_feed(telem_decoder_t *d, uint8_t c, telem_record_t *rec,
+	telem_msg_t *msg)
+{
+	telem_feed_t got = TELEM_FEED_NONE;
+	size_t len;
+
+	// The body of a raw message, then its CRC, then the delimiter
+	if (d->raw) {
+		if (d->len < d->raw_len + 2u) {
+			d->buf[d->len++] = c;
+			return TELEM_FEED_NONE;
+		}
+		d->raw = false;
+		len = d->raw_len;
+		if (c == 0 && telem_crc16(d->buf, len) ==
+		    ((d->buf[len] << 8) | d->buf[len + 1])) {
+			msg->type = d->raw_type;
+			msg->data = d->buf;
+			msg->len = len;
+			++d->nr_msg;
+			got = TELEM_FEED_MSG;
+		} else {
+			// Bytes were lost; c may well be part of the next frame
+			++d->nr_bad;
+		}
+		d->len = 0;
+		if (c == 0)
+			return got;
+	}
+
+	if (c != 0) {
+		if (d->len < sizeof(d->buf))
+			d->buf[d->len++] = c;
+		else
+			d->overflow = true;
+		return TELEM_FEED_NONE;
+	}
+
+	// Back-to-back delimiters are just idle fill
+	if (d->overflow) {
+		++d->nr_bad;
+	} else if (d->len > 0) {
+		len = telem_check_crc(d->buf, telem_cobs_decode(d->buf, d->len));
+		if (len == 0) {
+			++d->nr_bad;
+		} else if (d->buf[0] >= TELEM_TYPE_RAW &&
+			   d->buf[0] < TELEM_TYPE_CAP) {
+			if (len == 3 && telem_get16(&d->buf[1]) <= TELEM_MSG_MAX) {
+				d->raw = true;
+				d->raw_type = d->buf[0];
+				d->raw_len = telem_get16(&d->buf[1]);
+			} else {
+				++d->nr_bad;
+			}
+		} else if (d->buf[0] >= TELEM_TYPE_MSG) {
+			msg->type = d->buf[0];
+			msg->data = &d->buf[1];
+			msg->len = len - 1;
+			++d->nr_msg;
+			got = TELEM_FEED_MSG;
+		} else if (d->buf[0] != TELEM_VERSION) {
+			++d->nr_version;
+		} else if (telem_decode_record(d, d->buf, len, rec)) {
+			got = TELEM_FEED_RECORD;
+		}
+	}
+	d->len = 0;
+	d->overflow = false;
+	return got;
+}
+
+bool telem_feed_byte(telem_decoder_t *d, uint8_t c, telem_record_t *rec)
+{
+	telem_msg_t msg;
+
+	return telem_feed(d, c, rec, &msg) == TELEM_FEED_RECORD;
+}
@@ -0,0 +1,345 @@
+/**
+ * @file telem.h
+ * @brief Binary telemetry records for the ESP8266 downlink
+ *
+ * This codec has no dependency on the target; ground software builds the
+ * very same telem.c to decode what the CanSat sends.
+ */
+
+#if !defined(TELEM_H_)
+#define TELEM_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// C linkage should be maintained
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+
+/// Format version, sent as the first byte of every record
+#define TELEM_VERSION	2
+
+/// Size of an encoded record, before CRC and framing
+#define TELEM_RECORD_LEN	48
+
+/// Largest frame on the wire: record, CRC, COBS overhead and delimiter
+#define TELEM_FRAME_MAX	(TELEM_RECORD_LEN + 2 + 1 + 1)
+
+/**
+ * @name Frame types
+ *
+ * The first byte of every frame says what it holds: telemetry records have
+ * their version there, capture frames (see cap.h) TELEM_TYPE_CAP and above,
+ * and other messages one of these. Their layouts are given in telem.c.
+ * @{
+ */
+#define TELEM_TYPE_MSG		0x10	///< Lowest type that is not a version
+#define TELEM_TYPE_RAW		0x80	///< Lowest type of a raw message
+#define TELEM_TYPE_CAP		0xC0	///< Lowest type of a capture frame
+
+#define TELEM_TYPE_STATS	0x10	///< USART and idle counters
+#define TELEM_TYPE_EPOCH	0x80	///< Epoch record (raw)
+#define TELEM_TYPE_LOGS		0x81	///< Deferred log batch (raw)
+/** @} */
+
+/// Largest message, before its type, CRC and framing
+#define TELEM_MSG_MAX	2048
+
+/// Largest frame holding a message of @p len bytes, delimiter included
+#define TELEM_MSG_FRAME_LEN(len) \
+	((len) + 1 + 2 + ((len) + 3) / 254 + 1 + 1)
+
+/// Header frame of a raw message, and its trailer
+#define TELEM_RAW_HDR_LEN	TELEM_MSG_FRAME_LEN(2)
+#define TELEM_RAW_END_LEN	3
+
+/// Initial value of a CRC-16/CCITT-FALSE
+#define TELEM_CRC16_INIT	0xFFFF
+
+/**
+ * @name Record flags
+ *
+ * Fields of a source that is not flagged are zero.
+ * @{
+ */
+#define TELEM_F_CO2	0x01	///< @c co2_ppm is valid
+#define TELEM_F_PMS	0x02	///< PM, temperature, humidity and AQI are valid
+#define TELEM_F_GPS	0x04	///< The GPS fields hold a fix
+#define TELEM_F_CO2_STALE	0x08	///< @c co2_ppm is older than allowed
+#define TELEM_F_PMS_STALE	0x10	///< The PM fields are older than allowed
+#define TELEM_F_GPS_STALE	0x20	///< The fix is older than allowed
+
+/// On the wire only: the record holds deltas from the one before it
+#define TELEM_F_DELTA	0x80
+/** @} */
+
+/// One telemetry record
+typedef struct telem_record_type {
+	/// TELEM_F_* bits
+	uint8_t		flags;
+
+	/// Incremented for every record sent
+	uint16_t	seq;
+
+	/// Time since boot, in milliseconds
+	uint32_t	time_ms;
+
+	/// CO2 concentration, in ppm
+	uint16_t	co2_ppm;
+
+	/// PM concentrations in ug/m^3, atmospheric environment
+	uint16_t	pm1_0;
+	uint16_t	pm2_5;
+	uint16_t	pm10;
+
+	/// Temperature, in 0.1 degrees Celsius
+	int16_t		temp_dc;
+
+	/// Relative humidity, in 0.1 %
+	uint16_t	rh_pm;
+
+	/// Position, in 1e-7 degrees, and altitude, in millimeters
+	int32_t		lat_e7;
+	int32_t		lon_e7;
+	int32_t		alt_mm;
+
+	/// UTC time of day of the fix, in milliseconds
+	uint32_t	gps_time_ms;
+
+	/// Speed over ground, in cm/s
+	uint16_t	speed_cmps;
+
+	/// Number of satellites used, and fix quality
+	uint8_t		nr_sats;
+	uint8_t		quality;
+
+	/// US-EPA AQI, from the rolling PM2.5 and PM10 means
+	uint16_t	aqi;
+
+	/// Rolling means of PM2.5 (in 0.1 ug/m^3), PM10 and CO2
+	uint16_t	pm2_5_mean_d;
+	uint16_t	pm10_mean;
+	uint16_t	co2_mean;
+} telem_record_t;
+
+/**
+ * Encode a record into a frame
+ *
+ * The record is serialized little-endian, followed by a CRC-16/CCITT-FALSE
+ * of it, then COBS-encoded and terminated by a zero byte.
+ *
+ * @param[out]	buf	Destination; at least @c TELEM_FRAME_MAX bytes
+ *
+ * @return	Size of the frame, including the delimiter
+ */
+size_t telem_encode(const telem_record_t *rec, uint8_t *buf);
+
+/**
+ * Encoder state for compressed telemetry; treat as opaque, except for the
+ * counters
+ */
+typedef struct telem_encoder_type {
+	/// Last record encoded, which the next delta is taken from
+	telem_record_t	prev;
+
+	/// Records per keyframe, and records encoded since the last one
+	uint8_t		key_interval;
+	uint8_t		since_key;
+
+	/// Keyframes and delta records encoded
+	uint32_t	nr_key;
+	uint32_t	nr_delta;
+
+	/// Bytes encoded, delimiters included
+	uint32_t	nr_bytes;
+} telem_encoder_t;
+
+/**
+ * Reset an encoder, including its counters
+ *
+ * @param[in]	key_interval	Records per keyframe; 1 (or 0) turns
+ *				compression off
+ */
+void telem_encoder_init(telem_encoder_t *e, uint8_t key_interval);
+
+/**
+ * Encode a record as a keyframe or as a delta from the previous one
+ *
+ * Every @c key_interval records, and whenever a delta would not be any
+ * shorter, a full record (as from @c telem_encode()) is sent instead. Each
+ * field of a delta record is the zig-zag varint of its difference from the
+ * previous record, so slowly-changing fields take a byte each.
+ *
+ * @note
+ * @p rec->seq must be one more than that of the previous record, or the
+ * decoder drops deltas until the next keyframe. If a frame does not make it
+ * onto the link, call @c telem_encoder_resync().
+ *
+ * @param[out]	buf	Destination; at least @c TELEM_FRAME_MAX bytes
+ *
+ * @return	Size of the frame, including the delimiter
+ */
+size_t telem_encode_next(telem_encoder_t *e, const telem_record_t *rec,
+	uint8_t *buf);
+
+/// Make the next record a keyframe
+void telem_encoder_resync(telem_encoder_t *e);
+
+/**
+ * Encode a message other than a telemetry record into a frame
+ *
+ * The type byte and @p data are framed as records are: followed by their
+ * CRC, COBS-encoded and terminated by a zero byte.
+ *
+ * @param[in]	type	TELEM_TYPE_*, other than a record version
+ * @param[out]	buf	Destination; at least @c TELEM_MSG_FRAME_LEN(len)
+ *			bytes
+ *
+ * @return	Size of the frame, including the delimiter
+ */
+size_t telem_encode_msg(uint8_t type, const void *data, size_t len,
+	uint8_t *buf);
+
+/**
+ * Carry a CRC-16/CCITT-FALSE on over @p len more bytes
+ *
+ * @param[in]	crc	@c TELEM_CRC16_INIT, or the CRC of the bytes so far
+ */
+uint16_t telem_crc16_update(uint16_t crc, const void *data, size_t len);
+
+/**
+ * COBS-encode @p len bytes of @p src into @p dst, which may not overlap it
+ *
+ * @param[out]	dst	Destination; at least @p len + @p len / 254 + 1 bytes
+ *
+ * @return	Encoded size, excluding any delimiter
+ */
+size_t telem_cobs_encode(const uint8_t *src, size_t len, uint8_t *dst);
+
+/**
+ * COBS-decode @p len bytes of @p buf in place
+ *
+ * @return	Decoded size, or zero if the encoding is broken
+ */
+size_t telem_cobs_decode(uint8_t *buf, size_t len);
+
+/**
+ * Encode the header frame of a raw message
+ *
+ * A raw message is sent as it lies in memory, from as many fragments as it
+ * takes: the header frame goes first, then the @p len bytes of the message,
+ * then the trailer from @c telem_encode_raw_end().
+ *
+ * @param[in]	type	TELEM_TYPE_RAW or above, below TELEM_TYPE_CAP
+ * @param[in]	len	Size of the message, at most @c TELEM_MSG_MAX
+ * @param[out]	buf	Destination; at least @c TELEM_RAW_HDR_LEN bytes
+ *
+ * @return	Size of the frame, including the delimiter
+ */
+size_t telem_encode_raw(uint8_t type, uint16_t len, uint8_t *buf);
+
+/**
+ * Encode the trailer of a raw message
+ *
+ * @param[in]	crc	@c telem_crc16_update() of the message, from
+ *			@c TELEM_CRC16_INIT
+ * @param[out]	buf	Destination; @c TELEM_RAW_END_LEN bytes
+ *
+ * @return	@c TELEM_RAW_END_LEN
+ */
+size_t telem_encode_raw_end(uint16_t crc, uint8_t *buf);
+
+/// Decoder state; treat as opaque, except for the counters
+typedef struct telem_decoder_type {
+	uint8_t		buf[TELEM_MSG_FRAME_LEN(TELEM_MSG_MAX)];
+	uint16_t	len;
+
+	/// Last record decoded, which deltas apply to
+	telem_record_t	prev;
+	bool		have_prev;
+
+	/// Whether the frame in progress is being dropped as overlong
+	bool		overflow;
+
+	/// Whether the body of a raw message is being taken, and its header
+	bool		raw;
+	uint8_t		raw_type;
+	uint16_t	raw_len;
+
+	/// Records decoded
+	uint32_t	nr_good;
+
+	/// Other messages decoded
+	uint32_t	nr_msg;
+
+	/// Frames dropped due to bad COBS encoding, length or CRC
+	uint32_t	nr_bad;
+
+	/// Records dropped due to an unknown version
+	uint32_t	nr_version;
+
+	/// Delta records dropped because the record before them was lost
+	uint32_t	nr_lost;
+} telem_decoder_t;
+
+/// Reset a decoder, including its counters
+void telem_decoder_init(telem_decoder_t *d);
+
+/**
+ * Decode a single frame, without its delimiter
+ *
+ * Both keyframes and delta records are accepted; after a lost frame,
+ * decoding picks up again at the next keyframe.
+ *
+ * @return	@c true if @p rec was filled in from a valid frame
+ */
+bool telem_decode(telem_decoder_t *d, const uint8_t *frame, size_t len,
+	telem_record_t *rec);
+
+/// A message other than a telemetry record, as decoded
+typedef struct telem_msg_type {
+	/// TELEM_TYPE_*
+	uint8_t		type;
+
+	/// Message, in the decoder's buffer until the next byte is fed
+	const uint8_t	*data;
+	size_t		len;
+} telem_msg_t;
+
+/// What a byte fed to the decoder completed
+typedef enum telem_feed_type {
+	TELEM_FEED_NONE = 0,	///< Nothing, or a frame that was dropped
+	TELEM_FEED_RECORD,	///< A telemetry record
+	TELEM_FEED_MSG		///< Some other message
+} telem_feed_t;
+
+/**
+ * Feed a single byte into the decoder
+ *
+ * Reception may start anywhere; whatever precedes the first delimiter is
+ * dropped as a bad frame. Raw messages are handed back as messages; one that
+ * does not end as it should, as when bytes were lost, is a bad frame.
+ *
+ * @param[out]	rec	Filled in if a record was completed
+ * @param[out]	msg	Filled in if another message was completed
+ */
+telem_feed_t telem_feed(telem_decoder_t *d, uint8_t c, telem_record_t *rec,
+	telem_msg_t *msg);
+
+/**
+ * Feed a single byte into the decoder, keeping only records
+ *
+ * @return	@c true if @p c completed a valid frame, decoded into @p rec
+ */
+bool telem_feed_byte(telem_decoder_t *d, uint8_t c, telem_record_t *rec);
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifdef __cplusplus
+}
+#endif	// __cplusplus
+#endif	// !defined(TELEM_H_)
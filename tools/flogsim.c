@@ -0,0 +1,256 @@
+/**
+ * @file flogsim.c
+ * @brief Run the flash log against a simulated data flash on the host
+ *
+ * The flash behaves as NOR flash with ECC: erasing sets a whole row to ones,
+ * and a page may only be programmed once after that. Power is cut at random
+ * flash operations, leaving a half-erased row or a half-programmed page
+ * behind; the log is then reopened and read back, and must hold exactly the
+ * records that made it to flash, oldest to newest, up to the point of the
+ * power loss. Throughput is worked out from per-operation times, which are
+ * given on the command line.
+ *
+ * Build and run on Linux:
+ *
+ *   cc -O2 -Wall -I FINAL.X -o flogsim tools/flogsim.c FINAL.X/flog.c \
+ *	FINAL.X/telem.c
+ *   ./flogsim [nr_cycles [page_write_us [row_erase_us]]]
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "flog.h"
+
+/// Same size as the data flash area used on board
+#define SIM_SIZE	(8 * 1024)
+#define SIM_NR_ROWS	(SIM_SIZE / (FLOG_PAGE_SIZE * FLOG_ROW_PAGES))
+#define SIM_NR_PAGES	(SIM_NR_ROWS * FLOG_ROW_PAGES)
+
+static struct {
+	uint8_t		mem[SIM_SIZE];
+
+	/// Whether a page was programmed since its row was erased
+	bool		programmed[SIM_NR_PAGES];
+
+	/// Operations left until the power goes, if armed
+	long		fail_in;
+	bool		dead;
+
+	/// Row erase counts, for wear
+	uint32_t	erases[SIM_NR_ROWS];
+
+	/// Pages programmed twice without an erase in between
+	uint32_t	nr_overwrites;
+
+	uint64_t	nr_writes;
+	uint64_t	nr_erase;
+} sim;
+
+static uint32_t rng_state = 12345;
+
+static uint32_t rng(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+// Whether the power goes during this operation
+static bool sim_power_fails(void)
+{
+	if (sim.dead)
+		return true;
+	if (sim.fail_in > 0 && --sim.fail_in == 0) {
+		sim.dead = true;
+		return true;
+	}
+	return false;
+}
+
+static bool sim_erase_row(void *arg, uint32_t ofs)
+{
+	uint32_t row = ofs / (FLOG_PAGE_SIZE * FLOG_ROW_PAGES);
+	unsigned int x;
+
+	(void)arg;
+	if (sim_power_fails()) {
+		// Part of the bits are set
+		for (x = 0; x < FLOG_PAGE_SIZE * FLOG_ROW_PAGES; ++x)
+			sim.mem[ofs + x] |= (uint8_t)rng();
+		return false;
+	}
+	memset(&sim.mem[ofs], 0xFF, FLOG_PAGE_SIZE * FLOG_ROW_PAGES);
+	for (x = 0; x < FLOG_ROW_PAGES; ++x)
+		sim.programmed[row * FLOG_ROW_PAGES + x] = false;
+	++sim.erases[row];
+	++sim.nr_erase;
+	return true;
+}
+
+static bool sim_write_page(void *arg, uint32_t ofs, const uint8_t *data)
+{
+	uint32_t page = ofs / FLOG_PAGE_SIZE;
+	unsigned int x;
+
+	(void)arg;
+	if (sim.programmed[page])
+		++sim.nr_overwrites;
+	sim.programmed[page] = true;
+
+	if (sim_power_fails()) {
+		// Part of the bits are cleared
+		for (x = 0; x < FLOG_PAGE_SIZE; ++x)
+			sim.mem[ofs + x] &= data[x] | (uint8_t)rng();
+		return false;
+	}
+	for (x = 0; x < FLOG_PAGE_SIZE; ++x)
+		sim.mem[ofs + x] &= data[x];
+	++sim.nr_writes;
+	return true;
+}
+
+static const flog_flash_t sim_flash = {
+	.base = sim.mem,
+	.nr_rows = SIM_NR_ROWS,
+	.erase_row = sim_erase_row,
+	.write_page = sim_write_page,
+};
+
+// A record: its serial number, then filler derived from it
+static uint8_t make_rec(uint32_t serial, uint8_t *buf)
+{
+	uint8_t len = (uint8_t)(8 + serial * 7 % (FLOG_REC_MAX - 7));
+	unsigned int x;
+
+	memcpy(buf, &serial, 4);
+	for (x = 4; x < len; ++x)
+		buf[x] = (uint8_t)(serial * 31 + x);
+	return len;
+}
+
+static bool check_rec(const uint8_t *data, uint8_t len, uint32_t *serial)
+{
+	uint8_t buf[FLOG_REC_MAX];
+
+	if (len < 4)
+		return false;
+	memcpy(serial, data, 4);
+	return make_rec(*serial, buf) == len && memcmp(buf, data, len) == 0;
+}
+
+/*
+ * Read the whole log back: the records must be in order, with none missing
+ * up to @p durable, the last one known to be in flash. Some beyond it (but
+ * before @p limit) may have made it too, from the page being programmed when
+ * the power went.
+ */
+static bool verify(const flog_t *f, uint32_t durable, uint32_t limit,
+	uint32_t *last, uint32_t *nr_read)
+{
+	flog_cursor_t c;
+	const uint8_t *data;
+	uint32_t serial = 0;
+	uint8_t len;
+
+	*nr_read = 0;
+	flog_rewind(f, &c);
+	while ((len = flog_read(f, &c, &data)) > 0) {
+		if (!check_rec(data, len, &serial) || serial >= limit ||
+		    (*nr_read > 0 && (serial <= *last ||
+		     (serial <= durable && serial != *last + 1)))) {
+			fprintf(stderr, "record %u out of place after %u\n",
+				serial, *last);
+			return false;
+		}
+		*last = serial;
+		++*nr_read;
+	}
+	if (durable != UINT32_MAX && (*nr_read == 0 || *last < durable)) {
+		fprintf(stderr, "log ends before %u\n", durable);
+		return false;
+	}
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char **argv)
+{
+	long nr_cycles = argc > 1 ? atol(argv[1]) : 1000;
+	double t_write = argc > 2 ? atof(argv[2]) : 2500;
+	double t_erase = argc > 3 ? atof(argv[3]) : 6000;
+	uint8_t buf[FLOG_REC_MAX];
+	uint32_t serial = 0, durable = UINT32_MAX, last, nr_read = 0, before;
+	uint32_t wmin, wmax;
+	uint64_t nr_bytes = 0, nr_recs = 0;
+	unsigned long nr_torn = 0;
+	double us;
+	flog_t f;
+	long cycle, x;
+	uint8_t len;
+
+	memset(sim.mem, 0xFF, sizeof(sim.mem));
+
+	for (cycle = 0; cycle <= nr_cycles; ++cycle) {
+		flog_open(&f, &sim_flash);
+		nr_torn += f.nr_torn;
+		last = UINT32_MAX;
+		if (!verify(&f, durable, serial, &last, &nr_read)) {
+			fprintf(stderr, "cycle %ld: bad log after reopen\n",
+				cycle);
+			return 1;
+		}
+		if (cycle == nr_cycles)
+			break;
+
+		// Carry on from whatever made it to flash
+		serial = nr_read > 0 ? last + 1 : 0;
+		durable = nr_read > 0 ? last : UINT32_MAX;
+
+		// Run until the power goes, a few hundred operations in
+		sim.dead = false;
+		sim.fail_in = 1 + (long)(rng() % 400);
+		for (;;) {
+			len = make_rec(serial, buf);
+			before = f.nr_pages_written;
+			if (!flog_append(&f, buf, len) || sim.dead)
+				break;
+			nr_bytes += len;
+			++nr_recs;
+
+			// Whatever filled the page just written is safe
+			if (f.nr_pages_written != before)
+				durable = serial - 1;
+			++serial;
+		}
+	}
+
+	wmin = UINT32_MAX;
+	wmax = 0;
+	for (x = 0; x < SIM_NR_ROWS; ++x) {
+		if (sim.erases[x] < wmin)
+			wmin = sim.erases[x];
+		if (sim.erases[x] > wmax)
+			wmax = sim.erases[x];
+	}
+
+	us = (double)sim.nr_writes * t_write + (double)sim.nr_erase * t_erase;
+	printf("%ld power losses, %lu torn pages skipped, %u overwrites\n",
+		nr_cycles, nr_torn, sim.nr_overwrites);
+	printf("%llu records (%llu bytes) in %llu pages, %llu erases\n",
+		(unsigned long long)nr_recs, (unsigned long long)nr_bytes,
+		(unsigned long long)sim.nr_writes,
+		(unsigned long long)sim.nr_erase);
+	printf("fill %.1f%%, %u records in flash at the end\n",
+		100.0 * nr_bytes / ((double)sim.nr_writes * FLOG_PAGE_SIZE),
+		nr_read);
+	printf("wear: %u..%u erases per row\n", wmin, wmax);
+	printf("at %.0f us/page, %.0f us/row: %.0f B/s, %.0f records/s\n",
+		t_write, t_erase, nr_bytes / (us / 1e6), nr_recs / (us / 1e6));
+	return 0;
+}
@@ -0,0 +1,256 @@
+/**
+ * @file logdump.c
+ * @brief Render the deferred log of the CanSat on the host
+ *
+ * The firmware only sends the offset of each format string along with the
+ * raw arguments (see PLATFORM_LOG() in platform.h); the strings themselves
+ * are read back from the "logfmt" section of the very ELF file that was
+ * flashed. The batches are picked out of the capture by the telemetry
+ * decoder, and everything else in it (telemetry, statistics) is skipped.
+ *
+ * Build and run on Linux:
+ *
+ *   cc -O2 -Wall -IFINAL.X -o logdump tools/logdump.c FINAL.X/telem.c
+ *   ./logdump FINAL.X/dist/default/production/FINAL.X.production.elf \
+ *             capture.bin
+ */
+
+#include <elf.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "telem.h"
+
+/// Must match platform/log.c
+#define LOG_TIME_SHIFT		10
+#define LOG_TICKS_PER_US	12
+#define LOG_MAX_ARGS		15
+
+/// Format strings, as laid out in the firmware
+static struct {
+	uint32_t	size;
+	const char	*data;
+} fmts;
+
+static uint8_t *read_file(const char *path, size_t *len)
+{
+	FILE *f = fopen(path, "rb");
+	uint8_t *buf;
+	long size;
+
+	if (f == NULL) {
+		perror(path);
+		return NULL;
+	}
+	if (fseek(f, 0, SEEK_END) != 0 || (size = ftell(f)) < 0 ||
+	    fseek(f, 0, SEEK_SET) != 0) {
+		perror(path);
+		fclose(f);
+		return NULL;
+	}
+	buf = malloc((size_t)size + 1);
+	if (buf == NULL || fread(buf, 1, (size_t)size, f) != (size_t)size) {
+		fprintf(stderr, "%s: read failed\n", path);
+		free(buf);
+		fclose(f);
+		return NULL;
+	}
+	fclose(f);
+	buf[size] = 0;
+	*len = (size_t)size;
+	return buf;
+}
+
+static uint16_t get16(const uint8_t *p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+		((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Find the format strings in a little-endian ELF32 image
+static bool load_fmts(const uint8_t *elf, size_t len)
+{
+	const Elf32_Ehdr *eh = (const Elf32_Ehdr *)elf;
+	const Elf32_Shdr *sh, *strtab;
+	unsigned int x;
+
+	if (len < sizeof(*eh) || memcmp(eh->e_ident, ELFMAG, SELFMAG) != 0 ||
+	    eh->e_ident[EI_CLASS] != ELFCLASS32 ||
+	    eh->e_ident[EI_DATA] != ELFDATA2LSB ||
+	    eh->e_shentsize != sizeof(Elf32_Shdr) ||
+	    eh->e_shoff + (size_t)eh->e_shnum * sizeof(*sh) > len ||
+	    eh->e_shstrndx >= eh->e_shnum)
+		return false;
+
+	sh = (const Elf32_Shdr *)(elf + eh->e_shoff);
+	strtab = &sh[eh->e_shstrndx];
+	for (x = 0; x < eh->e_shnum; ++x) {
+		if (strtab->sh_offset + sh[x].sh_name >= len ||
+		    strcmp((const char *)elf + strtab->sh_offset +
+			   sh[x].sh_name, "logfmt") != 0)
+			continue;
+		if (sh[x].sh_offset + (size_t)sh[x].sh_size > len)
+			return false;
+		fmts.size = sh[x].sh_size;
+		fmts.data = (const char *)elf + sh[x].sh_offset;
+		return true;
+	}
+	return false;
+}
+
+static const char *find_fmt(uint32_t off)
+{
+	if (off >= fmts.size)
+		return NULL;
+	if (memchr(fmts.data + off, 0, fmts.size - off) == NULL)
+		return NULL;
+	return fmts.data + off;
+}
+
+/*
+ * Print a message, formatting each argument on its own so that only
+ * conversions taking an int ever reach printf()
+ */
+static void render(const char *fmt, const uint32_t *args, unsigned int nr)
+{
+	char spec[32];
+	unsigned int a = 0;
+	size_t n;
+	const char *p;
+
+	while (*fmt != '\0') {
+		if (*fmt != '%') {
+			putchar(*fmt++);
+			continue;
+		}
+		if (fmt[1] == '%') {
+			putchar('%');
+			fmt += 2;
+			continue;
+		}
+
+		// Flags, width and precision are kept, length modifiers dropped
+		n = 0;
+		spec[n++] = '%';
+		for (p = fmt + 1; *p != '\0' && strchr("-+ #0123456789.", *p);
+		     ++p) {
+			if (n < sizeof(spec) - 2)
+				spec[n++] = *p;
+		}
+		while (*p == 'l' || *p == 'h' || *p == 'z')
+			++p;
+		if (*p == '\0' || strchr("diuxXoc", *p) == NULL) {
+			fwrite(fmt, 1, (size_t)(p - fmt) + (*p != '\0'), stdout);
+			fmt = p + (*p != '\0');
+			continue;
+		}
+		spec[n++] = *p;
+		spec[n] = '\0';
+		fmt = p + 1;
+
+		if (a >= nr) {
+			fputs("<?>", stdout);
+		} else if (*p == 'd' || *p == 'i') {
+			printf(spec, (int)(int32_t)args[a++]);
+		} else {
+			printf(spec, (unsigned int)args[a++]);
+		}
+	}
+	putchar('\n');
+}
+
+// Print the messages of one batch; returns false if it was garbled
+static bool dump_batch(const uint8_t *p, unsigned int nr_words)
+{
+	uint32_t args[LOG_MAX_ARGS];
+	uint32_t off, word;
+	unsigned int nr, x;
+	const char *fmt;
+
+	while (nr_words >= 2) {
+		off = get32(p);
+		word = get32(p + 4);
+		nr = word >> 28;
+		if (nr_words < 2 + nr)
+			return false;
+		for (x = 0; x < nr; ++x)
+			args[x] = get32(p + 8 + 4 * x);
+		p += 4 * (2 + nr);
+		nr_words -= 2 + nr;
+
+		printf("[%11.4f] ", (double)((word & 0x0FFFFFFF) <<
+			LOG_TIME_SHIFT) / LOG_TICKS_PER_US / 1e6);
+		fmt = find_fmt(off);
+		if (fmt == NULL) {
+			printf("<unknown format at offset 0x%x>\n", off);
+			continue;
+		}
+		render(fmt, args, nr);
+	}
+	return nr_words == 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char **argv)
+{
+	uint8_t *elf, *cap;
+	size_t elf_len, cap_len, x;
+	unsigned int nr_words, nr_dropped;
+	unsigned long nr_batches = 0, nr_garbled = 0;
+	telem_decoder_t dec;
+	telem_record_t rec;
+	telem_msg_t msg;
+
+	if (argc != 3) {
+		fprintf(stderr, "usage: %s firmware.elf capture.bin\n",
+			argv[0]);
+		return 2;
+	}
+	elf = read_file(argv[1], &elf_len);
+	if (elf == NULL)
+		return 1;
+	if (!load_fmts(elf, elf_len)) {
+		fprintf(stderr, "%s: no logfmt section in an ELF32 LE file\n",
+			argv[1]);
+		return 1;
+	}
+	cap = read_file(argv[2], &cap_len);
+	if (cap == NULL)
+		return 1;
+
+	telem_decoder_init(&dec);
+	for (x = 0; x < cap_len; ++x) {
+		if (telem_feed(&dec, cap[x], &rec, &msg) != TELEM_FEED_MSG ||
+		    msg.type != TELEM_TYPE_LOGS)
+			continue;
+		++nr_batches;
+		nr_words = msg.len >= 4 ? get16(msg.data) : 0;
+		if (msg.len != 4 + 4 * (size_t)nr_words) {
+			++nr_garbled;
+			printf("<garbled batch ending at offset %zu>\n", x);
+			continue;
+		}
+		nr_dropped = get16(msg.data + 2);
+		if (nr_dropped > 0)
+			printf("<%u messages dropped>\n", nr_dropped);
+		if (!dump_batch(msg.data + 4, nr_words)) {
+			++nr_garbled;
+			printf("<garbled batch ending at offset %zu>\n", x);
+		}
+	}
+	fprintf(stderr, "%lu batches, %lu garbled; %u bad frames\n",
+		nr_batches, nr_garbled, dec.nr_bad);
+
+	free(cap);
+	free(elf);
+	return 0;
+}
@@ -0,0 +1,592 @@
+/**
+ * @file replay.c
+ * @brief Replay of captured sensor traffic into the firmware
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "platform.h"
+#include "cap.h"
+#include "nmea.h"
+#include "pms.h"
+#include "mhz19.h"
+#include "sim.h"
+#include "replay.h"
+
+/// SERCOMs the sensors are wired to, as on the board
+#define SERCOM_CO2	1
+#define SERCOM_PMS	3
+#define SERCOM_GPS	5
+
+/// When the first frame goes out, once the firmware is up
+#define REPLAY_START_MS		1000
+
+/// Time left after the last frame for the firmware to catch up
+#define REPLAY_SETTLE_MS	3000
+
+/// Time from the end of a request to the start of the MH-Z19C's response
+#define CO2_RESPONSE_US		2000
+
+/// How often the firmware reads the MH-Z19C, as set in main.c
+#define CO2_PERIOD_MS		2000
+
+/// A frame of the capture
+typedef struct replay_frame_type {
+	uint32_t	when;
+	size_t		ofs;
+	size_t		len;
+} replay_frame_t;
+
+/// What the firmware should make of a stretch of the traffic
+typedef struct replay_item_type {
+	/// Offset just past its last byte
+	size_t		end;
+
+	/// NMEA_SENT_* bit for sentences, zero for the others
+	uint8_t		type;
+
+	/// Values checked: position; PM1.0, PM2.5, PM10; CO2
+	int32_t		v[3];
+	unsigned int	nr_v;
+} replay_item_t;
+
+/// A sensor being replayed
+typedef struct replay_dev_type {
+	sim_dev_t	dev;
+	unsigned int	sercom;
+
+	/// All traffic of the sensor, and the frames it came in
+	uint8_t		*data;
+	size_t		len;
+	size_t		data_size;
+	replay_frame_t	*frames;
+	unsigned int	nr_frames;
+	size_t		frames_size;
+	unsigned int	next;
+
+	/// Reference items, and the next one to be matched
+	replay_item_t	*items;
+	unsigned int	nr_items;
+	size_t		items_size;
+	unsigned int	cur;
+
+	/// Bytes sent; when the first went out, and the last is through
+	size_t		sent;
+	sim_time_t	first;
+	sim_time_t	done;
+
+	replay_stats_t	stats;
+} replay_dev_t;
+
+static void replay_run(sim_dev_t *dev);
+static void co2_rx(sim_dev_t *dev, uint8_t c);
+static void co2_run(sim_dev_t *dev);
+
+static replay_dev_t gps = {
+	.dev = { .name = "gps", .baud = 9600, .run = replay_run },
+	.sercom = SERCOM_GPS,
+};
+static replay_dev_t pms = {
+	.dev = { .name = "pms", .baud = 9600, .run = replay_run },
+	.sercom = SERCOM_PMS,
+};
+static replay_dev_t co2 = {
+	.dev = { .name = "co2", .baud = 9600, .rx = co2_rx, .run = co2_run },
+	.sercom = SERCOM_CO2,
+};
+
+static replay_dev_t *const replay_devs[SENSOR_NR] = {
+	[SENSOR_GPS] = &gps,
+	[SENSOR_PMS] = &pms,
+	[SENSOR_CO2] = &co2,
+};
+
+/// Device each USART channel of a capture is replayed by, if any
+static replay_dev_t *const replay_by_ch[PLATFORM_USART_NR_CH] = {
+	[PLATFORM_USART_CO2] = &co2,
+	[PLATFORM_USART_PMS] = &pms,
+	[PLATFORM_USART_GPS] = &gps,
+};
+
+static struct {
+	bool		active;
+	bool		fast;
+
+	/// Capture time of the first frame, and when it is replayed
+	uint32_t	when0;
+	sim_time_t	base;
+
+	/// When the recorded traffic is over; requests are not answered after
+	sim_time_t	end;
+
+	unsigned int	co2_req_len;
+	uint32_t	co2_seq;
+} replay;
+
+/////////////////////////////////////////////////////////////////////////////
+
+static void *replay_grow(void *p, size_t nr, size_t *size, size_t elem)
+{
+	if (nr < *size)
+		return p;
+	*size = (*size != 0) ? 2 * *size : 64;
+	p = realloc(p, *size * elem);
+	if (p == NULL)
+		abort();
+	return p;
+}
+
+static void replay_add_item(replay_dev_t *r, const replay_item_t *item)
+{
+	r->items = replay_grow(r->items, r->nr_items, &r->items_size,
+		sizeof(*item));
+	r->items[r->nr_items++] = *item;
+}
+
+// [-]DDDMM.MMMMM into 1e-7 degrees, by way of a double; empty is zero
+static int32_t replay_ddmm(const char *field, size_t len, char hemi)
+{
+	char buf[24];
+	const char *dot;
+	double deg, min;
+	size_t nr_deg;
+
+	if (len == 0 || len >= sizeof(buf))
+		return 0;
+	memcpy(buf, field, len);
+	buf[len] = '\0';
+	dot = strchr(buf, '.');
+	nr_deg = ((dot != NULL) ? (size_t)(dot - buf) : len);
+	nr_deg = (nr_deg > 2) ? nr_deg - 2 : 0;
+	min = atof(&buf[nr_deg]);
+	buf[nr_deg] = '\0';
+	deg = atof(buf) + min / 60;
+	if (hemi == 'S' || hemi == 'W')
+		deg = -deg;
+	return (int32_t)(deg * 1e7 + (deg < 0 ? -0.5 : 0.5));
+}
+
+/*
+ * Sentences with a good checksum, of the types the firmware knows; GGA and
+ * RMC also carry the position
+ */
+static void replay_ref_gps(replay_dev_t *r)
+{
+	static const struct {
+		char	name[4];
+		uint8_t	type;
+		uint8_t	lat_field;
+	} types[] = {
+		{ "GGA", NMEA_SENT_GGA, 2 },
+		{ "RMC", NMEA_SENT_RMC, 3 },
+		{ "VTG", NMEA_SENT_VTG, 0 },
+		{ "GSA", NMEA_SENT_GSA, 0 },
+	};
+	const char *f[8];
+	size_t flen[8];
+	char line[128];
+	replay_item_t item;
+	unsigned int nr_f, x, lat;
+	size_t pos, len = 0, star = 0;
+	uint8_t sum;
+	bool in = false;
+	char c;
+
+	for (pos = 0; pos < r->len; ++pos) {
+		c = (char)r->data[pos];
+		if (c == '$') {
+			in = true;
+			len = 0;
+			star = 0;
+			continue;
+		}
+		if (!in)
+			continue;
+		if (len == sizeof(line) || c == '\r' || c == '\n') {
+			in = false;
+			continue;
+		}
+		line[len++] = c;
+		if (c == '*')
+			star = len;
+		if (star == 0 || len != star + 2)
+			continue;
+
+		// Body, then two hex digits
+		in = false;
+		for (sum = 0, x = 0; x + 1 < star; ++x)
+			sum ^= (uint8_t)line[x];
+		line[len] = '\0';
+		if (strtoul(&line[star], NULL, 16) != sum || star < 6)
+			continue;
+
+		for (x = 0; x < sizeof(types) / sizeof(types[0]); ++x) {
+			if (memcmp(&line[2], types[x].name, 3) == 0)
+				break;
+		}
+		if (x == sizeof(types) / sizeof(types[0]))
+			continue;
+
+		memset(&item, 0, sizeof(item));
+		item.end = pos + 1;
+		item.type = types[x].type;
+		lat = types[x].lat_field;
+		if (lat != 0) {
+			f[0] = line;
+			for (nr_f = 1, x = 0; x + 1 < star && nr_f < 8; ++x) {
+				if (line[x] != ',')
+					continue;
+				flen[nr_f - 1] = (size_t)(&line[x] - f[nr_f - 1]);
+				f[nr_f++] = &line[x + 1];
+			}
+			flen[nr_f - 1] = (size_t)(&line[star - 1] -
+				f[nr_f - 1]);
+			if (nr_f < lat + 4)
+				continue;
+			item.v[0] = replay_ddmm(f[lat], flen[lat],
+				flen[lat + 1] ? f[lat + 1][0] : 'N');
+			item.v[1] = replay_ddmm(f[lat + 2], flen[lat + 2],
+				flen[lat + 3] ? f[lat + 3][0] : 'E');
+			item.nr_v = 2;
+		}
+		replay_add_item(r, &item);
+	}
+}
+
+// Frames with a good length word and checksum
+static void replay_ref_pms(replay_dev_t *r)
+{
+	const uint8_t *p;
+	replay_item_t item;
+	size_t pos = 0;
+	uint16_t sum;
+	unsigned int x;
+
+	while (pos + PMS_FRAME_LEN <= r->len) {
+		p = &r->data[pos];
+		if (p[0] != 0x42 || p[1] != 0x4D || p[2] != 0 ||
+		    p[3] != PMS_FRAME_LEN - 4) {
+			++pos;
+			continue;
+		}
+		for (sum = 0, x = 0; x < PMS_FRAME_LEN - 2; ++x)
+			sum += p[x];
+		if (sum != ((p[30] << 8) | p[31])) {
+			++pos;
+			continue;
+		}
+
+		memset(&item, 0, sizeof(item));
+		item.end = pos + PMS_FRAME_LEN;
+		for (x = 0; x < 3; ++x)
+			item.v[x] = (p[10 + 2 * x] << 8) | p[11 + 2 * x];
+		item.nr_v = 3;
+		replay_add_item(r, &item);
+		pos += PMS_FRAME_LEN;
+	}
+}
+
+// Read responses with a good checksum
+static void replay_ref_co2(replay_dev_t *r)
+{
+	const uint8_t *p;
+	replay_item_t item;
+	size_t pos = 0;
+	uint8_t sum;
+	unsigned int x;
+
+	while (pos + 9 <= r->len) {
+		p = &r->data[pos];
+		for (sum = 0, x = 1; x < 8; ++x)
+			sum += p[x];
+		if (p[0] != 0xFF || p[1] != 0x86 || (uint8_t)-sum != p[8]) {
+			++pos;
+			continue;
+		}
+
+		memset(&item, 0, sizeof(item));
+		item.end = pos + 9;
+		item.v[0] = (p[2] << 8) | p[3];
+		item.nr_v = 1;
+		replay_add_item(r, &item);
+		pos += 9;
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+static sim_time_t replay_char_time(const replay_dev_t *r)
+{
+	return (sim_time_t)(10.0 * SIM_TICKS_PER_US * 1e6 / r->dev.baud + 0.5);
+}
+
+static void replay_send(replay_dev_t *r, const replay_frame_t *fr)
+{
+	sim_time_t now = sim_now();
+
+	if (r->stats.nr_sent == 0)
+		r->first = now;
+	sim_usart_send(r->sercom, &r->data[fr->ofs], fr->len);
+	r->done = ((r->done > now) ? r->done : now) +
+		fr->len * replay_char_time(r);
+	r->sent += fr->len;
+	r->stats.nr_sent += (uint32_t)fr->len;
+}
+
+// When a frame is due: as recorded, less the time its first byte took
+static sim_time_t replay_due(const replay_dev_t *r, const replay_frame_t *fr)
+{
+	sim_time_t t = replay.base - replay_char_time(r) +
+		((sim_time_t)(fr->when - replay.when0) <<
+		PLATFORM_USART_CAP_TIME_SHIFT);
+
+	return (t > sim_now()) ? t : sim_now();
+}
+
+/*
+ * Send whatever frames are due; in fast mode, the next frame is due as soon
+ * as the line is free
+ */
+static void replay_run(sim_dev_t *dev)
+{
+	replay_dev_t *r = (replay_dev_t *)dev;
+
+	do {
+		replay_send(r, &r->frames[r->next++]);
+		if (r->next == r->nr_frames) {
+			dev->due = SIM_TIME_NEVER;
+			return;
+		}
+		dev->due = replay.fast ? r->done :
+			replay_due(r, &r->frames[r->next]);
+	} while (dev->due <= sim_now());
+}
+
+// Any nine bytes starting with 0xFF make a request
+static void co2_rx(sim_dev_t *dev, uint8_t c)
+{
+	if (replay.co2_req_len == 0 && c != 0xFF)
+		return;
+	if (++replay.co2_req_len < 9)
+		return;
+	replay.co2_req_len = 0;
+	if (co2.next < co2.nr_frames && sim_now() < replay.end)
+		dev->due = sim_now() + SIM_TICKS_US(CO2_RESPONSE_US);
+}
+
+static void co2_run(sim_dev_t *dev)
+{
+	replay_send(&co2, &co2.frames[co2.next++]);
+	dev->due = SIM_TIME_NEVER;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Match what the firmware came up with against the items replayed so far,
+ * in order; items skipped on the way were missed. If @p nr > 1, as many
+ * items were parsed, but only the last one is known.
+ */
+static void replay_match(replay_dev_t *r, uint8_t type, const int32_t *v,
+	int32_t tol, unsigned int nr)
+{
+	const replay_item_t *item;
+	unsigned int x, k;
+
+	for (x = r->cur; x < r->nr_items && r->items[x].end <= r->sent; ++x) {
+		item = &r->items[x];
+		if (item->type != type)
+			continue;
+		for (k = 0; k < item->nr_v &&
+		     abs(item->v[k] - v[k]) <= tol; ++k)
+			;
+		if (k < item->nr_v)
+			continue;
+
+		k = x - r->cur + 1;
+		r->stats.nr_matched += (nr < k) ? nr : k;
+		r->cur = x + 1;
+		return;
+	}
+	++r->stats.nr_wrong;
+}
+
+/*
+ * The firmware's consumers: NMEA is fed a byte at a time, to see the fix
+ * after every sentence; the PMS5003T decoder hands back the last frame; the
+ * MH-Z19C reading is looked at whenever it is polled
+ */
+uint8_t __real_nmea_feed(nmea_parser_t *p, const char *buf, size_t len);
+unsigned int __real_pms_feed(pms_decoder_t *d, const uint8_t *buf,
+	size_t len, pms_data_t *out);
+bool __real_mhz19_latest(const mhz19_t *m, mhz19_sample_t *sample);
+
+uint8_t __wrap_nmea_feed(nmea_parser_t *p, const char *buf, size_t len)
+{
+	uint8_t mask = NMEA_SENT_NONE, sent;
+	int32_t v[2];
+	size_t x;
+
+	if (!replay.active)
+		return __real_nmea_feed(p, buf, len);
+
+	for (x = 0; x < len; ++x) {
+		sent = __real_nmea_feed(p, &buf[x], 1);
+		if (sent == NMEA_SENT_NONE)
+			continue;
+		v[0] = p->fix.lat_e7;
+		v[1] = p->fix.lon_e7;
+		replay_match(&gps, sent, v, 1, 1);
+		mask |= sent;
+	}
+	return mask;
+}
+
+unsigned int __wrap_pms_feed(pms_decoder_t *d, const uint8_t *buf,
+	size_t len, pms_data_t *out)
+{
+	unsigned int n = __real_pms_feed(d, buf, len, out);
+	int32_t v[3];
+
+	if (replay.active && n > 0) {
+		v[0] = out->pm1_0_atm;
+		v[1] = out->pm2_5_atm;
+		v[2] = out->pm10_atm;
+		replay_match(&pms, 0, v, 0, n);
+	}
+	return n;
+}
+
+bool __wrap_mhz19_latest(const mhz19_t *m, mhz19_sample_t *sample)
+{
+	bool ok = __real_mhz19_latest(m, sample);
+	int32_t v;
+
+	if (replay.active && ok && sample->seq != replay.co2_seq) {
+		v = sample->co2_ppm;
+		replay_match(&co2, 0, &v, 0, sample->seq - replay.co2_seq);
+		replay.co2_seq = sample->seq;
+	}
+	return ok;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+// Append a frame to the device that replays its channel
+static void replay_add_frame(const cap_frame_t *f)
+{
+	replay_dev_t *r = (f->ch < PLATFORM_USART_NR_CH) ?
+		replay_by_ch[f->ch] : NULL;
+
+	if (r == NULL)
+		return;
+
+	while (r->len + f->len > r->data_size)
+		r->data = replay_grow(r->data, r->data_size, &r->data_size, 1);
+	r->frames = replay_grow(r->frames, r->nr_frames, &r->frames_size,
+		sizeof(r->frames[0]));
+	r->frames[r->nr_frames].when = f->when;
+	r->frames[r->nr_frames].ofs = r->len;
+	r->frames[r->nr_frames].len = f->len;
+	++r->nr_frames;
+	memcpy(&r->data[r->len], f->data, f->len);
+	r->len += f->len;
+	r->stats.nr_frames = r->nr_frames;
+	r->stats.nr_bytes = (uint32_t)r->len;
+}
+
+bool replay_load(const char *path, bool fast, replay_capture_t *cap)
+{
+	sim_time_t span, busy, longest = 0;
+	cap_decoder_t dec;
+	cap_frame_t f;
+	uint32_t last = 0;
+	bool have_when = false;
+	unsigned int x;
+	FILE *fp;
+	int c;
+
+	fp = fopen(path, "rb");
+	if (fp == NULL)
+		return false;
+	cap_decoder_init(&dec);
+	while ((c = fgetc(fp)) != EOF) {
+		if (cap_feed_byte(&dec, (uint8_t)c, &f))
+			replay_add_frame(&f);
+	}
+	fclose(fp);
+
+	replay_ref_gps(&gps);
+	replay_ref_pms(&pms);
+	replay_ref_co2(&co2);
+
+	// The MH-Z19C is not on a timeline of its own
+	for (x = 0; x < SENSOR_NR; ++x) {
+		const replay_dev_t *r = replay_devs[x];
+
+		if (r == &co2 || r->nr_frames == 0)
+			continue;
+		if (!have_when || (int32_t)(r->frames[0].when - replay.when0) < 0)
+			replay.when0 = r->frames[0].when;
+		if (!have_when ||
+		    (int32_t)(r->frames[r->nr_frames - 1].when - last) > 0)
+			last = r->frames[r->nr_frames - 1].when;
+		have_when = true;
+
+		busy = (sim_time_t)r->len * replay_char_time(r);
+		if (busy > longest)
+			longest = busy;
+	}
+
+	// Back-to-back, the MH-Z19C still only answers at the firmware's pace
+	busy = (sim_time_t)co2.nr_frames * SIM_TICKS_MS(CO2_PERIOD_MS);
+	if (busy > longest)
+		longest = busy;
+	if (!have_when && co2.nr_frames == 0)
+		return false;
+
+	span = (sim_time_t)(last - replay.when0) << PLATFORM_USART_CAP_TIME_SHIFT;
+	replay.fast = fast;
+	replay.base = SIM_TICKS_MS(REPLAY_START_MS);
+	replay.end = replay.base + (fast ? longest : span);
+
+	memset(cap, 0, sizeof(*cap));
+	cap->nr_frames = dec.nr_good;
+	cap->nr_lost = dec.nr_lost;
+	cap->nr_loss = dec.nr_loss;
+	cap->span = span;
+	cap->duration = replay.end + SIM_TICKS_MS(REPLAY_SETTLE_MS);
+	return true;
+}
+
+void replay_attach(void)
+{
+	unsigned int x;
+	replay_dev_t *r;
+
+	replay.active = true;
+	for (x = 0; x < SENSOR_NR; ++x) {
+		r = replay_devs[x];
+		r->dev.due = SIM_TIME_NEVER;
+		if (r != &co2 && r->nr_frames > 0)
+			r->dev.due = replay.fast ? replay.base :
+				replay_due(r, &r->frames[0]);
+		sim_usart_attach(r->sercom, &r->dev);
+	}
+}
+
+void replay_stats(sensor_t sensor, replay_stats_t *stats)
+{
+	const replay_dev_t *r = replay_devs[sensor];
+	unsigned int x;
+
+	*stats = r->stats;
+	stats->busy = (r->stats.nr_sent != 0) ? r->done - r->first : 0;
+	for (x = 0; x < r->nr_items && r->items[x].end <= r->sent; ++x)
+		;
+	stats->nr_items = x;
+}
@@ -0,0 +1,94 @@
+/**
+ * @file replay.h
+ * @brief Replay of captured sensor traffic into the firmware
+ *
+ * A capture (as written with sensors_capture(), or received from the CanSat
+ * on the ground) is played back on the sensor USARTs in place of the virtual
+ * sensors: either at the time each frame was received, or as fast as the
+ * line allows. The NEO-6M and PMS5003T streams are sent as recorded; the
+ * MH-Z19C only ever speaks when spoken to, so its responses are sent one per
+ * request, in the order recorded.
+ *
+ * The recorded streams are also parsed on the host, independently of the
+ * firmware's parsers, into the sentences, frames and readings the firmware
+ * should make of them; what the firmware does make of them is picked up at
+ * nmea_feed(), pms_feed() and mhz19_latest(), and checked against those in
+ * order.
+ */
+
+#if !defined(REPLAY_H_)
+#define REPLAY_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sim.h"
+#include "sensors.h"
+
+// C linkage should be maintained
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+
+/// What was found in a capture
+typedef struct replay_capture_type {
+	/// Capture frames decoded
+	uint32_t	nr_frames;
+
+	/// Frames lost in transit (as far as the decoder can tell)
+	uint32_t	nr_lost;
+
+	/// Frames flagged as following bytes dropped on the device
+	uint32_t	nr_loss;
+
+	/// Time from the first frame to the last
+	sim_time_t	span;
+
+	/// Simulated time the replay takes, including some to settle
+	sim_time_t	duration;
+} replay_capture_t;
+
+/// Counters of one sensor's replay
+typedef struct replay_stats_type {
+	/// Frames and bytes in the capture
+	uint32_t	nr_frames;
+	uint32_t	nr_bytes;
+
+	/// Bytes replayed, and the time from the first one to the last
+	uint32_t	nr_sent;
+	sim_time_t	busy;
+
+	/// Sentences, frames or readings in the bytes replayed
+	uint32_t	nr_items;
+
+	/// Of those, the ones the firmware came up with, as they were
+	uint32_t	nr_matched;
+
+	/// Items the firmware came up with that were not in the traffic
+	uint32_t	nr_wrong;
+} replay_stats_t;
+
+/**
+ * Load a capture
+ *
+ * @param[in]	fast	Send the frames back-to-back rather than in time
+ * @param[out]	cap	What was found
+ *
+ * @return	@c false if the file cannot be read, or holds no traffic
+ */
+bool replay_load(const char *path, bool fast, replay_capture_t *cap);
+
+/// Put the replay on the sensor USARTs
+void replay_attach(void);
+
+/// Get the counters of a sensor
+void replay_stats(sensor_t sensor, replay_stats_t *stats);
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifdef __cplusplus
+}
+#endif	// __cplusplus
+#endif	// !defined(REPLAY_H_)
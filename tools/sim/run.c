@@ -0,0 +1,495 @@
+/**
+ * @file run.c
+ * @brief Run the firmware on the host, against the simulated board
+ *
+ * main.c and everything under platform/ are built unchanged
+ * against the stand-in xc.h, and run for a given stretch of simulated time
+ * with the virtual sensors on their USARTs. The report covers each link as
+ * seen on the wire and by the driver, the tasks, the main loop and the
+ * telemetry that came out.
+ *
+ * Build and run on Linux:
+ *
+ *   make -C tools/sim
+ *   tools/sim/fwsim [-t seconds] [-x slowdown] [-c] [-w capture | -r capture [-f]]
+ *
+ * By default, only register accesses and interrupts cost time, so runs are
+ * repeatable, and what they measure is the driver design rather than code
+ * speed. With -x, host CPU time spent in the firmware is charged to the
+ * simulated target as well, scaled by the given factor (how much slower the
+ * target is); this catches code that is too slow, but host noise then shows
+ * up in the maxima. With -c, the exit status tells whether nothing was lost
+ * or garbled, no task missed a period or ran for longer than a jiffy, the
+ * firmware kept time to the clock (unless -x is given, as time then passes
+ * in code the firmware cannot account for while SysTick is stopped), and
+ * the telemetry matched the sensors.
+ *
+ * With -w, the firmware is told to capture the traffic of the sensors, and
+ * everything on the uplink goes to the given file; the captured bytes are
+ * checked against what the sensors sent, and their time stamps against when
+ * it was sent. With -r, such a capture is played
+ * back in place of the virtual sensors, at the recorded times or, with -f,
+ * back-to-back; the run takes as long as the capture (unless -t is given),
+ * and the report has the replay throughput, and how much of the traffic
+ * made it through the firmware's parsers as it should have. Back-to-back,
+ * the PMS5003T frames come far faster than the sensor ever sends them, and
+ * the MH-Z19C is answered at every request until its responses run out;
+ * -c holds either way to the same checks: every byte replayed, nothing
+ * dropped by the driver, and every item parsed, and parsed right.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "platform.h"
+#include "sim.h"
+#include "sensors.h"
+#include "replay.h"
+
+/// The firmware's main(), renamed at build time
+int fw_main(void);
+
+/// Tasks tracked, as started by the firmware
+#define RUN_NR_TASKS	16
+
+/*
+ * Largest error allowed in the firmware's time: a read of the tick may see
+ * the reload a clock late
+ */
+#define RUN_CLOCK_ERR_MAX	1
+
+/*
+ * Longest a task may run: anything that takes longer, such as waiting on the
+ * flash, is to be polled for from one run to the next
+ */
+#define RUN_TASK_PEAK_MAX	SIM_TICKS_US(PLATFORM_TICK_PERIOD_US)
+
+/*
+ * Latest a capture time stamp may be on the first byte of its frame: the
+ * RXC handler's latency, behind whatever else is running
+ */
+#define RUN_CAP_LATE_MAX	SIM_TICKS_US(20)
+
+/// SERCOM of each USART channel
+static const unsigned int run_sercom[PLATFORM_USART_NR_CH] = {
+	[PLATFORM_USART_ESP] = 0,
+	[PLATFORM_USART_CO2] = 1,
+	[PLATFORM_USART_PMS] = 3,
+	[PLATFORM_USART_GPS] = 5,
+};
+
+static const char *const run_ch_name[PLATFORM_USART_NR_CH] = {
+	[PLATFORM_USART_ESP] = "esp",
+	[PLATFORM_USART_CO2] = "co2",
+	[PLATFORM_USART_PMS] = "pms",
+	[PLATFORM_USART_GPS] = "gps",
+};
+
+static struct {
+	double		secs;
+	double		slowdown;
+	bool		check;
+
+	/// Capture written, or replayed, if any
+	const char	*capture;
+	const char	*replay;
+	bool		fast;
+	replay_capture_t cap;
+
+	/// Host time at the start of the run
+	struct timespec	t0;
+
+	/// Driver counters, summed over every reset by the firmware
+	platform_usart_stats_t usart[PLATFORM_USART_NR_CH];
+
+	platform_task_t	*tasks[RUN_NR_TASKS];
+	platform_tick_t	late_max[RUN_NR_TASKS];
+	unsigned int	nr_tasks;
+
+	/// Firmware time against simulated time: when next, and worst so far
+	sim_time_t	clock_next;
+	int64_t		clock_err_max;
+	uint32_t	nr_clock_checks;
+} run;
+
+/////////////////////////////////////////////////////////////////////////////
+
+/*
+ * The firmware takes (and resets) the driver counters itself, so every
+ * snapshot is added up on its way out
+ */
+void __real_platform_usart_stats(platform_usart_ch_t ch,
+	platform_usart_stats_t *stats, bool reset);
+
+static void run_usart_add(platform_usart_stats_t *acc,
+	const platform_usart_stats_t *s)
+{
+	acc->nr_rx_bytes += s->nr_rx_bytes;
+	acc->nr_tx_bytes += s->nr_tx_bytes;
+	acc->nr_rx_dropped += s->nr_rx_dropped;
+	acc->nr_err_frame += s->nr_err_frame;
+	acc->nr_err_parity += s->nr_err_parity;
+	acc->nr_err_overflow += s->nr_err_overflow;
+	acc->nr_err_dma += s->nr_err_dma;
+	acc->nr_compl_idle += s->nr_compl_idle;
+	acc->nr_compl_full += s->nr_compl_full;
+	acc->nr_compl_frame += s->nr_compl_frame;
+	if (s->isr_time_peak > acc->isr_time_peak)
+		acc->isr_time_peak = s->isr_time_peak;
+}
+
+void __wrap_platform_usart_stats(platform_usart_ch_t ch,
+	platform_usart_stats_t *stats, bool reset)
+{
+	__real_platform_usart_stats(ch, stats, reset);
+	if (reset && ch < PLATFORM_USART_NR_CH)
+		run_usart_add(&run.usart[ch], stats);
+}
+
+/*
+ * Once a simulated second, see that the firmware keeps time through its
+ * sleeps: its tick must be the time since SysTick first loaded, to the
+ * clock. The tick is read with interrupts masked, as the firmware would;
+ * VAL is read on the first access, a clock in.
+ */
+static void run_check_clock(void)
+{
+	platform_tick_t fw;
+	sim_stats_t st;
+	sim_time_t t;
+	uint32_t primask;
+	int64_t err;
+
+	if (sim_now() < run.clock_next)
+		return;
+	primask = __get_PRIMASK();
+	__disable_irq();
+	t = sim_now();
+	fw = platform_tick_get();
+	__set_PRIMASK(primask);
+
+	sim_stats(&st);
+	err = (int64_t)(fw - (t + 1 - st.systick_zero));
+	if (err < 0)
+		err = -err;
+	if (err > run.clock_err_max)
+		run.clock_err_max = err;
+	++run.nr_clock_checks;
+	run.clock_next = t + SIM_TICKS_MS(1000);
+}
+
+// Keep track of the tasks, and of how late each got to run
+void __real_platform_task_start(platform_task_t *task, platform_tick_t delay,
+	platform_tick_t period);
+void __real_platform_sched_run(platform_tick_t now);
+
+void __wrap_platform_task_start(platform_task_t *task, platform_tick_t delay,
+	platform_tick_t period)
+{
+	unsigned int x;
+
+	for (x = 0; x < run.nr_tasks && run.tasks[x] != task; ++x)
+		;
+	if (x == run.nr_tasks && x < RUN_NR_TASKS)
+		run.tasks[run.nr_tasks++] = task;
+	__real_platform_task_start(task, delay, period);
+}
+
+void __wrap_platform_sched_run(platform_tick_t now)
+{
+	const platform_task_t *t;
+	unsigned int x;
+
+	for (x = 0; x < run.nr_tasks; ++x) {
+		t = run.tasks[x];
+		if (t->armed && platform_tick_expired(now, t->due) &&
+		    now - t->due > run.late_max[x])
+			run.late_max[x] = now - t->due;
+	}
+	__real_platform_sched_run(now);
+	run_check_clock();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+static double run_us(sim_time_t t)
+{
+	return (double)t / SIM_TICKS_PER_US;
+}
+
+static double run_host_secs(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (double)(t.tv_sec - run.t0.tv_sec) +
+		(t.tv_nsec - run.t0.tv_nsec) * 1e-9;
+}
+
+// The replay; returns false if the firmware did not get all of it right
+static bool run_report_replay(void)
+{
+	static const char *const name[SENSOR_NR] = {
+		[SENSOR_GPS] = "gps",
+		[SENSOR_PMS] = "pms",
+		[SENSOR_CO2] = "co2",
+	};
+	replay_stats_t rs;
+	uint32_t total = 0;
+	double busy, host;
+	unsigned int x;
+	bool ok = true;
+
+	printf("\nreplay of %s: %.1f s of traffic in %u frames, %u lost, "
+		"%u after a loss; %s\n", run.replay,
+		run_us(run.cap.span) / 1e6, run.cap.nr_frames, run.cap.nr_lost,
+		run.cap.nr_loss, run.fast ? "back-to-back" : "as recorded");
+	printf("sensor frames   bytes    sent   busy s     B/s  items "
+		"matched missed wrong\n");
+	for (x = 0; x < SENSOR_NR; ++x) {
+		replay_stats((sensor_t)x, &rs);
+		busy = run_us(rs.busy) / 1e6;
+		printf("%-6s %6u %7u %7u %8.2f %7.0f %6u %7u %6u %5u\n",
+			name[x], rs.nr_frames, rs.nr_bytes, rs.nr_sent, busy,
+			busy > 0 ? rs.nr_sent / busy : 0, rs.nr_items,
+			rs.nr_matched, rs.nr_items - rs.nr_matched,
+			rs.nr_wrong);
+		total += rs.nr_sent;
+
+		if (rs.nr_sent != rs.nr_bytes ||
+		    rs.nr_matched != rs.nr_items || rs.nr_wrong != 0)
+			ok = false;
+	}
+	host = run_host_secs();
+	printf("%u bytes replayed in %.2f s on the host, %.0f B/s\n", total,
+		host, host > 0 ? total / host : 0);
+	return ok;
+}
+
+// The virtual sensors, and the telemetry; returns false if anything is off
+static bool run_report_sensors(void)
+{
+	sensors_stats_t ss;
+	unsigned int x;
+	bool ok = true;
+
+	sensors_stats(&ss);
+	printf("\nsensors: %u fixes, %u PMS frames, %u CO2 readings "
+		"(%u requests, %u garbled)\n",
+		ss.nr_samples[SENSOR_GPS], ss.nr_samples[SENSOR_PMS],
+		ss.nr_samples[SENSOR_CO2], ss.nr_co2_requests,
+		ss.nr_co2_bad_requests);
+	printf("uplink: %u bytes, %u bad frames; %u telemetry records, "
+		"%u lost, %u statistics (%u bad), %u epochs (%u bad), "
+		"%u log batches (%u bad)\n",
+		ss.nr_uplink_bytes, ss.nr_uplink_bad, ss.nr_records,
+		ss.nr_records_lost, ss.nr_stats, ss.nr_stats_bad, ss.nr_epochs,
+		ss.nr_epochs_bad, ss.nr_logs, ss.nr_logs_bad);
+	printf("checked against the sensors: gps %u/%u, pms %u/%u, "
+		"co2 %u/%u wrong\n",
+		ss.nr_wrong[SENSOR_GPS], ss.nr_checked[SENSOR_GPS],
+		ss.nr_wrong[SENSOR_PMS], ss.nr_checked[SENSOR_PMS],
+		ss.nr_wrong[SENSOR_CO2], ss.nr_checked[SENSOR_CO2]);
+
+	// One record a second, but for the first and the one in flight
+	if (ss.nr_records + 2 < (uint32_t)run.secs || ss.nr_records_lost != 0 ||
+	    ss.nr_co2_bad_requests != 0)
+		ok = false;
+
+	// Everything on the uplink is framed, and must decode
+	if (ss.nr_uplink_bad != 0 || ss.nr_logs_bad != 0)
+		ok = false;
+
+	// Statistics every 10 s, but not while capturing
+	if (ss.nr_stats_bad != 0 ||
+	    (run.capture == NULL && ss.nr_stats + 1 < (uint32_t)run.secs / 10))
+		ok = false;
+
+	// Epoch records along with the telemetry, again not while capturing
+	if (ss.nr_epochs_bad != 0 ||
+	    (run.capture == NULL && ss.nr_epochs + 2 < (uint32_t)run.secs))
+		ok = false;
+	for (x = 0; x < SENSOR_NR; ++x) {
+		if (ss.nr_checked[x] == 0 || ss.nr_wrong[x] != 0)
+			ok = false;
+	}
+
+	if (run.capture == NULL)
+		return ok;
+	printf("capture: %u frames, %u bytes, %u lost, %u bytes wrong; "
+		"stamped %.1f us early to %.1f us late\n",
+		ss.nr_cap_frames, ss.nr_cap_bytes, ss.nr_cap_lost,
+		ss.nr_cap_wrong, run_us(ss.cap_stamp_early_max),
+		run_us(ss.cap_stamp_late_max));
+	if (ss.nr_cap_frames == 0 || ss.nr_cap_lost != 0 ||
+	    ss.nr_cap_wrong != 0)
+		ok = false;
+	// Stamps are rounded down, so are less than a time unit early
+	if (run.slowdown == 0 &&
+	    (ss.cap_stamp_early_max >= (1u << PLATFORM_USART_CAP_TIME_SHIFT) ||
+	     ss.cap_stamp_late_max > RUN_CAP_LATE_MAX))
+		ok = false;
+	return ok;
+}
+
+// Print the report; returns false if anything went wrong
+static bool run_report(void)
+{
+	platform_usart_stats_t fw;
+	sim_usart_stats_t wire;
+	sim_stats_t st;
+	const platform_task_t *t;
+	double period, duty;
+	unsigned int ch, x;
+	bool ok = true;
+
+	sim_stats(&st);
+
+	printf("%.1f s simulated\n\n", run.secs);
+	printf("link  baud  offered arrived    read overrun garbled      tx"
+		"   rxc lat max/avg us  isr peak us\n");
+	for (ch = 0; ch < PLATFORM_USART_NR_CH; ++ch) {
+		sim_usart_stats(run_sercom[ch], &wire);
+		__real_platform_usart_stats((platform_usart_ch_t)ch, &fw,
+			false);
+		run_usart_add(&run.usart[ch], &fw);
+		fw = run.usart[ch];
+
+		printf("%-4s %5.0f %8u %7u %7u %7u %7u %7u %10.1f/%-8.1f %8.1f\n",
+			run_ch_name[ch], sim_usart_baud(run_sercom[ch]),
+			wire.nr_offered, wire.nr_arrived, wire.nr_read,
+			wire.nr_overrun, wire.nr_garbled, wire.nr_tx,
+			run_us(wire.rxc_lat_max),
+			wire.nr_rxc ? run_us(wire.rxc_lat_total) / wire.nr_rxc : 0,
+			run_us(fw.isr_time_peak));
+		printf("      driver: %u bytes in, %u out, %u dropped, "
+			"%u frame/%u parity/%u overflow/%u DMAC errors\n",
+			fw.nr_rx_bytes, fw.nr_tx_bytes, fw.nr_rx_dropped,
+			fw.nr_err_frame, fw.nr_err_parity, fw.nr_err_overflow,
+			fw.nr_err_dma);
+
+		if (wire.nr_overrun != 0 || wire.nr_garbled != 0 ||
+		    fw.nr_rx_dropped != 0 ||
+		    fw.nr_err_frame != 0 ||
+		    fw.nr_err_parity != 0 || fw.nr_err_overflow != 0 ||
+		    fw.nr_err_dma != 0)
+			ok = false;
+	}
+
+	printf("\ntask      runs missed  late max us  run peak us  "
+		"run avg us\n");
+	for (x = 0; x < run.nr_tasks; ++x) {
+		t = run.tasks[x];
+		printf("%-8s %5u %6u %12.1f %12.1f %11.1f\n",
+			t->name != NULL ? t->name : "?", t->stats.nr_runs,
+			t->stats.nr_missed, run_us(run.late_max[x]),
+			run_us(t->stats.runtime_peak),
+			t->stats.nr_runs ? run_us(t->stats.runtime_total) /
+				t->stats.nr_runs : 0);
+		if (t->stats.nr_missed != 0 ||
+		    (t->stats.runtime_peak > RUN_TASK_PEAK_MAX &&
+		     run.slowdown == 0))
+			ok = false;
+	}
+
+	printf("\nasleep %.1f%% in %u sleeps; awake for %.1f us at most, "
+		"%.1f us on average\n",
+		100.0 * run_us(st.asleep) / (run.secs * 1e6), st.nr_sleeps,
+		run_us(st.awake_max),
+		st.nr_sleeps ? run_us(st.awake_total) / st.nr_sleeps : 0);
+	printf("%u interrupts, %.1f%% of the time; SysTick kept waiting "
+		"%.1f us at most\n", st.nr_isr,
+		100.0 * run_us(st.in_isr) / (run.secs * 1e6),
+		run_us(st.systick_lat_max));
+	printf("firmware clock: off by %lld SysTick clocks at most, "
+		"in %u checks\n", (long long)run.clock_err_max,
+		run.nr_clock_checks);
+	if (run.nr_clock_checks == 0 ||
+	    (run.clock_err_max > RUN_CLOCK_ERR_MAX && run.slowdown == 0))
+		ok = false;
+	printf("flash: %u rows erased, %u pages written\n",
+		st.nr_flash_erases, st.nr_flash_writes);
+	if (sim_tcc1_pwm(&period, &duty))
+		printf("TCC1 PWM: %.3f s period, %.2f%% duty\n", period,
+			100.0 * duty);
+
+	if (!(run.replay != NULL ? run_report_replay() : run_report_sensors()))
+		ok = false;
+
+	printf("\n%s\n", ok ? "PASS" : "FAIL");
+	return ok;
+}
+
+static void run_done(void)
+{
+	bool ok = run_report();
+
+	fflush(stdout);
+	exit((run.check && !ok) ? 1 : 0);
+}
+
+int main(int argc, char **argv)
+{
+	bool secs_given = false;
+	int opt;
+
+	clock_gettime(CLOCK_MONOTONIC, &run.t0);
+	run.secs = 60;
+	while ((opt = getopt(argc, argv, "t:x:cw:r:f")) != -1) {
+		switch (opt) {
+		case 't':
+			run.secs = atof(optarg);
+			secs_given = true;
+			break;
+		case 'x':
+			run.slowdown = atof(optarg);
+			break;
+		case 'c':
+			run.check = true;
+			break;
+		case 'w':
+			run.capture = optarg;
+			break;
+		case 'r':
+			run.replay = optarg;
+			break;
+		case 'f':
+			run.fast = true;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-t seconds] [-x slowdown] "
+				"[-c] [-w capture | -r capture [-f]]\n",
+				argv[0]);
+			return 2;
+		}
+	}
+
+	if (run.replay != NULL) {
+		if (!replay_load(run.replay, run.fast, &run.cap)) {
+			fprintf(stderr, "%s: no traffic to replay in %s\n",
+				argv[0], run.replay);
+			return 2;
+		}
+		if (!secs_given)
+			run.secs = run_us(run.cap.duration) / 1e6;
+	}
+
+	sim_init((sim_time_t)(run.secs * 1e6) * SIM_TICKS_PER_US, run.slowdown,
+		run_done);
+	if (run.replay != NULL) {
+		replay_attach();
+	} else {
+		sensors_attach();
+		if (run.capture != NULL && !sensors_capture(run.capture)) {
+			perror(run.capture);
+			return 2;
+		}
+	}
+	fw_main();
+	return 1;
+}
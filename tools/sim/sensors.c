@@ -0,0 +1,531 @@
+/**
+ * @file sensors.c
+ * @brief Virtual sensors and uplink for the simulated board
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "platform.h"
+#include "telem.h"
+#include "cap.h"
+#include "fuse.h"
+#include "mhz19.h"
+#include "pms.h"
+#include "nmea.h"
+#include "sim.h"
+#include "sensors.h"
+
+/// SERCOMs the devices are wired to, as on the board
+#define SERCOM_ESP	0
+#define SERCOM_CO2	1
+#define SERCOM_PMS	3
+#define SERCOM_GPS	5
+
+/// Readings kept per sensor, for checking the telemetry against
+#define NR_HISTORY	8
+
+/// Time from the end of a request to the start of the MH-Z19C's response
+#define CO2_RESPONSE_US	2000
+
+/// When the ESP8266 sends the capture command, if asked to
+#define CAPTURE_AT_MS	500
+
+/// A device, and the readings it sent last
+typedef struct sensor_dev_type {
+	sim_dev_t	dev;
+	unsigned int	sercom;
+	uint32_t	nr_samples;
+	int32_t		history[NR_HISTORY];
+	unsigned int	nr_history;
+
+	/// When capturing: all bytes sent, and the time each was through
+	uint8_t		*sent;
+	sim_time_t	*sent_at;
+	size_t		nr_sent;
+	size_t		sent_size;
+
+	/// Where the captured bytes are up to in @c sent; valid if @c synced
+	size_t		cap_pos;
+	bool		cap_synced;
+} sensor_dev_t;
+
+static void gps_run(sim_dev_t *dev);
+static void pms_run(sim_dev_t *dev);
+static void co2_rx(sim_dev_t *dev, uint8_t c);
+static void co2_run(sim_dev_t *dev);
+static void esp_rx(sim_dev_t *dev, uint8_t c);
+static void esp_run(sim_dev_t *dev);
+
+static sensor_dev_t gps = {
+	.dev = { .name = "gps", .baud = 9600, .run = gps_run },
+	.sercom = SERCOM_GPS,
+};
+static sensor_dev_t pms = {
+	.dev = { .name = "pms", .baud = 9600, .run = pms_run },
+	.sercom = SERCOM_PMS,
+};
+static sensor_dev_t co2 = {
+	.dev = { .name = "co2", .baud = 9600, .rx = co2_rx, .run = co2_run },
+	.sercom = SERCOM_CO2,
+};
+static sim_dev_t esp = {
+	.name = "esp", .baud = 9600, .rx = esp_rx, .run = esp_run
+};
+
+static sensor_dev_t *const sensors[SENSOR_NR] = {
+	[SENSOR_GPS] = &gps,
+	[SENSOR_PMS] = &pms,
+	[SENSOR_CO2] = &co2,
+};
+
+/// Sensor each USART channel of a capture belongs to, if any
+static sensor_dev_t *const sensors_by_ch[PLATFORM_USART_NR_CH] = {
+	[PLATFORM_USART_CO2] = &co2,
+	[PLATFORM_USART_PMS] = &pms,
+	[PLATFORM_USART_GPS] = &gps,
+};
+
+static struct {
+	uint8_t		co2_req[9];
+	unsigned int	co2_req_len;
+	telem_decoder_t	dec;
+	sensors_stats_t	stats;
+
+	/// Last epoch decoded
+	uint32_t	epoch;
+
+	/// Where the uplink goes when capturing, and the capture decoder
+	FILE		*cap_file;
+	cap_decoder_t	cap_dec;
+} sensors_ctx;
+
+/////////////////////////////////////////////////////////////////////////////
+
+// Note a reading as sent, and send it
+static void sensor_send(sensor_dev_t *s, int32_t reading, const void *buf,
+	size_t len)
+{
+	const sim_time_t t_char = (sim_time_t)(10.0 * SIM_TICKS_PER_US * 1e6 /
+		s->dev.baud + 0.5);
+	size_t x;
+
+	s->history[s->nr_history++ % NR_HISTORY] = reading;
+	++s->nr_samples;
+	sim_usart_send(s->sercom, buf, len);
+
+	// The line is idle in between, so each byte is through a character later
+	if (sensors_ctx.cap_file == NULL)
+		return;
+	if (s->nr_sent + len > s->sent_size) {
+		s->sent_size = 2 * (s->nr_sent + len);
+		s->sent = realloc(s->sent, s->sent_size);
+		s->sent_at = realloc(s->sent_at,
+			s->sent_size * sizeof(s->sent_at[0]));
+		if (s->sent == NULL || s->sent_at == NULL)
+			abort();
+	}
+	for (x = 0; x < len; ++x) {
+		s->sent[s->nr_sent] = ((const uint8_t *)buf)[x];
+		s->sent_at[s->nr_sent++] = sim_now() + (x + 1) * t_char;
+	}
+}
+
+static bool sensor_check(sensor_t sensor, int32_t reading)
+{
+	const sensor_dev_t *s = sensors[sensor];
+	unsigned int x;
+
+	++sensors_ctx.stats.nr_checked[sensor];
+	for (x = 0; x < NR_HISTORY && x < s->nr_history; ++x) {
+		if (s->history[x] == reading)
+			return true;
+	}
+	++sensors_ctx.stats.nr_wrong[sensor];
+	return false;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+// Append an NMEA sentence, with its checksum, to @p out
+static size_t nmea_put(char *out, const char *body)
+{
+	uint8_t sum = 0;
+	const char *p;
+
+	for (p = body; *p != '\0'; ++p)
+		sum ^= (uint8_t)*p;
+	return (size_t)sprintf(out, "$%s*%02X\r\n", body, sum);
+}
+
+/*
+ * Once a second, the NEO-6M default set of sentences; the latitude moves by
+ * 0.006' (10^-4 degrees, exactly) per fix, so that it converts exactly too
+ */
+static void gps_run(sim_dev_t *dev)
+{
+	sensor_dev_t *s = (sensor_dev_t *)dev;
+	uint32_t k = s->nr_samples;
+	uint32_t min_e5 = 703800 + 600 * (k % 100);
+	uint32_t t = 12 * 3600 + k;
+	char body[96], out[640];
+	size_t len = 0;
+
+	snprintf(body, sizeof(body),
+		"GPRMC,%02u%02u%02u.00,A,48%02u.%05u,N,01131.20000,E,"
+		"0.512,77.52,160526,,,A",
+		t / 3600 % 24, t / 60 % 60, t % 60,
+		min_e5 / 100000, min_e5 % 100000);
+	len += nmea_put(&out[len], body);
+	len += nmea_put(&out[len], "GPVTG,77.52,T,,M,0.512,N,0.948,K,A");
+	snprintf(body, sizeof(body),
+		"GPGGA,%02u%02u%02u.00,48%02u.%05u,N,01131.20000,E,1,08,"
+		"1.01,545.4,M,46.9,M,,",
+		t / 3600 % 24, t / 60 % 60, t % 60,
+		min_e5 / 100000, min_e5 % 100000);
+	len += nmea_put(&out[len], body);
+	len += nmea_put(&out[len], "GPGSA,A,3,04,05,09,12,24,25,29,31,,,,,"
+		"2.11,1.01,1.85");
+	len += nmea_put(&out[len], "GPGSV,3,1,11,04,41,287,34,05,26,052,31,"
+		"09,17,312,28,12,69,190,37");
+	len += nmea_put(&out[len], "GPGSV,3,2,11,24,44,223,33,25,11,133,22,"
+		"29,20,084,30,31,15,261,27");
+	len += nmea_put(&out[len], "GPGSV,3,3,11,02,04,348,,14,02,170,,"
+		"20,01,031,");
+	snprintf(body, sizeof(body),
+		"GPGLL,48%02u.%05u,N,01131.20000,E,%02u%02u%02u.00,A,A",
+		min_e5 / 100000, min_e5 % 100000,
+		t / 3600 % 24, t / 60 % 60, t % 60);
+	len += nmea_put(&out[len], body);
+
+	sensor_send(s, 480000000 + (int32_t)(min_e5 * 100 / 60), out, len);
+	dev->due += SIM_TICKS_MS(1000);
+}
+
+// Once a second, in active mode
+static void pms_run(sim_dev_t *dev)
+{
+	sensor_dev_t *s = (sensor_dev_t *)dev;
+	uint32_t k = s->nr_samples;
+	uint16_t w[13], sum = 0;
+	uint8_t frame[32];
+	unsigned int x;
+
+	w[0] = (uint16_t)(8 + k % 7);
+	w[1] = (uint16_t)(12 + k % 13);
+	w[2] = (uint16_t)(15 + k % 17);
+	w[3] = w[0];
+	w[4] = w[1];
+	w[5] = w[2];
+	w[6] = 1500;
+	w[7] = 420;
+	w[8] = 88;
+	w[9] = 6;
+	w[10] = (uint16_t)(215 + k % 5);
+	w[11] = 456;
+	w[12] = 0x9700;
+
+	frame[0] = 0x42;
+	frame[1] = 0x4D;
+	frame[2] = 0;
+	frame[3] = 28;
+	for (x = 0; x < 13; ++x) {
+		frame[4 + 2 * x] = (uint8_t)(w[x] >> 8);
+		frame[5 + 2 * x] = (uint8_t)w[x];
+	}
+	for (x = 0; x < 30; ++x)
+		sum += frame[x];
+	frame[30] = (uint8_t)(sum >> 8);
+	frame[31] = (uint8_t)sum;
+
+	sensor_send(s, w[4], frame, sizeof(frame));
+	dev->due += SIM_TICKS_MS(1000);
+}
+
+// Requests come in nine bytes at a time; anything else is dropped
+static void co2_rx(sim_dev_t *dev, uint8_t c)
+{
+	static const uint8_t read_cmd[9] = {
+		0xFF, 0x01, 0x86, 0x00, 0x00, 0x00, 0x00, 0x00, 0x79
+	};
+
+	if (sensors_ctx.co2_req_len == 0 && c != 0xFF)
+		return;
+	sensors_ctx.co2_req[sensors_ctx.co2_req_len++] = c;
+	if (sensors_ctx.co2_req_len < sizeof(read_cmd))
+		return;
+	sensors_ctx.co2_req_len = 0;
+
+	++sensors_ctx.stats.nr_co2_requests;
+	if (memcmp(sensors_ctx.co2_req, read_cmd, sizeof(read_cmd)) != 0) {
+		++sensors_ctx.stats.nr_co2_bad_requests;
+		return;
+	}
+	dev->due = sim_now() + SIM_TICKS_US(CO2_RESPONSE_US);
+}
+
+static void co2_run(sim_dev_t *dev)
+{
+	sensor_dev_t *s = (sensor_dev_t *)dev;
+	uint16_t ppm = (uint16_t)(400 + 10 * (s->nr_samples % 50));
+	uint8_t resp[9] = { 0xFF, 0x86, (uint8_t)(ppm >> 8), (uint8_t)ppm,
+		0x47, 0x00, 0x00, 0x00, 0x00 };
+	uint8_t sum = 0;
+	unsigned int x;
+
+	for (x = 1; x < 8; ++x)
+		sum += resp[x];
+	resp[8] = (uint8_t)-sum;
+
+	sensor_send(s, ppm, resp, sizeof(resp));
+	dev->due = SIM_TIME_NEVER;
+}
+
+/*
+ * Find where the bytes of a capture frame were sent: the latest place they
+ * fit, as traffic repeats itself
+ */
+static bool cap_sync(sensor_dev_t *s, const cap_frame_t *f)
+{
+	size_t pos;
+
+	if (s->nr_sent < f->len)
+		return false;
+	for (pos = s->nr_sent - f->len + 1; pos-- > 0; ) {
+		if (memcmp(&s->sent[pos], f->data, f->len) == 0) {
+			s->cap_pos = pos;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Check a capture frame against what the sensor sent
+static void cap_check(const cap_frame_t *f)
+{
+	sensors_stats_t *st = &sensors_ctx.stats;
+	sensor_dev_t *s = NULL;
+	sim_stats_t sim_st;
+	sim_time_t stamp, at;
+	int64_t err;
+	unsigned int x;
+
+	++st->nr_cap_frames;
+	st->nr_cap_bytes += f->len;
+	if (f->loss)
+		++st->nr_cap_lost;
+	if (f->ch < PLATFORM_USART_NR_CH)
+		s = sensors_by_ch[f->ch];
+	if (s == NULL) {
+		st->nr_cap_wrong += f->len;
+		return;
+	}
+
+	if (!s->cap_synced || f->loss)
+		s->cap_synced = cap_sync(s, f);
+	if (!s->cap_synced) {
+		st->nr_cap_wrong += f->len;
+		return;
+	}
+
+	/*
+	 * The stamp is the firmware's tick in the RXC handler of the first
+	 * byte, rounded down to a time unit; the tick counts from a clock
+	 * after SysTick first loaded. So the stamp is up to a unit early on
+	 * when the byte was through, and late by the handler's latency.
+	 */
+	sim_stats(&sim_st);
+	stamp = (sim_time_t)f->when << PLATFORM_USART_CAP_TIME_SHIFT;
+	at = s->sent_at[s->cap_pos] + 1 - sim_st.systick_zero;
+	err = (int64_t)(stamp - at);
+	if (err < 0 && (sim_time_t)-err > st->cap_stamp_early_max)
+		st->cap_stamp_early_max = (sim_time_t)-err;
+	if (err > 0 && (sim_time_t)err > st->cap_stamp_late_max)
+		st->cap_stamp_late_max = (sim_time_t)err;
+
+	for (x = 0; x < f->len; ++x) {
+		if (s->cap_pos >= s->nr_sent ||
+		    s->sent[s->cap_pos++] != f->data[x]) {
+			st->nr_cap_wrong += f->len - x;
+			s->cap_synced = false;
+			return;
+		}
+	}
+}
+
+// A statistics message must hold every channel, and the idle counters
+static void esp_check_stats(const telem_msg_t *msg)
+{
+	const uint8_t *idle = msg->data + 1 + PLATFORM_USART_NR_CH * 11 * 4;
+	uint64_t total = 0, asleep = 0;
+	uint32_t nr_sleeps = 0, nr_restarts = 0;
+	unsigned int x;
+
+	++sensors_ctx.stats.nr_stats;
+	if (msg->len != 1 + PLATFORM_USART_NR_CH * 11 * 4 + 8 + 8 + 4 + 4 ||
+	    msg->data[0] != PLATFORM_USART_NR_CH) {
+		++sensors_ctx.stats.nr_stats_bad;
+		return;
+	}
+	for (x = 0; x < 8; ++x) {
+		total |= (uint64_t)idle[x] << (8 * x);
+		asleep |= (uint64_t)idle[8 + x] << (8 * x);
+	}
+	for (x = 0; x < 4; ++x) {
+		nr_sleeps |= (uint32_t)idle[16 + x] << (8 * x);
+		nr_restarts |= (uint32_t)idle[20 + x] << (8 * x);
+	}
+
+	// At most two restarts per sleep, one to go to sleep and one on waking
+	if (total == 0 || asleep > total ||
+	    nr_restarts > 2 * (uint64_t)nr_sleeps)
+		++sensors_ctx.stats.nr_stats_bad;
+}
+
+// An epoch record must hold every sample, and follow the one before it
+static void esp_check_epoch(const telem_msg_t *msg)
+{
+	static const uint8_t size[FUSE_NR_SRC] = {
+		[FUSE_SRC_CO2] = sizeof(mhz19_sample_t),
+		[FUSE_SRC_PMS] = sizeof(pms_data_t),
+		[FUSE_SRC_GPS] = sizeof(nmea_fix_t),
+	};
+	fuse_hdr_t hdr;
+
+	++sensors_ctx.stats.nr_epochs;
+	if (msg->len != sizeof(hdr) + sizeof(mhz19_sample_t) +
+	    sizeof(pms_data_t) + sizeof(nmea_fix_t)) {
+		++sensors_ctx.stats.nr_epochs_bad;
+		return;
+	}
+	memcpy(&hdr, msg->data, sizeof(hdr));
+	if (memcmp(hdr.size, size, sizeof(size)) != 0 ||
+	    hdr.epoch <= sensors_ctx.epoch)
+		++sensors_ctx.stats.nr_epochs_bad;
+	sensors_ctx.epoch = hdr.epoch;
+}
+
+// Format strings of the firmware's log, as platform/log.c has them
+extern const char __start_logfmt[], __stop_logfmt[];
+
+// A log batch must hold whole messages, each of a known format string
+static void esp_check_logs(const telem_msg_t *msg)
+{
+	const size_t size = (size_t)(__stop_logfmt - __start_logfmt);
+	const uint8_t *p = msg->data + 4;
+	uint32_t off, nr_words, nr;
+
+	++sensors_ctx.stats.nr_logs;
+	nr_words = (uint32_t)(msg->data[0] | (msg->data[1] << 8));
+	if (msg->len < 4 || msg->len != 4 + 4 * (size_t)nr_words) {
+		++sensors_ctx.stats.nr_logs_bad;
+		return;
+	}
+	while (nr_words >= 2) {
+		memcpy(&off, p, sizeof(off));
+		memcpy(&nr, p + 4, sizeof(nr));
+		nr >>= 28;
+		if (off >= size ||
+		    memchr(__start_logfmt + off, 0, size - off) == NULL ||
+		    nr > PLATFORM_LOG_MAX_ARGS || 2 + nr > nr_words)
+			break;
+		p += 4 * (2 + nr);
+		nr_words -= 2 + nr;
+	}
+	if (nr_words != 0)
+		++sensors_ctx.stats.nr_logs_bad;
+}
+
+/*
+ * Telemetry frames and other messages are picked out of everything else on
+ * the uplink by their delimiters; capture frames come out as messages of
+ * their own, and are left to the capture decoder.
+ */
+static void esp_rx(sim_dev_t *dev, uint8_t c)
+{
+	telem_record_t rec;
+	telem_msg_t msg;
+	cap_frame_t f;
+
+	(void)dev;
+	++sensors_ctx.stats.nr_uplink_bytes;
+	if (sensors_ctx.cap_file != NULL) {
+		fputc(c, sensors_ctx.cap_file);
+		if (cap_feed_byte(&sensors_ctx.cap_dec, c, &f))
+			cap_check(&f);
+	}
+	switch (telem_feed(&sensors_ctx.dec, c, &rec, &msg)) {
+	case TELEM_FEED_RECORD:
+		break;
+	case TELEM_FEED_MSG:
+		if (msg.type == TELEM_TYPE_STATS)
+			esp_check_stats(&msg);
+		else if (msg.type == TELEM_TYPE_EPOCH)
+			esp_check_epoch(&msg);
+		else if (msg.type == TELEM_TYPE_LOGS)
+			esp_check_logs(&msg);
+		return;
+	default:
+		return;
+	}
+
+	++sensors_ctx.stats.nr_records;
+	if ((rec.flags & TELEM_F_GPS) != 0)
+		sensor_check(SENSOR_GPS, rec.lat_e7);
+	if ((rec.flags & TELEM_F_PMS) != 0)
+		sensor_check(SENSOR_PMS, rec.pm2_5);
+	if ((rec.flags & TELEM_F_CO2) != 0)
+		sensor_check(SENSOR_CO2, rec.co2_ppm);
+}
+
+// Ask for a capture
+static void esp_run(sim_dev_t *dev)
+{
+	static const char cmd[] = "CAPTURE\n";
+
+	sim_usart_send(SERCOM_ESP, cmd, sizeof(cmd) - 1);
+	dev->due = SIM_TIME_NEVER;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+void sensors_attach(void)
+{
+	telem_decoder_init(&sensors_ctx.dec);
+
+	// Out of step with each other, and with the firmware's tasks
+	gps.dev.due = SIM_TICKS_MS(130);
+	pms.dev.due = SIM_TICKS_MS(370);
+	co2.dev.due = SIM_TIME_NEVER;
+	esp.due = SIM_TIME_NEVER;
+
+	sim_usart_attach(SERCOM_GPS, &gps.dev);
+	sim_usart_attach(SERCOM_PMS, &pms.dev);
+	sim_usart_attach(SERCOM_CO2, &co2.dev);
+	sim_usart_attach(SERCOM_ESP, &esp);
+}
+
+bool sensors_capture(const char *path)
+{
+	sensors_ctx.cap_file = fopen(path, "wb");
+	if (sensors_ctx.cap_file == NULL)
+		return false;
+	cap_decoder_init(&sensors_ctx.cap_dec);
+	esp.due = SIM_TICKS_MS(CAPTURE_AT_MS);
+	return true;
+}
+
+void sensors_stats(sensors_stats_t *stats)
+{
+	unsigned int x;
+
+	*stats = sensors_ctx.stats;
+	for (x = 0; x < SENSOR_NR; ++x)
+		stats->nr_samples[x] = sensors[x]->nr_samples;
+	stats->nr_records_lost = sensors_ctx.dec.nr_lost;
+	stats->nr_uplink_bad = sensors_ctx.dec.nr_bad;
+	stats->nr_cap_lost += sensors_ctx.cap_dec.nr_lost;
+}
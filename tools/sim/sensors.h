@@ -0,0 +1,106 @@
+/**
+ * @file sensors.h
+ * @brief Virtual sensors and uplink for the simulated board
+ *
+ * The NEO-6M, PMS5003T and MH-Z19C send what the real ones do, at the same
+ * rates; the readings change with every sample, and each sensor keeps the
+ * last few it sent. The ESP8266 decodes the telemetry frames coming from the
+ * firmware, and checks every field against those.
+ *
+ * When asked to, the ESP8266 also has the firmware capture the traffic of
+ * the sensors, keeps everything it receives in a file, and checks the
+ * captured bytes, and their time stamps, against what was sent.
+ */
+
+#if !defined(SENSORS_H_)
+#define SENSORS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sim.h"
+
+// C linkage should be maintained
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+
+/// Sensors whose readings are checked
+typedef enum sensor_type {
+	SENSOR_GPS = 0,
+	SENSOR_PMS,
+	SENSOR_CO2,
+
+	SENSOR_NR
+} sensor_t;
+
+/// Counters of the virtual sensors and uplink
+typedef struct sensors_stats_type {
+	/// Samples sent by each sensor (fixes, frames, responses)
+	uint32_t	nr_samples[SENSOR_NR];
+
+	/// Read requests received by the MH-Z19C, and those that were garbled
+	uint32_t	nr_co2_requests;
+	uint32_t	nr_co2_bad_requests;
+
+	/// Bytes received by the ESP8266, and frames in them that did not decode
+	uint32_t	nr_uplink_bytes;
+	uint32_t	nr_uplink_bad;
+
+	/// Telemetry records decoded; delta records lost with the one before
+	uint32_t	nr_records;
+	uint32_t	nr_records_lost;
+
+	/// Statistics messages decoded, and those not laid out as they should
+	uint32_t	nr_stats;
+	uint32_t	nr_stats_bad;
+
+	/// Epoch records decoded, and those not laid out as they should
+	uint32_t	nr_epochs;
+	uint32_t	nr_epochs_bad;
+
+	/// Log batches decoded, and those not laid out as they should
+	uint32_t	nr_logs;
+	uint32_t	nr_logs_bad;
+
+	/// Fields checked against the sensors, and those that did not match
+	uint32_t	nr_checked[SENSOR_NR];
+	uint32_t	nr_wrong[SENSOR_NR];
+
+	/// Capture frames decoded off the uplink, and bytes of traffic in them
+	uint32_t	nr_cap_frames;
+	uint32_t	nr_cap_bytes;
+
+	/// Capture frames lost on the uplink, or flagged as following a loss
+	uint32_t	nr_cap_lost;
+
+	/// Captured bytes that were not what the sensor sent
+	uint32_t	nr_cap_wrong;
+
+	/// How much earlier and later than the first byte frames were stamped
+	sim_time_t	cap_stamp_early_max;
+	sim_time_t	cap_stamp_late_max;
+} sensors_stats_t;
+
+/// Put the sensors and the ESP8266 on their USARTs
+void sensors_attach(void);
+
+/**
+ * Have the ESP8266 start a capture with the "CAPTURE" command, and write all
+ * it receives to @p path; call after @c sensors_attach()
+ *
+ * @return	@c false if the file cannot be created
+ */
+bool sensors_capture(const char *path);
+
+/// Get the counters
+void sensors_stats(sensors_stats_t *stats);
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifdef __cplusplus
+}
+#endif	// __cplusplus
+#endif	// !defined(SENSORS_H_)
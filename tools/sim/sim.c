@@ -0,0 +1,1509 @@
+/**
+ * @file sim.c
+ * @brief Simulated PIC32CM LS00: NVIC, SysTick, SERCOM USARTs, TCC1, NVMCTRL,
+ *	  DMAC
+ */
+
+/*
+ * Writes to plain memory cannot be trapped, so the models only see register
+ * writes when the firmware next calls into the simulator (see xc.h), and
+ * compare the registers against what they last published there:
+ *
+ * -- Write-1-to-clear and set/clear pairs (INTFLAG, INTENSET/INTENCLR) are
+ *    published with a reserved bit set, which the firmware never writes; a
+ *    value without it is a write.
+ * -- DATA is published with bit 31 set, and a value without it is a byte to
+ *    send. Reading DATA cannot be seen at all, so the receive buffer is
+ *    popped once the RXC handler returns; that is the only place the
+ *    firmware reads it from.
+ * -- SysTick VAL counts as written (cleared) whenever it differs from the
+ *    value published, and the same goes for a command in NVMCTRL CTRLA,
+ *    and for the channel registers of the DMAC. Those show the channel
+ *    selected by CHID, which is taken up (and the others published for it)
+ *    at the access after it was written.
+ * -- The page buffer of NVMCTRL is the flash mapping itself; pages that
+ *    differ from what was last programmed are written out, ANDed with the
+ *    old contents, once the buffer is written (or on WP with MANW set).
+ *
+ * The DMAC reads its descriptors and data by the 32-bit addresses the
+ * firmware programs, so the simulator is linked below 4 GiB (see the
+ * Makefile), and whatever the DMAC is given must not be on the stack. Only
+ * beat-triggered transfers into the DATA of the SERCOM whose transmitter
+ * triggers them are modelled, which is all the firmware does with it.
+ *
+ * Everything else is plain memory: the clock and power setup needs no more
+ * than its status bits reading as ready, and SYNCBUSY is always zero.
+ */
+
+#define _GNU_SOURCE
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include "sim.h"
+
+#if !defined(MAP_FIXED_NOREPLACE)
+#define MAP_FIXED_NOREPLACE	0x100000
+#endif
+
+/// Time charged per register access or intrinsic, and per interrupt taken
+#define SIM_COST_ACCESS	1
+#define SIM_COST_IRQ	8
+
+/*
+ * Memory the firmware reads by address: the data flash, and the software
+ * calibration row (for the DFLL coarse value)
+ */
+#define SIM_FLASH_ADDR	0x00400000u
+#define SIM_FLASH_SIZE	(8u * 1024)
+#define SIM_FLASH_PAGE	64u
+#define SIM_FLASH_ROW	256u
+#define SIM_CAL_ADDR	0x00806000u
+#define SIM_CAL_SIZE	4096u
+
+/// Flash timings, as assumed in tools/flogsim.c
+#define SIM_FLASH_WRITE_TIME	SIM_TICKS_US(2500)
+#define SIM_FLASH_ERASE_TIME	SIM_TICKS_US(6000)
+
+// SERCOM USART register bits
+#define USART_INT_DRE		(1 << 0)
+#define USART_INT_TXC		(1 << 1)
+#define USART_INT_RXC		(1 << 2)
+#define USART_INT_MARK		(1 << 6)
+#define USART_DATA_MARK		(1UL << 31)
+#define USART_STATUS_FERR	(1 << 1)
+#define USART_STATUS_BUFOVF	(1 << 2)
+
+/// Depth of the receive buffer
+#define USART_RX_FIFO		2
+
+/// Bytes a device may have on their way to a USART
+#define USART_LINE_LEN		4096
+
+// NVMCTRL register bits, besides those of xc.h
+#define NVM_CTRLB_MANW		(1 << 7)
+#define NVM_INT_MARK		(1 << 15)
+
+/// DMAC channels modelled: those with a vector of their own
+#define SIM_DMAC_NR_CH		2
+#define DMAC_CTRL_SWRST		(1 << 0)
+#define DMAC_CTRL_DMAENABLE	(1 << 1)
+#define DMAC_CHCTRLA_SWRST	(1 << 0)
+#define DMAC_CHCTRLA_ENABLE	(1 << 1)
+#define DMAC_BTCTRL_VALID	(1 << 0)
+#define DMAC_BTCTRL_BLOCKACT_INT (1 << 3)
+#define DMAC_BTCTRL_SRCINC	(1 << 10)
+#define DMAC_INT_TERR		(1 << 0)
+#define DMAC_INT_TCMPL		(1 << 1)
+#define DMAC_INT_MARK		(1 << 7)
+#define DMAC_STATUS_BUSY	(1 << 1)
+#define DMAC_STATUS_FERR	(1 << 2)
+
+/// One IRQ slot per interrupt number, plus one for SysTick in front
+#define SIM_NR_IRQ	(PERIPH_COUNT_IRQn + 1)
+#define SIM_IRQ_IDX(irq) ((int)(irq) + 1)
+
+// Handlers, as defined by the firmware; any of them may be missing
+extern void SysTick_Handler(void) __attribute__((weak));
+extern void EIC_EXTINT_2_Handler(void) __attribute__((weak));
+extern void DMAC_0_Handler(void) __attribute__((weak));
+extern void DMAC_1_Handler(void) __attribute__((weak));
+extern void SERCOM0_0_Handler(void) __attribute__((weak));
+extern void SERCOM0_1_Handler(void) __attribute__((weak));
+extern void SERCOM0_2_Handler(void) __attribute__((weak));
+extern void SERCOM1_0_Handler(void) __attribute__((weak));
+extern void SERCOM1_1_Handler(void) __attribute__((weak));
+extern void SERCOM1_2_Handler(void) __attribute__((weak));
+extern void SERCOM3_0_Handler(void) __attribute__((weak));
+extern void SERCOM3_1_Handler(void) __attribute__((weak));
+extern void SERCOM3_2_Handler(void) __attribute__((weak));
+extern void SERCOM5_0_Handler(void) __attribute__((weak));
+extern void SERCOM5_1_Handler(void) __attribute__((weak));
+extern void SERCOM5_2_Handler(void) __attribute__((weak));
+
+static const struct {
+	IRQn_Type	irq;
+	void		(*fn)(void);
+} sim_vectors[] = {
+	{ SysTick_IRQn,		SysTick_Handler },
+	{ EIC_EXTINT_2_IRQn,	EIC_EXTINT_2_Handler },
+	{ DMAC_0_IRQn,		DMAC_0_Handler },
+	{ DMAC_1_IRQn,		DMAC_1_Handler },
+	{ SERCOM0_0_IRQn,	SERCOM0_0_Handler },
+	{ SERCOM0_1_IRQn,	SERCOM0_1_Handler },
+	{ SERCOM0_2_IRQn,	SERCOM0_2_Handler },
+	{ SERCOM1_0_IRQn,	SERCOM1_0_Handler },
+	{ SERCOM1_1_IRQn,	SERCOM1_1_Handler },
+	{ SERCOM1_2_IRQn,	SERCOM1_2_Handler },
+	{ SERCOM3_0_IRQn,	SERCOM3_0_Handler },
+	{ SERCOM3_1_IRQn,	SERCOM3_1_Handler },
+	{ SERCOM3_2_IRQn,	SERCOM3_2_Handler },
+	{ SERCOM5_0_IRQn,	SERCOM5_0_Handler },
+	{ SERCOM5_1_IRQn,	SERCOM5_1_Handler },
+	{ SERCOM5_2_IRQn,	SERCOM5_2_Handler },
+};
+#define SIM_NR_VECTORS	(sizeof(sim_vectors) / sizeof(sim_vectors[0]))
+
+/// Register blocks
+static struct {
+	SysTick_Type		systick;
+	SCB_Type		scb;
+	sercom_registers_t	sercom[6];
+	gclk_registers_t	gclk;
+	mclk_registers_t	mclk;
+	oscctrl_registers_t	oscctrl;
+	pm_registers_t		pm;
+	supc_registers_t	supc;
+	nvmctrl_registers_t	nvmctrl;
+	eic_registers_t		eic;
+	evsys_registers_t	evsys;
+	port_registers_t	port;
+	tcc_registers_t		tcc[3];
+	dmac_registers_t	dmac;
+} regs;
+
+static void *const sim_blk_ptr[SIM_NR_BLK] = {
+	[SIM_BLK_SYSTICK]	= &regs.systick,
+	[SIM_BLK_SCB]		= &regs.scb,
+	[SIM_BLK_SERCOM0]	= &regs.sercom[0],
+	[SIM_BLK_SERCOM1]	= &regs.sercom[1],
+	[SIM_BLK_SERCOM2]	= &regs.sercom[2],
+	[SIM_BLK_SERCOM3]	= &regs.sercom[3],
+	[SIM_BLK_SERCOM4]	= &regs.sercom[4],
+	[SIM_BLK_SERCOM5]	= &regs.sercom[5],
+	[SIM_BLK_GCLK]		= &regs.gclk,
+	[SIM_BLK_MCLK]		= &regs.mclk,
+	[SIM_BLK_OSCCTRL]	= &regs.oscctrl,
+	[SIM_BLK_PM]		= &regs.pm,
+	[SIM_BLK_SUPC]		= &regs.supc,
+	[SIM_BLK_NVMCTRL]	= &regs.nvmctrl,
+	[SIM_BLK_EIC]		= &regs.eic,
+	[SIM_BLK_EVSYS]		= &regs.evsys,
+	[SIM_BLK_PORT]		= &regs.port,
+	[SIM_BLK_TCC0]		= &regs.tcc[0],
+	[SIM_BLK_TCC1]		= &regs.tcc[1],
+	[SIM_BLK_TCC2]		= &regs.tcc[2],
+	[SIM_BLK_DMAC]		= &regs.dmac,
+};
+
+/// A SERCOM in USART mode, and the line to the device on its far end
+typedef struct sim_usart_type {
+	sercom_usart_int_registers_t *regs;
+
+	/// GCLK peripheral channel of its core clock, and its DRE interrupt
+	unsigned int	pch;
+	IRQn_Type	irq;
+
+	sim_dev_t	*dev;
+
+	/// Interrupt flags and enables, without the marker
+	bool		txc;
+	uint8_t		inten;
+
+	/// Values last published, to tell writes apart
+	uint8_t		pub_inten;
+	uint8_t		pub_flags;
+
+	/// Bytes from the device, and when the one in front is complete
+	uint8_t		line[USART_LINE_LEN];
+	uint32_t	line_head;
+	uint32_t	line_tail;
+	sim_time_t	rx_done;
+
+	/// Receive buffer: data, then STATUS bits
+	uint8_t		fifo[USART_RX_FIFO][2];
+	unsigned int	nr_fifo;
+	uint8_t		rx_status;
+
+	/// Transmitter: DATA, and the shift register; negative if empty
+	int		tx_data;
+	int		tx_shift;
+	sim_time_t	tx_done;
+
+	/// DMAC channel feeding DATA, if any
+	int		(*src)(void *arg);
+	void		*src_arg;
+
+	sim_usart_stats_t stats;
+} sim_usart_t;
+
+/// A DMAC channel
+typedef struct sim_dmac_ch_type {
+	/// CHCTRLB, and interrupt flags and enables, without the marker
+	uint32_t	ctrlb;
+	uint8_t		inten;
+	uint8_t		intflag;
+
+	/// Enabled, and working through @c desc, which BTCNT counts down in
+	bool		on;
+	dmac_descriptor_registers_t desc;
+
+	/// The last descriptor fetched was not valid
+	bool		ferr;
+
+	/// Beats left before a transfer error is forced, plus one; 0 if none
+	uint32_t	fail_in;
+
+	/// SERCOM whose transmitter triggers it, while on; negative if none
+	int		sercom;
+} sim_dmac_ch_t;
+
+/// Simulator state
+static struct {
+	sim_time_t	now;
+	sim_time_t	end;
+	void		(*done)(void);
+	bool		finishing;
+
+	/// Host CPU time to charge, in SysTick clocks per nanosecond
+	double		host_rate;
+	double		host_debt;
+	int64_t		host_mark;
+
+	/// Cost of reading the host clock, which is not charged
+	int64_t		host_overhead;
+
+	uint32_t	primask;
+	bool		in_isr;
+	sim_time_t	woke;
+
+	/// NVIC; SysTick has slot 0
+	bool		irq_en[SIM_NR_IRQ];
+	uint8_t		irq_prio[SIM_NR_IRQ];
+	bool		irq_was[SIM_NR_IRQ];
+	sim_time_t	irq_since[SIM_NR_IRQ];
+
+	sim_usart_t	usart[6];
+
+	/// DMAC: the channel CHID selects, and what was last published for it
+	struct {
+		uint8_t		chid;
+		uint8_t		pub_ctrla;
+		uint32_t	pub_ctrlb;
+		uint8_t		pub_inten;
+		uint8_t		pub_flags;
+		sim_dmac_ch_t	ch[SIM_DMAC_NR_CH];
+	} dmac;
+
+	/// SysTick: counter, as of @c at
+	struct {
+		uint32_t	ctrl;
+		uint32_t	cnt;
+		sim_time_t	at;
+		bool		pend;
+		bool		countflag;
+		uint32_t	pub_val;
+		uint32_t	pub_icsr;
+	} st;
+
+	/// TCC1: when it was enabled
+	struct {
+		bool		on;
+		sim_time_t	t0;
+	} tcc;
+
+	/// NVMCTRL, and the contents of the data flash as last programmed
+	struct {
+		uint8_t		*flash;
+		uint8_t		shadow[SIM_FLASH_SIZE];
+		sim_time_t	ready_at;
+		uint16_t	intflag;
+		uint16_t	pub_intflag;
+		bool		load;
+	} nvm;
+
+	sim_stats_t	stats;
+} sim;
+
+/////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Frequency of the generator feeding peripheral channel @p pch
+ *
+ * Only OSC16M and DFLL48M are known, as in the firmware.
+ */
+static double gclk_hz(unsigned int pch)
+{
+	static const double osc16m_hz[4] = { 4e6, 8e6, 12e6, 16e6 };
+	uint32_t pchctrl = regs.gclk.GCLK_PCHCTRL[pch];
+	uint32_t genctrl, div;
+	double hz;
+
+	if ((pchctrl & (1 << 6)) == 0 || (pchctrl & 0x0F) >= 5)
+		return 0;
+	genctrl = regs.gclk.GCLK_GENCTRL[pchctrl & 0x0F];
+	if ((genctrl & (1 << 8)) == 0)
+		return 0;
+
+	switch (genctrl & 0x1F) {
+	case 0x05:
+		hz = osc16m_hz[(regs.oscctrl.OSCCTRL_OSC16MCTRL >> 2) & 0x03];
+		break;
+	case 0x07:
+		hz = 48e6;
+		break;
+	default:
+		return 0;
+	}
+
+	div = genctrl >> 16;
+	if ((genctrl & (1 << 12)) != 0)
+		return hz / (double)(1UL << (div + 1));
+	return (div > 1) ? hz / div : hz;
+}
+
+static sim_time_t char_time(double baud, unsigned int nr_bits)
+{
+	return (sim_time_t)(nr_bits * SIM_TICKS_PER_US * 1e6 / baud + 0.5);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+// Baud rate of a USART, from BAUD with arithmetic generation; 0 if disabled
+static double usart_baud(const sim_usart_t *u)
+{
+	const sercom_usart_int_registers_t *r = u->regs;
+	unsigned int nr_samples;
+
+	if ((r->SERCOM_CTRLA & (1 << 1)) == 0)
+		return 0;
+	nr_samples = (((r->SERCOM_CTRLA >> 13) & 0x7) >= 2) ? 8 : 16;
+	return gclk_hz(u->pch) * (65536.0 - r->SERCOM_BAUD) / 65536.0 /
+		nr_samples;
+}
+
+// Bits per character: start, data, parity and stop
+static unsigned int usart_frame_bits(const sim_usart_t *u)
+{
+	static const unsigned int chsize[8] = { 8, 9, 8, 8, 8, 5, 6, 7 };
+	const sercom_usart_int_registers_t *r = u->regs;
+
+	return 1 + chsize[r->SERCOM_CTRLB & 0x7] +
+		(((r->SERCOM_CTRLA >> 24) & 0xF) == 1) +
+		(((r->SERCOM_CTRLB >> 6) & 1) ? 2 : 1);
+}
+
+static uint8_t usart_flags(const sim_usart_t *u)
+{
+	return (u->tx_data < 0 ? USART_INT_DRE : 0) |
+		(u->txc ? USART_INT_TXC : 0) |
+		(u->nr_fifo > 0 ? USART_INT_RXC : 0);
+}
+
+static void usart_publish(sim_usart_t *u)
+{
+	sercom_usart_int_registers_t *r = u->regs;
+
+	u->pub_flags = usart_flags(u) | USART_INT_MARK;
+	u->pub_inten = u->inten | USART_INT_MARK;
+	r->SERCOM_INTFLAG = u->pub_flags;
+	r->SERCOM_INTENSET = u->pub_inten;
+	r->SERCOM_INTENCLR = u->pub_inten;
+	r->SERCOM_DATA = USART_DATA_MARK |
+		(u->nr_fifo > 0 ? u->fifo[0][0] : 0);
+	r->SERCOM_STATUS = (u->nr_fifo > 0) ? u->fifo[0][1] : 0;
+	r->SERCOM_SYNCBUSY = 0;
+}
+
+// Software reset; the line itself stays as it is
+static void usart_reset(sim_usart_t *u)
+{
+	memset((void *)u->regs, 0, sizeof(*u->regs));
+	u->txc = false;
+	u->inten = 0;
+	u->nr_fifo = 0;
+	u->rx_status = 0;
+	u->tx_data = -1;
+	u->tx_shift = -1;
+	u->tx_done = SIM_TIME_NEVER;
+	u->src = NULL;
+	usart_publish(u);
+}
+
+static void usart_tx_write(sim_usart_t *u, uint8_t c)
+{
+	double baud = usart_baud(u);
+
+	if (baud <= 0 || (u->regs->SERCOM_CTRLB & (1 << 16)) == 0)
+		return;
+
+	// Writing DATA clears TXC
+	u->txc = false;
+	++u->stats.nr_tx;
+	if (u->tx_shift < 0) {
+		u->tx_shift = c;
+		u->tx_done = sim.now + char_time(baud, usart_frame_bits(u));
+	} else {
+		u->tx_data = c;
+	}
+}
+
+// Let the DMAC (beat-triggered on DRE) fill DATA
+static void usart_tx_feed(sim_usart_t *u)
+{
+	int c;
+
+	while (u->src != NULL && u->tx_data < 0) {
+		c = u->src(u->src_arg);
+		if (c < 0) {
+			u->src = NULL;
+			break;
+		}
+		usart_tx_write(u, (uint8_t)c);
+	}
+}
+
+static void usart_tx_complete(sim_usart_t *u)
+{
+	uint8_t c = (uint8_t)u->tx_shift;
+
+	u->tx_shift = -1;
+	u->tx_done = SIM_TIME_NEVER;
+	if (u->tx_data >= 0) {
+		u->tx_shift = u->tx_data;
+		u->tx_data = -1;
+		u->tx_done = sim.now + char_time(usart_baud(u),
+			usart_frame_bits(u));
+	}
+	usart_tx_feed(u);
+	if (u->tx_shift < 0)
+		u->txc = true;
+
+	if (u->dev != NULL && u->dev->rx != NULL)
+		u->dev->rx(u->dev, c);
+}
+
+static void usart_rx_complete(sim_usart_t *u)
+{
+	uint8_t c = u->line[u->line_tail++ % USART_LINE_LEN];
+	const sercom_usart_int_registers_t *r = u->regs;
+	double baud = usart_baud(u);
+	uint8_t status = 0;
+
+	++u->stats.nr_arrived;
+	u->rx_done = (u->line_tail != u->line_head) ?
+		u->rx_done + char_time(u->dev->baud, 10) : SIM_TIME_NEVER;
+
+	if (baud <= 0 || (r->SERCOM_CTRLB & (1 << 17)) == 0) {
+		++u->stats.nr_garbled;
+		return;
+	}
+	if (fabs(baud - u->dev->baud) > 0.025 * u->dev->baud) {
+		++u->stats.nr_garbled;
+		status |= USART_STATUS_FERR;
+		c ^= 0x5A;
+	}
+
+	if (u->nr_fifo == USART_RX_FIFO) {
+		++u->stats.nr_overrun;
+		u->rx_status |= USART_STATUS_BUFOVF;
+		return;
+	}
+	u->fifo[u->nr_fifo][0] = c;
+	u->fifo[u->nr_fifo][1] = status | u->rx_status;
+	++u->nr_fifo;
+	u->rx_status = 0;
+}
+
+// Pop the receive buffer, once the RXC handler has read DATA
+static void usart_rx_pop(sim_usart_t *u)
+{
+	if (u->nr_fifo == 0)
+		return;
+	memmove(u->fifo[0], u->fifo[1], sizeof(u->fifo[0]));
+	--u->nr_fifo;
+	++u->stats.nr_read;
+}
+
+static void usart_absorb(sim_usart_t *u)
+{
+	sercom_usart_int_registers_t *r = u->regs;
+	uint32_t data;
+	uint8_t v;
+
+	if ((r->SERCOM_CTRLA & 0x01) != 0) {
+		usart_reset(u);
+		return;
+	}
+
+	// INTENCLR first; the firmware never sets and clears alike in one go
+	v = r->SERCOM_INTENCLR;
+	if (v != u->pub_inten)
+		u->inten &= ~v;
+	v = r->SERCOM_INTENSET;
+	if (v != u->pub_inten)
+		u->inten |= v & ~USART_INT_MARK;
+	v = r->SERCOM_INTFLAG;
+	if (v != u->pub_flags && (v & USART_INT_TXC) != 0)
+		u->txc = false;
+
+	data = r->SERCOM_DATA;
+	if ((data & USART_DATA_MARK) == 0) {
+		r->SERCOM_DATA = USART_DATA_MARK;
+		usart_tx_write(u, (uint8_t)data);
+	}
+}
+
+static sim_usart_t *usart_of_irq(IRQn_Type irq, unsigned int *k)
+{
+	unsigned int x;
+
+	for (x = 0; x < 6; ++x) {
+		if (sim.usart[x].irq != 0 && irq >= sim.usart[x].irq &&
+		    irq <= sim.usart[x].irq + 2) {
+			*k = (unsigned int)(irq - sim.usart[x].irq);
+			return &sim.usart[x];
+		}
+	}
+	return NULL;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+// Run the SysTick counter up to @p t
+static void systick_catch_up(sim_time_t t)
+{
+	sim_time_t d = t - sim.st.at;
+	uint32_t load;
+
+	sim.st.at = t;
+	if ((sim.st.ctrl & 0x01) == 0)
+		return;
+
+	while (d > 0) {
+		if (sim.st.cnt == 0) {
+			load = regs.systick.LOAD & 0x00FFFFFF;
+			if (load == 0)
+				return;
+			sim.st.cnt = load;
+			--d;
+			continue;
+		}
+		if (d < sim.st.cnt) {
+			sim.st.cnt -= (uint32_t)d;
+			break;
+		}
+		d -= sim.st.cnt;
+		sim.st.cnt = 0;
+		sim.st.countflag = true;
+		if ((sim.st.ctrl & 0x02) != 0)
+			sim.st.pend = true;
+	}
+}
+
+static sim_time_t systick_next(void)
+{
+	uint32_t load = regs.systick.LOAD & 0x00FFFFFF;
+
+	if ((sim.st.ctrl & 0x03) != 0x03)
+		return SIM_TIME_NEVER;
+	if (sim.st.cnt != 0)
+		return sim.st.at + sim.st.cnt;
+	return (load != 0) ? sim.st.at + load + 1 : SIM_TIME_NEVER;
+}
+
+static void systick_absorb(void)
+{
+	uint32_t icsr = regs.scb.ICSR;
+
+	systick_catch_up(sim.now);
+	if (regs.systick.VAL != sim.st.pub_val) {
+		sim.st.cnt = 0;
+		sim.st.countflag = false;
+	}
+	sim.st.ctrl = regs.systick.CTRL & 0x07;
+	if ((sim.st.ctrl & 0x01) != 0 && !sim.stats.systick_started) {
+		sim.stats.systick_zero = sim.now + 1;
+		sim.stats.systick_started = true;
+	}
+
+	if (icsr != sim.st.pub_icsr) {
+		if ((icsr & SCB_ICSR_PENDSTSET_Msk) != 0)
+			sim.st.pend = true;
+		if ((icsr & SCB_ICSR_PENDSTCLR_Msk) != 0)
+			sim.st.pend = false;
+	}
+}
+
+static void systick_publish(void)
+{
+	sim.st.pub_val = sim.st.cnt;
+	sim.st.pub_icsr = sim.st.pend ? SCB_ICSR_PENDSTSET_Msk : 0;
+	regs.systick.VAL = sim.st.pub_val;
+	regs.systick.CTRL = sim.st.ctrl | (sim.st.countflag ? (1UL << 16) : 0);
+	regs.scb.ICSR = sim.st.pub_icsr;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+// TCC1 counter clock, from its GCLK channel and prescaler
+static double tcc1_hz(void)
+{
+	static const unsigned int div[8] = { 1, 2, 4, 8, 16, 64, 256, 1024 };
+
+	return gclk_hz(25) / div[(regs.tcc[1].TCC_CTRLA >> 8) & 0x7];
+}
+
+static void tcc1_absorb(void)
+{
+	tcc_registers_t *r = &regs.tcc[1];
+	bool on = (r->TCC_CTRLA & (1 << 1)) != 0;
+
+	if ((r->TCC_CTRLA & 0x01) != 0) {
+		memset(r, 0, sizeof(*r));
+		on = false;
+	}
+	if (on && !sim.tcc.on)
+		sim.tcc.t0 = sim.now;
+	sim.tcc.on = on;
+}
+
+static void tcc1_publish(void)
+{
+	tcc_registers_t *r = &regs.tcc[1];
+	uint64_t count;
+
+	r->TCC_SYNCBUSY = 0;
+	if (!sim.tcc.on)
+		return;
+	count = (uint64_t)((double)(sim.now - sim.tcc.t0) * tcc1_hz() /
+		(SIM_TICKS_PER_US * 1e6));
+	r->TCC_COUNT = (uint32_t)(count % ((uint64_t)r->TCC_PER + 1));
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+// Program a page from the page buffer, ANDed with what is there
+static void nvm_program(uint32_t ofs)
+{
+	unsigned int x;
+
+	for (x = 0; x < SIM_FLASH_PAGE; ++x) {
+		sim.nvm.shadow[ofs + x] &= sim.nvm.flash[ofs + x];
+		sim.nvm.flash[ofs + x] = sim.nvm.shadow[ofs + x];
+	}
+	sim.nvm.ready_at = sim.now + SIM_FLASH_WRITE_TIME;
+	sim.nvm.intflag |= NVMCTRL_INTFLAG_DONE_Msk;
+	++sim.stats.nr_flash_writes;
+}
+
+// Find a page with data in the page buffer; returns its offset, or -1
+static long nvm_loaded_page(void)
+{
+	uint32_t ofs;
+
+	for (ofs = 0; ofs < SIM_FLASH_SIZE; ofs += SIM_FLASH_PAGE) {
+		if (memcmp(&sim.nvm.flash[ofs], &sim.nvm.shadow[ofs],
+			   SIM_FLASH_PAGE) != 0)
+			return (long)ofs;
+	}
+	return -1;
+}
+
+static void nvm_command(uint16_t cmd)
+{
+	uint32_t addr = regs.nvmctrl.NVMCTRL_ADDR;
+	uint32_t ofs = addr - SIM_FLASH_ADDR;
+	bool in_range = addr >= SIM_FLASH_ADDR && ofs < SIM_FLASH_SIZE;
+
+	if ((cmd & ~NVMCTRL_CTRLA_CMD_Msk) != NVMCTRL_CTRLA_CMDEX_KEY) {
+		sim.nvm.intflag |= NVMCTRL_INTFLAG_KEYE_Msk;
+		return;
+	}
+	if (sim.now < sim.nvm.ready_at) {
+		sim.nvm.intflag |= NVMCTRL_INTFLAG_PROGE_Msk;
+		return;
+	}
+
+	switch (cmd & NVMCTRL_CTRLA_CMD_Msk) {
+	case NVMCTRL_CTRLA_CMD_ER:
+		if (!in_range)
+			break;
+		ofs &= ~(SIM_FLASH_ROW - 1);
+		memset(&sim.nvm.flash[ofs], 0xFF, SIM_FLASH_ROW);
+		memset(&sim.nvm.shadow[ofs], 0xFF, SIM_FLASH_ROW);
+		sim.nvm.ready_at = sim.now + SIM_FLASH_ERASE_TIME;
+		sim.nvm.intflag |= NVMCTRL_INTFLAG_DONE_Msk;
+		++sim.stats.nr_flash_erases;
+		return;
+
+	case NVMCTRL_CTRLA_CMD_WP:
+		if (!in_range)
+			break;
+		nvm_program(ofs & ~(SIM_FLASH_PAGE - 1));
+		sim.nvm.load = false;
+		return;
+
+	case NVMCTRL_CTRLA_CMD_PBC:
+		memcpy(sim.nvm.flash, sim.nvm.shadow, SIM_FLASH_SIZE);
+		sim.nvm.load = false;
+		sim.nvm.intflag |= NVMCTRL_INTFLAG_DONE_Msk;
+		return;
+
+	default:
+		break;
+	}
+	sim.nvm.intflag |= NVMCTRL_INTFLAG_PROGE_Msk;
+}
+
+static void nvm_absorb(bool accessed)
+{
+	nvmctrl_registers_t *r = &regs.nvmctrl;
+	uint16_t v;
+	long ofs;
+
+	v = r->NVMCTRL_INTFLAG;
+	if (v != sim.nvm.pub_intflag)
+		sim.nvm.intflag &= ~v;
+	v = r->NVMCTRL_CTRLA;
+	if (v != 0) {
+		r->NVMCTRL_CTRLA = 0;
+		nvm_command(v);
+	}
+
+	// The page buffer is only looked at when NVMCTRL itself is accessed
+	if (!accessed || sim.now < sim.nvm.ready_at)
+		return;
+	ofs = nvm_loaded_page();
+	sim.nvm.load = ofs >= 0;
+	if (sim.nvm.load && (r->NVMCTRL_CTRLB & NVM_CTRLB_MANW) == 0) {
+		nvm_program((uint32_t)ofs);
+		sim.nvm.load = false;
+	}
+}
+
+static void nvm_publish(void)
+{
+	nvmctrl_registers_t *r = &regs.nvmctrl;
+
+	sim.nvm.pub_intflag = sim.nvm.intflag | NVM_INT_MARK;
+	r->NVMCTRL_INTFLAG = sim.nvm.pub_intflag;
+	r->NVMCTRL_STATUS =
+		(sim.now >= sim.nvm.ready_at ? NVMCTRL_STATUS_READY_Msk : 0) |
+		(sim.nvm.load ? NVMCTRL_STATUS_LOAD_Msk : 0);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+static sim_dmac_ch_t *dmac_of_irq(IRQn_Type irq)
+{
+	if (irq < DMAC_0_IRQn || irq >= DMAC_0_IRQn + SIM_DMAC_NR_CH)
+		return NULL;
+	return &sim.dmac.ch[irq - DMAC_0_IRQn];
+}
+
+static void dmac_desc_copy(dmac_descriptor_registers_t *dst,
+	const dmac_descriptor_registers_t *src)
+{
+	dst->DMAC_BTCTRL = src->DMAC_BTCTRL;
+	dst->DMAC_BTCNT = src->DMAC_BTCNT;
+	dst->DMAC_SRCADDR = src->DMAC_SRCADDR;
+	dst->DMAC_DSTADDR = src->DMAC_DSTADDR;
+	dst->DMAC_DESCADDR = src->DMAC_DESCADDR;
+}
+
+/*
+ * Stop a channel, raising @p flags; the descriptor it was working on is
+ * written back, as when the DMAC disables a channel
+ */
+static void dmac_stop(unsigned int ch, uint8_t flags)
+{
+	sim_dmac_ch_t *c = &sim.dmac.ch[ch];
+	sim_usart_t *u;
+
+	c->intflag |= flags;
+	if (!c->on)
+		return;
+	c->on = false;
+	if (regs.dmac.DMAC_WRBADDR != 0)
+		dmac_desc_copy((dmac_descriptor_registers_t *)(uintptr_t)
+			regs.dmac.DMAC_WRBADDR + ch, &c->desc);
+
+	if (c->sercom >= 0) {
+		u = &sim.usart[c->sercom];
+		if (u->src_arg == (void *)(uintptr_t)ch)
+			u->src = NULL;
+	}
+	c->sercom = -1;
+}
+
+// Fetch the descriptor at @p addr; a transfer error if it is not valid
+static bool dmac_fetch(unsigned int ch, uint32_t addr)
+{
+	sim_dmac_ch_t *c = &sim.dmac.ch[ch];
+
+	dmac_desc_copy(&c->desc,
+		(const dmac_descriptor_registers_t *)(uintptr_t)addr);
+	++sim.stats.nr_dmac_fetches;
+	if ((c->desc.DMAC_BTCTRL & DMAC_BTCTRL_VALID) == 0) {
+		c->ferr = true;
+		dmac_stop(ch, DMAC_INT_TERR);
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Next beat of a channel, which its SERCOM asks for whenever DATA is empty;
+ * -1 once it has no more
+ */
+static int dmac_beat(void *arg)
+{
+	unsigned int ch = (unsigned int)(uintptr_t)arg;
+	sim_dmac_ch_t *c = &sim.dmac.ch[ch];
+	const sim_usart_t *u;
+	uint32_t src;
+	uint8_t v;
+
+	if (!c->on)
+		return -1;
+
+	/*
+	 * A transfer error when one is forced; also for anything but DATA of
+	 * the SERCOM triggering it, which is not modelled
+	 */
+	u = &sim.usart[c->sercom];
+	if ((c->fail_in != 0 && --c->fail_in == 0) ||
+	    c->desc.DMAC_DSTADDR !=
+	    (uint32_t)(uintptr_t)&u->regs->SERCOM_DATA) {
+		dmac_stop(ch, DMAC_INT_TERR);
+		return -1;
+	}
+
+	// With SRCINC, SRCADDR is the end of the block
+	src = c->desc.DMAC_SRCADDR;
+	if ((c->desc.DMAC_BTCTRL & DMAC_BTCTRL_SRCINC) != 0)
+		src -= c->desc.DMAC_BTCNT;
+	v = *(const uint8_t *)(uintptr_t)src;
+	++sim.stats.nr_dmac_beats;
+
+	if (--c->desc.DMAC_BTCNT == 0) {
+		if ((c->desc.DMAC_BTCTRL & DMAC_BTCTRL_BLOCKACT_INT) != 0)
+			c->intflag |= DMAC_INT_TCMPL;
+		if (c->desc.DMAC_DESCADDR == 0)
+			dmac_stop(ch, 0);
+		else
+			dmac_fetch(ch, c->desc.DMAC_DESCADDR);
+	}
+	return v;
+}
+
+// Enable a channel: fetch its first descriptor, and wait for the trigger
+static void dmac_start(unsigned int ch)
+{
+	sim_dmac_ch_t *c = &sim.dmac.ch[ch];
+	unsigned int trig = (c->ctrlb >> 8) & 0x3F;
+	sim_usart_t *u;
+
+	if ((regs.dmac.DMAC_CTRL & DMAC_CTRL_DMAENABLE) == 0)
+		return;
+
+	c->on = true;
+	c->ferr = false;
+	c->sercom = -1;
+	if (!dmac_fetch(ch, regs.dmac.DMAC_BASEADDR +
+			ch * sizeof(dmac_descriptor_registers_t)))
+		return;
+
+	// SERCOMn TX is trigger 5 + 2n
+	if (trig < 5 || (trig - 5) % 2 != 0 || (trig - 5) / 2 >= 6 ||
+	    sim.usart[(trig - 5) / 2].regs == NULL)
+		return;
+	c->sercom = (int)(trig - 5) / 2;
+	u = &sim.usart[c->sercom];
+	u->src = dmac_beat;
+	u->src_arg = (void *)(uintptr_t)ch;
+	usart_tx_feed(u);
+}
+
+static void dmac_absorb(void)
+{
+	dmac_registers_t *r = &regs.dmac;
+	sim_dmac_ch_t *c;
+	unsigned int x;
+	uint8_t v;
+
+	if ((r->DMAC_CTRL & DMAC_CTRL_SWRST) != 0) {
+		for (x = 0; x < SIM_DMAC_NR_CH; ++x)
+			dmac_stop(x, 0);
+		memset(r, 0, sizeof(*r));
+		memset(&sim.dmac, 0, sizeof(sim.dmac));
+		return;
+	}
+
+	// The others are those of the channel previously selected
+	if (r->DMAC_CHID != sim.dmac.chid) {
+		sim.dmac.chid = r->DMAC_CHID;
+		return;
+	}
+	if (sim.dmac.chid >= SIM_DMAC_NR_CH)
+		return;
+	c = &sim.dmac.ch[sim.dmac.chid];
+
+	v = r->DMAC_CHCTRLA;
+	if (v != sim.dmac.pub_ctrla) {
+		if ((v & DMAC_CHCTRLA_SWRST) != 0) {
+			dmac_stop(sim.dmac.chid, 0);
+			c->ctrlb = 0;
+			c->inten = 0;
+			c->intflag = 0;
+		} else if ((v & DMAC_CHCTRLA_ENABLE) != 0 && !c->on) {
+			dmac_start(sim.dmac.chid);
+		} else if ((v & DMAC_CHCTRLA_ENABLE) == 0 && c->on) {
+			dmac_stop(sim.dmac.chid, 0);
+		}
+	}
+	if (r->DMAC_CHCTRLB != sim.dmac.pub_ctrlb)
+		c->ctrlb = r->DMAC_CHCTRLB;
+
+	v = r->DMAC_CHINTENCLR;
+	if (v != sim.dmac.pub_inten)
+		c->inten &= ~v;
+	v = r->DMAC_CHINTENSET;
+	if (v != sim.dmac.pub_inten)
+		c->inten |= v & ~DMAC_INT_MARK;
+	v = r->DMAC_CHINTFLAG;
+	if (v != sim.dmac.pub_flags)
+		c->intflag &= ~v;
+}
+
+static void dmac_publish(void)
+{
+	dmac_registers_t *r = &regs.dmac;
+	static const sim_dmac_ch_t none;
+	const sim_dmac_ch_t *c = (sim.dmac.chid < SIM_DMAC_NR_CH) ?
+		&sim.dmac.ch[sim.dmac.chid] : &none;
+
+	sim.dmac.pub_ctrla = c->on ? DMAC_CHCTRLA_ENABLE : 0;
+	sim.dmac.pub_ctrlb = c->ctrlb;
+	sim.dmac.pub_inten = c->inten | DMAC_INT_MARK;
+	sim.dmac.pub_flags = c->intflag | DMAC_INT_MARK;
+	r->DMAC_CHCTRLA = sim.dmac.pub_ctrla;
+	r->DMAC_CHCTRLB = sim.dmac.pub_ctrlb;
+	r->DMAC_CHINTENCLR = sim.dmac.pub_inten;
+	r->DMAC_CHINTENSET = sim.dmac.pub_inten;
+	r->DMAC_CHINTFLAG = sim.dmac.pub_flags;
+	r->DMAC_CHSTATUS = (c->on ? DMAC_STATUS_BUSY : 0) |
+		(c->ferr ? DMAC_STATUS_FERR : 0);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+static bool irq_pending(IRQn_Type irq)
+{
+	sim_usart_t *u;
+	sim_dmac_ch_t *c;
+	unsigned int k;
+
+	if (irq == SysTick_IRQn)
+		return sim.st.pend;
+	if (!sim.irq_en[SIM_IRQ_IDX(irq)])
+		return false;
+	u = usart_of_irq(irq, &k);
+	if (u != NULL)
+		return (usart_flags(u) & u->inten & (1 << k)) != 0;
+	c = dmac_of_irq(irq);
+	if (c != NULL)
+		return (c->intflag & c->inten & ~DMAC_INT_MARK) != 0;
+	return false;
+}
+
+// Note when each interrupt went pending, for the latencies
+static void irq_scan(void)
+{
+	unsigned int x;
+	bool p;
+
+	for (x = 0; x < SIM_NR_VECTORS; ++x) {
+		p = irq_pending(sim_vectors[x].irq);
+		if (p && !sim.irq_was[SIM_IRQ_IDX(sim_vectors[x].irq)])
+			sim.irq_since[SIM_IRQ_IDX(sim_vectors[x].irq)] = sim.now;
+		sim.irq_was[SIM_IRQ_IDX(sim_vectors[x].irq)] = p;
+	}
+}
+
+// The pending interrupt to take next, by priority then number; -1 if none
+static int irq_next(void)
+{
+	int best = -1;
+	unsigned int x, idx;
+
+	for (x = 0; x < SIM_NR_VECTORS; ++x) {
+		if (!irq_pending(sim_vectors[x].irq))
+			continue;
+		idx = (unsigned int)SIM_IRQ_IDX(sim_vectors[x].irq);
+		if (best < 0 || sim.irq_prio[idx] <
+		    sim.irq_prio[SIM_IRQ_IDX(sim_vectors[best].irq)])
+			best = (int)x;
+	}
+	return best;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+static sim_time_t sim_next_event(void)
+{
+	sim_time_t t = systick_next();
+	unsigned int x;
+
+	for (x = 0; x < 6; ++x) {
+		if (sim.usart[x].rx_done < t)
+			t = sim.usart[x].rx_done;
+		if (sim.usart[x].tx_done < t)
+			t = sim.usart[x].tx_done;
+		if (sim.usart[x].dev != NULL && sim.usart[x].dev->due < t)
+			t = sim.usart[x].dev->due;
+	}
+	return t;
+}
+
+// Process whatever happens at @p t, the time of the next event
+static void sim_step(sim_time_t t)
+{
+	sim_usart_t *u;
+	sim_time_t due;
+	unsigned int x;
+
+	sim.now = t;
+	systick_catch_up(t);
+	for (x = 0; x < 6; ++x) {
+		u = &sim.usart[x];
+		if (u->rx_done == t)
+			usart_rx_complete(u);
+		if (u->tx_done == t)
+			usart_tx_complete(u);
+		if (u->dev != NULL && u->dev->due <= t) {
+			due = u->dev->due;
+			u->dev->run(u->dev);
+			if (u->dev->due == due)
+				u->dev->due = SIM_TIME_NEVER;
+		}
+	}
+	irq_scan();
+}
+
+static void sim_advance(sim_time_t to)
+{
+	sim_time_t t;
+
+	while ((t = sim_next_event()) <= to)
+		sim_step(t);
+	sim.now = to;
+	systick_catch_up(to);
+	irq_scan();
+}
+
+static void sim_absorb(bool nvm_accessed)
+{
+	unsigned int x;
+
+	systick_absorb();
+	for (x = 0; x < 6; ++x) {
+		if (sim.usart[x].regs != NULL)
+			usart_absorb(&sim.usart[x]);
+	}
+	dmac_absorb();
+	tcc1_absorb();
+	nvm_absorb(nvm_accessed);
+	irq_scan();
+}
+
+static void sim_publish(void)
+{
+	unsigned int x;
+
+	systick_publish();
+	for (x = 0; x < 6; ++x) {
+		if (sim.usart[x].regs != NULL)
+			usart_publish(&sim.usart[x]);
+	}
+	dmac_publish();
+	tcc1_publish();
+	nvm_publish();
+}
+
+static void sim_finish(void)
+{
+	sim.finishing = true;
+	sim.done();
+	exit(1);
+}
+
+static int64_t host_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Find out what reading the host clock costs, as the least of a few tries
+static void sim_calibrate_host(void)
+{
+	int64_t t0, dt;
+	unsigned int x;
+
+	sim.host_overhead = INT64_MAX;
+	for (x = 0; x < 1000; ++x) {
+		t0 = host_ns();
+		dt = host_ns() - t0;
+		if (dt < sim.host_overhead)
+			sim.host_overhead = dt;
+	}
+}
+
+// Charge the host time spent in the firmware since the last call
+static void sim_charge_host(void)
+{
+	int64_t ns;
+	sim_time_t whole;
+
+	if (sim.host_rate <= 0)
+		return;
+	ns = host_ns();
+	if (sim.host_mark != 0 && ns - sim.host_mark > sim.host_overhead)
+		sim.host_debt += (double)(ns - sim.host_mark -
+			sim.host_overhead) * sim.host_rate;
+	whole = (sim_time_t)sim.host_debt;
+	sim.host_debt -= (double)whole;
+	if (whole > 0)
+		sim_advance(sim.now + whole);
+}
+
+static void sim_mark_host(void)
+{
+	if (sim.host_rate > 0)
+		sim.host_mark = host_ns();
+}
+
+// Take pending interrupts, as long as PRIMASK allows
+static void sim_dispatch(void)
+{
+	sim_usart_t *u;
+	sim_time_t t0, lat;
+	unsigned int k, idx;
+	int x;
+
+	if (sim.in_isr || sim.primask != 0)
+		return;
+
+	while ((x = irq_next()) >= 0) {
+		idx = (unsigned int)SIM_IRQ_IDX(sim_vectors[x].irq);
+		if (sim_vectors[x].fn == NULL) {
+			fprintf(stderr, "sim: no handler for IRQ %d\n",
+				sim_vectors[x].irq);
+			sim.irq_en[idx] = false;
+			continue;
+		}
+
+		t0 = sim.now;
+		lat = t0 - sim.irq_since[idx];
+		u = usart_of_irq(sim_vectors[x].irq, &k);
+		if (u != NULL && k == 2) {
+			if (lat > u->stats.rxc_lat_max)
+				u->stats.rxc_lat_max = lat;
+			u->stats.rxc_lat_total += lat;
+			++u->stats.nr_rxc;
+		} else if (sim_vectors[x].irq == SysTick_IRQn &&
+			   lat > sim.stats.systick_lat_max) {
+			sim.stats.systick_lat_max = lat;
+		}
+
+		// Pending state is cleared on entry
+		sim.in_isr = true;
+		if (sim_vectors[x].irq == SysTick_IRQn)
+			sim.st.pend = false;
+		sim_publish();
+		sim_advance(sim.now + SIM_COST_IRQ);
+
+		sim_vectors[x].fn();
+
+		sim_absorb(false);
+		if (u != NULL && k == 2)
+			usart_rx_pop(u);
+		sim.in_isr = false;
+		irq_scan();
+		sim_publish();
+
+		sim.stats.in_isr += sim.now - t0;
+		++sim.stats.nr_isr;
+	}
+}
+
+// Catch up with the firmware; see xc.h
+static void sim_sync(bool nvm_accessed)
+{
+	if (sim.finishing)
+		return;
+
+	sim_charge_host();
+	sim_absorb(nvm_accessed);
+	sim_advance(sim.now + SIM_COST_ACCESS);
+	if (sim.now >= sim.end)
+		sim_finish();
+	sim_dispatch();
+	sim_publish();
+	sim_mark_host();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+void *sim_regs(sim_blk_t blk)
+{
+	sim_sync(blk == SIM_BLK_NVMCTRL);
+	return sim_blk_ptr[blk];
+}
+
+uint32_t __get_PRIMASK(void)
+{
+	sim_sync(false);
+	return sim.primask;
+}
+
+void __set_PRIMASK(uint32_t primask)
+{
+	sim.primask = primask & 1;
+	sim_sync(false);
+}
+
+void __disable_irq(void)
+{
+	sim.primask = 1;
+	sim_sync(false);
+}
+
+void __enable_irq(void)
+{
+	sim.primask = 0;
+	sim_sync(false);
+}
+
+void __DMB(void)
+{
+	sim_sync(false);
+}
+
+void __DSB(void)
+{
+	sim_sync(false);
+}
+
+void __ISB(void)
+{
+	sim_sync(false);
+}
+
+/*
+ * Sleep until an interrupt is pending, whether or not PRIMASK lets it be
+ * taken; time skips ahead from one event to the next meanwhile
+ */
+void __WFI(void)
+{
+	sim_time_t t0, t;
+	unsigned int x;
+	bool pending = false;
+
+	if (sim.finishing)
+		return;
+	sim_charge_host();
+	sim_absorb(false);
+
+	t = sim.now - sim.woke;
+	if (t > sim.stats.awake_max)
+		sim.stats.awake_max = t;
+	sim.stats.awake_total += t;
+	++sim.stats.nr_sleeps;
+
+	t0 = sim.now;
+	for (;;) {
+		for (x = 0; x < SIM_NR_VECTORS && !pending; ++x)
+			pending = irq_pending(sim_vectors[x].irq);
+		if (pending)
+			break;
+
+		t = sim_next_event();
+		if (t >= sim.end) {
+			sim_advance(sim.end);
+			sim.stats.asleep += sim.now - t0;
+			sim_finish();
+		}
+		sim_advance(t);
+	}
+	sim.stats.asleep += sim.now - t0;
+	sim.woke = sim.now;
+
+	sim_dispatch();
+	sim_publish();
+	sim_mark_host();
+}
+
+void NVIC_SetPriority(IRQn_Type irq, uint32_t prio)
+{
+	if (SIM_IRQ_IDX(irq) >= 0 && SIM_IRQ_IDX(irq) < SIM_NR_IRQ)
+		sim.irq_prio[SIM_IRQ_IDX(irq)] = (uint8_t)prio;
+	sim_sync(false);
+}
+
+void NVIC_EnableIRQ(IRQn_Type irq)
+{
+	if (SIM_IRQ_IDX(irq) >= 0 && SIM_IRQ_IDX(irq) < SIM_NR_IRQ)
+		sim.irq_en[SIM_IRQ_IDX(irq)] = true;
+	sim_sync(false);
+}
+
+void NVIC_DisableIRQ(IRQn_Type irq)
+{
+	if (SIM_IRQ_IDX(irq) >= 0 && SIM_IRQ_IDX(irq) < SIM_NR_IRQ)
+		sim.irq_en[SIM_IRQ_IDX(irq)] = false;
+	sim_sync(false);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+static void *sim_map(uintptr_t addr, size_t len)
+{
+	void *p = mmap((void *)addr, len, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+
+	if (p != (void *)addr) {
+		fprintf(stderr, "sim: cannot map 0x%08lx; "
+			"is the executable linked over it?\n",
+			(unsigned long)addr);
+		exit(2);
+	}
+	return p;
+}
+
+void sim_init(sim_time_t end, double slowdown, void (*done)(void))
+{
+	static const struct {
+		unsigned int	pch;
+		IRQn_Type	irq;
+	} usart_cfg[6] = {
+		[0] = { 17, SERCOM0_0_IRQn },
+		[1] = { 18, SERCOM1_0_IRQn },
+		[3] = { 20, SERCOM3_0_IRQn },
+		[5] = { 22, SERCOM5_0_IRQn },
+	};
+	uint8_t *cal;
+	unsigned int x;
+
+	if ((uintptr_t)&regs > UINT32_MAX) {
+		fprintf(stderr, "sim: linked above 4 GiB, "
+			"out of the DMAC's reach\n");
+		exit(2);
+	}
+
+	memset(&regs, 0, sizeof(regs));
+	memset(&sim, 0, sizeof(sim));
+	sim.end = end;
+	sim.done = done;
+	sim.host_rate = slowdown * SIM_TICKS_PER_US / 1000.0;
+	if (sim.host_rate > 0)
+		sim_calibrate_host();
+
+	// Out of reset: GCLK_GEN0 on OSC16M at 4 MHz, everything ready
+	regs.gclk.GCLK_GENCTRL[0] = 0x00000105;
+	regs.oscctrl.OSCCTRL_OSC16MCTRL = 0x82;
+	regs.oscctrl.OSCCTRL_STATUS = (1UL << 24) | (1 << 4);
+	regs.pm.PM_INTFLAG = 0x01;
+	regs.supc.SUPC_STATUS = (1UL << 18);
+	regs.nvmctrl.NVMCTRL_STATUS = NVMCTRL_STATUS_READY_Msk;
+
+	for (x = 0; x < 6; ++x) {
+		sim.usart[x].rx_done = SIM_TIME_NEVER;
+		sim.usart[x].tx_done = SIM_TIME_NEVER;
+		if (usart_cfg[x].pch == 0)
+			continue;
+		sim.usart[x].regs = &regs.sercom[x].USART_INT;
+		sim.usart[x].pch = usart_cfg[x].pch;
+		sim.usart[x].irq = usart_cfg[x].irq;
+		usart_reset(&sim.usart[x]);
+	}
+
+	sim.nvm.flash = sim_map(SIM_FLASH_ADDR, SIM_FLASH_SIZE);
+	memset(sim.nvm.flash, 0xFF, SIM_FLASH_SIZE);
+	memset(sim.nvm.shadow, 0xFF, SIM_FLASH_SIZE);
+
+	// DFLL48M coarse value in the calibration row
+	cal = sim_map(SIM_CAL_ADDR, SIM_CAL_SIZE);
+	memset(cal, 0xFF, SIM_CAL_SIZE);
+	cal[0x20] = 0x00;
+	cal[0x21] = 0x00;
+	cal[0x22] = 0x00;
+	cal[0x23] = 0x3E;
+
+	systick_publish();
+	nvm_publish();
+	sim_mark_host();
+}
+
+sim_time_t sim_now(void)
+{
+	return sim.now;
+}
+
+void sim_usart_attach(unsigned int sercom, sim_dev_t *dev)
+{
+	if (sercom < 6 && sim.usart[sercom].regs != NULL)
+		sim.usart[sercom].dev = dev;
+}
+
+void sim_usart_send(unsigned int sercom, const void *buf, size_t len)
+{
+	sim_usart_t *u = &sim.usart[sercom];
+	const uint8_t *p = buf;
+
+	if (sercom >= 6 || u->dev == NULL)
+		return;
+
+	for (; len > 0; --len) {
+		if (u->line_head - u->line_tail >= USART_LINE_LEN)
+			break;
+		if (u->line_head == u->line_tail)
+			u->rx_done = sim.now + char_time(u->dev->baud, 10);
+		u->line[u->line_head++ % USART_LINE_LEN] = *p++;
+		++u->stats.nr_offered;
+	}
+}
+
+void sim_usart_stats(unsigned int sercom, sim_usart_stats_t *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+	if (sercom < 6)
+		*stats = sim.usart[sercom].stats;
+}
+
+double sim_usart_baud(unsigned int sercom)
+{
+	return (sercom < 6 && sim.usart[sercom].regs != NULL) ?
+		usart_baud(&sim.usart[sercom]) : 0;
+}
+
+void sim_dmac_fail(unsigned int ch, uint32_t after)
+{
+	if (ch < SIM_DMAC_NR_CH)
+		sim.dmac.ch[ch].fail_in = after + 1;
+}
+
+void sim_stats(sim_stats_t *stats)
+{
+	*stats = sim.stats;
+}
+
+bool sim_tcc1_pwm(double *period_s, double *duty)
+{
+	const tcc_registers_t *r = &regs.tcc[1];
+	double hz = tcc1_hz();
+
+	if (!sim.tcc.on || (r->TCC_WAVE & 0x7) != 2 || hz <= 0)
+		return false;
+	*period_s = ((double)r->TCC_PER + 1) / hz;
+	*duty = (double)r->TCC_CC[0] / ((double)r->TCC_PER + 1);
+	return true;
+}
@@ -0,0 +1,160 @@
+/**
+ * @file sim.h
+ * @brief Simulated PIC32CM LS00 for running the firmware on the host
+ *
+ * Time is counted in SysTick clocks (PLATFORM_TICKS_PER_US per microsecond),
+ * and only moves on at the points where the firmware meets the simulator:
+ * register accesses and intrinsics cost a fixed number of clocks each, and
+ * __WFI() skips ahead to the next event. Code in between is free, unless a
+ * slowdown is given with sim_init(), in which case the host CPU time spent
+ * in it is charged as well, scaled up to the speed of the target.
+ *
+ * Interrupts are taken at those same points, once PRIMASK allows; handlers
+ * never nest, as all of those used by the firmware share a priority.
+ */
+
+#if !defined(SIM_H_)
+#define SIM_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "xc.h"
+
+// C linkage should be maintained
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+
+/// Simulated time, in SysTick clocks
+typedef uint64_t sim_time_t;
+
+#define SIM_TIME_NEVER	UINT64_MAX
+
+/// SysTick clocks per microsecond; must match PLATFORM_TICKS_PER_US
+#define SIM_TICKS_PER_US	12
+#define SIM_TICKS_US(x)		((sim_time_t)(x) * SIM_TICKS_PER_US)
+#define SIM_TICKS_MS(x)		SIM_TICKS_US((sim_time_t)(x) * 1000)
+
+/// Something on the far end of a USART
+typedef struct sim_dev_type sim_dev_t;
+struct sim_dev_type {
+	const char	*name;
+
+	/// Line rate of the device itself; bytes are garbled if off by > 2.5%
+	uint32_t	baud;
+
+	/// A byte sent by the firmware has fully arrived; may be NULL
+	void		(*rx)(sim_dev_t *dev, uint8_t c);
+
+	/// Called once the time reaches @c due, which it should move on
+	void		(*run)(sim_dev_t *dev);
+	sim_time_t	due;
+};
+
+/// Counters of a simulated USART, as seen on the wire and at the registers
+typedef struct sim_usart_stats_type {
+	/// Bytes queued by the device, and those that made it across the line
+	uint32_t	nr_offered;
+	uint32_t	nr_arrived;
+
+	/// Bytes read out of DATA by the RXC handler
+	uint32_t	nr_read;
+
+	/// Bytes lost as the receive buffer was full (BUFOVF)
+	uint32_t	nr_overrun;
+
+	/// Bytes garbled by a baud rate mismatch, or lost with RX disabled
+	uint32_t	nr_garbled;
+
+	/// Bytes sent by the firmware
+	uint32_t	nr_tx;
+
+	/// Interrupt latency of RXC: from the flag going up to the handler
+	sim_time_t	rxc_lat_max;
+	sim_time_t	rxc_lat_total;
+	uint32_t	nr_rxc;
+} sim_usart_stats_t;
+
+/// Counters of the simulation as a whole
+typedef struct sim_stats_type {
+	/// Time spent in __WFI(), and number of times it was entered
+	sim_time_t	asleep;
+	uint32_t	nr_sleeps;
+
+	/// Stretches of time between two sleeps, i.e. a pass of the main loop
+	sim_time_t	awake_max;
+	sim_time_t	awake_total;
+
+	/// Time spent in handlers, and how many were run
+	sim_time_t	in_isr;
+	uint32_t	nr_isr;
+
+	/// Longest time a SysTick interrupt was kept waiting
+	sim_time_t	systick_lat_max;
+
+	/// When SysTick first loaded, i.e. tick zero to the firmware
+	sim_time_t	systick_zero;
+	bool		systick_started;
+
+	/// Flash rows erased and pages programmed
+	uint32_t	nr_flash_erases;
+	uint32_t	nr_flash_writes;
+
+	/// Descriptors fetched by the DMAC, and beats it moved
+	uint32_t	nr_dmac_fetches;
+	uint32_t	nr_dmac_beats;
+} sim_stats_t;
+
+/**
+ * Set up the simulated chip, as out of reset
+ *
+ * @param[in]	end		Time at which @p done is called
+ * @param[in]	slowdown	Host CPU time is charged to the target times
+ *				this; 0 to charge nothing
+ * @param[in]	done		Called once @p end is reached; must not
+ *				return
+ */
+void sim_init(sim_time_t end, double slowdown, void (*done)(void));
+
+/// Current time
+sim_time_t sim_now(void);
+
+/// Put @p dev on the far end of SERCOM @p sercom
+void sim_usart_attach(unsigned int sercom, sim_dev_t *dev);
+
+/**
+ * Have the device send bytes to the firmware
+ *
+ * They go out back-to-back at the device's baud rate, after whatever is
+ * still on its way.
+ */
+void sim_usart_send(unsigned int sercom, const void *buf, size_t len);
+
+/// Get the counters of SERCOM @p sercom
+void sim_usart_stats(unsigned int sercom, sim_usart_stats_t *stats);
+
+/// Get the current baud rate of SERCOM @p sercom, as programmed; 0 if off
+double sim_usart_baud(unsigned int sercom);
+
+/**
+ * Have DMAC channel @p ch stop with a transfer error (as on a bus error)
+ * instead of moving its next beat, once it has moved @p after more
+ */
+void sim_dmac_fail(unsigned int ch, uint32_t after);
+
+/// Get the counters of the simulation
+void sim_stats(sim_stats_t *stats);
+
+/// Get the period and duty cycle of the PWM on TCC1 WO[0]
+bool sim_tcc1_pwm(double *period_s, double *duty);
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifdef __cplusplus
+}
+#endif	// __cplusplus
+#endif	// !defined(SIM_H_)
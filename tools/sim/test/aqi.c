@@ -0,0 +1,300 @@
+/**
+ * @file aqi.c
+ * @brief Host test of the rolling windows and the AQI, and their cost
+ *
+ * The AQI is checked at every concentration either table covers, and past
+ * them, against the EPA's tables as published (in ug/m^3, with one decimal
+ * for PM2.5), interpolated in double precision; and at the edges of every
+ * row, against the index values the tables give there.
+ *
+ * Windows of every size are fed random samples, runs that rise or fall
+ * without end (the worst case for the minimum and maximum queues), long
+ * ties, and the ends of the range; after every sample, the statistics must
+ * match those computed over the samples in the window by brute force.
+ *
+ * The benchmark times a push and the statistics, against recomputing them
+ * over the window each time, and the AQI lookups.
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "aqi.h"
+#include "test.h"
+
+/// Samples fed through each window, and iterations of each benchmark
+#define AQI_NR_SAMPLES	20000
+#define AQI_NR_BENCH	2000000
+
+/// Window the firmware takes the PM means over, as in main.c
+#define AQI_PM_WINDOW	60
+
+/////////////////////////////////////////////////////////////////////////////
+
+// A row of an EPA table, as published
+typedef struct ref_bp_type {
+	double		c_lo, c_hi;
+	unsigned int	i_lo, i_hi;
+} ref_bp_t;
+
+// PM2.5, 24-hour, in ug/m^3 (2024 revision)
+static const ref_bp_t ref_pm2_5[] = {
+	{   0.0,   9.0,   0,  50 },
+	{   9.1,  35.4,  51, 100 },
+	{  35.5,  55.4, 101, 150 },
+	{  55.5, 125.4, 151, 200 },
+	{ 125.5, 225.4, 201, 300 },
+	{ 225.5, 325.4, 301, 500 },
+};
+
+// PM10, 24-hour, in ug/m^3
+static const ref_bp_t ref_pm10[] = {
+	{   0,  54,   0,  50 },
+	{  55, 154,  51, 100 },
+	{ 155, 254, 101, 150 },
+	{ 255, 354, 151, 200 },
+	{ 355, 424, 201, 300 },
+	{ 425, 604, 301, 500 },
+};
+
+#define REF_NR_BP	6
+
+/*
+ * The index for a concentration, truncated to the table's precision, or -1
+ * past its top; @p frac is set to how far the unrounded index is from a
+ * half, so that a tie can be told apart from a rounding error
+ */
+static int ref_aqi(const ref_bp_t *tbl, double c, double *frac)
+{
+	const ref_bp_t *bp;
+	double i;
+	unsigned int x;
+
+	for (x = 0; x < REF_NR_BP; ++x) {
+		bp = &tbl[x];
+		if (c > bp->c_hi + 1e-9)
+			continue;
+		i = (bp->i_hi - bp->i_lo) / (bp->c_hi - bp->c_lo) *
+			(c - bp->c_lo) + bp->i_lo;
+		*frac = fabs(i - floor(i) - 0.5);
+		return (int)floor(i + 0.5);
+	}
+	*frac = 1;
+	return -1;
+}
+
+static void aqi_check_table(uint16_t (*fn)(uint16_t), const ref_bp_t *tbl,
+	double unit)
+{
+	unsigned int c, x;
+	double frac;
+	int i;
+
+	// Every concentration, and a good way past the top
+	for (c = 0; c <= 65535; ++c) {
+		i = ref_aqi(tbl, c * unit, &frac);
+		if (i < 0)
+			TEST_CHECK(fn((uint16_t)c) == 500);
+		else if (frac > 1e-9)
+			TEST_CHECK(fn((uint16_t)c) == i);
+		else
+			TEST_CHECK(abs(fn((uint16_t)c) - i) <= 1);
+	}
+
+	// The edges of every row, exactly as tabulated
+	for (x = 0; x < REF_NR_BP; ++x) {
+		TEST_CHECK(fn((uint16_t)lround(tbl[x].c_lo / unit)) ==
+			tbl[x].i_lo);
+		TEST_CHECK(fn((uint16_t)lround(tbl[x].c_hi / unit)) ==
+			tbl[x].i_hi);
+		if (x + 1 < REF_NR_BP)
+			TEST_CHECK(fn((uint16_t)lround(tbl[x].c_hi / unit) + 1) ==
+				tbl[x + 1].i_lo);
+	}
+	TEST_CHECK(fn((uint16_t)lround(tbl[REF_NR_BP - 1].c_hi / unit) + 1) ==
+		500);
+	TEST_CHECK(fn(UINT16_MAX) == 500);
+}
+
+static void aqi_test_tables(void)
+{
+	aqi_check_table(aqi_pm2_5, ref_pm2_5, 0.1);
+	aqi_check_table(aqi_pm10, ref_pm10, 1);
+
+	// A few the EPA's calculator gives
+	TEST_CHECK(aqi_pm2_5(122) == 57);
+	TEST_CHECK(aqi_pm2_5(355) == 101);
+	TEST_CHECK(aqi_pm10(100) == 73);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+// Statistics over the last @p n of @p len samples, by brute force
+static void ref_stats(const uint16_t *v, unsigned int len, unsigned int size,
+	aqi_stats_t *st)
+{
+	unsigned int n = len < size ? len : size, x;
+	uint64_t sum = 0, sum_sq = 0;
+
+	memset(st, 0, sizeof(*st));
+	if (n == 0)
+		return;
+	v += len - n;
+	st->min = UINT16_MAX;
+	for (x = 0; x < n; ++x) {
+		sum += v[x];
+		sum_sq += (uint64_t)v[x] * v[x];
+		if (v[x] < st->min)
+			st->min = v[x];
+		if (v[x] > st->max)
+			st->max = v[x];
+	}
+	st->n = (uint8_t)n;
+	st->mean = (uint16_t)((sum + n / 2) / n);
+	st->var = (uint32_t)((n * sum_sq - sum * sum) / ((uint64_t)n * n));
+}
+
+// A sequence of samples of one of a few kinds
+static void aqi_make_samples(uint16_t *v, unsigned int n, unsigned int kind)
+{
+	unsigned int x;
+
+	for (x = 0; x < n; ++x) {
+		switch (kind) {
+		case 0:
+			v[x] = (uint16_t)test_rand();
+			break;
+		case 1:
+			// Small values, with many ties
+			v[x] = (uint16_t)test_rand_below(4);
+			break;
+		case 2:
+			// Runs rising or falling for longer than a window
+			v[x] = (uint16_t)(((x / 150) & 1) ? 150 - x % 150 :
+				x % 150);
+			break;
+		case 3:
+			// Runs of one value
+			v[x] = (x == 0 || test_rand_below(40) != 0) ?
+				(x == 0 ? 7 : v[x - 1]) : (uint16_t)test_rand();
+			break;
+		default:
+			// The ends of the range
+			v[x] = test_rand_below(2) ? UINT16_MAX : 0;
+			break;
+		}
+	}
+}
+
+static void aqi_test_windows(void)
+{
+	static uint16_t v[AQI_NR_SAMPLES];
+	aqi_win_t w;
+	aqi_stats_t st, ref;
+	unsigned int size, kind, x, eff;
+
+	for (size = 0; size <= AQI_WIN_MAX + 2; ++size) {
+		eff = size == 0 ? 1 : size > AQI_WIN_MAX ? AQI_WIN_MAX : size;
+		for (kind = 0; kind < 5; ++kind) {
+			aqi_make_samples(v, AQI_NR_SAMPLES / 8, kind);
+			aqi_win_init(&w, (uint8_t)size);
+			aqi_win_stats(&w, &st);
+			TEST_CHECK(st.n == 0 && st.mean == 0 && st.min == 0 &&
+				st.max == 0 && st.var == 0);
+			for (x = 0; x < AQI_NR_SAMPLES / 8; ++x) {
+				aqi_win_push(&w, v[x]);
+				aqi_win_stats(&w, &st);
+				ref_stats(v, x + 1, eff, &ref);
+				TEST_CHECK(st.n == ref.n && st.mean == ref.mean &&
+					st.min == ref.min && st.max == ref.max &&
+					st.var == ref.var);
+			}
+		}
+	}
+
+	// The firmware's window, for longer
+	aqi_make_samples(v, AQI_NR_SAMPLES, 0);
+	aqi_win_init(&w, AQI_PM_WINDOW);
+	for (x = 0; x < AQI_NR_SAMPLES; ++x) {
+		aqi_win_push(&w, (uint16_t)(v[x] % 5000));
+		v[x] %= 5000;
+		aqi_win_stats(&w, &st);
+		ref_stats(v, x + 1, AQI_PM_WINDOW, &ref);
+		TEST_CHECK(st.mean == ref.mean && st.min == ref.min &&
+			st.max == ref.max && st.var == ref.var);
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+#define BENCH_NR_IN	1024
+static uint16_t bench_in[BENCH_NR_IN];
+
+static void bench_window(void *arg, unsigned int n)
+{
+	aqi_win_t w;
+	aqi_stats_t st;
+
+	(void)arg;
+	aqi_win_init(&w, AQI_PM_WINDOW);
+	while (n-- > 0) {
+		aqi_win_push(&w, bench_in[n % BENCH_NR_IN]);
+		aqi_win_stats(&w, &st);
+		test_sink += st.mean + st.min + st.max + st.var;
+	}
+}
+
+// The same, recomputed over a ring of samples every time
+static void bench_brute(void *arg, unsigned int n)
+{
+	uint16_t ring[AQI_PM_WINDOW];
+	aqi_stats_t st;
+	unsigned int len = 0, head = 0;
+
+	(void)arg;
+	while (n-- > 0) {
+		ring[head] = bench_in[n % BENCH_NR_IN];
+		head = (head + 1) % AQI_PM_WINDOW;
+		if (len < AQI_PM_WINDOW)
+			++len;
+		ref_stats(ring, len, AQI_PM_WINDOW, &st);
+		test_sink += st.mean + st.min + st.max + st.var;
+	}
+}
+
+static void bench_aqi(void *arg, unsigned int n)
+{
+	(void)arg;
+	while (n-- > 0)
+		test_sink += aqi_pm2_5(bench_in[n % BENCH_NR_IN]) +
+			aqi_pm10(bench_in[n % BENCH_NR_IN] / 10);
+}
+
+static void bench(void)
+{
+	unsigned int x;
+
+	// What the PMS5003T reports on an ordinary day
+	for (x = 0; x < BENCH_NR_IN; ++x)
+		bench_in[x] = (uint16_t)(50 + test_rand_below(400));
+
+	printf("per sample, over a window of %u:\n", AQI_PM_WINDOW);
+	printf("  aqi_win_push + stats        %6.1f ns\n",
+		test_bench(bench_window, NULL, AQI_NR_BENCH));
+	printf("  brute force                 %6.1f ns\n",
+		test_bench(bench_brute, NULL, AQI_NR_BENCH / 10));
+	printf("  aqi_pm2_5 + aqi_pm10        %6.1f ns\n",
+		test_bench(bench_aqi, NULL, AQI_NR_BENCH));
+}
+
+int main(void)
+{
+	aqi_test_tables();
+	aqi_test_windows();
+	bench();
+	return test_done("aqi");
+}
@@ -0,0 +1,343 @@
+/**
+ * @file baud.c
+ * @brief Host test of the baud rate setting of the USART driver, on the
+ *	  simulated board
+ *
+ * For rates from 300 to 500000 baud, on every link, BAUD and CTRLA.SAMPR
+ * must be what the datasheet's formula for arithmetic baud generation gives,
+ * BAUD = 65536 * (1 - S * f_baud / f_ref), with 16 samples a bit wherever
+ * the reference clock allows and 8 otherwise; and the rate that comes out,
+ * as the simulated SERCOM sees it, no further from the one asked for than
+ * half a step of BAUD. Rates the reference clock can't reach, and a rate
+ * change while a frame is being sent, must be refused with nothing changed.
+ *
+ * At the new rate, bytes must go both ways unharmed, and the idle timeout
+ * must still be three character times: a burst completes no sooner than
+ * that after its last byte, and within two jiffies of it.
+ *
+ * The table printed gives the error of each rate, in percent.
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "platform.h"
+#include "sim.h"
+#include "test.h"
+
+/// Channels, as numbered by platform_usart_ch_t, and their SERCOMs
+#define BAUD_NR_CH	4
+static const unsigned int baud_sercom[BAUD_NR_CH] = { 0, 1, 3, 5 };
+
+/// Reference clock of the USARTs: GCLK_GEN2, on OSC16M at 4 MHz; see gpio.c
+#define BAUD_FREF	4000000.0
+
+/// Line rate all channels come up at
+#define BAUD_DEFAULT	9600
+
+/// Character time on the line, 10 bits, in simulated clocks
+#define BAUD_CHAR(baud) \
+	((sim_time_t)(SIM_TICKS_US(1000000) * 10 / (baud)))
+
+/// Idle timeout, as in platform/usart.c
+#define BAUD_IDLE(baud)	(3 * BAUD_CHAR(baud))
+
+/// Jiffy length
+#define BAUD_JIFFY	SIM_TICKS_US(PLATFORM_TICK_PERIOD_US)
+
+#define BAUD_NR_RATES	14
+static const uint32_t baud_rates[BAUD_NR_RATES] = {
+	300, 1200, 2400, 4800, 9600, 19200, 31250, 38400, 57600, 74880,
+	115200, 230400, 250000, 500000
+};
+
+/////////////////////////////////////////////////////////////////////////////
+
+// The far end of a SERCOM, taking whatever the firmware sends
+typedef struct line_type {
+	sim_dev_t	dev;
+	uint8_t		buf[256];
+	size_t		len;
+} line_t;
+
+static void line_rx(sim_dev_t *dev, uint8_t c)
+{
+	line_t *l = (line_t *)dev;
+
+	if (l->len < sizeof(l->buf))
+		l->buf[l->len] = c;
+	++l->len;
+}
+
+static line_t baud_lines[BAUD_NR_CH] = {
+	{ .dev = { "esp", BAUD_DEFAULT, line_rx, NULL, SIM_TIME_NEVER } },
+	{ .dev = { "co2", BAUD_DEFAULT, line_rx, NULL, SIM_TIME_NEVER } },
+	{ .dev = { "pms", BAUD_DEFAULT, line_rx, NULL, SIM_TIME_NEVER } },
+	{ .dev = { "gps", BAUD_DEFAULT, line_rx, NULL, SIM_TIME_NEVER } },
+};
+
+static sercom_usart_int_registers_t *baud_regs(unsigned int ch)
+{
+	switch (baud_sercom[ch]) {
+	case 0:
+		return &SERCOM0_REGS->USART_INT;
+	case 1:
+		return &SERCOM1_REGS->USART_INT;
+	case 3:
+		return &SERCOM3_REGS->USART_INT;
+	default:
+		return &SERCOM5_REGS->USART_INT;
+	}
+}
+
+// Hold up the main loop until a given time, as a blocking call would
+static void baud_block_until(sim_time_t t)
+{
+	while (sim_now() < t)
+		__WFI();
+}
+
+// Change the rate at both ends of a link
+static bool baud_set(unsigned int ch, uint32_t baud)
+{
+	if (!platform_usart_set_baud(ch, baud))
+		return false;
+	baud_lines[ch].dev.baud = baud;
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+/*
+ * BAUD and SAMPR for @p baud on channel @p ch, against the datasheet; the
+ * error of the rate programmed is returned, in parts of the rate asked for
+ */
+static double baud_check_regs(unsigned int ch, uint32_t baud)
+{
+	const sercom_usart_int_registers_t *r = baud_regs(ch);
+	unsigned int nr_samples = (baud * 16.0 <= BAUD_FREF) ? 16 : 8;
+	long expect = lround(65536.0 * (1.0 - nr_samples * baud / BAUD_FREF));
+	double actual;
+
+	TEST_CHECK(baud_set(ch, baud));
+	TEST_CHECK(platform_usart_get_baud(ch) == baud);
+	TEST_CHECK(((r->SERCOM_CTRLA >> 13) & 0x7) ==
+		(nr_samples == 16 ? 0x0 : 0x2));
+	TEST_CHECK(r->SERCOM_BAUD == expect);
+
+	// Within half a step of BAUD of the rate asked for
+	actual = sim_usart_baud(baud_sercom[ch]);
+	TEST_CHECK(fabs(actual - baud) <=
+		BAUD_FREF / nr_samples / 65536.0 / 2 * 1.0001);
+	return (actual - baud) / baud;
+}
+
+static void baud_test_regs(void)
+{
+	double err[BAUD_NR_RATES];
+	unsigned int ch, x;
+
+	for (ch = 0; ch < BAUD_NR_CH; ++ch) {
+		for (x = 0; x < BAUD_NR_RATES; ++x)
+			err[x] = baud_check_regs(ch, baud_rates[x]);
+		TEST_CHECK(baud_set(ch, BAUD_DEFAULT));
+	}
+
+	printf("baud rates from a %.0f MHz reference:\n", BAUD_FREF / 1e6);
+	for (x = 0; x < BAUD_NR_RATES; ++x)
+		printf("  %6u baud, %2ux: %+8.4f%%\n", baud_rates[x],
+			(baud_rates[x] * 16.0 <= BAUD_FREF) ? 16 : 8,
+			100 * err[x]);
+}
+
+// Rates out of reach of the reference clock leave everything as it was
+static void baud_test_refused(void)
+{
+	const sercom_usart_int_registers_t *r = baud_regs(PLATFORM_USART_ESP);
+	static const uint32_t bad[] = {
+		0, (uint32_t)(BAUD_FREF / 8) + 1, 1000000, UINT32_MAX
+	};
+	uint32_t ctrla = r->SERCOM_CTRLA;
+	uint16_t reg = r->SERCOM_BAUD;
+	unsigned int x;
+
+	for (x = 0; x < sizeof(bad) / sizeof(bad[0]); ++x) {
+		TEST_CHECK(!platform_usart_set_baud(PLATFORM_USART_ESP, bad[x]));
+		TEST_CHECK(platform_usart_get_baud(PLATFORM_USART_ESP) ==
+			BAUD_DEFAULT);
+		TEST_CHECK(r->SERCOM_BAUD == reg && r->SERCOM_CTRLA == ctrla);
+	}
+	TEST_CHECK(!platform_usart_set_baud(PLATFORM_USART_NR_CH, 9600));
+}
+
+/*
+ * A message to the ESP8266 at @p baud, then one back: refused while it is
+ * being sent, and not garbled either way
+ */
+static void baud_check_tx(uint32_t baud)
+{
+	static platform_usart_tx_msg_t msg;
+	static platform_usart_tx_bufdesc_t desc;
+	static char sent[64];
+	static char buf[sizeof(sent)];
+	static platform_usart_rx_async_desc_t rx;
+	line_t *l = &baud_lines[PLATFORM_USART_ESP];
+	platform_usart_stats_t ust0, ust;
+	sim_usart_stats_t sst0, sst;
+	unsigned int x;
+
+	for (x = 0; x < sizeof(sent); ++x)
+		sent[x] = (char)test_rand();
+	TEST_CHECK(baud_set(PLATFORM_USART_ESP, baud));
+	platform_usart_stats(PLATFORM_USART_ESP, &ust0, false);
+	sim_usart_stats(0, &sst0);
+
+	l->len = 0;
+	desc.buf = sent;
+	desc.len = sizeof(sent);
+	memset(&msg, 0, sizeof(msg));
+	msg.desc = &desc;
+	msg.nr_desc = 1;
+	TEST_CHECK(platform_usart_tx_submit(PLATFORM_USART_ESP, &msg));
+	TEST_CHECK(!platform_usart_set_baud(PLATFORM_USART_ESP, BAUD_DEFAULT));
+	TEST_CHECK(platform_usart_get_baud(PLATFORM_USART_ESP) == baud);
+	baud_block_until(sim_now() + sizeof(sent) * BAUD_CHAR(baud) +
+		BAUD_JIFFY);
+	TEST_CHECK(l->len == sizeof(sent) &&
+		memcmp(l->buf, sent, sizeof(sent)) == 0);
+
+	memset(&rx, 0, sizeof(rx));
+	rx.buf = buf;
+	rx.max_len = sizeof(buf);
+	TEST_CHECK(platform_usart_esp_rx_async(&rx));
+	sim_usart_send(0, sent, sizeof(sent));
+	baud_block_until(sim_now() + sizeof(sent) * BAUD_CHAR(baud) +
+		BAUD_JIFFY);
+	TEST_CHECK(rx.compl_type == PLATFORM_USART_RX_COMPL_DATA &&
+		rx.compl_info.data_len == sizeof(sent) &&
+		memcmp(buf, sent, sizeof(sent)) == 0);
+
+	platform_usart_stats(PLATFORM_USART_ESP, &ust, false);
+	sim_usart_stats(0, &sst);
+	TEST_CHECK(sst.nr_garbled == sst0.nr_garbled);
+	TEST_CHECK(ust.nr_err_frame == ust0.nr_err_frame);
+
+	// Once sent, the rate may change again
+	TEST_CHECK(baud_set(PLATFORM_USART_ESP, BAUD_DEFAULT));
+}
+
+// Bytes from a far end left at the old rate are all framing errors
+static void baud_test_mismatch(void)
+{
+	static const uint8_t sent[16] = "$GPGGA,mismatch";
+	platform_usart_stats_t ust0, ust;
+
+	TEST_CHECK(platform_usart_set_baud(PLATFORM_USART_ESP, 115200));
+	platform_usart_stats(PLATFORM_USART_ESP, &ust0, false);
+	sim_usart_send(0, sent, sizeof(sent));
+	baud_block_until(sim_now() + sizeof(sent) * BAUD_CHAR(BAUD_DEFAULT) +
+		BAUD_JIFFY);
+	platform_usart_stats(PLATFORM_USART_ESP, &ust, false);
+	TEST_CHECK(ust.nr_err_frame - ust0.nr_err_frame == sizeof(sent));
+	TEST_CHECK(platform_usart_set_baud(PLATFORM_USART_ESP, BAUD_DEFAULT));
+}
+
+/// Descriptor being polled for, and when it was first seen complete
+static volatile platform_usart_rx_async_desc_t *baud_polled;
+static sim_time_t baud_compl;
+
+// Hold up the main loop as baud_block_until() does, polling for completion
+static void baud_poll_until(sim_time_t t)
+{
+	while (sim_now() < t) {
+		__WFI();
+		if (baud_compl == 0 &&
+		    baud_polled->compl_type != PLATFORM_USART_RX_COMPL_NONE)
+			baud_compl = sim_now();
+	}
+}
+
+/*
+ * Two bursts to the ESP8266 link at @p baud, far enough apart to be split:
+ * four character times, or, at rates where that is shorter than the timer
+ * can tell apart, two jiffies past the idle timeout. The first must
+ * complete three character times after its end.
+ */
+static void baud_check_idle(uint32_t baud)
+{
+	static char buf[64];
+	static uint8_t sent[40];
+	static platform_usart_rx_async_desc_t desc;
+	const sim_time_t ch_time = BAUD_CHAR(baud);
+	sim_time_t t0, last, gap;
+	unsigned int x;
+
+	for (x = 0; x < sizeof(sent); ++x)
+		sent[x] = (uint8_t)test_rand();
+	TEST_CHECK(baud_set(PLATFORM_USART_ESP, baud));
+
+	memset(&desc, 0, sizeof(desc));
+	desc.buf = buf;
+	desc.max_len = sizeof(buf);
+	TEST_CHECK(platform_usart_esp_rx_async(&desc));
+	baud_polled = &desc;
+	baud_compl = 0;
+
+	t0 = sim_now();
+	last = t0 + 20 * ch_time;
+	sim_usart_send(0, sent, 20);
+	gap = BAUD_IDLE(baud) + 2 * BAUD_JIFFY;
+	if (gap < 4 * ch_time)
+		gap = 4 * ch_time;
+	baud_poll_until(last + gap);
+	sim_usart_send(0, &sent[20], 20);
+	baud_poll_until(last + BAUD_IDLE(baud) + 3 * BAUD_JIFFY);
+
+	TEST_CHECK(desc.compl_type == PLATFORM_USART_RX_COMPL_DATA);
+	TEST_CHECK(desc.compl_info.data_len == 20 &&
+		memcmp(buf, sent, 20) == 0);
+	TEST_CHECK(baud_compl >= last + BAUD_IDLE(baud));
+	TEST_CHECK(baud_compl <= last + BAUD_IDLE(baud) + 2 * BAUD_JIFFY);
+
+	platform_usart_esp_rx_abort();
+	baud_block_until(sim_now() + 20 * ch_time + BAUD_JIFFY);
+	TEST_CHECK(baud_set(PLATFORM_USART_ESP, BAUD_DEFAULT));
+}
+
+static void baud_test_link(void)
+{
+	static const uint32_t rates[] = { 2400, 9600, 57600, 115200, 250000 };
+	unsigned int x;
+
+	for (x = 0; x < sizeof(rates) / sizeof(rates[0]); ++x) {
+		baud_check_tx(rates[x]);
+		baud_check_idle(rates[x]);
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+static void done(void)
+{
+	exit(2);
+}
+
+int main(void)
+{
+	unsigned int ch;
+
+	sim_init(SIM_TIME_NEVER, 0, done);
+	for (ch = 0; ch < BAUD_NR_CH; ++ch)
+		sim_usart_attach(baud_sercom[ch], &baud_lines[ch].dev);
+	platform_init();
+
+	baud_test_regs();
+	baud_test_refused();
+	baud_test_link();
+	baud_test_mismatch();
+	return test_done("baud");
+}
@@ -0,0 +1,712 @@
+/**
+ * @file dmac.c
+ * @brief Host test of the DMAC transmit path, on the simulated board
+ *
+ * Random arrays of fragments, some of them empty, are started on both
+ * channels at once. The chains of descriptors platform/dmac.c builds are
+ * walked from the DMAC's base table and checked against the fragments, and
+ * then run by the simulated DMAC: what arrives at the far end of each
+ * SERCOM must be its fragments back to back, with the completion called
+ * once. Transfers aborted part of the way through must leave a prefix of
+ * them on the line, and call nothing unless they had already finished; the
+ * channel must be usable again right away. Transfers cut short by a transfer
+ * error must leave a prefix too, and call the completion once, as failed.
+ *
+ * The same goes through platform/usart.c: frames sent on both DMAC links,
+ * and a queue of messages submitted faster than the line takes them, must
+ * arrive whole and in order, with the link busy until the last byte has
+ * left the wire. A transfer error must abort the message it hits, and only
+ * that one, with the rest of the queue going out after it; a message
+ * submitted while the channel is still busy must wait for it, not be lost.
+ *
+ * The benchmark gives what a chain costs to build, in host time and in
+ * register accesses, and what a frame costs the CPU once started: the
+ * interrupts taken and the simulated time spent in handlers, for the DMAC
+ * against the interrupt-driven (DRE) path of the same driver.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "platform.h"
+#include "sim.h"
+#include "test.h"
+
+// Functions defined in platform/dmac.c and platform/usart.c
+extern bool platform_dmac_tx_setup(unsigned int ch, uint8_t trigsrc,
+	void (*done)(void *arg, bool ok), void *arg);
+extern bool platform_dmac_tx_start(unsigned int ch, volatile void *dst,
+	const platform_usart_tx_bufdesc_t *desc, unsigned int nr_desc);
+extern bool platform_dmac_busy(unsigned int ch);
+extern void platform_dmac_abort(unsigned int ch);
+extern void platform_usart_esp_init(void);
+extern void platform_usart_co2_init(void);
+extern void platform_usart_pms_init(void);
+
+/// Channels, their SERCOMs and trigger sources, as in platform/usart.c
+#define DMAC_NR_CH	2
+static const unsigned int dmac_sercom[DMAC_NR_CH] = { 0, 1 };
+static const uint8_t dmac_trigsrc[DMAC_NR_CH] = { 0x05, 0x07 };
+
+/// The DATA register a channel writes to
+#define DMAC_DATA(ch) \
+	(&((ch) == 0 ? SERCOM0_REGS : SERCOM1_REGS)->USART_INT.SERCOM_DATA)
+
+/// Limits of platform/dmac.c
+#define DMAC_NR_DESC_MAX	32
+
+/// BTCTRL, as platform/dmac.c sets it
+#define DMAC_BTCTRL_VALID	(1 << 0)
+#define DMAC_BTCTRL_BLOCKACT_INT (1 << 3)
+#define DMAC_BTCTRL_SRCINC	(1 << 10)
+
+/// Transfers of each kind
+#define DMAC_NR_CHAINS	300
+#define DMAC_NR_ABORTS	100
+#define DMAC_NR_FAULTS	100
+#define DMAC_NR_MSGS	64
+
+/// Bytes the fragments are taken from; the DMAC needs them off the stack
+#define DMAC_POOL_SIZE	4096
+static char dmac_pool[DMAC_NR_CH][DMAC_POOL_SIZE];
+
+/// Iterations of each benchmark
+#define DMAC_NR_BENCH	20000
+
+/////////////////////////////////////////////////////////////////////////////
+
+// The far end of a SERCOM, taking whatever the firmware sends
+typedef struct line_type {
+	sim_dev_t	dev;
+	uint8_t		buf[1 << 16];
+	size_t		len;
+} line_t;
+
+static void line_rx(sim_dev_t *dev, uint8_t c)
+{
+	line_t *l = (line_t *)dev;
+
+	if (l->len < sizeof(l->buf))
+		l->buf[l->len] = c;
+	++l->len;
+}
+
+static line_t dmac_lines[DMAC_NR_CH + 1] = {
+	{ .dev = { "esp", 9600, line_rx, NULL, SIM_TIME_NEVER } },
+	{ .dev = { "co2", 9600, line_rx, NULL, SIM_TIME_NEVER } },
+	{ .dev = { "pms", 9600, line_rx, NULL, SIM_TIME_NEVER } },
+};
+
+// Sleep until a given time, as the main loop does
+static void dmac_sleep_until(sim_time_t t)
+{
+	while (sim_now() < t)
+		__WFI();
+}
+
+// Let the lines drain: a few character times with nothing going on
+static void dmac_drain(void)
+{
+	dmac_sleep_until(sim_now() + SIM_TICKS_MS(5));
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+/// Completions seen per channel, and how many of them were failures
+static unsigned int dmac_nr_done[DMAC_NR_CH];
+static unsigned int dmac_nr_failed[DMAC_NR_CH];
+
+static void dmac_done(void *arg, bool ok)
+{
+	++dmac_nr_done[(uintptr_t)arg];
+	if (!ok)
+		++dmac_nr_failed[(uintptr_t)arg];
+}
+
+/*
+ * A random array of fragments out of a channel's pool, some of them empty
+ * or NULL; returns the bytes they hold, which are also put in @p expect
+ */
+static size_t dmac_make_frags(unsigned int ch, platform_usart_tx_bufdesc_t *desc,
+	unsigned int nr_desc, unsigned int max_len, uint8_t *expect)
+{
+	size_t total = 0;
+	unsigned int x, ofs;
+	uint16_t len;
+
+	for (x = 0; x < nr_desc; ++x) {
+		len = (uint16_t)(test_rand_below(4) == 0 ? 0 :
+			1 + test_rand_below(max_len));
+		ofs = test_rand_below(DMAC_POOL_SIZE - len + 1);
+		desc[x].buf = (test_rand_below(16) == 0) ? NULL :
+			&dmac_pool[ch][ofs];
+		desc[x].len = len;
+		if (desc[x].buf != NULL) {
+			memcpy(&expect[total], desc[x].buf, len);
+			total += len;
+		}
+	}
+	return total;
+}
+
+// Walk the chain of a channel from the base table, against the fragments
+static void dmac_check_chain(unsigned int ch,
+	const platform_usart_tx_bufdesc_t *desc, unsigned int nr_desc)
+{
+	const dmac_descriptor_registers_t *d = (const dmac_descriptor_registers_t *)
+		(uintptr_t)DMAC_SEC_REGS->DMAC_BASEADDR + ch;
+	uint32_t data = (uint32_t)(uintptr_t)DMAC_DATA(ch);
+	unsigned int x, nr_left = 0, nr_used = 0;
+
+	for (x = 0; x < nr_desc; ++x)
+		nr_left += (desc[x].buf != NULL && desc[x].len != 0);
+
+	for (x = 0; x < nr_desc; ++x) {
+		if (desc[x].buf == NULL || desc[x].len == 0)
+			continue;
+		--nr_left;
+		++nr_used;
+
+		TEST_CHECK(d->DMAC_BTCTRL == (DMAC_BTCTRL_VALID |
+			DMAC_BTCTRL_SRCINC |
+			(nr_left == 0 ? DMAC_BTCTRL_BLOCKACT_INT : 0)));
+		TEST_CHECK(d->DMAC_BTCNT == desc[x].len);
+		TEST_CHECK(d->DMAC_SRCADDR ==
+			(uint32_t)(uintptr_t)(desc[x].buf + desc[x].len));
+		TEST_CHECK(d->DMAC_DSTADDR == data);
+		if (nr_left == 0) {
+			TEST_CHECK(d->DMAC_DESCADDR == 0);
+			break;
+		}
+		if (!TEST_CHECK(d->DMAC_DESCADDR != 0))
+			break;
+		d = (const dmac_descriptor_registers_t *)(uintptr_t)
+			d->DMAC_DESCADDR;
+	}
+	TEST_CHECK(nr_used <= DMAC_NR_DESC_MAX);
+}
+
+// Chains on both channels at once, each run to completion
+static void dmac_test_chains(void)
+{
+	static platform_usart_tx_bufdesc_t desc[DMAC_NR_CH][DMAC_NR_DESC_MAX];
+	static uint8_t expect[DMAC_NR_CH][DMAC_NR_DESC_MAX * 64];
+	unsigned int nr_desc[DMAC_NR_CH];
+	size_t total[DMAC_NR_CH];
+	sim_stats_t st0, st;
+	unsigned int n, ch, nr_used;
+	bool ok;
+
+	for (n = 0; n < DMAC_NR_CHAINS; ++n) {
+		sim_stats(&st0);
+		nr_used = 0;
+		for (ch = 0; ch < DMAC_NR_CH; ++ch) {
+			nr_desc[ch] = 1 + test_rand_below(DMAC_NR_DESC_MAX);
+			do {
+				total[ch] = dmac_make_frags(ch, desc[ch],
+					nr_desc[ch], 64, expect[ch]);
+			} while (total[ch] == 0);
+			dmac_lines[ch].len = 0;
+			dmac_nr_done[ch] = 0;
+		}
+		for (ch = 0; ch < DMAC_NR_CH; ++ch) {
+			ok = platform_dmac_tx_start(ch, DMAC_DATA(ch),
+				desc[ch], nr_desc[ch]);
+			TEST_CHECK(ok && platform_dmac_busy(ch));
+		}
+
+		// Both chains, side by side in the channels' descriptor pools
+		for (ch = 0; ch < DMAC_NR_CH; ++ch) {
+			dmac_check_chain(ch, desc[ch], nr_desc[ch]);
+			for (unsigned int x = 0; x < nr_desc[ch]; ++x)
+				nr_used += (desc[ch][x].buf != NULL &&
+					desc[ch][x].len != 0);
+		}
+
+		// Busy until done, and done exactly once, with every byte out
+		ch = test_rand_below(DMAC_NR_CH);
+		TEST_CHECK(!platform_dmac_tx_start(ch, DMAC_DATA(ch),
+			desc[ch], nr_desc[ch]));
+		while (platform_dmac_busy(0) || platform_dmac_busy(1))
+			__WFI();
+		dmac_drain();
+
+		sim_stats(&st);
+		TEST_CHECK(st.nr_dmac_fetches - st0.nr_dmac_fetches == nr_used);
+		TEST_CHECK(st.nr_dmac_beats - st0.nr_dmac_beats ==
+			total[0] + total[1]);
+		for (ch = 0; ch < DMAC_NR_CH; ++ch) {
+			TEST_CHECK(dmac_nr_done[ch] == 1);
+			TEST_CHECK(dmac_lines[ch].len == total[ch] &&
+				memcmp(dmac_lines[ch].buf, expect[ch],
+					total[ch]) == 0);
+		}
+	}
+}
+
+// What a channel must refuse
+static void dmac_test_refused(void)
+{
+	static platform_usart_tx_bufdesc_t desc[DMAC_NR_DESC_MAX + 1];
+	volatile void *data = DMAC_DATA(0);
+	unsigned int x;
+
+	for (x = 0; x <= DMAC_NR_DESC_MAX; ++x) {
+		desc[x].buf = dmac_pool[0];
+		desc[x].len = 1;
+	}
+	dmac_lines[0].len = 0;
+	dmac_nr_done[0] = 0;
+	TEST_CHECK(!platform_dmac_tx_start(0, data, desc,
+		DMAC_NR_DESC_MAX + 1));
+	TEST_CHECK(!platform_dmac_tx_start(DMAC_NR_CH, data, desc, 1));
+
+	// Nothing but empty fragments
+	for (x = 0; x < DMAC_NR_DESC_MAX; ++x)
+		desc[x].len = 0;
+	desc[3].buf = NULL;
+	desc[3].len = 7;
+	TEST_CHECK(!platform_dmac_tx_start(0, data, desc, DMAC_NR_DESC_MAX));
+	TEST_CHECK(!platform_dmac_tx_start(0, data, desc, 0));
+	TEST_CHECK(!platform_dmac_busy(0));
+
+	dmac_drain();
+	TEST_CHECK(dmac_lines[0].len == 0 && dmac_nr_done[0] == 0);
+}
+
+// Transfers aborted part of the way through, each followed by a whole one
+static void dmac_test_abort(void)
+{
+	static platform_usart_tx_bufdesc_t desc[DMAC_NR_DESC_MAX];
+	static uint8_t expect[DMAC_NR_DESC_MAX * 64];
+	volatile void *data = DMAC_DATA(1);
+	unsigned int n, nr_desc;
+	sim_stats_t st0, st;
+	size_t total, sent;
+
+	for (n = 0; n < DMAC_NR_ABORTS; ++n) {
+		nr_desc = 1 + test_rand_below(DMAC_NR_DESC_MAX);
+		do {
+			total = dmac_make_frags(1, desc, nr_desc, 32, expect);
+		} while (total == 0);
+		dmac_lines[1].len = 0;
+		dmac_nr_done[1] = 0;
+
+		sim_stats(&st0);
+		TEST_CHECK(platform_dmac_tx_start(1, data, desc, nr_desc));
+		dmac_sleep_until(sim_now() +
+			test_rand_below((uint32_t)total * SIM_TICKS_MS(1)));
+		platform_dmac_abort(1);
+		sim_stats(&st);
+		sent = st.nr_dmac_beats - st0.nr_dmac_beats;
+		TEST_CHECK(!platform_dmac_busy(1));
+
+		// What was handed over still goes out, and nothing more
+		dmac_drain();
+		TEST_CHECK(dmac_lines[1].len == sent &&
+			memcmp(dmac_lines[1].buf, expect, sent) == 0);
+		TEST_CHECK(dmac_nr_done[1] == (sent == total));
+
+		// And the channel starts over cleanly
+		dmac_lines[1].len = 0;
+		dmac_nr_done[1] = 0;
+		TEST_CHECK(platform_dmac_tx_start(1, data, desc, nr_desc));
+		while (platform_dmac_busy(1))
+			__WFI();
+		dmac_drain();
+		TEST_CHECK(dmac_nr_done[1] == 1);
+		TEST_CHECK(dmac_lines[1].len == total &&
+			memcmp(dmac_lines[1].buf, expect, total) == 0);
+	}
+}
+
+// Transfers cut short by a transfer error, each followed by a whole one
+static void dmac_test_terr(void)
+{
+	static platform_usart_tx_bufdesc_t desc[DMAC_NR_DESC_MAX];
+	static uint8_t expect[DMAC_NR_DESC_MAX * 64];
+	unsigned int n, ch, nr_desc;
+	size_t total, sent;
+
+	for (n = 0; n < DMAC_NR_FAULTS; ++n) {
+		ch = test_rand_below(DMAC_NR_CH);
+		nr_desc = 1 + test_rand_below(DMAC_NR_DESC_MAX);
+		do {
+			total = dmac_make_frags(ch, desc, nr_desc, 32, expect);
+		} while (total == 0);
+		sent = test_rand_below((uint32_t)total);
+		dmac_lines[ch].len = 0;
+		dmac_nr_done[ch] = 0;
+		dmac_nr_failed[ch] = 0;
+
+		sim_dmac_fail(ch, (uint32_t)sent);
+		TEST_CHECK(platform_dmac_tx_start(ch, DMAC_DATA(ch), desc,
+			nr_desc));
+		while (platform_dmac_busy(ch))
+			__WFI();
+		dmac_drain();
+		TEST_CHECK(dmac_nr_done[ch] == 1 && dmac_nr_failed[ch] == 1);
+		TEST_CHECK(dmac_lines[ch].len == sent &&
+			memcmp(dmac_lines[ch].buf, expect, sent) == 0);
+
+		dmac_lines[ch].len = 0;
+		TEST_CHECK(platform_dmac_tx_start(ch, DMAC_DATA(ch), desc,
+			nr_desc));
+		while (platform_dmac_busy(ch))
+			__WFI();
+		dmac_drain();
+		TEST_CHECK(dmac_nr_done[ch] == 2 && dmac_nr_failed[ch] == 1);
+		TEST_CHECK(dmac_lines[ch].len == total &&
+			memcmp(dmac_lines[ch].buf, expect, total) == 0);
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+/// Messages handed back, in order
+static platform_usart_tx_msg_t *dmac_retired[DMAC_NR_MSGS];
+static unsigned int dmac_nr_retired;
+
+static void dmac_msg_done(platform_usart_tx_msg_t *msg, bool sent)
+{
+	TEST_CHECK(sent);
+	if (dmac_nr_retired < DMAC_NR_MSGS)
+		dmac_retired[dmac_nr_retired] = msg;
+	++dmac_nr_retired;
+}
+
+// Frames on both links at once, busy until the last byte is on the far end
+static void dmac_test_usart(void)
+{
+	static platform_usart_tx_bufdesc_t desc[DMAC_NR_CH][DMAC_NR_DESC_MAX];
+	static uint8_t expect[DMAC_NR_CH][DMAC_NR_DESC_MAX * 16];
+	bool (*const tx_async[DMAC_NR_CH])(const platform_usart_tx_bufdesc_t *,
+		unsigned int) = {
+		platform_usart_esp_tx_async, platform_usart_co2_tx_async
+	};
+	bool (*const tx_busy[DMAC_NR_CH])(void) = {
+		platform_usart_esp_tx_busy, platform_usart_co2_tx_busy
+	};
+	unsigned int n, ch, nr_desc[DMAC_NR_CH];
+	size_t total[DMAC_NR_CH];
+	bool busy[DMAC_NR_CH];
+
+	for (n = 0; n < DMAC_NR_CHAINS / 4; ++n) {
+		for (ch = 0; ch < DMAC_NR_CH; ++ch) {
+			nr_desc[ch] = 1 + test_rand_below(DMAC_NR_DESC_MAX);
+			total[ch] = dmac_make_frags(ch, desc[ch], nr_desc[ch],
+				16, expect[ch]);
+			dmac_lines[ch].len = 0;
+			TEST_CHECK(tx_async[ch](desc[ch], nr_desc[ch]));
+			busy[ch] = true;
+		}
+
+		while (busy[0] || busy[1]) {
+			__WFI();
+			for (ch = 0; ch < DMAC_NR_CH; ++ch) {
+				if (!busy[ch] || tx_busy[ch]())
+					continue;
+				busy[ch] = false;
+				TEST_CHECK(dmac_lines[ch].len == total[ch] &&
+					memcmp(dmac_lines[ch].buf, expect[ch],
+						total[ch]) == 0);
+			}
+		}
+	}
+}
+
+// A queue of messages, kept topped up, must go out whole and in order
+static void dmac_test_queue(void)
+{
+	static platform_usart_tx_msg_t msg[DMAC_NR_MSGS];
+	static platform_usart_tx_bufdesc_t desc[DMAC_NR_MSGS][4];
+	static uint8_t expect[DMAC_NR_MSGS * 4 * 24];
+	platform_usart_txq_stats_t qs0, qs;
+	unsigned int n = 0, x;
+	size_t total = 0;
+
+	platform_usart_txq_stats(PLATFORM_USART_ESP, &qs0);
+	dmac_lines[0].len = 0;
+	dmac_nr_retired = 0;
+	for (x = 0; x < DMAC_NR_MSGS; ++x) {
+		msg[x].nr_desc = 1 + test_rand_below(4);
+		total += dmac_make_frags(0, desc[x], msg[x].nr_desc, 24,
+			&expect[total]);
+		msg[x].desc = desc[x];
+		msg[x].compl_cb = dmac_msg_done;
+	}
+
+	while (dmac_nr_retired < DMAC_NR_MSGS) {
+		while (n < DMAC_NR_MSGS &&
+		       platform_usart_tx_submit(PLATFORM_USART_ESP, &msg[n]))
+			++n;
+		platform_do_loop_one();
+	}
+	dmac_drain();
+
+	for (x = 0; x < DMAC_NR_MSGS; ++x)
+		TEST_CHECK(dmac_retired[x] == &msg[x]);
+	TEST_CHECK(dmac_lines[0].len == total &&
+		memcmp(dmac_lines[0].buf, expect, total) == 0);
+	platform_usart_txq_stats(PLATFORM_USART_ESP, &qs);
+	TEST_CHECK(qs.nr_sent - qs0.nr_sent == DMAC_NR_MSGS);
+	TEST_CHECK(qs.depth == 0 && qs.depth_peak == 8);
+}
+
+/// Messages a TX queue holds
+#define DMAC_TXQ_LEN	8
+
+/// Messages handed back, and whether each was sent
+static unsigned int dmac_nr_handed;
+static bool dmac_sent[DMAC_TXQ_LEN];
+
+static void dmac_fault_done(platform_usart_tx_msg_t *msg, bool sent)
+{
+	unsigned int x = (unsigned int)(uintptr_t)msg->arg;
+
+	TEST_CHECK(x == dmac_nr_handed);
+	if (x < DMAC_TXQ_LEN)
+		dmac_sent[x] = sent;
+	++dmac_nr_handed;
+}
+
+/*
+ * A full queue, with a transfer error somewhere in it: the message it hits
+ * is aborted after what made it out, and the rest go out whole
+ */
+static void dmac_test_queue_terr(void)
+{
+	static platform_usart_tx_msg_t msg[DMAC_TXQ_LEN];
+	static platform_usart_tx_bufdesc_t desc[DMAC_TXQ_LEN][4];
+	static uint8_t expect[DMAC_TXQ_LEN * 4 * 24];
+	platform_usart_stats_t ust0, ust;
+	size_t start[DMAC_TXQ_LEN + 1], fail;
+	unsigned int n, x, hit;
+
+	for (n = 0; n < DMAC_NR_FAULTS; ++n) {
+		platform_usart_stats(PLATFORM_USART_ESP, &ust0, false);
+		memset(msg, 0, sizeof(msg));
+		start[0] = 0;
+		for (x = 0; x < DMAC_TXQ_LEN; ++x) {
+			msg[x].nr_desc = 1 + test_rand_below(4);
+			start[x + 1] = start[x] + dmac_make_frags(0, desc[x],
+				msg[x].nr_desc, 24, &expect[start[x]]);
+			msg[x].desc = desc[x];
+			msg[x].compl_cb = dmac_fault_done;
+			msg[x].arg = (void *)(uintptr_t)x;
+		}
+		if (start[DMAC_TXQ_LEN] == 0)
+			continue;
+		fail = test_rand_below((uint32_t)start[DMAC_TXQ_LEN]);
+		for (hit = 0; start[hit + 1] <= fail; ++hit)
+			;
+
+		dmac_lines[0].len = 0;
+		dmac_nr_handed = 0;
+		sim_dmac_fail(0, (uint32_t)fail);
+		for (x = 0; x < DMAC_TXQ_LEN; ++x)
+			TEST_CHECK(platform_usart_tx_submit(PLATFORM_USART_ESP,
+				&msg[x]));
+		while (dmac_nr_handed < DMAC_TXQ_LEN)
+			platform_do_loop_one();
+		dmac_drain();
+
+		for (x = 0; x < DMAC_TXQ_LEN; ++x)
+			TEST_CHECK(dmac_sent[x] == (x != hit));
+		TEST_CHECK(dmac_lines[0].len ==
+			fail + start[DMAC_TXQ_LEN] - start[hit + 1] &&
+			memcmp(dmac_lines[0].buf, expect, fail) == 0 &&
+			memcmp(dmac_lines[0].buf + fail, &expect[start[hit + 1]],
+				start[DMAC_TXQ_LEN] - start[hit + 1]) == 0);
+		platform_usart_stats(PLATFORM_USART_ESP, &ust, false);
+		TEST_CHECK(ust.nr_err_dma == ust0.nr_err_dma + 1);
+	}
+}
+
+// A message submitted while the DMAC channel is still busy waits for it
+static void dmac_test_busy(void)
+{
+	static platform_usart_tx_msg_t msg;
+	static platform_usart_tx_bufdesc_t raw[1], desc[2];
+	unsigned int n;
+
+	for (n = 0; n < DMAC_NR_FAULTS; ++n) {
+		raw[0].buf = &dmac_pool[0][0];
+		raw[0].len = (uint16_t)(1 + test_rand_below(16));
+		desc[0].buf = &dmac_pool[0][100];
+		desc[0].len = (uint16_t)(1 + test_rand_below(16));
+		desc[1].buf = &dmac_pool[0][200];
+		desc[1].len = (uint16_t)test_rand_below(16);
+		memset(&msg, 0, sizeof(msg));
+		msg.desc = desc;
+		msg.nr_desc = 2;
+		dmac_lines[0].len = 0;
+
+		TEST_CHECK(platform_dmac_tx_start(0, DMAC_DATA(0), raw, 1));
+		TEST_CHECK(platform_usart_tx_submit(PLATFORM_USART_ESP, &msg));
+		TEST_CHECK(msg.state == PLATFORM_USART_TX_MSG_QUEUED);
+		while (PLATFORM_USART_TX_MSG_BUSY(&msg))
+			platform_do_loop_one();
+		dmac_drain();
+
+		TEST_CHECK(dmac_lines[0].len ==
+			(size_t)raw[0].len + desc[0].len + desc[1].len &&
+			memcmp(dmac_lines[0].buf, raw[0].buf, raw[0].len) == 0 &&
+			memcmp(dmac_lines[0].buf + raw[0].len, desc[0].buf,
+				desc[0].len) == 0 &&
+			memcmp(dmac_lines[0].buf + raw[0].len + desc[0].len,
+				desc[1].buf, desc[1].len) == 0);
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+static platform_usart_tx_bufdesc_t bench_desc[DMAC_NR_DESC_MAX];
+
+static void bench_chain(void *arg, unsigned int n)
+{
+	unsigned int nr_desc = (unsigned int)(uintptr_t)arg;
+	volatile void *data = DMAC_DATA(0);
+
+	while (n-- > 0) {
+		platform_dmac_tx_start(0, data, bench_desc, nr_desc);
+		platform_dmac_abort(0);
+	}
+}
+
+// Time a chain of @p nr_desc fragments, and count its register accesses
+static void bench_chain_run(unsigned int nr_desc)
+{
+	sim_time_t t0 = sim_now();
+	double ns, clocks;
+
+	bench_chain((void *)(uintptr_t)nr_desc, DMAC_NR_BENCH);
+	clocks = (double)(sim_now() - t0) / DMAC_NR_BENCH;
+	ns = test_bench(bench_chain, (void *)(uintptr_t)nr_desc,
+		DMAC_NR_BENCH);
+	printf("  %2u fragments %8.1f ns %6.1f accesses\n", nr_desc, ns,
+		clocks);
+}
+
+/// Frames sent back to back by each run, as many as a queue holds
+#define BENCH_NR_FRAMES	8
+
+// Turn on the transmitter of the PMS5003T link, which has no DMAC channel
+static void bench_pms_tx_on(void)
+{
+	sercom_usart_int_registers_t *r = &SERCOM3_REGS->USART_INT;
+
+	platform_usart_pms_init();
+	r->SERCOM_CTRLA &= ~(1 << 1);
+	r->SERCOM_CTRLB |= (1 << 16);
+	r->SERCOM_CTRLA |= (1 << 1);
+}
+
+/*
+ * Queue frames of @p len bytes in @p nr_desc fragments on a channel, and
+ * report what they cost the CPU from submission until the last has left
+ */
+static void bench_frame(const char *what, platform_usart_ch_t ch,
+	unsigned int nr_desc, uint16_t len)
+{
+	static platform_usart_tx_msg_t msg[BENCH_NR_FRAMES];
+	sim_stats_t st0, st;
+	unsigned int x;
+
+	for (x = 0; x < nr_desc; ++x) {
+		bench_desc[x].buf = &dmac_pool[0][x * len / nr_desc];
+		bench_desc[x].len = (uint16_t)((x + 1) * len / nr_desc -
+			x * len / nr_desc);
+	}
+
+	/*
+	 * Only the ESP8266 and MH-Z19C queues are ever handed back, so the
+	 * PMS5003T link is set up afresh each time
+	 */
+	if (ch == PLATFORM_USART_PMS)
+		bench_pms_tx_on();
+	memset(msg, 0, sizeof(msg));
+
+	sim_stats(&st0);
+	for (x = 0; x < BENCH_NR_FRAMES; ++x) {
+		msg[x].desc = bench_desc;
+		msg[x].nr_desc = nr_desc;
+		TEST_CHECK(platform_usart_tx_submit(ch, &msg[x]));
+	}
+	while (msg[BENCH_NR_FRAMES - 1].state == PLATFORM_USART_TX_MSG_QUEUED)
+		platform_do_loop_one();
+	sim_stats(&st);
+
+	printf("  %-16s %3u B in %2u: %5.1f interrupts, %6.1f us in handlers\n",
+		what, len, nr_desc,
+		(double)(st.nr_isr - st0.nr_isr) / BENCH_NR_FRAMES,
+		(double)(st.in_isr - st0.in_isr) / BENCH_NR_FRAMES /
+			SIM_TICKS_PER_US);
+	while (PLATFORM_USART_TX_MSG_BUSY(&msg[BENCH_NR_FRAMES - 1]) &&
+	       ch != PLATFORM_USART_PMS)
+		platform_do_loop_one();
+}
+
+static void bench(void)
+{
+	unsigned int x;
+
+	for (x = 0; x < DMAC_NR_DESC_MAX; ++x) {
+		bench_desc[x].buf = &dmac_pool[0][x * 16];
+		bench_desc[x].len = 16;
+	}
+	printf("building a chain (start + abort):\n");
+	bench_chain_run(1);
+	bench_chain_run(2);
+	bench_chain_run(8);
+	bench_chain_run(32);
+
+	printf("per frame, from submission until it has left:\n");
+	bench_frame("DMAC (ESP8266)", PLATFORM_USART_ESP, 2, 53);
+	bench_frame("DRE (PMS5003T)", PLATFORM_USART_PMS, 2, 53);
+	bench_frame("DMAC (ESP8266)", PLATFORM_USART_ESP, 17, 200);
+	bench_frame("DRE (PMS5003T)", PLATFORM_USART_PMS, 17, 200);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+static void done(void)
+{
+	exit(2);
+}
+
+int main(void)
+{
+	unsigned int ch, x;
+
+	sim_init(SIM_TIME_NEVER, 0, done);
+	for (ch = 0; ch <= DMAC_NR_CH; ++ch)
+		sim_usart_attach(ch < DMAC_NR_CH ? dmac_sercom[ch] : 3,
+			&dmac_lines[ch].dev);
+	for (x = 0; x < sizeof(dmac_pool); ++x)
+		dmac_pool[x / DMAC_POOL_SIZE][x % DMAC_POOL_SIZE] =
+			(char)test_rand();
+	platform_init();
+
+	// Through the driver first, then straight on the channels
+	dmac_test_usart();
+	dmac_test_queue();
+	dmac_test_queue_terr();
+	dmac_test_busy();
+	for (ch = 0; ch < DMAC_NR_CH; ++ch)
+		platform_dmac_tx_setup(ch, dmac_trigsrc[ch], dmac_done,
+			(void *)(uintptr_t)ch);
+	dmac_test_chains();
+	dmac_test_refused();
+	dmac_test_abort();
+	dmac_test_terr();
+
+	// Give the links back to the driver
+	platform_usart_esp_init();
+	platform_usart_co2_init();
+	bench();
+	return test_done("dmac");
+}
@@ -0,0 +1,341 @@
+/**
+ * @file fixpt.c
+ * @brief Host randomized tests of the fixed-point conversions, and their cost
+ *
+ * Each conversion is checked on a few hundred thousand random fields, of the
+ * shapes NMEA sentences have and beyond, against the same conversion done in
+ * double precision with strtod(). The double result is exact to well within
+ * the last unit kept, except right at a rounding tie, where it may fall
+ * either side; there, either neighbour is accepted. Conversions documented as
+ * exact (or as inverses of one another) are checked for that, and saturation
+ * at the ends of the range as well.
+ *
+ * The benchmark times parsing against atof() and sscanf(), on fields taken
+ * from the NEO-6M logs the NMEA test uses.
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fixpt.h"
+#include "test.h"
+
+/// Random fields checked per conversion, and iterations of each benchmark
+#define FIXPT_NR_RANDOM	300000
+#define FIXPT_NR_BENCH	200000
+
+/// Fastest speed fixpt_knots_to_cmps() takes before saturating, in 0.001 kn
+#define FIXPT_KN_E3_MAX	((UINT32_MAX - 4500) / 463)
+
+/// How close to a tie the double result may be and still go either way
+#define FIXPT_TIE	1e-6
+
+/////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Whether an integer result matches a double reference, rounded half away
+ * from zero and saturated at +-max
+ */
+static bool fixpt_near(int64_t v, double ref, double max)
+{
+	double r = round(ref), frac = fabs(ref - trunc(ref));
+
+	if (r > max)
+		r = max;
+	else if (r < -max)
+		r = -max;
+	if (v == (int64_t)r)
+		return true;
+	return fabs(frac - 0.5) < FIXPT_TIE && fabs(ref) < max &&
+		fabs((double)v - ref) <= 0.5 + FIXPT_TIE;
+}
+
+// A random decimal field: up to @p nr_int integer digits and @p nr_dec decimals
+static void fixpt_rand_field(char *buf, unsigned int nr_int,
+	unsigned int nr_dec, bool sign)
+{
+	unsigned int x, n;
+
+	if (sign && test_rand_below(4) == 0)
+		*buf++ = test_rand_below(2) ? '-' : '+';
+	n = test_rand_below(nr_int + 1);
+	for (x = 0; x < n; ++x)
+		*buf++ = (char)('0' + test_rand_below(10));
+	n = test_rand_below(nr_dec + 1);
+	if (n > 0 || test_rand_below(2) == 0)
+		*buf++ = '.';
+	for (x = 0; x < n; ++x) {
+		// Fives and nines are where rounding goes wrong
+		switch (test_rand_below(4)) {
+		case 0:  *buf++ = '5'; break;
+		case 1:  *buf++ = '9'; break;
+		default: *buf++ = (char)('0' + test_rand_below(10)); break;
+		}
+	}
+	// Something that is not part of the number
+	*buf++ = test_rand_below(2) ? ',' : '*';
+	*buf = '\0';
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+static void fixpt_test_parse(void)
+{
+	static const double pow10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+	};
+	static const struct {
+		const char	*s;
+		uint8_t		nr_dec;
+		int32_t		v;
+	} known[] = {
+		{ "",			3, 0 },
+		{ ",",			3, 0 },
+		{ ".",			2, 0 },
+		{ "-",			2, 0 },
+		{ "0.0049",		2, 0 },
+		{ "0.005",		2, 1 },
+		{ "-0.005",		2, -1 },
+		{ "1.5",		0, 2 },
+		{ "-2.5",		0, -3 },
+		{ "499.6",		3, 499600 },
+		{ "2147483647",		0, INT32_MAX },
+		{ "2147483648",		0, INT32_MAX },
+		{ "-2147483648",	0, -INT32_MAX },
+		{ "2.147483647",	9, INT32_MAX },
+		{ "2.1474836475",	9, INT32_MAX },
+		{ "99999999999999",	3, INT32_MAX },
+	};
+	char buf[40];
+	const char *end;
+	unsigned int x;
+	uint8_t nr_dec;
+	int32_t v;
+
+	for (x = 0; x < sizeof(known) / sizeof(known[0]); ++x)
+		TEST_CHECK(fixpt_parse(known[x].s, known[x].nr_dec, NULL) ==
+			known[x].v);
+
+	for (x = 0; x < FIXPT_NR_RANDOM; ++x) {
+		nr_dec = (uint8_t)test_rand_below(10);
+		fixpt_rand_field(buf, 11, 12, true);
+		v = fixpt_parse(buf, nr_dec, &end);
+		TEST_CHECK(fixpt_near(v, strtod(buf, NULL) * pow10[nr_dec],
+			INT32_MAX));
+		TEST_CHECK(*end == ',' || *end == '*');
+	}
+}
+
+static void fixpt_test_fmt(void)
+{
+	char buf[16], ref[40];
+	unsigned int x;
+	uint8_t nr_dec;
+	int32_t v;
+	size_t len;
+
+	for (x = 0; x < FIXPT_NR_RANDOM; ++x) {
+		nr_dec = (uint8_t)test_rand_below(10);
+		v = (int32_t)(test_rand() >> (32 + test_rand_below(32)));
+		if (v == INT32_MIN)
+			continue;
+
+		// As printf() has it, and back exactly
+		len = fixpt_fmt(buf, v, nr_dec);
+		snprintf(ref, sizeof(ref), "%.*f", nr_dec,
+			v / pow(10, nr_dec));
+		TEST_CHECK(len == strlen(buf) && len < 13);
+		TEST_CHECK(strcmp(buf, ref) == 0 ||
+			(v == 0 && strcmp(buf, ref + 1) == 0));
+		TEST_CHECK(fixpt_parse(buf, nr_dec, NULL) == v);
+	}
+}
+
+static void fixpt_test_ddmm(void)
+{
+	char buf[40], hemi;
+	unsigned int x, deg, nr_dec;
+	double ref;
+	int32_t e7;
+	bool is_lon;
+
+	for (x = 0; x < FIXPT_NR_RANDOM; ++x) {
+		// Up to six decimals of minutes, correctly rounded
+		is_lon = test_rand_below(2);
+		deg = test_rand_below(is_lon ? 181 : 91);
+		nr_dec = test_rand_below(9);
+		snprintf(buf, sizeof(buf), "%0*u%02u", is_lon ? 3 : 2, deg,
+			test_rand_below(60));
+		fixpt_rand_field(buf + strlen(buf), 0, nr_dec, false);
+		hemi = "NSEW"[test_rand_below(4)];
+		e7 = fixpt_ddmm_to_e7(buf, hemi);
+		ref = (deg + fmod(strtod(buf, NULL), 100) / 60) * 1e7;
+		if (hemi == 'S' || hemi == 'W')
+			ref = -ref;
+		if (nr_dec <= 6)
+			TEST_CHECK(fixpt_near(e7, ref, INT32_MAX));
+		else
+			TEST_CHECK(fabs(e7 - ref) <= 1);
+
+		// Back and forth, exactly
+		e7 = (int32_t)test_rand_below(is_lon ? 3600000001u : 1800000001u) -
+			(is_lon ? 1800000000 : 900000000);
+		fixpt_e7_to_ddmm(buf, e7, is_lon, &hemi);
+		TEST_CHECK(fixpt_ddmm_to_e7(buf, hemi) == e7);
+		TEST_CHECK(strlen(buf) == (is_lon ? 12u : 11u));
+		TEST_CHECK(hemi == (is_lon ? (e7 < 0 ? 'W' : 'E') :
+			(e7 < 0 ? 'S' : 'N')));
+		ref = strtod(buf, NULL);
+		ref = (floor(ref / 100) + fmod(ref, 100) / 60) * 1e7;
+		TEST_CHECK(fabs(ref - fabs((double)e7)) < 0.01);
+	}
+
+	// Past the poles and the date line, the degrees saturate
+	TEST_CHECK(fixpt_ddmm_to_e7("99959.999999", 'E') == 1810000000);
+	TEST_CHECK(fixpt_ddmm_to_e7("", 'N') == 0);
+}
+
+static void fixpt_test_speed(void)
+{
+	char buf[40];
+	unsigned int x;
+	uint32_t cmps, v;
+	double s;
+
+	for (x = 0; x < FIXPT_NR_RANDOM; ++x) {
+		// Up to three decimals, as parsed, and so correctly rounded
+		fixpt_rand_field(buf, 4, 3, false);
+		s = strtod(buf, NULL);
+		TEST_CHECK(fixpt_near(fixpt_knots_to_cmps(buf),
+			fmin(s * 1000, FIXPT_KN_E3_MAX) * 463 / 9000, INT32_MAX));
+		TEST_CHECK(fixpt_near(fixpt_kmh_to_cmps(buf), s * 100000 / 3600,
+			INT32_MAX));
+		TEST_CHECK(fixpt_near(fixpt_m_to_mm(buf), s * 1000, INT32_MAX));
+
+		// Up to 300 m/s, and the other way
+		cmps = test_rand_below(30000);
+		v = fixpt_cmps_to_knots_e3(cmps);
+		TEST_CHECK(fixpt_near(v, cmps * 3600.0 / 1852 * 10, UINT32_MAX));
+		TEST_CHECK(fixpt_cmps_to_kmh_e3(cmps) == cmps * 36);
+		snprintf(buf, sizeof(buf), "%u.%03u", v / 1000, v % 1000);
+		TEST_CHECK(fixpt_knots_to_cmps(buf) == cmps);
+	}
+
+	// Saturated, not wrapped
+	TEST_CHECK(fixpt_knots_to_cmps("99999999") ==
+		(FIXPT_KN_E3_MAX * 463 + 4500) / 9000);
+	TEST_CHECK(fixpt_cmps_to_knots_e3(UINT32_MAX) ==
+		((UINT32_MAX - 231) / 9000 * 9000 + 231) / 463);
+	TEST_CHECK(fixpt_cmps_to_kmh_e3(UINT32_MAX) == UINT32_MAX / 36 * 36);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+/// Numeric fields of the NMEA logs, and those of them that are angles
+#define BENCH_NR_FIELDS	32768
+static const char *bench_fields[BENCH_NR_FIELDS];
+static const char *bench_angles[BENCH_NR_FIELDS];
+static unsigned int bench_nr_fields, bench_nr_angles;
+
+// Pick the numeric fields out of an NMEA log, NUL-terminating them in place
+static void bench_load(const char *name)
+{
+	char *log, *s, *dot;
+	size_t len;
+
+	log = (char *)test_load(name, &len);
+	for (s = log; *s != '\0' && bench_nr_fields < BENCH_NR_FIELDS; ++s) {
+		if (*s != ',' || s[1] < '0' || s[1] > '9')
+			continue;
+		bench_fields[bench_nr_fields++] = ++s;
+		len = strspn(s, "0123456789.");
+		dot = memchr(s, '.', len);
+		if (dot != NULL && dot - s >= 4)
+			bench_angles[bench_nr_angles++] = s;
+		s += len;
+		*s = '\0';
+	}
+}
+
+static void bench_fixpt(void *arg, unsigned int n)
+{
+	(void)arg;
+	while (n-- > 0)
+		test_sink += (uint32_t)fixpt_parse(
+			bench_fields[n % bench_nr_fields], 3, NULL);
+}
+
+static void bench_atof(void *arg, unsigned int n)
+{
+	(void)arg;
+	while (n-- > 0)
+		test_sink += (uint32_t)lround(
+			atof(bench_fields[n % bench_nr_fields]) * 1000);
+}
+
+static void bench_sscanf(void *arg, unsigned int n)
+{
+	double d;
+
+	(void)arg;
+	while (n-- > 0) {
+		if (sscanf(bench_fields[n % bench_nr_fields], "%lf", &d) == 1)
+			test_sink += (uint32_t)lround(d * 1000);
+	}
+}
+
+static void bench_ddmm_fixpt(void *arg, unsigned int n)
+{
+	(void)arg;
+	while (n-- > 0)
+		test_sink += (uint32_t)fixpt_ddmm_to_e7(
+			bench_angles[n % bench_nr_angles], 'N');
+}
+
+static void bench_ddmm_atof(void *arg, unsigned int n)
+{
+	double v, deg;
+
+	(void)arg;
+	while (n-- > 0) {
+		v = atof(bench_angles[n % bench_nr_angles]);
+		deg = floor(v / 100);
+		test_sink += (uint32_t)lround((deg + (v - deg * 100) / 60) * 1e7);
+	}
+}
+
+static void bench(void)
+{
+	bench_load("neo6m-cold.nmea");
+	bench_load("neo6m-drive.nmea");
+
+	printf("per field, over %u fields of the NMEA logs:\n",
+		bench_nr_fields);
+	printf("  fixpt_parse                 %6.1f ns\n",
+		test_bench(bench_fixpt, NULL, FIXPT_NR_BENCH));
+	printf("  atof                        %6.1f ns\n",
+		test_bench(bench_atof, NULL, FIXPT_NR_BENCH));
+	printf("  sscanf                      %6.1f ns\n",
+		test_bench(bench_sscanf, NULL, FIXPT_NR_BENCH));
+	printf("per angle, over %u:\n", bench_nr_angles);
+	printf("  fixpt_ddmm_to_e7            %6.1f ns\n",
+		test_bench(bench_ddmm_fixpt, NULL, FIXPT_NR_BENCH));
+	printf("  atof, in double             %6.1f ns\n",
+		test_bench(bench_ddmm_atof, NULL, FIXPT_NR_BENCH));
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+int main(void)
+{
+	fixpt_test_parse();
+	fixpt_test_fmt();
+	fixpt_test_ddmm();
+	fixpt_test_speed();
+	bench();
+	return test_done("fixpt");
+}
@@ -0,0 +1,379 @@
+/**
+ * @file log.c
+ * @brief Host test of the deferred log, on the simulated board
+ *
+ * Messages of every number of arguments, with random values, are logged from
+ * the main loop in bursts, some of them more than the ring holds, and drained
+ * over the ESP8266 link as the firmware drains them. On the far end, every
+ * batch must come out of the telemetry decoder as a raw message, with no bad
+ * frame in between. Together the batches must hold every message that was
+ * not dropped, in order: each with the offset of its own format string in
+ * the "logfmt" section, its time stamp and its arguments. The counts of
+ * dropped messages they carry must add up to those the log dropped. Over
+ * the run the ring wraps around many times, so many batches go out in two
+ * spans.
+ *
+ * The benchmarks set PLATFORM_LOG() against the sprintf() formatting of the
+ * MH-Z19C debug output it replaced, in host time and in bytes per call. A
+ * log call reads SysTick for its time stamp and masks interrupts, all
+ * through the simulator, which costs the host far more than it does the
+ * target; the report gives the register accesses per call as well, as
+ * test/tick.c does for the tick alone.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "platform.h"
+#include "telem.h"
+#include "sim.h"
+#include "test.h"
+
+/// SERCOM of the ESP8266, and the line rate it comes up at
+#define LOG_SERCOM	0
+#define LOG_BAUD	9600
+
+/// Drain period, as in main.c
+#define LOG_PERIOD_MS	500
+
+/// Rounds of logging, and the most messages logged in one
+#define LOG_NR_ROUNDS	400
+#define LOG_BURST_MAX	80
+
+/// Messages kept track of
+#define LOG_NR_MAX	(LOG_NR_ROUNDS * LOG_BURST_MAX)
+
+/// Benchmark rounds, each with the ring emptied first
+#define LOG_NR_BENCH	40
+
+/// Calls to time of the sprintf() versions, which need no draining
+#define LOG_NR_BENCH_FMT	100000
+
+/// Runs test_bench() makes of each, as in test.c; all go into one ring
+#define LOG_BENCH_RUNS	5
+
+/// Time for a full ring to be drained at LOG_BAUD, and freed
+#define LOG_DRAIN_MS	(3 * LOG_PERIOD_MS + 1200)
+
+/// Ring size, and time stamp unit, as in platform/log.c
+#define LOG_RING_LEN	256
+#define LOG_TIME_SHIFT	10
+
+// Format strings of the log, as platform/log.c has them
+extern const char __start_logfmt[], __stop_logfmt[];
+
+/// A message as logged, or dropped
+typedef struct log_ent_type {
+	const char	*fmt;
+	uint32_t	args[PLATFORM_LOG_MAX_ARGS];
+	unsigned int	nr_args;
+	uint32_t	stamp_lo, stamp_hi;
+	bool		dropped;
+} log_ent_t;
+
+static struct {
+	log_ent_t	ent[LOG_NR_MAX];
+	unsigned int	nr_logged;
+
+	/// Next message expected in a batch
+	unsigned int	next;
+
+	telem_decoder_t	dec;
+	unsigned int	nr_batches;
+	uint32_t	nr_words;
+	uint32_t	nr_dropped;
+
+	/// Benchmarks running, whose batches are not checked
+	bool		bench;
+} log_test;
+
+/////////////////////////////////////////////////////////////////////////////
+
+#define LOG_FMT_0	"none"
+#define LOG_FMT_1	"one %u"
+#define LOG_FMT_2	"two %d %x"
+#define LOG_FMT_15	"fifteen %u %u %u %u %u %u %u %u %u %u %u %u %u %u %u"
+
+// Log a message with @p nr_args of @p a; returns its format string
+static const char *log_one(unsigned int nr_args, const uint32_t *a)
+{
+	switch (nr_args) {
+	case 0:
+		PLATFORM_LOG(LOG_FMT_0);
+		return LOG_FMT_0;
+	case 1:
+		PLATFORM_LOG(LOG_FMT_1, a[0]);
+		return LOG_FMT_1;
+	case 2:
+		PLATFORM_LOG(LOG_FMT_2, a[0], a[1]);
+		return LOG_FMT_2;
+	default:
+		PLATFORM_LOG(LOG_FMT_15, a[0], a[1], a[2], a[3], a[4], a[5],
+			a[6], a[7], a[8], a[9], a[10], a[11], a[12], a[13],
+			a[14]);
+		return LOG_FMT_15;
+	}
+}
+
+// Check a batch against the messages logged
+static void log_check_batch(const telem_msg_t *msg)
+{
+	const uint8_t *p = msg->data + 4;
+	uint32_t nr_words, word, stamp;
+	unsigned int nr, x;
+	log_ent_t *e;
+
+	++log_test.nr_batches;
+	nr_words = (uint32_t)(msg->data[0] | (msg->data[1] << 8));
+	if (!TEST_CHECK(msg->len >= 4 && msg->len == 4 + 4 * nr_words))
+		return;
+	log_test.nr_dropped += (uint32_t)(msg->data[2] | (msg->data[3] << 8));
+	log_test.nr_words += nr_words;
+
+	while (nr_words >= 2) {
+		while (log_test.next < log_test.nr_logged &&
+		       log_test.ent[log_test.next].dropped)
+			++log_test.next;
+		if (!TEST_CHECK(log_test.next < log_test.nr_logged))
+			return;
+		e = &log_test.ent[log_test.next++];
+
+		memcpy(&word, p, sizeof(word));
+		TEST_CHECK(word < (uint32_t)(__stop_logfmt - __start_logfmt) &&
+			strcmp(__start_logfmt + word, e->fmt) == 0);
+		memcpy(&word, p + 4, sizeof(word));
+		nr = word >> 28;
+		stamp = word & 0x0FFFFFFF;
+		TEST_CHECK(nr == e->nr_args);
+		TEST_CHECK(stamp - e->stamp_lo <= e->stamp_hi - e->stamp_lo);
+		if (!TEST_CHECK(2 + nr <= nr_words))
+			return;
+		for (x = 0; x < nr; ++x) {
+			memcpy(&word, p + 8 + 4 * x, sizeof(word));
+			TEST_CHECK(word == e->args[x]);
+		}
+		p += 4 * (2 + nr);
+		nr_words -= 2 + nr;
+	}
+	TEST_CHECK(nr_words == 0);
+}
+
+// The ESP8266, decoding the uplink as the ground side would
+static void log_rx(sim_dev_t *dev, uint8_t c)
+{
+	telem_record_t rec;
+	telem_msg_t msg;
+
+	(void)dev;
+	if (telem_feed(&log_test.dec, c, &rec, &msg) == TELEM_FEED_MSG &&
+	    TEST_CHECK(msg.type == TELEM_TYPE_LOGS) && !log_test.bench)
+		log_check_batch(&msg);
+}
+
+static sim_dev_t log_esp = {
+	"esp", LOG_BAUD, log_rx, NULL, SIM_TIME_NEVER
+};
+
+static inline uint32_t log_stamp(void)
+{
+	return (uint32_t)(platform_tick_get() >> LOG_TIME_SHIFT) & 0x0FFFFFFF;
+}
+
+// Run the main loop for a while, as the firmware does
+static void log_run_for(platform_tick_t delay)
+{
+	platform_tick_t end = platform_tick_get() + delay;
+
+	while (!platform_tick_expired(platform_tick_get(), end))
+		platform_do_loop_one();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+static void log_test_batches(void)
+{
+	static const unsigned int nr_args[] = { 0, 1, 2, 15 };
+	platform_log_stats_t st0, st;
+	unsigned int n, x, burst;
+	log_ent_t *e;
+
+	platform_log_stats(&st);
+	for (n = 0; n < LOG_NR_ROUNDS; ++n) {
+		// Now and then, far more than the ring holds
+		burst = test_rand_below(n % 16 == 15 ? LOG_BURST_MAX : 12);
+		for (x = 0; x < burst; ++x) {
+			e = &log_test.ent[log_test.nr_logged++];
+			e->nr_args = nr_args[test_rand_below(4)];
+			for (unsigned int a = 0; a < e->nr_args; ++a)
+				e->args[a] = (uint32_t)test_rand();
+			st0 = st;
+			e->stamp_lo = log_stamp();
+			e->fmt = log_one(e->nr_args, e->args);
+			e->stamp_hi = log_stamp();
+			platform_log_stats(&st);
+			e->dropped = st.nr_dropped != st0.nr_dropped;
+			TEST_CHECK(st.nr_dropped + st.nr_logged ==
+				st0.nr_dropped + st0.nr_logged + 1);
+		}
+		log_run_for(PLATFORM_TICKS_MS(50 + test_rand_below(700)));
+	}
+
+	// One more, so the last of the drops get reported, then all of it out
+	e = &log_test.ent[log_test.nr_logged++];
+	e->stamp_lo = log_stamp();
+	e->fmt = log_one(0, NULL);
+	e->stamp_hi = log_stamp();
+	log_run_for(PLATFORM_TICKS_MS(4 * LOG_PERIOD_MS));
+
+	platform_log_stats(&st);
+	TEST_CHECK(st.nr_dropped > 0 && st.nr_logged > 0);
+	TEST_CHECK(log_test.next == log_test.nr_logged);
+	TEST_CHECK(log_test.nr_dropped == st.nr_dropped);
+	TEST_CHECK(log_test.nr_words == st.nr_words_sent);
+	TEST_CHECK(st.nr_words_sent > 8 * LOG_RING_LEN);
+	TEST_CHECK(st.depth_peak <= LOG_RING_LEN);
+	TEST_CHECK(log_test.dec.nr_bad == 0 && log_test.dec.nr_msg ==
+		log_test.nr_batches);
+	printf("%u messages logged, %u dropped; %u batches, %u words\n",
+		st.nr_logged, st.nr_dropped, log_test.nr_batches,
+		st.nr_words_sent);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+/// A read response of the MH-Z19C: 420 ppm
+static const uint8_t bench_resp[9] = {
+	0xFF, 0x86, 0x01, 0xA4, 0x00, 0x00, 0x00, 0x00, 0xD5
+};
+
+static char bench_text[128];
+
+// The CO2 reading, as the old code printed it
+static int bench_fmt_co2(void)
+{
+	return snprintf(bench_text, sizeof(bench_text), "CO2: %u ppm\r\n",
+		(unsigned int)((bench_resp[2] << 8) | bench_resp[3]));
+}
+
+// The raw response, as the old code printed it, a byte at a time
+static int bench_fmt_resp(void)
+{
+	int pos;
+	unsigned int x;
+
+	pos = snprintf(bench_text, sizeof(bench_text), "MH-Z19C RX: ");
+	for (x = 0; x < 9; ++x)
+		pos += snprintf(&bench_text[pos], sizeof(bench_text) - pos,
+			"%02X ", bench_resp[x]);
+	pos += snprintf(&bench_text[pos], sizeof(bench_text) - pos, "\r\n");
+	return pos;
+}
+
+static void bench_sprintf_co2(void *arg, unsigned int n)
+{
+	(void)arg;
+	while (n-- > 0)
+		test_sink += (uint64_t)bench_fmt_co2();
+}
+
+static void bench_sprintf_resp(void *arg, unsigned int n)
+{
+	(void)arg;
+	while (n-- > 0)
+		test_sink += (uint64_t)bench_fmt_resp();
+}
+
+static void bench_log_co2(void *arg, unsigned int n)
+{
+	(void)arg;
+	while (n-- > 0)
+		PLATFORM_LOG("CO2: %u ppm",
+			(bench_resp[2] << 8) | bench_resp[3]);
+}
+
+static void bench_log_resp(void *arg, unsigned int n)
+{
+	const uint8_t *r = bench_resp;
+
+	(void)arg;
+	while (n-- > 0)
+		PLATFORM_LOG("MH-Z19C RX: %02X %02X %02X %02X %02X %02X %02X "
+			"%02X %02X", r[0], r[1], r[2], r[3], r[4], r[5], r[6],
+			r[7], r[8]);
+}
+
+/*
+ * Time PLATFORM_LOG() over as many calls as fit into an empty ring, so that
+ * none is dropped, and the drain is left out of it
+ */
+static void bench_log(const char *what,
+	void (*fn)(void *arg, unsigned int n), unsigned int nr_args)
+{
+	const unsigned int n = LOG_RING_LEN / (2 + nr_args) / LOG_BENCH_RUNS;
+	platform_log_stats_t st0, st;
+	double ns, best = 0, clocks, clocks_best = 0;
+	sim_time_t t0;
+	unsigned int x;
+
+	for (x = 0; x < LOG_NR_BENCH; ++x) {
+		log_run_for(PLATFORM_TICKS_MS(LOG_DRAIN_MS));
+		platform_log_stats(&st0);
+		t0 = sim_now();
+		ns = test_bench(fn, NULL, n);
+		clocks = (double)(sim_now() - t0) / (n * LOG_BENCH_RUNS);
+		platform_log_stats(&st);
+		TEST_CHECK(st.nr_dropped == st0.nr_dropped &&
+			st.nr_logged == st0.nr_logged + n * LOG_BENCH_RUNS);
+		if (x == 0 || ns < best)
+			best = ns;
+		if (x == 0 || clocks < clocks_best)
+			clocks_best = clocks;
+	}
+	printf("  %-28s %8.1f ns %6.2f accesses %3u B\n", what, best,
+		clocks_best, 4 * (2 + nr_args));
+}
+
+static void bench_sprintf(const char *what,
+	void (*fn)(void *arg, unsigned int n), int (*fmt)(void))
+{
+	printf("  %-28s %8.1f ns %6.2f accesses %3d B\n", what,
+		test_bench(fn, NULL, LOG_NR_BENCH_FMT), 0.0, fmt());
+}
+
+static void bench(void)
+{
+	log_test.bench = true;
+	printf("per call, and bytes that go out:\n");
+	bench_sprintf("CO2 reading: snprintf", bench_sprintf_co2,
+		bench_fmt_co2);
+	bench_log("CO2 reading: PLATFORM_LOG", bench_log_co2, 1);
+	bench_sprintf("raw response: snprintf", bench_sprintf_resp,
+		bench_fmt_resp);
+	bench_log("raw response: PLATFORM_LOG", bench_log_resp, 9);
+	log_run_for(PLATFORM_TICKS_MS(LOG_DRAIN_MS));
+	log_test.bench = false;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+static void done(void)
+{
+	exit(2);
+}
+
+int main(void)
+{
+	sim_init(SIM_TIME_NEVER, 0, done);
+	sim_usart_attach(LOG_SERCOM, &log_esp);
+	platform_init();
+	telem_decoder_init(&log_test.dec);
+	platform_log_start(PLATFORM_USART_ESP,
+		PLATFORM_TICKS_MS(LOG_PERIOD_MS));
+
+	log_test_batches();
+	bench();
+	return test_done("log");
+}
@@ -0,0 +1,557 @@
+/**
+ * @file mhz19.c
+ * @brief Host test of the MH-Z19C driver, on the simulated board
+ *
+ * The driver runs from the main loop, as in the firmware, against a sensor
+ * scripted by each case: every frame the driver sends must be well formed
+ * with a good checksum, and reads are answered in time, not at all, with a
+ * spoiled checksum, or only after the request has timed out. The virtual
+ * sensor of fwsim only answers reads, and always in time.
+ *
+ * Dropped responses must be retried, and a reading given up on after the
+ * last retry; a bad checksum must be counted and retried too, and the value
+ * it carries never taken. A response that comes after its request timed
+ * out must not be taken as the answer to the retry. Calibration and ABC
+ * commands must go out as frames of their own, with the span's argument and
+ * checksum right; of ABC on and off, only the later request; and when
+ * queued with a read in flight, only once the read is over, but before the
+ * next one.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "platform.h"
+#include "mhz19.h"
+#include "sim.h"
+#include "test.h"
+
+/// SERCOM of the MH-Z19C, and its line rate
+#define MHZ_SERCOM	1
+#define MHZ_BAUD	9600
+
+/// Read period given to the driver; all retries are over well within it
+#define MHZ_PERIOD_MS	1000
+
+/// Rounds of each case
+#define MHZ_NR_ROUNDS	40
+
+/// Time from the end of a request to the start of a response in time
+#define MHZ_RESPONSE_US	2000
+
+/// Time a late response is waited for, and thrown away, as in mhz19.c
+#define MHZ_LATE_MS	50
+
+/// Frames and responses kept track of
+#define MHZ_NR_FRAMES	4096
+#define MHZ_NR_PENDING	4
+
+/// Command bytes of the frames the driver sends
+#define MHZ_CMD_READ	0x86
+#define MHZ_CMD_ZERO	0x87
+#define MHZ_CMD_SPAN	0x88
+#define MHZ_CMD_ABC	0x79
+
+/// How the sensor answers a read
+typedef enum mhz_answer_type {
+	MHZ_ANSWER = 0,		///< In time
+	MHZ_DROP,		///< Not at all
+	MHZ_BAD_SUM,		///< In time, with the checksum spoiled
+	MHZ_LATE,		///< Only after the request timed out
+} mhz_answer_t;
+
+/// A frame sent by the driver
+typedef struct mhz_frame_type {
+	uint8_t		data[MHZ19_FRAME_LEN];
+	sim_time_t	when;
+} mhz_frame_t;
+
+/// A response on its way
+typedef struct mhz_resp_type {
+	uint8_t		data[MHZ19_FRAME_LEN];
+	sim_time_t	due;
+} mhz_resp_t;
+
+static struct {
+	uint8_t		req[MHZ19_FRAME_LEN];
+	unsigned int	req_len;
+
+	mhz_frame_t	frame[MHZ_NR_FRAMES];
+	unsigned int	nr_frames;
+
+	/// How the next reads are answered, in turn; in time once it runs out
+	mhz_answer_t	script[MHZ19_NR_RETRIES + 1];
+	unsigned int	nr_script;
+
+	/// Value of the last response sent in time, and when it was over
+	uint16_t	ppm;
+	sim_time_t	ppm_done;
+
+	/// Values sent with a bad checksum, or late, which must not be taken
+	uint16_t	ppm_spoiled;
+
+	mhz_resp_t	pending[MHZ_NR_PENDING];
+	unsigned int	nr_pending;
+	unsigned int	nr_late;
+} mhz_sensor;
+
+static mhz19_t mhz;
+
+/// End of the current period's run, a quarter of a period short of the read
+static platform_tick_t mhz_end;
+
+/////////////////////////////////////////////////////////////////////////////
+
+static sim_time_t mhz_char_time(void)
+{
+	return SIM_TICKS_US(10 * 1000000 / MHZ_BAUD);
+}
+
+static uint8_t mhz_checksum(const uint8_t *frame)
+{
+	uint8_t sum = 0;
+	unsigned int x;
+
+	for (x = 1; x < MHZ19_FRAME_LEN - 1; ++x)
+		sum += frame[x];
+	return (uint8_t)-sum;
+}
+
+static void mhz_schedule(sim_dev_t *dev)
+{
+	unsigned int x;
+
+	dev->due = SIM_TIME_NEVER;
+	for (x = 0; x < mhz_sensor.nr_pending; ++x)
+		if (mhz_sensor.pending[x].due < dev->due)
+			dev->due = mhz_sensor.pending[x].due;
+}
+
+// Answer a read as the script says
+static void mhz_answer(sim_dev_t *dev)
+{
+	mhz_answer_t how = MHZ_ANSWER;
+	mhz_resp_t *r;
+	uint16_t ppm;
+
+	if (mhz_sensor.nr_script > 0) {
+		how = mhz_sensor.script[0];
+		memmove(&mhz_sensor.script[0], &mhz_sensor.script[1],
+			--mhz_sensor.nr_script * sizeof(mhz_sensor.script[0]));
+	}
+	if (how == MHZ_DROP || !TEST_CHECK(mhz_sensor.nr_pending <
+	    MHZ_NR_PENDING))
+		return;
+
+	// A value never sent before, so that each can be told apart
+	ppm = (uint16_t)(400 + test_rand_below(4600));
+	while (ppm == mhz_sensor.ppm || ppm == mhz_sensor.ppm_spoiled)
+		ppm = (uint16_t)(400 + test_rand_below(4600));
+
+	r = &mhz_sensor.pending[mhz_sensor.nr_pending++];
+	r->data[0] = 0xFF;
+	r->data[1] = MHZ_CMD_READ;
+	r->data[2] = (uint8_t)(ppm >> 8);
+	r->data[3] = (uint8_t)ppm;
+	r->data[4] = 0x47;
+	r->data[5] = r->data[6] = r->data[7] = 0;
+	r->data[8] = mhz_checksum(r->data);
+	r->due = sim_now() + SIM_TICKS_US(MHZ_RESPONSE_US);
+
+	switch (how) {
+	case MHZ_BAD_SUM:
+		r->data[8] ^= (uint8_t)(1 + test_rand_below(255));
+		mhz_sensor.ppm_spoiled = ppm;
+		break;
+	case MHZ_LATE:
+		// Past the timeout, by more than it takes to notice it
+		r->due = sim_now() + SIM_TICKS_MS(MHZ19_RESPONSE_TIMEOUT_MS) +
+			SIM_TICKS_US(test_rand_below(1000 *
+				(MHZ_LATE_MS - 20)));
+		mhz_sensor.ppm_spoiled = ppm;
+		++mhz_sensor.nr_late;
+		break;
+	default:
+		mhz_sensor.ppm = ppm;
+		mhz_sensor.ppm_done = r->due + MHZ19_FRAME_LEN *
+			mhz_char_time();
+		break;
+	}
+	mhz_schedule(dev);
+}
+
+// Frames come in nine bytes at a time, starting with 0xFF
+static void mhz_rx(sim_dev_t *dev, uint8_t c)
+{
+	mhz_frame_t *f;
+
+	if (mhz_sensor.req_len == 0 && c != 0xFF)
+		return;
+	mhz_sensor.req[mhz_sensor.req_len++] = c;
+	if (mhz_sensor.req_len < MHZ19_FRAME_LEN)
+		return;
+	mhz_sensor.req_len = 0;
+
+	TEST_CHECK(mhz_sensor.req[1] == 0x01 &&
+		mhz_sensor.req[8] == mhz_checksum(mhz_sensor.req));
+	if (!TEST_CHECK(mhz_sensor.nr_frames < MHZ_NR_FRAMES))
+		return;
+	f = &mhz_sensor.frame[mhz_sensor.nr_frames++];
+	memcpy(f->data, mhz_sensor.req, sizeof(f->data));
+	f->when = sim_now();
+
+	if (f->data[2] == MHZ_CMD_READ)
+		mhz_answer(dev);
+}
+
+// Send the response that is due
+static void mhz_run(sim_dev_t *dev)
+{
+	unsigned int x;
+
+	for (x = 0; x < mhz_sensor.nr_pending; ++x) {
+		if (mhz_sensor.pending[x].due != dev->due)
+			continue;
+		sim_usart_send(MHZ_SERCOM, mhz_sensor.pending[x].data,
+			MHZ19_FRAME_LEN);
+		mhz_sensor.pending[x] =
+			mhz_sensor.pending[--mhz_sensor.nr_pending];
+		break;
+	}
+	mhz_schedule(dev);
+}
+
+static sim_dev_t mhz_dev = {
+	"co2", MHZ_BAUD, mhz_rx, mhz_run, SIM_TIME_NEVER
+};
+
+/////////////////////////////////////////////////////////////////////////////
+
+static void mhz_wake(platform_timer_t *timer, void *arg)
+{
+	(void)timer;
+	(void)arg;
+}
+
+/// Wakes the main loop at the end of a run, which it would sleep through
+static platform_timer_t mhz_timer = { mhz_wake, NULL };
+
+// Run the main loop until @p end, as the firmware does
+static void mhz_run_until(platform_tick_t end)
+{
+	platform_tick_t now = platform_tick_get();
+
+	if (platform_tick_expired(now, end))
+		return;
+	platform_timer_arm(&mhz_timer, end - now);
+	while (!platform_tick_expired(platform_tick_get(), end))
+		platform_do_loop_one();
+	platform_timer_cancel(&mhz_timer);
+}
+
+// Run the rest of the driver's period, up to a quarter short of the next
+static void mhz_run_period(void)
+{
+	mhz_end += PLATFORM_TICKS_MS(MHZ_PERIOD_MS);
+	mhz_run_until(mhz_end);
+}
+
+// Run one period of the driver, with its read answered as @p script says
+static void mhz_period(const mhz_answer_t *script, unsigned int nr_script)
+{
+	memcpy(mhz_sensor.script, script, nr_script * sizeof(script[0]));
+	mhz_sensor.nr_script = nr_script;
+	mhz_run_period();
+	TEST_CHECK(mhz_sensor.nr_script == 0 && mhz_sensor.nr_pending == 0);
+}
+
+// Frames sent with command byte @p cmd, from frame @p from on
+static unsigned int mhz_count(uint8_t cmd, unsigned int from)
+{
+	unsigned int x, n = 0;
+
+	for (x = from; x < mhz_sensor.nr_frames; ++x)
+		if (mhz_sensor.frame[x].data[2] == cmd)
+			++n;
+	return n;
+}
+
+/*
+ * Check that the read of the last period got the value of the response in
+ * time, if there was one, and never a spoiled one
+ */
+static void mhz_check_reading(bool answered, const mhz19_sample_t *prev)
+{
+	mhz19_sample_t s;
+
+	TEST_CHECK(mhz19_latest(&mhz, &s) || !answered);
+	if (!answered) {
+		TEST_CHECK(s.seq == prev->seq && s.co2_ppm == prev->co2_ppm);
+		return;
+	}
+	TEST_CHECK(s.seq == prev->seq + 1);
+	TEST_CHECK(s.co2_ppm == mhz_sensor.ppm &&
+		s.co2_ppm != mhz_sensor.ppm_spoiled);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+// Reads answered in time
+static void mhz_test_answer(void)
+{
+	mhz19_stats_t st0, st;
+	mhz19_sample_t prev;
+	unsigned int n;
+
+	for (n = 0; n < MHZ_NR_ROUNDS; ++n) {
+		mhz19_stats(&mhz, &st0);
+		mhz19_latest(&mhz, &prev);
+		mhz_period(NULL, 0);
+		mhz19_stats(&mhz, &st);
+
+		TEST_CHECK(st.nr_requests == st0.nr_requests + 1);
+		TEST_CHECK(st.nr_good == st0.nr_good + 1);
+		TEST_CHECK(st.nr_timeout == st0.nr_timeout &&
+			st.nr_bad == st0.nr_bad && st.nr_failed == st0.nr_failed);
+		mhz_check_reading(true, &prev);
+	}
+}
+
+// Some or all of the responses to a read dropped
+static void mhz_test_dropped(void)
+{
+	static const mhz_answer_t drops[] = {
+		MHZ_DROP, MHZ_DROP, MHZ_DROP,
+	};
+	mhz19_stats_t st0, st;
+	mhz19_sample_t prev;
+	unsigned int n, nr, first, x;
+	bool answered;
+
+	for (n = 0; n < MHZ_NR_ROUNDS; ++n) {
+		nr = 1 + n % (MHZ19_NR_RETRIES + 1);
+		answered = nr <= MHZ19_NR_RETRIES;
+		mhz19_stats(&mhz, &st0);
+		mhz19_latest(&mhz, &prev);
+		first = mhz_sensor.nr_frames;
+		mhz_period(drops, nr);
+		mhz19_stats(&mhz, &st);
+
+		TEST_CHECK(st.nr_requests == st0.nr_requests + nr + answered);
+		TEST_CHECK(st.nr_timeout == st0.nr_timeout + nr);
+		TEST_CHECK(st.nr_good == st0.nr_good + answered);
+		TEST_CHECK(st.nr_failed == st0.nr_failed + !answered);
+		TEST_CHECK(mhz_count(MHZ_CMD_READ, first) == nr + answered);
+		mhz_check_reading(answered, &prev);
+
+		// Each retry only once the one before has timed out
+		for (x = first + 1; x < mhz_sensor.nr_frames; ++x)
+			TEST_CHECK(mhz_sensor.frame[x].when -
+				mhz_sensor.frame[x - 1].when >=
+				SIM_TICKS_MS(MHZ19_RESPONSE_TIMEOUT_MS));
+	}
+}
+
+// Responses with a bad checksum, then one in time, or none at all
+static void mhz_test_bad_sum(void)
+{
+	static const mhz_answer_t bad[] = {
+		MHZ_BAD_SUM, MHZ_BAD_SUM, MHZ_BAD_SUM,
+	};
+	mhz19_stats_t st0, st;
+	mhz19_sample_t prev;
+	unsigned int n, nr;
+	bool answered;
+
+	for (n = 0; n < MHZ_NR_ROUNDS; ++n) {
+		nr = 1 + n % (MHZ19_NR_RETRIES + 1);
+		answered = nr <= MHZ19_NR_RETRIES;
+		mhz19_stats(&mhz, &st0);
+		mhz19_latest(&mhz, &prev);
+		mhz_period(bad, nr);
+		mhz19_stats(&mhz, &st);
+
+		TEST_CHECK(st.nr_requests == st0.nr_requests + nr + answered);
+		TEST_CHECK(st.nr_bad == st0.nr_bad + nr);
+		TEST_CHECK(st.nr_timeout == st0.nr_timeout);
+		TEST_CHECK(st.nr_good == st0.nr_good + answered);
+		TEST_CHECK(st.nr_failed == st0.nr_failed + !answered);
+		mhz_check_reading(answered, &prev);
+	}
+}
+
+// A response after its request timed out, then the retry answered in time
+static void mhz_test_late(void)
+{
+	static const mhz_answer_t late[] = { MHZ_LATE, MHZ_ANSWER };
+	mhz19_stats_t st0, st;
+	mhz19_sample_t prev;
+	unsigned int n;
+
+	for (n = 0; n < MHZ_NR_ROUNDS; ++n) {
+		mhz19_stats(&mhz, &st0);
+		mhz19_latest(&mhz, &prev);
+		mhz_period(late, 2);
+		mhz19_stats(&mhz, &st);
+
+		TEST_CHECK(st.nr_requests == st0.nr_requests + 2);
+		TEST_CHECK(st.nr_timeout == st0.nr_timeout + 1);
+		TEST_CHECK(st.nr_late == st0.nr_late + 1);
+		TEST_CHECK(st.nr_good == st0.nr_good + 1);
+		mhz_check_reading(true, &prev);
+	}
+	TEST_CHECK(mhz_sensor.nr_late == MHZ_NR_ROUNDS);
+}
+
+// Calibration commands, with the span's argument
+static void mhz_test_calibrate(void)
+{
+	mhz19_stats_t st0, st;
+	const mhz_frame_t *f;
+	unsigned int n, first;
+	uint16_t ppm;
+
+	for (n = 0; n < MHZ_NR_ROUNDS; ++n) {
+		ppm = (uint16_t)test_rand();
+		mhz19_stats(&mhz, &st0);
+		first = mhz_sensor.nr_frames;
+		mhz19_calibrate_zero(&mhz);
+		TEST_CHECK(mhz19_calibrate_span(&mhz, ppm));
+		mhz_period(NULL, 0);
+		mhz19_stats(&mhz, &st);
+
+		TEST_CHECK(st.nr_commands == st0.nr_commands + 2);
+		TEST_CHECK(mhz_count(MHZ_CMD_ZERO, first) == 1);
+		if (!TEST_CHECK(mhz_count(MHZ_CMD_SPAN, first) == 1))
+			continue;
+		for (f = &mhz_sensor.frame[first];
+		     f->data[2] != MHZ_CMD_SPAN; ++f)
+			;
+		TEST_CHECK(((f->data[3] << 8) | f->data[4]) == ppm);
+		TEST_CHECK(f->data[5] == 0 && f->data[6] == 0 &&
+			f->data[7] == 0);
+	}
+}
+
+// ABC turned on and off in a row: only the later request goes out
+static void mhz_test_abc(void)
+{
+	mhz19_stats_t st0, st;
+	unsigned int n, x, nr, first;
+	bool on = false;
+
+	for (n = 0; n < MHZ_NR_ROUNDS; ++n) {
+		mhz19_stats(&mhz, &st0);
+		first = mhz_sensor.nr_frames;
+		nr = 1 + test_rand_below(4);
+		for (x = 0; x < nr; ++x) {
+			on = test_rand_below(2) != 0;
+			mhz19_set_abc(&mhz, on);
+		}
+		mhz_period(NULL, 0);
+		mhz19_stats(&mhz, &st);
+
+		TEST_CHECK(st.nr_commands == st0.nr_commands + 1);
+		if (!TEST_CHECK(mhz_count(MHZ_CMD_ABC, first) == 1))
+			continue;
+		for (x = first; mhz_sensor.frame[x].data[2] != MHZ_CMD_ABC;
+		     ++x)
+			;
+		TEST_CHECK(mhz_sensor.frame[x].data[3] == (on ? 0xA0 : 0x00));
+	}
+}
+
+/*
+ * Commands queued once a read is in flight: out after the response, or
+ * after the read is given up on, and before the next read
+ */
+static void mhz_test_in_flight(void)
+{
+	static const mhz_answer_t scripts[][MHZ19_NR_RETRIES + 1] = {
+		{ MHZ_ANSWER },
+		{ MHZ_DROP, MHZ_ANSWER },
+		{ MHZ_BAD_SUM, MHZ_DROP, MHZ_ANSWER },
+		{ MHZ_DROP, MHZ_DROP, MHZ_DROP },
+	};
+	static const unsigned int nr_script[] = { 1, 2, 3, 3 };
+	mhz19_stats_t st0, st;
+	mhz19_sample_t prev;
+	unsigned int n, x, s, first, nr_reads;
+	sim_time_t read_done;
+	bool answered;
+
+	for (n = 0; n < MHZ_NR_ROUNDS; ++n) {
+		s = n % 4;
+		answered = s != 3;
+		nr_reads = nr_script[s];
+		mhz19_stats(&mhz, &st0);
+		mhz19_latest(&mhz, &prev);
+		first = mhz_sensor.nr_frames;
+		memcpy(mhz_sensor.script, scripts[s], sizeof(scripts[s]));
+		mhz_sensor.nr_script = nr_script[s];
+
+		// Until the first request is in, then a little more
+		while (mhz_sensor.nr_frames == first)
+			platform_do_loop_one();
+		mhz_run_until(platform_tick_get() + PLATFORM_TICKS_US(
+			test_rand_below(1000 * MHZ19_RESPONSE_TIMEOUT_MS / 2)));
+		mhz19_calibrate_zero(&mhz);
+		mhz19_set_abc(&mhz, true);
+		mhz_run_period();
+		mhz19_stats(&mhz, &st);
+
+		TEST_CHECK(mhz_sensor.nr_script == 0);
+		TEST_CHECK(st.nr_commands == st0.nr_commands + 2);
+		TEST_CHECK(st.nr_failed == st0.nr_failed + !answered);
+		mhz_check_reading(answered, &prev);
+
+		// All the reads first, then the commands
+		if (!TEST_CHECK(mhz_sensor.nr_frames == first + nr_reads + 2))
+			continue;
+		for (x = 0; x < nr_reads; ++x)
+			TEST_CHECK(mhz_sensor.frame[first + x].data[2] ==
+				MHZ_CMD_READ);
+		TEST_CHECK(mhz_sensor.frame[first + nr_reads].data[2] ==
+			MHZ_CMD_ZERO);
+		TEST_CHECK(mhz_sensor.frame[first + nr_reads + 1].data[2] ==
+			MHZ_CMD_ABC);
+
+		// Not before the response has come in, or the read timed out
+		read_done = answered ? mhz_sensor.ppm_done :
+			mhz_sensor.frame[first + nr_reads - 1].when +
+			SIM_TICKS_MS(MHZ19_RESPONSE_TIMEOUT_MS);
+		TEST_CHECK(mhz_sensor.frame[first + nr_reads].when >
+			read_done);
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+static void done(void)
+{
+	exit(2);
+}
+
+int main(void)
+{
+	sim_init(SIM_TIME_NEVER, 0, done);
+	sim_usart_attach(MHZ_SERCOM, &mhz_dev);
+	platform_init();
+	mhz.task.name = "mhz19";
+	mhz19_start(&mhz, PLATFORM_TICKS_MS(MHZ_PERIOD_MS));
+	mhz_end = platform_tick_get() - PLATFORM_TICKS_MS(MHZ_PERIOD_MS / 4);
+
+	mhz_test_answer();
+	mhz_test_dropped();
+	mhz_test_bad_sum();
+	mhz_test_late();
+	mhz_test_calibrate();
+	mhz_test_abc();
+	mhz_test_in_flight();
+	printf("%u frames sent to the sensor, %u late responses\n",
+		mhz_sensor.nr_frames, mhz_sensor.nr_late);
+	return test_done("mhz19");
+}
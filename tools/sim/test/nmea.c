@@ -0,0 +1,446 @@
+/**
+ * @file nmea.c
+ * @brief Host test of the NMEA parser, against NEO-6M logs
+ *
+ * The logs in test/data are what a NEO-6M sends at 1 Hz with its default
+ * configuration: RMC, VTG, GGA, GSA, GSV and GLL.
+ * -- neo6m-cold.nmea starts mid-sentence, from a cold start: empty
+ *    sentences, then time without a fix, then a 2D and a 3D fix, walking.
+ * -- neo6m-drive.nmea is a drive in the southern and western hemispheres,
+ *    across midnight UTC and the new year.
+ *
+ * Each log is fed in pieces of random length, and after every sentence
+ * the fix is checked against a reference decode of that sentence's fields,
+ * done here with strtod(); the counters must match the sentences seen. A
+ * few sentences are checked against hand-decoded values as well, and every
+ * sentence of the logs is fed again with its checksum, body or terminator
+ * damaged, which must leave the fix alone.
+ *
+ * The benchmark gives the parser's throughput, in bytes per second.
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nmea.h"
+#include "test.h"
+
+static const char *const nmea_logs[] = {
+	"neo6m-cold.nmea",
+	"neo6m-drive.nmea",
+};
+#define NMEA_NR_LOGS	(sizeof(nmea_logs) / sizeof(nmea_logs[0]))
+
+/// Most fields in a sentence, as far as the reference is concerned
+#define NMEA_NR_FIELDS	24
+
+/// Passes over each log in the benchmark
+#define NMEA_NR_BENCH	20
+
+/////////////////////////////////////////////////////////////////////////////
+
+// A sentence split into fields, the address first
+typedef struct nmea_ref_sentence_type {
+	char	buf[128];
+	char	*field[NMEA_NR_FIELDS];
+	unsigned int nr_fields;
+	bool	cksum_ok;
+} nmea_ref_sentence_t;
+
+// Split "$...*hh" (without the line end); false if it is not one
+static bool nmea_ref_split(nmea_ref_sentence_t *r, const char *s, size_t len)
+{
+	const char *star = memchr(s, '*', len);
+	unsigned int x, sum = 0;
+	char *p;
+
+	if (len < 4 || s[0] != '$' || star == NULL ||
+	    len >= sizeof(r->buf) || star + 3 != s + len)
+		return false;
+	memcpy(r->buf, s + 1, (size_t)(star - s - 1));
+	r->buf[star - s - 1] = '\0';
+	for (p = r->buf; *p != '\0'; ++p)
+		sum ^= (uint8_t)*p;
+	r->cksum_ok = strtoul(star + 1, NULL, 16) == sum;
+
+	r->nr_fields = 0;
+	for (p = r->buf, x = 0; x < NMEA_NR_FIELDS; ++x) {
+		r->field[r->nr_fields++] = p;
+		p = strchr(p, ',');
+		if (p == NULL)
+			break;
+		*p++ = '\0';
+	}
+	return true;
+}
+
+static const char *nmea_ref_field(const nmea_ref_sentence_t *r, unsigned x)
+{
+	return (x < r->nr_fields) ? r->field[x] : "";
+}
+
+static double nmea_ref_num(const nmea_ref_sentence_t *r, unsigned int x)
+{
+	return strtod(nmea_ref_field(r, x), NULL);
+}
+
+static int32_t nmea_ref_ddmm(const nmea_ref_sentence_t *r, unsigned int x)
+{
+	double v = nmea_ref_num(r, x);
+	double deg = floor(v / 100);
+	int32_t e7 = (int32_t)llround((deg + (v - deg * 100) / 60) * 1e7);
+	char hemi = nmea_ref_field(r, x + 1)[0];
+
+	return (hemi == 'S' || hemi == 'W') ? -e7 : e7;
+}
+
+static uint32_t nmea_ref_time(const nmea_ref_sentence_t *r, unsigned int x)
+{
+	double v = nmea_ref_num(r, x);
+	uint32_t hhmmss = (uint32_t)v;
+
+	return ((hhmmss / 10000) * 3600 + (hhmmss / 100 % 100) * 60 +
+		hhmmss % 100) * 1000 + (uint32_t)llround((v - hhmmss) * 1000);
+}
+
+// Apply a sentence to the reference fix; returns its type
+static uint8_t nmea_ref_apply(nmea_fix_t *f, const nmea_ref_sentence_t *r)
+{
+	const char *a = r->field[0];
+	uint32_t date;
+	uint8_t type;
+
+	if (strlen(a) != 5)
+		return NMEA_SENT_NONE;
+	if (strcmp(a + 2, "GGA") == 0) {
+		type = NMEA_SENT_GGA;
+		f->time_ms = nmea_ref_time(r, 1);
+		f->lat_e7 = nmea_ref_ddmm(r, 2);
+		f->lon_e7 = nmea_ref_ddmm(r, 4);
+		f->quality = (uint8_t)nmea_ref_num(r, 6);
+		f->nr_sats = (uint8_t)nmea_ref_num(r, 7);
+		f->hdop_c = (uint16_t)llround(nmea_ref_num(r, 8) * 100);
+		f->alt_mm = (int32_t)llround(nmea_ref_num(r, 9) * 1000);
+	} else if (strcmp(a + 2, "RMC") == 0) {
+		type = NMEA_SENT_RMC;
+		f->time_ms = nmea_ref_time(r, 1);
+		f->valid = nmea_ref_field(r, 2)[0] == 'A';
+		f->lat_e7 = nmea_ref_ddmm(r, 3);
+		f->lon_e7 = nmea_ref_ddmm(r, 5);
+		f->speed_cmps = (uint16_t)llround(nmea_ref_num(r, 7) *
+			185200 / 3600);
+		f->course_cdeg = (uint16_t)llround(nmea_ref_num(r, 8) * 100);
+		date = (uint32_t)nmea_ref_num(r, 9);
+		f->day = (uint8_t)(date / 10000);
+		f->month = (uint8_t)(date / 100 % 100);
+		f->year = (uint8_t)(date % 100);
+	} else if (strcmp(a + 2, "VTG") == 0) {
+		type = NMEA_SENT_VTG;
+		f->course_cdeg = (uint16_t)llround(nmea_ref_num(r, 1) * 100);
+		f->speed_cmps = (uint16_t)llround(nmea_ref_num(r, 7) *
+			100000 / 3600);
+	} else if (strcmp(a + 2, "GSA") == 0) {
+		type = NMEA_SENT_GSA;
+		f->mode = (uint8_t)nmea_ref_num(r, 2);
+		f->pdop_c = (uint16_t)llround(nmea_ref_num(r, 15) * 100);
+		f->hdop_c = (uint16_t)llround(nmea_ref_num(r, 16) * 100);
+		f->vdop_c = (uint16_t)llround(nmea_ref_num(r, 17) * 100);
+	} else {
+		return NMEA_SENT_NONE;
+	}
+	f->updated |= type;
+	return type;
+}
+
+/*
+ * Compare the parser's fix with the reference; the unit conversions done in
+ * floating point here may round the other way at a tie
+ */
+static void nmea_check_fix(const nmea_fix_t *f, const nmea_fix_t *ref)
+{
+	TEST_CHECK(labs((long)f->lat_e7 - ref->lat_e7) <= 1);
+	TEST_CHECK(labs((long)f->lon_e7 - ref->lon_e7) <= 1);
+	TEST_CHECK(f->alt_mm == ref->alt_mm);
+	TEST_CHECK(f->time_ms == ref->time_ms);
+	TEST_CHECK(abs((int)f->speed_cmps - ref->speed_cmps) <= 1);
+	TEST_CHECK(f->course_cdeg == ref->course_cdeg);
+	TEST_CHECK(f->pdop_c == ref->pdop_c);
+	TEST_CHECK(f->hdop_c == ref->hdop_c);
+	TEST_CHECK(f->vdop_c == ref->vdop_c);
+	TEST_CHECK(f->day == ref->day && f->month == ref->month &&
+		f->year == ref->year);
+	TEST_CHECK(f->quality == ref->quality);
+	TEST_CHECK(f->mode == ref->mode);
+	TEST_CHECK(f->nr_sats == ref->nr_sats);
+	TEST_CHECK(f->valid == ref->valid);
+	TEST_CHECK(f->updated == ref->updated);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+// Feed a log in random pieces, checking the fix after every sentence
+static void nmea_test_log(const char *name, unsigned int *nr_types)
+{
+	nmea_parser_t p;
+	nmea_fix_t ref, taken;
+	nmea_ref_sentence_t r;
+	uint32_t nr_ok = 0, nr_dropped = 0;
+	const char *log, *line, *end, *eol;
+	size_t len, pos, n;
+	uint8_t type, done;
+	unsigned int x;
+
+	log = (const char *)test_load(name, &len);
+	end = log + len;
+	nmea_init(&p);
+	memset(&ref, 0, sizeof(ref));
+
+	for (line = log; line < end; line = eol + 1) {
+		eol = memchr(line, '\n', (size_t)(end - line));
+		if (eol == NULL)
+			eol = end;
+
+		// In pieces of up to 32 bytes, split anywhere
+		done = NMEA_SENT_NONE;
+		for (pos = 0; line + pos <= eol && line + pos < end; pos += n) {
+			n = 1 + test_rand_below(32);
+			if (line + pos + n > eol + 1)
+				n = (size_t)(eol + 1 - line - pos);
+			if (line + pos + n > end)
+				n = (size_t)(end - line - pos);
+			done |= nmea_feed(&p, line + pos, n);
+		}
+
+		n = (size_t)(eol - line);
+		if (n > 0 && line[n - 1] == '\r')
+			--n;
+		if (!nmea_ref_split(&r, line, n)) {
+			// Only the first line, cut short, may not be one
+			TEST_CHECK(line == log);
+			TEST_CHECK(done == NMEA_SENT_NONE);
+			continue;
+		}
+		TEST_CHECK(r.cksum_ok);
+		type = nmea_ref_apply(&ref, &r);
+		TEST_CHECK(done == type);
+		if (type != NMEA_SENT_NONE) {
+			++nr_ok;
+			for (x = 0; x < 4; ++x)
+				nr_types[x] += (type >> x) & 1;
+		} else {
+			++nr_dropped;
+		}
+		nmea_check_fix(&p.fix, &ref);
+
+		// Taken now and then, as GPS_Read() does on GGA and RMC
+		if (type == NMEA_SENT_GGA) {
+			TEST_CHECK(nmea_take_fix(&p, &taken) == ref.updated);
+			nmea_check_fix(&taken, &ref);
+			ref.updated = NMEA_SENT_NONE;
+		}
+	}
+
+	TEST_CHECK(p.nr_ok == nr_ok);
+	TEST_CHECK(p.nr_bad_cksum == 0);
+	TEST_CHECK(p.nr_dropped == nr_dropped);
+	free((void *)log);
+}
+
+// A whole sentence, with its checksum
+static size_t nmea_format(char *buf, size_t size, const char *body)
+{
+	unsigned int sum = 0;
+	const char *s;
+
+	for (s = body; *s != '\0'; ++s)
+		sum ^= (uint8_t)*s;
+	return (size_t)snprintf(buf, size, "$%s*%02X\r\n", body, sum);
+}
+
+static uint8_t nmea_put(nmea_parser_t *p, const char *body)
+{
+	char buf[128];
+
+	return nmea_feed(p, buf, nmea_format(buf, sizeof(buf), body));
+}
+
+// Sentences decoded by hand
+static void nmea_test_known(void)
+{
+	nmea_parser_t p;
+	nmea_fix_t f;
+	char buf[128];
+	size_t len;
+
+	nmea_init(&p);
+	TEST_CHECK(nmea_put(&p, "GPGGA,092725.00,4717.11399,N,00833.91590,E,"
+		"1,08,1.01,499.6,M,48.0,M,,") == NMEA_SENT_GGA);
+	TEST_CHECK(p.fix.time_ms == ((9 * 60 + 27) * 60 + 25) * 1000);
+	TEST_CHECK(p.fix.lat_e7 == 472852332);		// 47 + 17.11399 / 60
+	TEST_CHECK(p.fix.lon_e7 == 85652650);		// 8 + 33.91590 / 60
+	TEST_CHECK(p.fix.quality == 1 && p.fix.nr_sats == 8);
+	TEST_CHECK(p.fix.hdop_c == 101 && p.fix.alt_mm == 499600);
+
+	TEST_CHECK(nmea_put(&p, "GPRMC,235959.99,A,3436.31566,S,05823.24790,W,"
+		"27.880,254.41,311225,,,A") == NMEA_SENT_RMC);
+	TEST_CHECK(p.fix.time_ms == 86399990);
+	TEST_CHECK(p.fix.lat_e7 == -346052610);
+	TEST_CHECK(p.fix.lon_e7 == -583874650);
+	TEST_CHECK(p.fix.speed_cmps == 1434);		// 27.880 kn
+	TEST_CHECK(p.fix.course_cdeg == 25441);
+	TEST_CHECK(p.fix.day == 31 && p.fix.month == 12 && p.fix.year == 25);
+	TEST_CHECK(p.fix.valid == 1);
+
+	TEST_CHECK(nmea_put(&p, "GPVTG,77.52,T,,M,0.512,N,0.948,K,A") ==
+		NMEA_SENT_VTG);
+	TEST_CHECK(p.fix.course_cdeg == 7752 && p.fix.speed_cmps == 26);
+
+	TEST_CHECK(nmea_put(&p, "GPGSA,A,3,04,05,09,12,24,25,29,31,,,,,"
+		"1.72,1.01,1.39") == NMEA_SENT_GSA);
+	TEST_CHECK(p.fix.mode == 3 && p.fix.pdop_c == 172 &&
+		p.fix.hdop_c == 101 && p.fix.vdop_c == 139);
+
+	// Any talker; other sentences are skipped
+	TEST_CHECK(nmea_put(&p, "GNGGA,000001.00,,,,,0,00,99.99,,,,,,") ==
+		NMEA_SENT_GGA);
+	TEST_CHECK(p.fix.quality == 0 && p.fix.lat_e7 == 0);
+	TEST_CHECK(nmea_put(&p, "GPGSV,1,1,00") == NMEA_SENT_NONE);
+	TEST_CHECK(p.nr_ok == 5 && p.nr_dropped == 1);
+
+	// Taking the fix clears what it reports, but not the fix itself
+	TEST_CHECK(nmea_take_fix(&p, &f) == (NMEA_SENT_GGA | NMEA_SENT_RMC |
+		NMEA_SENT_VTG | NMEA_SENT_GSA));
+	TEST_CHECK(f.updated == (NMEA_SENT_GGA | NMEA_SENT_RMC |
+		NMEA_SENT_VTG | NMEA_SENT_GSA));
+	TEST_CHECK(nmea_take_fix(&p, &f) == NMEA_SENT_NONE);
+	TEST_CHECK(f.mode == 3);
+
+	// Nor does a sentence in progress bring the bits back
+	len = nmea_format(buf, sizeof(buf), "GPVTG,77.52,T,,M,0.512,N,0.948,K,A");
+	TEST_CHECK(nmea_feed(&p, buf, 21) == NMEA_SENT_NONE);
+	TEST_CHECK(nmea_take_fix(&p, &f) == NMEA_SENT_NONE);
+	TEST_CHECK(nmea_feed(&p, buf + 21, len - 21) == NMEA_SENT_VTG);
+	TEST_CHECK(nmea_take_fix(&p, &f) == NMEA_SENT_VTG);
+}
+
+/*
+ * Every sentence of a log, damaged three ways after a good one: a body byte
+ * changed, a checksum digit changed, and the checksum cut off. Each must be
+ * counted once, as a bad checksum if it is of a known type; a body byte
+ * changed may make it unknown, or lengthen a field too much, and then it is
+ * dropped instead.
+ */
+static void nmea_test_damaged(const char *name)
+{
+	nmea_parser_t p;
+	nmea_fix_t before;
+	char buf[128];
+	const char *log, *line, *end, *eol, *star;
+	size_t len, n;
+	uint32_t nr_bad, nr_dropped;
+	unsigned int how, x;
+	bool known;
+
+	log = (const char *)test_load(name, &len);
+	end = log + len;
+	nmea_init(&p);
+
+	for (line = log; line < end; line = eol + 1) {
+		eol = memchr(line, '\n', (size_t)(end - line));
+		if (eol == NULL)
+			break;
+		n = (size_t)(eol + 1 - line);
+		star = memchr(line, '*', n);
+		if (line[0] != '$' || star == NULL || n >= sizeof(buf))
+			continue;
+
+		known = nmea_feed(&p, line, n) != NMEA_SENT_NONE;
+		before = p.fix;
+		for (how = 0; how < 3; ++how) {
+			memcpy(buf, line, n);
+			switch (how) {
+			case 0:
+				// Past the talker, short of the '*'
+				x = 3 + test_rand_below(
+					(uint32_t)(star - line - 3));
+				buf[x] ^= 1 << test_rand_below(7);
+				if (buf[x] == '$' || buf[x] == '*' ||
+				    buf[x] == ',' || buf[x] == '\r' ||
+				    buf[x] == '\n')
+					buf[x] = '~';
+				break;
+			case 1:
+				x = (unsigned int)(star - line) + 1 +
+					test_rand_below(2);
+				buf[x] = (buf[x] == '0') ? '1' : '0';
+				break;
+			case 2:
+				x = (unsigned int)(star - line);
+				memcpy(&buf[x], "\r\n", 2);
+				break;
+			}
+			nr_bad = p.nr_bad_cksum;
+			nr_dropped = p.nr_dropped;
+			TEST_CHECK(nmea_feed(&p, buf, n) == NMEA_SENT_NONE);
+			TEST_CHECK(memcmp(&p.fix, &before, sizeof(before)) == 0);
+			TEST_CHECK(p.nr_bad_cksum - nr_bad +
+				p.nr_dropped - nr_dropped == 1);
+			if (how > 0)
+				TEST_CHECK(p.nr_bad_cksum - nr_bad == known);
+		}
+	}
+	free((void *)log);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+typedef struct nmea_bench_type {
+	const char	*buf;
+	size_t		len;
+} nmea_bench_t;
+
+static void nmea_bench_feed(void *arg, unsigned int n)
+{
+	const nmea_bench_t *b = arg;
+	nmea_parser_t p;
+
+	nmea_init(&p);
+	while (n-- > 0)
+		test_sink += nmea_feed(&p, b->buf, b->len);
+	test_sink += p.nr_ok;
+}
+
+static void nmea_bench(void)
+{
+	nmea_bench_t b;
+	unsigned int x;
+	double ns;
+
+	for (x = 0; x < NMEA_NR_LOGS; ++x) {
+		b.buf = (const char *)test_load(nmea_logs[x], &b.len);
+		ns = test_bench(nmea_bench_feed, &b, NMEA_NR_BENCH);
+		printf("%s: %.1f MB/s on the host, %.1f ns per byte\n",
+			nmea_logs[x], b.len / ns * 1e3, ns / b.len);
+		free((void *)b.buf);
+	}
+}
+
+int main(void)
+{
+	unsigned int nr_types[4] = { 0, 0, 0, 0 };
+	unsigned int x;
+
+	for (x = 0; x < NMEA_NR_LOGS; ++x) {
+		nmea_test_log(nmea_logs[x], nr_types);
+		nmea_test_damaged(nmea_logs[x]);
+	}
+	for (x = 0; x < 4; ++x)
+		TEST_CHECK(nr_types[x] > 100);
+	nmea_test_known();
+	nmea_bench();
+	return test_done("nmea");
+}
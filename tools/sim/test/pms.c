@@ -0,0 +1,445 @@
+/**
+ * @file pms.c
+ * @brief Host test of the PMS5003T frame decoder
+ *
+ * Streams of random frames are fed in pieces of random length, clean, cut
+ * into at any byte, with a length word or a checksum spoiled, with false
+ * headers inside frames, and with bytes flipped, dropped and inserted at
+ * random. What comes out, and the counters, must match a reference that
+ * scans the whole stream at once: from each position in turn, a frame is
+ * taken if the next 32 bytes are a good one, and the position skipped
+ * otherwise. A position is counted as a bad frame if its header matched and
+ * its length word or checksum did not, and each run of skipped positions as
+ * a resync.
+ *
+ * The benchmark gives the decoder's throughput, in bytes per second.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pms.h"
+#include "test.h"
+
+/// Frames in each stream, and bytes it may take
+#define PMS_NR_FRAMES	256
+#define PMS_STREAM_MAX	(2 * PMS_NR_FRAMES * PMS_FRAME_LEN)
+
+/// Streams fed per case, and passes over a stream in the benchmark
+#define PMS_NR_STREAMS	200
+#define PMS_NR_BENCH	200
+
+/////////////////////////////////////////////////////////////////////////////
+
+typedef struct pms_stream_type {
+	uint8_t		buf[PMS_STREAM_MAX];
+	size_t		len;
+} pms_stream_t;
+
+// What the reference makes of a stream
+typedef struct pms_ref_type {
+	pms_data_t	frame[PMS_STREAM_MAX / PMS_FRAME_LEN];
+	unsigned int	nr_good;
+	uint32_t	nr_bad;
+	uint32_t	nr_resync;
+} pms_ref_t;
+
+static void pms_put_word(uint8_t *buf, uint16_t v)
+{
+	buf[0] = (uint8_t)(v >> 8);
+	buf[1] = (uint8_t)v;
+}
+
+static uint16_t pms_get_word(const uint8_t *buf)
+{
+	return (uint16_t)((buf[0] << 8) | buf[1]);
+}
+
+// Append a frame of random data to a stream
+static void pms_put_frame(pms_stream_t *s)
+{
+	uint8_t *f = &s->buf[s->len];
+	uint16_t sum = 0;
+	unsigned int x;
+
+	f[0] = 0x42;
+	f[1] = 0x4D;
+	pms_put_word(&f[2], PMS_FRAME_LEN - 4);
+	for (x = 4; x < PMS_FRAME_LEN - 2; ++x)
+		f[x] = (uint8_t)test_rand();
+	for (x = 0; x < PMS_FRAME_LEN - 2; ++x)
+		sum += f[x];
+	pms_put_word(&f[PMS_FRAME_LEN - 2], sum);
+	s->len += PMS_FRAME_LEN;
+}
+
+// Same layout as pms.c, decoded field by field
+static void pms_ref_decode(const uint8_t *f, pms_data_t *d)
+{
+	uint16_t *w = &d->pm1_0_cf1;
+	unsigned int x;
+
+	// The first twelve fields are consecutive words
+	for (x = 0; x < 12; ++x)
+		w[x] = pms_get_word(&f[4 + 2 * x]);
+	d->version = f[28];
+	d->error = f[29];
+}
+
+/*
+ * How a frame starting at @p p fares: the number of bytes it took to tell
+ * whether it is good, or 0 if the stream ends before that is known
+ */
+static size_t pms_ref_try(const pms_stream_t *s, size_t p, bool *good)
+{
+	const uint8_t *f = &s->buf[p];
+	size_t left = s->len - p;
+	uint16_t sum = 0;
+	unsigned int x;
+
+	*good = false;
+	if (left < 1)
+		return 0;
+	if (f[0] != 0x42)
+		return 1;
+	if (left < 2)
+		return 0;
+	if (f[1] != 0x4D)
+		return 2;
+	if (left < 4)
+		return 0;
+	if (pms_get_word(&f[2]) != PMS_FRAME_LEN - 4)
+		return 4;
+	if (left < PMS_FRAME_LEN)
+		return 0;
+	for (x = 0; x < PMS_FRAME_LEN - 2; ++x)
+		sum += f[x];
+	*good = sum == pms_get_word(&f[PMS_FRAME_LEN - 2]);
+	return PMS_FRAME_LEN;
+}
+
+static void pms_ref_scan(const pms_stream_t *s, pms_ref_t *r)
+{
+	bool hunting = false, good;
+	size_t p = 0, n;
+
+	memset(r, 0, sizeof(*r));
+	while (p < s->len) {
+		n = pms_ref_try(s, p, &good);
+		if (n == 0)
+			break;
+		if (good) {
+			pms_ref_decode(&s->buf[p], &r->frame[r->nr_good++]);
+			hunting = false;
+			p += PMS_FRAME_LEN;
+			continue;
+		}
+		if (n > 2)
+			++r->nr_bad;
+		if (!hunting)
+			++r->nr_resync;
+		hunting = true;
+		++p;
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+static bool pms_data_equal(const pms_data_t *a, const pms_data_t *b)
+{
+	return memcmp(a, b, sizeof(*a)) == 0;
+}
+
+/*
+ * Feed a stream in random pieces, one byte at a time now and then so that
+ * every frame can be checked, and compare with the reference
+ */
+static void pms_check_stream(const pms_stream_t *s)
+{
+	pms_decoder_t d;
+	pms_data_t out;
+	pms_ref_t *r = malloc(sizeof(*r));
+	unsigned int nr_good = 0, got;
+	size_t pos, n;
+	bool bytewise = test_rand_below(2);
+
+	pms_ref_scan(s, r);
+	pms_init(&d);
+	for (pos = 0; pos < s->len; pos += n) {
+		n = bytewise ? 1 : 1 + test_rand_below(3 * PMS_FRAME_LEN / 2);
+		if (pos + n > s->len)
+			n = s->len - pos;
+		memset(&out, 0xA5, sizeof(out));
+		got = pms_feed(&d, &s->buf[pos], n, &out);
+		nr_good += got;
+		if (got > 0 && TEST_CHECK(nr_good <= r->nr_good))
+			TEST_CHECK(pms_data_equal(&out,
+				&r->frame[nr_good - 1]));
+		if (got == 0)
+			TEST_CHECK(*(const uint8_t *)&out == 0xA5);
+	}
+	TEST_CHECK(nr_good == r->nr_good);
+	TEST_CHECK(d.nr_good == r->nr_good);
+	TEST_CHECK(d.nr_bad == r->nr_bad);
+	TEST_CHECK(d.nr_resync == r->nr_resync);
+
+	// Without somewhere to put them, frames are only counted
+	pms_init(&d);
+	TEST_CHECK(pms_feed(&d, s->buf, s->len, NULL) == r->nr_good);
+	free(r);
+}
+
+static void pms_make_clean(pms_stream_t *s, unsigned int nr_frames)
+{
+	s->len = 0;
+	while (nr_frames-- > 0)
+		pms_put_frame(s);
+}
+
+// Recompute the checksum of the frame at @p f, after changing its data
+static void pms_fix_sum(uint8_t *f)
+{
+	uint16_t sum = 0;
+	unsigned int x;
+
+	for (x = 0; x < PMS_FRAME_LEN - 2; ++x)
+		sum += f[x];
+	pms_put_word(&f[PMS_FRAME_LEN - 2], sum);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+static void pms_test_clean(void)
+{
+	pms_stream_t *s = malloc(sizeof(*s));
+	pms_decoder_t d;
+	pms_data_t out;
+
+	pms_make_clean(s, PMS_NR_FRAMES);
+	pms_check_stream(s);
+
+	pms_init(&d);
+	TEST_CHECK(pms_feed(&d, s->buf, s->len, &out) == PMS_NR_FRAMES);
+	TEST_CHECK(d.nr_good == PMS_NR_FRAMES && d.nr_bad == 0 &&
+		d.nr_resync == 0);
+
+	// A known frame, as the datasheet lays it out
+	memcpy(s->buf, (const uint8_t[]){
+		0x42, 0x4D, 0x00, 0x1C,
+		0x00, 0x05, 0x00, 0x08, 0x00, 0x09,	// PM, CF=1
+		0x00, 0x05, 0x00, 0x08, 0x00, 0x09,	// PM, atmospheric
+		0x03, 0xE8, 0x01, 0x2C, 0x00, 0x32,	// Counts
+		0x00, 0x07,
+		0xFF, 0x9C, 0x02, 0x3A,			// -10.0 C, 57.0 %
+		0x91, 0x00,
+		0x00, 0x00 }, PMS_FRAME_LEN);
+	pms_fix_sum(s->buf);
+	pms_init(&d);
+	TEST_CHECK(pms_feed(&d, s->buf, PMS_FRAME_LEN, &out) == 1);
+	TEST_CHECK(out.pm1_0_cf1 == 5 && out.pm2_5_cf1 == 8 &&
+		out.pm10_cf1 == 9);
+	TEST_CHECK(out.pm1_0_atm == 5 && out.pm2_5_atm == 8 &&
+		out.pm10_atm == 9);
+	TEST_CHECK(out.nr_0_3 == 1000 && out.nr_0_5 == 300 &&
+		out.nr_1_0 == 50 && out.nr_2_5 == 7);
+	TEST_CHECK(out.temp_dc == -100 && out.rh_pm == 570);
+	TEST_CHECK(out.version == 0x91 && out.error == 0);
+	free(s);
+}
+
+// Reception starting anywhere within a frame costs that frame only
+static void pms_test_mid_frame(void)
+{
+	pms_stream_t *s = malloc(sizeof(*s));
+	pms_decoder_t d;
+	size_t skip;
+	uint8_t *f;
+
+	for (skip = 1; skip < PMS_FRAME_LEN; ++skip) {
+		pms_make_clean(s, 8);
+
+		// Now and then, with a false header where reception starts
+		if ((skip & 1) && skip + 4 <= PMS_FRAME_LEN - 2) {
+			f = s->buf;
+			f[skip] = 0x42;
+			f[skip + 1] = 0x4D;
+			if (skip & 2)
+				pms_put_word(&f[skip + 2], PMS_FRAME_LEN - 4);
+			pms_fix_sum(f);
+		}
+		pms_init(&d);
+		TEST_CHECK(pms_feed(&d, s->buf + skip, s->len - skip, NULL) ==
+			7);
+		TEST_CHECK(d.nr_good == 7 && d.nr_resync == 1);
+		memmove(s->buf, s->buf + skip, s->len - skip);
+		s->len -= skip;
+		pms_check_stream(s);
+	}
+	free(s);
+}
+
+// A spoiled length word or checksum costs its frame, and is counted
+static void pms_test_bad_frames(void)
+{
+	pms_stream_t *s = malloc(sizeof(*s));
+	pms_decoder_t d;
+	unsigned int x, nr_spoiled = 0, at;
+	uint8_t good[PMS_FRAME_LEN], *f;
+
+	pms_make_clean(s, PMS_NR_FRAMES);
+	for (x = 0; x < PMS_NR_FRAMES; x += 1 + test_rand_below(4)) {
+		f = &s->buf[x * PMS_FRAME_LEN];
+		memcpy(good, f, PMS_FRAME_LEN);
+		do {
+			memcpy(f, good, PMS_FRAME_LEN);
+			switch (test_rand_below(3)) {
+			case 0:
+				pms_put_word(&f[2], (uint16_t)(PMS_FRAME_LEN -
+					4 + 1 + test_rand_below(0xFFFF)));
+				break;
+			case 1:
+				at = 4 + test_rand_below(PMS_FRAME_LEN - 4);
+				f[at] ^= (uint8_t)(1 + test_rand_below(0xFF));
+				break;
+			case 2:
+				// The sum misses this, but not the length
+				f[2] = (uint8_t)(f[2] + 1);
+				f[3] = (uint8_t)(f[3] - 1);
+				break;
+			}
+
+			// No other header in it, so that it is counted once
+		} while (memchr(&f[1], 0x42, PMS_FRAME_LEN - 1) != NULL);
+		++nr_spoiled;
+	}
+
+	pms_init(&d);
+	TEST_CHECK(pms_feed(&d, s->buf, s->len, NULL) ==
+		PMS_NR_FRAMES - nr_spoiled);
+	TEST_CHECK(d.nr_bad == nr_spoiled);
+	TEST_CHECK(d.nr_resync <= nr_spoiled);
+	pms_check_stream(s);
+	free(s);
+}
+
+/*
+ * A false header inside a frame, with a good length word, is found when the
+ * frame it is in fails; what the sensor sent must still come through
+ */
+static void pms_test_false_header(void)
+{
+	pms_stream_t *s = malloc(sizeof(*s));
+	pms_decoder_t d;
+	unsigned int x, at;
+	uint8_t *f;
+
+	pms_make_clean(s, PMS_NR_FRAMES);
+	for (x = 0; x < PMS_NR_FRAMES; ++x) {
+		f = &s->buf[x * PMS_FRAME_LEN];
+		at = 4 + test_rand_below(PMS_FRAME_LEN - 9);
+		f[at] = 0x42;
+		f[at + 1] = 0x4D;
+		f[at + 2] = 0x00;
+		f[at + 3] = PMS_FRAME_LEN - 4;
+		pms_fix_sum(f);
+	}
+	pms_init(&d);
+	TEST_CHECK(pms_feed(&d, s->buf, s->len, NULL) == PMS_NR_FRAMES);
+	TEST_CHECK(d.nr_bad == 0 && d.nr_resync == 0);
+	pms_check_stream(s);
+
+	// Spoil every other frame's sum: its false header is tried next
+	for (x = 0; x < PMS_NR_FRAMES; x += 2)
+		s->buf[x * PMS_FRAME_LEN + PMS_FRAME_LEN - 1] ^= 1;
+	pms_init(&d);
+	TEST_CHECK(pms_feed(&d, s->buf, s->len, NULL) >= PMS_NR_FRAMES / 2);
+	TEST_CHECK(d.nr_bad >= PMS_NR_FRAMES / 2);
+	pms_check_stream(s);
+	free(s);
+}
+
+// Bytes flipped, dropped and inserted at random
+static void pms_test_noise(void)
+{
+	pms_stream_t *clean = malloc(sizeof(*clean));
+	pms_stream_t *s = malloc(sizeof(*s));
+	unsigned int x, rate;
+	size_t pos;
+
+	for (x = 0; x < PMS_NR_STREAMS; ++x) {
+		pms_make_clean(clean, PMS_NR_FRAMES);
+		rate = 1 + test_rand_below(400);
+		s->len = 0;
+		for (pos = 0; pos < clean->len; ++pos) {
+			switch (test_rand_below(rate) == 0 ?
+				test_rand_below(4) : 0) {
+			case 0:
+				s->buf[s->len++] = clean->buf[pos];
+				break;
+			case 1:
+				s->buf[s->len++] = clean->buf[pos] ^
+					(uint8_t)(1 << test_rand_below(8));
+				break;
+			case 2:
+				break;
+			case 3:
+				s->buf[s->len++] = test_rand_below(2) ?
+					0x42 : (uint8_t)test_rand();
+				s->buf[s->len++] = clean->buf[pos];
+				break;
+			}
+		}
+		pms_check_stream(s);
+	}
+	free(clean);
+	free(s);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+static void pms_bench_feed(void *arg, unsigned int n)
+{
+	const pms_stream_t *s = arg;
+	pms_decoder_t d;
+	pms_data_t out;
+
+	pms_init(&d);
+	memset(&out, 0, sizeof(out));
+	while (n-- > 0)
+		test_sink += pms_feed(&d, s->buf, s->len, &out);
+	test_sink += out.pm2_5_atm;
+}
+
+static void pms_bench(void)
+{
+	pms_stream_t *s = malloc(sizeof(*s));
+	double ns;
+	size_t pos;
+
+	pms_make_clean(s, PMS_NR_FRAMES);
+	ns = test_bench(pms_bench_feed, s, PMS_NR_BENCH);
+	printf("clean: %.1f MB/s on the host, %.2f ns per byte\n",
+		s->len / ns * 1e3, ns / s->len);
+
+	// One byte in 64 spoiled, so that most frames fail
+	for (pos = 0; pos < s->len; pos += 64)
+		s->buf[pos + test_rand_below(64)] ^= 0x10;
+	ns = test_bench(pms_bench_feed, s, PMS_NR_BENCH);
+	printf("noisy: %.1f MB/s on the host, %.2f ns per byte\n",
+		s->len / ns * 1e3, ns / s->len);
+	free(s);
+}
+
+int main(void)
+{
+	pms_test_clean();
+	pms_test_mid_frame();
+	pms_test_bad_frames();
+	pms_test_false_header();
+	pms_test_noise();
+	pms_bench();
+	return test_done("pms");
+}
@@ -0,0 +1,168 @@
+/**
+ * @file sched.c
+ * @brief Host test of the cooperative scheduler, on the simulated board
+ *
+ * Periodic tasks of random periods and phases run from the main loop, as
+ * the firmware's do, and now and then defer themselves from their body:
+ * mostly to a time short of their next periodic run, as a state machine
+ * polling for something does, and sometimes to a time past it.
+ *
+ * Every periodic run must come at the task's start plus a whole number of
+ * periods, however many times it was deferred in between, and no later
+ * than a couple of jiffies after that. Every deferred run must come no
+ * sooner than asked for; one that comes at or after the time of the
+ * periodic run takes its place, and the next periodic run is a period on.
+ * No task may miss a period.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "platform.h"
+#include "sim.h"
+#include "test.h"
+
+/// Tasks, and the simulated time they are run for
+#define SCHED_NR_TASKS	8
+#define SCHED_RUN_MS	60000
+
+/// Range of the periods, in milliseconds
+#define SCHED_PERIOD_MIN_MS	20
+#define SCHED_PERIOD_MAX_MS	200
+
+/// Jiffy length
+#define SCHED_JIFFY	PLATFORM_TICKS_US(PLATFORM_TICK_PERIOD_US)
+
+/// Latest a run may come: the main loop only wakes up on jiffies
+#define SCHED_LATE_MAX	(2 * SCHED_JIFFY)
+
+typedef struct sched_task_type {
+	platform_task_t	task;
+
+	/// When the next periodic run is due
+	platform_tick_t	expected;
+
+	/// Whether the task deferred itself, and to when
+	bool		deferred;
+	platform_tick_t	defer_at;
+
+	unsigned int	nr_periodic;
+	unsigned int	nr_deferred;
+	unsigned int	nr_merged;
+} sched_task_t;
+
+static sched_task_t sched_tasks[SCHED_NR_TASKS];
+
+/////////////////////////////////////////////////////////////////////////////
+
+static void sched_defer(sched_task_t *s, platform_tick_t now,
+	platform_tick_t delay)
+{
+	s->deferred = true;
+	s->defer_at = now + delay;
+	platform_task_defer(&s->task, delay);
+}
+
+static void sched_task(platform_task_t *task, void *arg)
+{
+	sched_task_t *s = arg;
+	platform_tick_t now = platform_tick_get();
+	platform_tick_t period = task->period;
+	platform_tick_t delay;
+
+	if (s->deferred) {
+		TEST_CHECK(platform_tick_expired(now, s->defer_at));
+		TEST_CHECK(now - s->defer_at <= SCHED_LATE_MAX);
+		s->deferred = false;
+		++s->nr_deferred;
+
+		// Past the time of the periodic run, so in its place
+		if (platform_tick_expired(now, s->expected)) {
+			s->expected += period;
+			++s->nr_merged;
+		}
+	} else {
+		TEST_CHECK(platform_tick_expired(now, s->expected));
+		TEST_CHECK(now - s->expected <= SCHED_LATE_MAX);
+		s->expected += period;
+		++s->nr_periodic;
+	}
+
+	switch (test_rand_below(8)) {
+	case 0: case 1: case 2: case 3: case 4:
+		// Short of the next periodic run, with room to spare
+		delay = test_rand_below((uint32_t)(period / 2));
+		if (now + delay + SCHED_LATE_MAX < s->expected)
+			sched_defer(s, now, delay);
+		break;
+	case 5:
+		// Past it, by less than a period
+		sched_defer(s, now, s->expected - now +
+			test_rand_below((uint32_t)(period / 2)));
+		break;
+	default:
+		break;
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+static void sched_test(void)
+{
+	unsigned int x, nr_periodic = 0, nr_deferred = 0, nr_merged = 0;
+	platform_tick_t delay, period, end;
+	sched_task_t *s;
+
+	for (x = 0; x < SCHED_NR_TASKS; ++x) {
+		s = &sched_tasks[x];
+		period = PLATFORM_TICKS_MS(SCHED_PERIOD_MIN_MS +
+			test_rand_below(SCHED_PERIOD_MAX_MS -
+				SCHED_PERIOD_MIN_MS));
+		delay = test_rand_below((uint32_t)period);
+		s->task.name = "sched";
+		s->task.fn = sched_task;
+		s->task.arg = s;
+		s->expected = platform_tick_get() + delay;
+		platform_task_start(&s->task, delay, period);
+	}
+
+	end = platform_tick_get() + PLATFORM_TICKS_MS(SCHED_RUN_MS);
+	while (!platform_tick_expired(platform_tick_get(), end))
+		platform_do_loop_one();
+
+	for (x = 0; x < SCHED_NR_TASKS; ++x) {
+		s = &sched_tasks[x];
+		platform_task_stop(&s->task);
+		TEST_CHECK(s->task.stats.nr_missed == 0);
+		TEST_CHECK(s->task.stats.nr_runs ==
+			s->nr_periodic + s->nr_deferred);
+
+		// Periodic runs, including those deferred runs took over
+		TEST_CHECK(s->nr_periodic + s->nr_merged + 1 >=
+			SCHED_RUN_MS / (s->task.period / PLATFORM_TICKS_MS(1)));
+		nr_periodic += s->nr_periodic;
+		nr_deferred += s->nr_deferred;
+		nr_merged += s->nr_merged;
+	}
+	TEST_CHECK(nr_deferred > nr_merged && nr_merged > 0);
+	printf("%u periodic runs, %u deferred, %u of them in place of a "
+		"periodic one\n", nr_periodic, nr_deferred, nr_merged);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+static void done(void)
+{
+	exit(2);
+}
+
+int main(void)
+{
+	sim_init(SIM_TIME_NEVER, 0, done);
+	platform_init();
+
+	sched_test();
+	return test_done("sched");
+}
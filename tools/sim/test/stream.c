@@ -0,0 +1,405 @@
+/**
+ * @file stream.c
+ * @brief Host test of streaming reception, on the simulated board
+ *
+ * The recorded NMEA logs in test/data are sent to the GPS link, at 9600 and
+ * at 115200 baud, into rings of several sizes, and drained as the main loop
+ * would: through peek and consume, and through read, in random amounts. What
+ * comes out must be the logs, byte for byte. Both logs go through the same
+ * ring one after the other, some 68 KB, so the 16-bit head and tail wrap
+ * around as well as the index into the ring.
+ *
+ * Bytes arriving at a full ring must be dropped and counted, and nothing
+ * already in the ring touched; peek must stop at the end of the ring, and
+ * read carry on from its start.
+ *
+ * The benchmark gives what a byte costs in the RXC handler with a ring
+ * behind it, and, for rings of each size, what is lost at 115200 baud when
+ * the main loop only gets to them every so often.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "platform.h"
+#include "sim.h"
+#include "test.h"
+
+/// The GPS link's SERCOM
+#define STREAM_SERCOM	5
+
+/// Line rate all channels come up at
+#define STREAM_BAUD	9600
+
+/// Character time on the line, 10 bits, in simulated clocks
+#define STREAM_CHAR(baud) \
+	((sim_time_t)(SIM_TICKS_US(1000000) * 10 / (baud)))
+
+/// Jiffy length
+#define STREAM_JIFFY	SIM_TICKS_US(PLATFORM_TICK_PERIOD_US)
+
+/// Bytes handed to the simulated line at a time, well within what it holds
+#define STREAM_CHUNK	1024
+
+/// Largest ring used
+#define STREAM_RING_MAX	4096
+
+#define STREAM_NR_LOGS	2
+static const char *const stream_logs[STREAM_NR_LOGS] = {
+	"neo6m-cold.nmea", "neo6m-drive.nmea"
+};
+
+/////////////////////////////////////////////////////////////////////////////
+
+// The GPS receiver; only ever sends
+static sim_dev_t stream_gps = {
+	"gps", STREAM_BAUD, NULL, NULL, SIM_TIME_NEVER
+};
+
+static char stream_ring[STREAM_RING_MAX];
+
+// What the main loop got out of the ring
+typedef struct stream_out_type {
+	char		*buf;
+	size_t		len;
+	size_t		max;
+} stream_out_t;
+
+// Hold up the main loop until a given time, as a blocking call would
+static void stream_block_until(sim_time_t t)
+{
+	while (sim_now() < t)
+		__WFI();
+}
+
+static void stream_set_baud(uint32_t baud)
+{
+	TEST_CHECK(platform_usart_set_baud(PLATFORM_USART_GPS, baud));
+	stream_gps.baud = baud;
+}
+
+// Take everything there is, in random amounts, by peek and consume or read
+static void stream_drain(stream_out_t *o)
+{
+	const char *data;
+	uint16_t len, n;
+
+	for (;;) {
+		if (test_rand_below(2) == 0) {
+			n = 1 + test_rand_below(64);
+			if (n > o->max - o->len)
+				n = o->max - o->len;
+			n = platform_usart_rx_stream_read(PLATFORM_USART_GPS,
+				&o->buf[o->len], n);
+		} else {
+			len = platform_usart_rx_stream_peek(PLATFORM_USART_GPS,
+				&data);
+			n = (len > 0) ? 1 + test_rand_below(len) : 0;
+			if (n > o->max - o->len)
+				n = o->max - o->len;
+			memcpy(&o->buf[o->len], data, n);
+			platform_usart_rx_stream_consume(PLATFORM_USART_GPS, n);
+		}
+		if (n == 0)
+			break;
+		o->len += n;
+	}
+}
+
+/*
+ * Send @p len bytes at the current baud rate, draining the ring into @p o
+ * every @p poll, or on every interrupt if 0, until a jiffy after the last
+ */
+static void stream_feed(const uint8_t *buf, size_t len, sim_time_t poll,
+	stream_out_t *o)
+{
+	const sim_time_t chr = STREAM_CHAR(stream_gps.baud);
+	sim_time_t end, next;
+	size_t n;
+
+	end = sim_now();
+	while (len > 0 || sim_now() < end) {
+		if (len > 0 && sim_now() >= end) {
+			n = (len < STREAM_CHUNK) ? len : STREAM_CHUNK;
+			sim_usart_send(STREAM_SERCOM, buf, n);
+			buf += n;
+			len -= n;
+			end = sim_now() + n * chr;
+			if (len == 0)
+				end += STREAM_JIFFY;
+		}
+		if (poll == 0) {
+			__WFI();
+		} else {
+			next = sim_now() + poll;
+			stream_block_until(next < end ? next : end);
+		}
+		stream_drain(o);
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+// Both logs through the one ring of @p size, at @p baud, byte for byte
+static void stream_test_logs(uint32_t baud, uint16_t size)
+{
+	const uint8_t *log[STREAM_NR_LOGS];
+	size_t len[STREAM_NR_LOGS], total = 0, off = 0;
+	sim_usart_stats_t sst0, sst;
+	uint32_t dropped;
+	stream_out_t o;
+	unsigned int x;
+
+	for (x = 0; x < STREAM_NR_LOGS; ++x) {
+		log[x] = test_load(stream_logs[x], &len[x]);
+		total += len[x];
+	}
+	o.buf = malloc(total);
+	o.len = 0;
+	o.max = total;
+
+	stream_set_baud(baud);
+	TEST_CHECK(sim_usart_baud(STREAM_SERCOM) > baud * 0.99 &&
+		sim_usart_baud(STREAM_SERCOM) < baud * 1.01);
+	dropped = platform_usart_rx_dropped(PLATFORM_USART_GPS);
+	sim_usart_stats(STREAM_SERCOM, &sst0);
+
+	TEST_CHECK(platform_usart_rx_stream_start(PLATFORM_USART_GPS,
+		stream_ring, size));
+	for (x = 0; x < STREAM_NR_LOGS; ++x)
+		stream_feed(log[x], len[x], 0, &o);
+	platform_usart_rx_stream_stop(PLATFORM_USART_GPS);
+	sim_usart_stats(STREAM_SERCOM, &sst);
+
+	TEST_CHECK(sst.nr_arrived - sst0.nr_arrived == total);
+	TEST_CHECK(sst.nr_overrun == sst0.nr_overrun);
+	TEST_CHECK(platform_usart_rx_dropped(PLATFORM_USART_GPS) == dropped);
+	TEST_CHECK(o.len == total);
+	for (x = 0; x < STREAM_NR_LOGS; ++x) {
+		TEST_CHECK(o.len >= off + len[x] &&
+			memcmp(&o.buf[off], log[x], len[x]) == 0);
+		off += len[x];
+		free((void *)log[x]);
+	}
+	free(o.buf);
+	stream_set_baud(STREAM_BAUD);
+}
+
+/*
+ * A ring left alone fills up: what came first is kept, the rest dropped and
+ * counted, and what comes after it has been emptied gets through again
+ */
+static void stream_test_full(void)
+{
+	static uint8_t sent[3 * 64];
+	static char buf[sizeof(sent)];
+	const sim_time_t chr = STREAM_CHAR(STREAM_BAUD);
+	uint32_t dropped;
+	uint16_t n;
+	unsigned int x;
+
+	for (x = 0; x < sizeof(sent); ++x)
+		sent[x] = (uint8_t)test_rand();
+	dropped = platform_usart_rx_dropped(PLATFORM_USART_GPS);
+
+	TEST_CHECK(platform_usart_rx_stream_start(PLATFORM_USART_GPS,
+		stream_ring, 64));
+	sim_usart_send(STREAM_SERCOM, sent, 2 * 64);
+	stream_block_until(sim_now() + 2 * 64 * chr + STREAM_JIFFY);
+	TEST_CHECK(platform_usart_rx_dropped(PLATFORM_USART_GPS) ==
+		dropped + 64);
+
+	n = platform_usart_rx_stream_read(PLATFORM_USART_GPS, buf, sizeof(buf));
+	TEST_CHECK(n == 64 && memcmp(buf, sent, 64) == 0);
+
+	sim_usart_send(STREAM_SERCOM, &sent[2 * 64], 64);
+	stream_block_until(sim_now() + 64 * chr + STREAM_JIFFY);
+	n = platform_usart_rx_stream_read(PLATFORM_USART_GPS, buf, sizeof(buf));
+	TEST_CHECK(n == 64 && memcmp(buf, &sent[2 * 64], 64) == 0);
+	TEST_CHECK(platform_usart_rx_dropped(PLATFORM_USART_GPS) ==
+		dropped + 64);
+	platform_usart_rx_stream_stop(PLATFORM_USART_GPS);
+}
+
+// Peek stops at the end of the ring; read carries on from its start
+static void stream_test_wrap(void)
+{
+	static uint8_t sent[48 + 40];
+	static char buf[sizeof(sent)];
+	const sim_time_t chr = STREAM_CHAR(STREAM_BAUD);
+	platform_usart_rx_async_desc_t desc;
+	const char *data;
+	uint16_t n;
+	unsigned int x;
+
+	for (x = 0; x < sizeof(sent); ++x)
+		sent[x] = (uint8_t)test_rand();
+
+	TEST_CHECK(platform_usart_rx_stream_start(PLATFORM_USART_GPS,
+		stream_ring, 64));
+	// While streaming, no descriptor can be armed, nor the ring moved
+	memset(&desc, 0, sizeof(desc));
+	desc.buf = buf;
+	desc.max_len = sizeof(buf);
+	TEST_CHECK(!platform_usart_gps_rx_async(&desc));
+	TEST_CHECK(!platform_usart_rx_stream_start(PLATFORM_USART_GPS,
+		&stream_ring[64], 64));
+
+	sim_usart_send(STREAM_SERCOM, sent, 48);
+	stream_block_until(sim_now() + 48 * chr + STREAM_JIFFY);
+	n = platform_usart_rx_stream_peek(PLATFORM_USART_GPS, &data);
+	TEST_CHECK(n == 48 && data == stream_ring);
+	// Consuming more than there is takes what there is
+	platform_usart_rx_stream_consume(PLATFORM_USART_GPS, 100);
+	TEST_CHECK(platform_usart_rx_stream_peek(PLATFORM_USART_GPS,
+		&data) == 0);
+
+	sim_usart_send(STREAM_SERCOM, &sent[48], 40);
+	stream_block_until(sim_now() + 40 * chr + STREAM_JIFFY);
+	n = platform_usart_rx_stream_peek(PLATFORM_USART_GPS, &data);
+	TEST_CHECK(n == 16 && data == &stream_ring[48] &&
+		memcmp(data, &sent[48], 16) == 0);
+	n = platform_usart_rx_stream_read(PLATFORM_USART_GPS, buf, sizeof(buf));
+	TEST_CHECK(n == 40 && memcmp(buf, &sent[48], 40) == 0);
+	n = platform_usart_rx_stream_peek(PLATFORM_USART_GPS, &data);
+	TEST_CHECK(n == 0 && data == &stream_ring[24]);
+
+	// Stopping throws away what is left
+	sim_usart_send(STREAM_SERCOM, sent, 8);
+	stream_block_until(sim_now() + 8 * chr + STREAM_JIFFY);
+	platform_usart_rx_stream_stop(PLATFORM_USART_GPS);
+	TEST_CHECK(platform_usart_rx_stream_peek(PLATFORM_USART_GPS,
+		&data) == 0);
+	TEST_CHECK(platform_usart_rx_stream_start(PLATFORM_USART_GPS,
+		stream_ring, 64));
+	TEST_CHECK(platform_usart_rx_stream_peek(PLATFORM_USART_GPS,
+		&data) == 0);
+	platform_usart_rx_stream_stop(PLATFORM_USART_GPS);
+}
+
+// Sizes that aren't a power of two, or are too large, are refused
+static void stream_test_sizes(void)
+{
+	TEST_CHECK(!platform_usart_rx_stream_start(PLATFORM_USART_GPS,
+		stream_ring, 0));
+	TEST_CHECK(!platform_usart_rx_stream_start(PLATFORM_USART_GPS,
+		stream_ring, 48));
+	TEST_CHECK(!platform_usart_rx_stream_start(PLATFORM_USART_GPS,
+		stream_ring, 65535));
+	TEST_CHECK(!platform_usart_rx_stream_start(PLATFORM_USART_GPS,
+		NULL, 64));
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+// Time spent in handlers over a stretch of @p len, with the main loop held
+static sim_time_t bench_isr_time(sim_time_t len)
+{
+	sim_stats_t st0, st;
+
+	sim_stats(&st0);
+	stream_block_until(sim_now() + len);
+	sim_stats(&st);
+	return st.in_isr - st0.in_isr;
+}
+
+// What a byte costs in the RXC handler, into a ring
+static void bench_rxc(void)
+{
+	static uint8_t sent[1000];
+	const sim_time_t len = sizeof(sent) * STREAM_CHAR(STREAM_BAUD) +
+		STREAM_JIFFY;
+	sim_time_t idle, busy;
+	unsigned int x;
+
+	for (x = 0; x < sizeof(sent); ++x)
+		sent[x] = (uint8_t)test_rand();
+	idle = bench_isr_time(len);
+
+	TEST_CHECK(platform_usart_rx_stream_start(PLATFORM_USART_GPS,
+		stream_ring, 1024));
+	sim_usart_send(STREAM_SERCOM, sent, sizeof(sent));
+	busy = bench_isr_time(len);
+	TEST_CHECK(platform_usart_rx_stream_read(PLATFORM_USART_GPS,
+		(char *)sent, sizeof(sent)) == sizeof(sent));
+	platform_usart_rx_stream_stop(PLATFORM_USART_GPS);
+
+	printf("  RXC into the ring, per byte   %6.2f us\n",
+		(double)(busy - idle) / sizeof(sent) / SIM_TICKS_PER_US);
+}
+
+/*
+ * The drive log at 115200 baud into a ring of @p size, drained only every
+ * @p poll
+ */
+static void bench_poll(uint16_t size, sim_time_t poll)
+{
+	const uint8_t *log;
+	size_t len;
+	uint32_t dropped;
+	stream_out_t o;
+
+	log = test_load(stream_logs[1], &len);
+	o.buf = malloc(len);
+	o.len = 0;
+	o.max = len;
+
+	stream_set_baud(115200);
+	dropped = platform_usart_rx_dropped(PLATFORM_USART_GPS);
+	TEST_CHECK(platform_usart_rx_stream_start(PLATFORM_USART_GPS,
+		stream_ring, size));
+	stream_feed(log, len, poll, &o);
+	platform_usart_rx_stream_stop(PLATFORM_USART_GPS);
+	dropped = platform_usart_rx_dropped(PLATFORM_USART_GPS) - dropped;
+
+	printf("  %4u B ring, every %2u ms: %5zu B of %5zu, %5u dropped\n",
+		size, (unsigned int)(poll / SIM_TICKS_MS(1)), o.len, len,
+		dropped);
+	TEST_CHECK(o.len + dropped == len);
+	free(o.buf);
+	free((void *)log);
+	stream_set_baud(STREAM_BAUD);
+}
+
+static void bench(void)
+{
+	uint16_t size;
+
+	printf("handlers, at %u baud:\n", STREAM_BAUD);
+	bench_rxc();
+	printf("%s at 115200 baud, drained every so often:\n",
+		stream_logs[1]);
+	for (size = 64; size <= STREAM_RING_MAX; size *= 4) {
+		bench_poll(size, SIM_TICKS_MS(10));
+		bench_poll(size, SIM_TICKS_MS(100));
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+static void done(void)
+{
+	exit(2);
+}
+
+int main(void)
+{
+	uint16_t size;
+
+	sim_init(SIM_TIME_NEVER, 0, done);
+	sim_usart_attach(STREAM_SERCOM, &stream_gps);
+	platform_init();
+
+	stream_test_sizes();
+	stream_test_wrap();
+	stream_test_full();
+	for (size = 64; size <= STREAM_RING_MAX; size *= 8) {
+		stream_test_logs(STREAM_BAUD, size);
+		stream_test_logs(115200, size);
+	}
+	bench();
+	return test_done("stream");
+}
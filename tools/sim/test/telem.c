@@ -0,0 +1,967 @@
+/**
+ * @file telem.c
+ * @brief Host round-trip test of the telemetry records, and their cost
+ *
+ * Random records, and records at the ends of every field's range, are
+ * encoded, and each frame is taken apart here without telem.c's help: it
+ * must be zero-free up to its delimiter, COBS-decode to the documented
+ * layout, and carry a CRC-16/CCITT-FALSE of it, computed bit by bit. The
+ * decoder must then give back the very same record, from the frame alone
+ * and from a stream of frames fed a byte at a time.
+ *
+ * Frames are corrupted by flipped bits, dropped, inserted and changed bytes
+ * and cut short, and the decoder must reject every one that does not pass
+ * the same checks here; frames of another version, overlong frames and
+ * garbage between delimiters must be counted as such.
+ *
+ * Other messages, of random types and sizes up to the largest, with COBS
+ * blocks filled up and cut short at their every end, must be framed as
+ * records are, and come out of a stream of them and records as they went
+ * in; corrupted, they must be rejected as records are. Raw messages, sent
+ * in random fragments and holding zeros, must come out whole as well; with
+ * a byte changed or lost, they must be dropped, and the decoder must pick up
+ * again by the second frame after them.
+ *
+ * Compressed records are checked on a flight's worth of records built the
+ * way Telem_Send() builds them, once a second: the GPS fields from the
+ * NEO-6M logs of the NMEA test, fed through the NMEA parser, the others
+ * from slowly drifting readings through the same rolling windows. Every
+ * delta must decode to the record it was taken of, as must random records
+ * far apart; and after a lost frame, the decoder must drop every delta up
+ * to the next keyframe, and only those, then pick up again.
+ *
+ * The benchmark gives the bytes each record takes on the wire, and what
+ * encoding and decoding one costs; and for the flight, the compression
+ * ratio and encoding cost at a few keyframe intervals.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "aqi.h"
+#include "nmea.h"
+#include "telem.h"
+#include "test.h"
+
+/// Records round-tripped, corruptions tried, and benchmark iterations
+#define TELEM_NR_RANDOM		200000
+#define TELEM_NR_MSGS		20000
+#define TELEM_NR_CORRUPT	200000
+#define TELEM_NR_BENCH		200000
+
+/// Records per keyframe in the firmware, as in main.c
+#define TELEM_KEY_INTERVAL	10
+
+/// Most records in a flight, and the rolling windows, as in main.c
+#define FLIGHT_MAX		4096
+#define FLIGHT_PM_WINDOW	60
+#define FLIGHT_CO2_WINDOW	30
+
+/////////////////////////////////////////////////////////////////////////////
+
+// CRC-16/CCITT-FALSE, a bit at a time
+static uint16_t ref_crc16(const uint8_t *buf, size_t len)
+{
+	uint16_t crc = 0xFFFF;
+	unsigned int x;
+
+	while (len-- > 0) {
+		crc ^= (uint16_t)(*buf++ << 8);
+		for (x = 0; x < 8; ++x)
+			crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) :
+				(uint16_t)(crc << 1);
+	}
+	return crc;
+}
+
+/*
+ * COBS-decode a frame without its delimiter; returns the decoded size, or
+ * -1 if the encoding is broken
+ */
+static int ref_cobs_decode(const uint8_t *in, size_t len, uint8_t *out)
+{
+	size_t x = 0, n = 0, end;
+	uint8_t code;
+
+	while (x < len) {
+		code = in[x++];
+		end = x + code - 1;
+		if (code == 0 || end > len)
+			return -1;
+		for (; x < end; ++x) {
+			if (in[x] == 0)
+				return -1;
+			out[n++] = in[x];
+		}
+		// A zero ends every block but a full one, and the last
+		if (code != 0xFF && x < len)
+			out[n++] = 0;
+	}
+	return (int)n;
+}
+
+// COBS-encode, the obvious way; returns the encoded size, without delimiter
+static size_t ref_cobs_encode(const uint8_t *in, size_t len, uint8_t *out)
+{
+	size_t code = 0, n = 1, x;
+
+	out[0] = 1;
+	for (x = 0; x < len; ++x) {
+		if (in[x] == 0) {
+			code = n++;
+			out[code] = 1;
+			continue;
+		}
+		out[n++] = in[x];
+		if (++out[code] == 0xFF && x + 1 < len) {
+			code = n++;
+			out[code] = 1;
+		}
+	}
+	return n;
+}
+
+static uint8_t *ref_put(uint8_t *p, uint32_t v, unsigned int size)
+{
+	while (size-- > 0) {
+		*p++ = (uint8_t)v;
+		v >>= 8;
+	}
+	return p;
+}
+
+// The documented layout of a record
+static void ref_serialize(const telem_record_t *r, uint8_t *raw)
+{
+	uint8_t *p = raw;
+
+	*p++ = TELEM_VERSION;
+	*p++ = r->flags;
+	p = ref_put(p, r->seq, 2);
+	p = ref_put(p, r->time_ms, 4);
+	p = ref_put(p, r->co2_ppm, 2);
+	p = ref_put(p, r->pm1_0, 2);
+	p = ref_put(p, r->pm2_5, 2);
+	p = ref_put(p, r->pm10, 2);
+	p = ref_put(p, (uint16_t)r->temp_dc, 2);
+	p = ref_put(p, r->rh_pm, 2);
+	p = ref_put(p, (uint32_t)r->lat_e7, 4);
+	p = ref_put(p, (uint32_t)r->lon_e7, 4);
+	p = ref_put(p, (uint32_t)r->alt_mm, 4);
+	p = ref_put(p, r->gps_time_ms, 4);
+	p = ref_put(p, r->speed_cmps, 2);
+	*p++ = r->nr_sats;
+	*p++ = r->quality;
+	p = ref_put(p, r->aqi, 2);
+	p = ref_put(p, r->pm2_5_mean_d, 2);
+	p = ref_put(p, r->pm10_mean, 2);
+	p = ref_put(p, r->co2_mean, 2);
+	TEST_CHECK(p == raw + TELEM_RECORD_LEN);
+}
+
+/*
+ * Check a frame as the ground side would; returns the size of the record it
+ * holds, CRC excluded, or -1 if it is not a valid frame
+ */
+static int ref_check_frame(const uint8_t *frame, size_t len, uint8_t *raw)
+{
+	int n;
+
+	if (len == 0 || len > TELEM_FRAME_MAX - 1)
+		return -1;
+	n = ref_cobs_decode(frame, len, raw);
+	if (n < 4 + 2 || ref_crc16(raw, (size_t)n - 2) !=
+	    ((raw[n - 2] << 8) | raw[n - 1]))
+		return -1;
+	return n - 2;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+static bool telem_equal(const telem_record_t *a, const telem_record_t *b)
+{
+	return a->flags == b->flags && a->seq == b->seq &&
+		a->time_ms == b->time_ms && a->co2_ppm == b->co2_ppm &&
+		a->pm1_0 == b->pm1_0 && a->pm2_5 == b->pm2_5 &&
+		a->pm10 == b->pm10 && a->temp_dc == b->temp_dc &&
+		a->rh_pm == b->rh_pm && a->lat_e7 == b->lat_e7 &&
+		a->lon_e7 == b->lon_e7 && a->alt_mm == b->alt_mm &&
+		a->gps_time_ms == b->gps_time_ms &&
+		a->speed_cmps == b->speed_cmps && a->nr_sats == b->nr_sats &&
+		a->quality == b->quality && a->aqi == b->aqi &&
+		a->pm2_5_mean_d == b->pm2_5_mean_d &&
+		a->pm10_mean == b->pm10_mean && a->co2_mean == b->co2_mean;
+}
+
+// A random value, biased towards the ends of the range and zero
+static uint32_t telem_rand_value(void)
+{
+	switch (test_rand_below(8)) {
+	case 0:  return 0;
+	case 1:  return UINT32_MAX;
+	case 2:  return 0x80000000u;
+	case 3:  return 0x7FFFFFFFu;
+	case 4:  return test_rand_below(256);
+	default: return (uint32_t)test_rand();
+	}
+}
+
+static void telem_rand_record(telem_record_t *r)
+{
+	memset(r, 0, sizeof(*r));
+	r->flags = (uint8_t)(telem_rand_value() & ~TELEM_F_DELTA);
+	r->seq = (uint16_t)telem_rand_value();
+	r->time_ms = telem_rand_value();
+	r->co2_ppm = (uint16_t)telem_rand_value();
+	r->pm1_0 = (uint16_t)telem_rand_value();
+	r->pm2_5 = (uint16_t)telem_rand_value();
+	r->pm10 = (uint16_t)telem_rand_value();
+	r->temp_dc = (int16_t)telem_rand_value();
+	r->rh_pm = (uint16_t)telem_rand_value();
+	r->lat_e7 = (int32_t)telem_rand_value();
+	r->lon_e7 = (int32_t)telem_rand_value();
+	r->alt_mm = (int32_t)telem_rand_value();
+	r->gps_time_ms = telem_rand_value();
+	r->speed_cmps = (uint16_t)telem_rand_value();
+	r->nr_sats = (uint8_t)telem_rand_value();
+	r->quality = (uint8_t)telem_rand_value();
+	r->aqi = (uint16_t)telem_rand_value();
+	r->pm2_5_mean_d = (uint16_t)telem_rand_value();
+	r->pm10_mean = (uint16_t)telem_rand_value();
+	r->co2_mean = (uint16_t)telem_rand_value();
+}
+
+// Check a keyframe against the reference, and decode it back
+static void telem_check_key(const telem_record_t *r, const uint8_t *frame,
+	size_t len)
+{
+	uint8_t raw[TELEM_FRAME_MAX], want[TELEM_RECORD_LEN];
+	uint8_t again[TELEM_FRAME_MAX];
+	telem_decoder_t d;
+	telem_record_t out;
+
+	TEST_CHECK(len <= TELEM_FRAME_MAX && frame[len - 1] == 0);
+	TEST_CHECK(memchr(frame, 0, len - 1) == NULL);
+	TEST_CHECK(ref_check_frame(frame, len - 1, raw) == TELEM_RECORD_LEN);
+	ref_serialize(r, want);
+	TEST_CHECK(memcmp(raw, want, TELEM_RECORD_LEN) == 0);
+	TEST_CHECK(ref_cobs_encode(raw, TELEM_RECORD_LEN + 2, again) ==
+		len - 1 && memcmp(again, frame, len - 1) == 0);
+
+	telem_decoder_init(&d);
+	memset(&out, 0xA5, sizeof(out));
+	TEST_CHECK(telem_decode(&d, frame, len - 1, &out));
+	TEST_CHECK(telem_equal(&out, r));
+	TEST_CHECK(d.nr_good == 1 && d.nr_bad == 0);
+}
+
+static void telem_test_roundtrip(void)
+{
+	uint8_t frame[TELEM_FRAME_MAX], stream[16 * (TELEM_FRAME_MAX + 1)];
+	telem_record_t r[16], out;
+	telem_decoder_t d;
+	size_t len, pos;
+	unsigned int x, y, nr_out;
+
+	// The check value of the CRC
+	TEST_CHECK(ref_crc16((const uint8_t *)"123456789", 9) == 0x29B1);
+
+	// All zeros, and no zeros at all
+	memset(&r[0], 0, sizeof(r[0]));
+	len = telem_encode(&r[0], frame);
+	telem_check_key(&r[0], frame, len);
+	memset(&r[0], 0xFF, sizeof(r[0]));
+	r[0].flags &= ~TELEM_F_DELTA;
+	len = telem_encode(&r[0], frame);
+	telem_check_key(&r[0], frame, len);
+
+	for (x = 0; x < TELEM_NR_RANDOM; ++x) {
+		telem_rand_record(&r[0]);
+		len = telem_encode(&r[0], frame);
+		telem_check_key(&r[0], frame, len);
+	}
+
+	// As a stream, a byte at a time, with idle fill between frames
+	for (x = 0; x < TELEM_NR_RANDOM / 16; ++x) {
+		pos = 0;
+		for (y = 0; y < 16; ++y) {
+			telem_rand_record(&r[y]);
+			if (test_rand_below(2))
+				stream[pos++] = 0;
+			pos += telem_encode(&r[y], &stream[pos]);
+		}
+		telem_decoder_init(&d);
+		for (y = 0, nr_out = 0; y < pos; ++y) {
+			if (!telem_feed_byte(&d, stream[y], &out))
+				continue;
+			TEST_CHECK(nr_out < 16 && telem_equal(&out, &r[nr_out]));
+			++nr_out;
+		}
+		TEST_CHECK(nr_out == 16 && d.nr_good == 16 && d.nr_bad == 0);
+	}
+}
+
+// Flip a bit of a byte, other than one that would leave it zero
+static void telem_flip(uint8_t *frame, size_t len)
+{
+	size_t at = test_rand_below((uint32_t)len);
+	uint8_t bit;
+
+	do {
+		bit = (uint8_t)(1 << test_rand_below(8));
+	} while (frame[at] == bit);
+	frame[at] ^= bit;
+}
+
+/*
+ * Corrupt a frame, without its delimiter, in one of a few ways; never with a
+ * zero, which would split it in two
+ */
+static size_t telem_corrupt(uint8_t *frame, size_t len)
+{
+	size_t at = test_rand_below((uint32_t)len);
+	uint8_t c;
+
+	switch (test_rand_below(5)) {
+	case 0:
+		// One to three bits
+		telem_flip(frame, len);
+		if (test_rand_below(2))
+			telem_flip(frame, len);
+		if (test_rand_below(2))
+			telem_flip(frame, len);
+		return len;
+	case 1:
+		memmove(&frame[at], &frame[at + 1], len - at - 1);
+		return len - 1;
+	case 2:
+		memmove(&frame[at + 1], &frame[at], len - at);
+		frame[at] = (uint8_t)(1 + test_rand_below(255));
+		return len + 1;
+	case 3:
+		do {
+			c = (uint8_t)(1 + test_rand_below(255));
+		} while (c == frame[at]);
+		frame[at] = c;
+		return len;
+	default:
+		return at;
+	}
+}
+
+static void telem_test_corrupt(void)
+{
+	uint8_t frame[TELEM_FRAME_MAX + 1], raw[TELEM_FRAME_MAX];
+	uint8_t good[TELEM_FRAME_MAX];
+	telem_record_t r, out;
+	telem_decoder_t d;
+	size_t len, x;
+	unsigned int nr_rejected = 0, nr_passed = 0;
+	int n;
+
+	for (x = 0; x < TELEM_NR_CORRUPT; ++x) {
+		telem_rand_record(&r);
+		len = telem_encode(&r, frame) - 1;
+		memcpy(good, frame, len);
+		n = (int)len;
+		len = telem_corrupt(frame, len);
+
+		// Two flips of the same bit undo each other
+		if (len == (size_t)n && memcmp(frame, good, len) == 0)
+			continue;
+
+		telem_decoder_init(&d);
+		n = ref_check_frame(frame, len, raw);
+		if (n != TELEM_RECORD_LEN || raw[0] != TELEM_VERSION ||
+		    (raw[1] & TELEM_F_DELTA) != 0) {
+			TEST_CHECK(!telem_decode(&d, frame, len, &out));
+			TEST_CHECK(d.nr_good == 0 &&
+				d.nr_bad + d.nr_version + d.nr_lost == 1);
+			++nr_rejected;
+		} else {
+			// The CRC missed it, one time in 65536 or so
+			TEST_CHECK(telem_decode(&d, frame, len, &out));
+			++nr_passed;
+		}
+	}
+	TEST_CHECK(nr_passed <= TELEM_NR_CORRUPT / 10000);
+	printf("corrupted frames: %u rejected, %u passed the CRC\n",
+		nr_rejected, nr_passed);
+}
+
+static void telem_test_counters(void)
+{
+	uint8_t raw[TELEM_FRAME_MAX], frame[TELEM_FRAME_MAX];
+	telem_record_t r, out;
+	telem_decoder_t d;
+	uint16_t crc;
+	size_t len, x;
+
+	telem_rand_record(&r);
+	telem_decoder_init(&d);
+
+	// Garbage before the first delimiter, as when joining mid-frame
+	len = telem_encode(&r, frame);
+	for (x = len / 2; x < len; ++x)
+		TEST_CHECK(!telem_feed_byte(&d, frame[x], &out));
+	TEST_CHECK(d.nr_bad == 1 && d.nr_good == 0);
+
+	// Back-to-back delimiters are idle fill, not frames
+	for (x = 0; x < 5; ++x)
+		TEST_CHECK(!telem_feed_byte(&d, 0, &out));
+	TEST_CHECK(d.nr_bad == 1);
+
+	// Overlong, and not decoded at all
+	for (x = 0; x < sizeof(d.buf) + 1; ++x)
+		TEST_CHECK(!telem_feed_byte(&d, 0x55, &out));
+	TEST_CHECK(!telem_feed_byte(&d, 0, &out));
+	TEST_CHECK(d.nr_bad == 2);
+
+	// Another version, with a good CRC
+	ref_serialize(&r, raw);
+	raw[0] = TELEM_VERSION + 1;
+	crc = ref_crc16(raw, TELEM_RECORD_LEN);
+	raw[TELEM_RECORD_LEN] = (uint8_t)(crc >> 8);
+	raw[TELEM_RECORD_LEN + 1] = (uint8_t)crc;
+	len = ref_cobs_encode(raw, TELEM_RECORD_LEN + 2, frame);
+	TEST_CHECK(ref_check_frame(frame, len, raw) == TELEM_RECORD_LEN);
+	for (x = 0; x < len; ++x)
+		TEST_CHECK(!telem_feed_byte(&d, frame[x], &out));
+	TEST_CHECK(!telem_feed_byte(&d, 0, &out));
+	TEST_CHECK(d.nr_version == 1 && d.nr_bad == 2 && d.nr_good == 0);
+
+	// And then a good one
+	len = telem_encode(&r, frame);
+	for (x = 0; x < len; ++x)
+		TEST_CHECK(telem_feed_byte(&d, frame[x], &out) == (x == len - 1));
+	TEST_CHECK(telem_equal(&out, &r) && d.nr_good == 1);
+}
+
+/*
+ * Random bytes: anything, no zeros at all so that COBS blocks fill up, or
+ * many zeros
+ */
+static void telem_rand_bytes(uint8_t *buf, size_t len)
+{
+	unsigned int kind = test_rand_below(3);
+	size_t x;
+
+	for (x = 0; x < len; ++x) {
+		if (kind == 0)
+			buf[x] = (uint8_t)test_rand();
+		else if (kind == 1)
+			buf[x] = (uint8_t)(1 + test_rand_below(255));
+		else
+			buf[x] = test_rand_below(4) ? 0 : (uint8_t)test_rand();
+	}
+}
+
+// Check a message frame as the ground side would
+static void telem_check_msg(uint8_t type, const uint8_t *data, size_t n,
+	const uint8_t *frame, size_t len)
+{
+	static uint8_t raw[TELEM_MSG_MAX + 3];
+	static uint8_t again[TELEM_MSG_FRAME_LEN(TELEM_MSG_MAX)];
+
+	TEST_CHECK(len <= TELEM_MSG_FRAME_LEN(n) && frame[len - 1] == 0);
+	TEST_CHECK(memchr(frame, 0, len - 1) == NULL);
+	TEST_CHECK(ref_cobs_decode(frame, len - 1, raw) == (int)(n + 3));
+	TEST_CHECK(raw[0] == type && memcmp(&raw[1], data, n) == 0);
+	TEST_CHECK(ref_crc16(raw, n + 1) == ((raw[n + 1] << 8) | raw[n + 2]));
+	TEST_CHECK(ref_cobs_encode(raw, n + 3, again) == len - 1 &&
+		memcmp(again, frame, len - 1) == 0);
+}
+
+static void telem_test_msgs(void)
+{
+	static uint8_t data[TELEM_MSG_MAX];
+	static uint8_t frame[TELEM_MSG_FRAME_LEN(TELEM_MSG_MAX) + 1];
+	static telem_decoder_t d;
+	uint8_t rframe[TELEM_FRAME_MAX];
+	telem_record_t r, out;
+	telem_msg_t msg;
+	telem_feed_t got;
+	unsigned int i, nr_rejected = 0, nr_passed = 0;
+	size_t n, len, rlen, x;
+	uint8_t type;
+
+	telem_decoder_init(&d);
+	for (i = 0; i < TELEM_NR_MSGS; ++i) {
+		// Type, data and CRC end a COBS block, or just miss it
+		if (test_rand_below(4) == 0)
+			n = 254 * (1 + test_rand_below(TELEM_MSG_MAX / 254)) -
+				3 - 2 + test_rand_below(5);
+		else
+			n = test_rand_below(TELEM_MSG_MAX + 1);
+		telem_rand_bytes(data, n);
+		type = (uint8_t)(TELEM_TYPE_MSG +
+			test_rand_below(TELEM_TYPE_RAW - TELEM_TYPE_MSG));
+		len = telem_encode_msg(type, data, n, frame);
+		telem_check_msg(type, data, n, frame, len);
+
+		// In a stream, after a record
+		telem_rand_record(&r);
+		rlen = telem_encode(&r, rframe);
+		for (x = 0; x < rlen; ++x)
+			TEST_CHECK(telem_feed(&d, rframe[x], &out, &msg) ==
+				(x == rlen - 1 ? TELEM_FEED_RECORD :
+					TELEM_FEED_NONE));
+		TEST_CHECK(telem_equal(&out, &r));
+		for (x = 0; x < len; ++x)
+			TEST_CHECK(telem_feed(&d, frame[x], &out, &msg) ==
+				(x == len - 1 ? TELEM_FEED_MSG :
+					TELEM_FEED_NONE));
+		TEST_CHECK(msg.type == type && msg.len == n &&
+			memcmp(msg.data, data, n) == 0);
+
+		// Corrupted, but for the CRC missing it now and then
+		len = telem_corrupt(frame, len - 1);
+		for (x = 0; x < len; ++x)
+			TEST_CHECK(telem_feed(&d, frame[x], &out, &msg) ==
+				TELEM_FEED_NONE);
+		got = telem_feed(&d, 0, &out, &msg);
+		if (got == TELEM_FEED_MSG)
+			++nr_passed;
+		else if (len > 0)
+			++nr_rejected;
+	}
+	TEST_CHECK(nr_passed <= 2);
+	TEST_CHECK(d.nr_good == TELEM_NR_MSGS &&
+		d.nr_msg == TELEM_NR_MSGS + nr_passed);
+	printf("messages: %u round-tripped, %u corrupted ones rejected\n",
+		TELEM_NR_MSGS, nr_rejected);
+}
+
+// Feed a record, and check that it comes out if @p out is set
+static void telem_feed_record(telem_decoder_t *d, bool out)
+{
+	uint8_t frame[TELEM_FRAME_MAX];
+	telem_record_t r, got;
+	telem_msg_t msg;
+	size_t len, x;
+
+	telem_rand_record(&r);
+	len = telem_encode(&r, frame);
+	for (x = 0; x < len - 1; ++x)
+		TEST_CHECK(telem_feed(d, frame[x], &got, &msg) ==
+			TELEM_FEED_NONE);
+	if (!out) {
+		telem_feed(d, 0, &got, &msg);
+		return;
+	}
+	TEST_CHECK(telem_feed(d, 0, &got, &msg) == TELEM_FEED_RECORD &&
+		telem_equal(&got, &r));
+}
+
+static void telem_test_raw(void)
+{
+	static uint8_t data[TELEM_MSG_MAX];
+	static uint8_t wire[TELEM_RAW_HDR_LEN + TELEM_MSG_MAX +
+		TELEM_RAW_END_LEN];
+	static telem_decoder_t d;
+	uint8_t raw[3 + 2];
+	telem_record_t out;
+	telem_msg_t msg;
+	telem_feed_t got;
+	uint16_t crc;
+	size_t n, hlen, len, at, frag, x;
+	unsigned int i;
+	uint8_t type;
+
+	telem_decoder_init(&d);
+	for (i = 0; i < TELEM_NR_MSGS; ++i) {
+		n = test_rand_below(TELEM_MSG_MAX + 1);
+		telem_rand_bytes(data, n);
+		type = (uint8_t)(TELEM_TYPE_RAW +
+			test_rand_below(TELEM_TYPE_CAP - TELEM_TYPE_RAW));
+
+		// The header is a message of its own, holding the length
+		hlen = telem_encode_raw(type, (uint16_t)n, wire);
+		TEST_CHECK(hlen <= TELEM_RAW_HDR_LEN && wire[hlen - 1] == 0);
+		TEST_CHECK(ref_cobs_decode(wire, hlen - 1, raw) == 5 &&
+			raw[0] == type && raw[1] == (uint8_t)n &&
+			raw[2] == (uint8_t)(n >> 8) &&
+			ref_crc16(raw, 3) == ((raw[3] << 8) | raw[4]));
+
+		// The body as it is, its CRC carried over random fragments
+		memcpy(&wire[hlen], data, n);
+		crc = TELEM_CRC16_INIT;
+		for (at = 0; at < n; at += frag) {
+			frag = 1 + test_rand_below((unsigned int)(n - at));
+			crc = telem_crc16_update(crc, &data[at], frag);
+		}
+		TEST_CHECK(crc == ref_crc16(data, n));
+		len = hlen + n;
+		len += telem_encode_raw_end(crc, &wire[len]);
+		TEST_CHECK(len == hlen + n + TELEM_RAW_END_LEN &&
+			wire[len - 1] == 0);
+
+		telem_feed_record(&d, true);
+		for (x = 0; x < len; ++x)
+			TEST_CHECK(telem_feed(&d, wire[x], &out, &msg) ==
+				(x == len - 1 ? TELEM_FEED_MSG :
+					TELEM_FEED_NONE));
+		TEST_CHECK(msg.type == type && msg.len == n &&
+			memcmp(msg.data, data, n) == 0);
+
+		// A byte of the body or trailer changed, or one lost
+		at = hlen + test_rand_below((unsigned int)(n + 2));
+		if (test_rand_below(2) == 0) {
+			wire[at] ^= (uint8_t)(1 + test_rand_below(255));
+		} else {
+			memmove(&wire[at], &wire[at + 1], len - at - 1);
+			--len;
+		}
+		got = TELEM_FEED_NONE;
+		for (x = 0; x < len && got == TELEM_FEED_NONE; ++x)
+			got = telem_feed(&d, wire[x], &out, &msg);
+		TEST_CHECK(got == TELEM_FEED_NONE);
+		telem_feed_record(&d, false);
+		telem_feed_record(&d, true);
+	}
+	TEST_CHECK(d.nr_msg == TELEM_NR_MSGS && d.nr_bad >= TELEM_NR_MSGS);
+	printf("raw messages: %u round-tripped, and as many dropped\n",
+		TELEM_NR_MSGS);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+static telem_record_t flight[FLIGHT_MAX];
+static unsigned int flight_len;
+
+// A reading that drifts by a step or so, and now and then jumps
+static uint16_t flight_drift(uint16_t v, uint16_t lo, uint16_t hi)
+{
+	int32_t n = v;
+
+	if (test_rand_below(50) == 0)
+		n += (int32_t)test_rand_below(41) - 20;
+	else
+		n += (int32_t)test_rand_below(3) - 1;
+	return (uint16_t)(n < lo ? lo : n > hi ? hi : n);
+}
+
+// Records of a flight along an NMEA log, one per GGA sentence
+static void flight_load(const char *name)
+{
+	nmea_parser_t p;
+	nmea_fix_t fix;
+	aqi_win_t pm2_5_win, pm10_win, co2_win;
+	aqi_stats_t st;
+	telem_record_t *r;
+	uint16_t pm2_5 = 120, pm10 = 25, co2 = 450, temp = 215, rh = 480;
+	const char *log;
+	size_t len, x;
+
+	log = (const char *)test_load(name, &len);
+	nmea_init(&p);
+	aqi_win_init(&pm2_5_win, FLIGHT_PM_WINDOW);
+	aqi_win_init(&pm10_win, FLIGHT_PM_WINDOW);
+	aqi_win_init(&co2_win, FLIGHT_CO2_WINDOW);
+	for (x = 0; x < len && flight_len < FLIGHT_MAX; ++x) {
+		if ((nmea_feed_byte(&p, log[x]) & NMEA_SENT_GGA) == 0)
+			continue;
+		nmea_take_fix(&p, &fix);
+		r = &flight[flight_len];
+		memset(r, 0, sizeof(*r));
+		r->seq = (uint16_t)flight_len;
+		r->time_ms = 1000 * flight_len + test_rand_below(3);
+
+		// The PMS5003T in 0.1 ug/m^3 for PM2.5, the MH-Z19C every 2 s
+		pm2_5 = flight_drift(pm2_5, 0, 5000);
+		pm10 = flight_drift(pm10, pm2_5 / 10, 1000);
+		temp = flight_drift(temp, 0, 500);
+		rh = flight_drift(rh, 0, 1000);
+		aqi_win_push(&pm2_5_win, pm2_5);
+		aqi_win_push(&pm10_win, pm10);
+		if (flight_len % 2 == 0) {
+			co2 = flight_drift(co2, 400, 5000);
+			aqi_win_push(&co2_win, co2);
+		}
+
+		r->flags = TELEM_F_CO2 | TELEM_F_PMS;
+		r->co2_ppm = co2;
+		aqi_win_stats(&co2_win, &st);
+		r->co2_mean = st.mean;
+		r->pm1_0 = (uint16_t)(pm2_5 * 7 / 100);
+		r->pm2_5 = pm2_5 / 10;
+		r->pm10 = pm10;
+		r->temp_dc = (int16_t)temp;
+		r->rh_pm = rh;
+		aqi_win_stats(&pm2_5_win, &st);
+		r->pm2_5_mean_d = st.mean;
+		r->aqi = aqi_pm2_5(st.mean);
+		aqi_win_stats(&pm10_win, &st);
+		r->pm10_mean = st.mean;
+		if (aqi_pm10(st.mean) > r->aqi)
+			r->aqi = aqi_pm10(st.mean);
+		if (fix.quality != 0) {
+			r->flags |= TELEM_F_GPS;
+			r->lat_e7 = fix.lat_e7;
+			r->lon_e7 = fix.lon_e7;
+			r->alt_mm = fix.alt_mm;
+			r->gps_time_ms = fix.time_ms;
+			r->speed_cmps = fix.speed_cmps;
+			r->nr_sats = fix.nr_sats;
+			r->quality = fix.quality;
+		}
+		++flight_len;
+	}
+	free((void *)log);
+}
+
+// Whether a frame holds a delta record, by the flags after COBS decoding
+static bool telem_is_delta(const uint8_t *frame, size_t len)
+{
+	uint8_t raw[TELEM_FRAME_MAX];
+
+	return ref_check_frame(frame, len - 1, raw) >= 2 &&
+		(raw[1] & TELEM_F_DELTA) != 0;
+}
+
+/*
+ * Encode records in turn, and decode every frame; each must give back its
+ * record. Returns the bytes it took.
+ */
+static size_t telem_check_deltas(const telem_record_t *r, unsigned int n,
+	uint8_t key_interval)
+{
+	uint8_t frame[TELEM_FRAME_MAX];
+	telem_encoder_t e;
+	telem_decoder_t d;
+	telem_record_t out;
+	unsigned int x, since_key = 0;
+	size_t len, bytes = 0;
+
+	telem_encoder_init(&e, key_interval);
+	telem_decoder_init(&d);
+	for (x = 0; x < n; ++x) {
+		len = telem_encode_next(&e, &r[x], frame);
+		bytes += len;
+		TEST_CHECK(len <= TELEM_FRAME_MAX && frame[len - 1] == 0);
+		TEST_CHECK(memchr(frame, 0, len - 1) == NULL);
+		TEST_CHECK(telem_decode(&d, frame, len - 1, &out));
+		TEST_CHECK(telem_equal(&out, &r[x]));
+
+		// A keyframe at least every key_interval records
+		if (telem_is_delta(frame, len)) {
+			TEST_CHECK(++since_key < key_interval);
+			TEST_CHECK(len < TELEM_RECORD_LEN + 4);
+		} else {
+			since_key = 0;
+		}
+	}
+	TEST_CHECK(e.nr_key + e.nr_delta == n && e.nr_bytes == bytes);
+	TEST_CHECK(d.nr_good == n && d.nr_bad == 0 && d.nr_lost == 0);
+	return bytes;
+}
+
+static void telem_test_deltas(void)
+{
+	static telem_record_t r[1024];
+	unsigned int x, y;
+	uint32_t v;
+
+	flight_load("neo6m-cold.nmea");
+	flight_load("neo6m-drive.nmea");
+	TEST_CHECK(flight_len > 100);
+	telem_check_deltas(flight, flight_len, TELEM_KEY_INTERVAL);
+	telem_check_deltas(flight, flight_len, 255);
+	telem_check_deltas(flight, flight_len, 1);
+
+	/*
+	 * Random records, so mostly keyframes; and random records apart by
+	 * small steps or across the wrap of a field, in either direction
+	 */
+	for (x = 0; x < 1024; ++x) {
+		telem_rand_record(&r[x]);
+		r[x].seq = (uint16_t)x;
+	}
+	telem_check_deltas(r, 1024, TELEM_KEY_INTERVAL);
+	for (x = 1; x < 1024; ++x) {
+		r[x] = r[x - 1];
+		r[x].seq = (uint16_t)(r[x - 1].seq + 1);
+		r[x].flags = (uint8_t)(telem_rand_value() & ~TELEM_F_DELTA);
+		for (y = 0; y < 3; ++y) {
+			v = (uint32_t)test_rand_below(129) - 64;
+			if (test_rand_below(8) == 0)
+				v = telem_rand_value();
+			switch (test_rand_below(6)) {
+			case 0:  r[x].time_ms += v; break;
+			case 1:  r[x].temp_dc = (int16_t)(r[x].temp_dc + v); break;
+			case 2:  r[x].lat_e7 += (int32_t)v; break;
+			case 3:  r[x].alt_mm += (int32_t)v; break;
+			case 4:  r[x].co2_mean = (uint16_t)(r[x].co2_mean + v); break;
+			default: r[x].quality = (uint8_t)(r[x].quality + v); break;
+			}
+		}
+	}
+	telem_check_deltas(r, 1024, 255);
+	telem_check_deltas(r, 1024, TELEM_KEY_INTERVAL);
+}
+
+/*
+ * Drop a frame of the flight: the deltas after it, up to the next keyframe,
+ * must be dropped as lost, and the rest decoded
+ */
+static void telem_test_loss(void)
+{
+	static uint8_t frame[FLIGHT_MAX][TELEM_FRAME_MAX];
+	static size_t len[FLIGHT_MAX];
+	telem_encoder_t e;
+	telem_decoder_t d;
+	telem_record_t out;
+	unsigned int x, lost, nr_lost, nr_good, nr_lost_all = 0;
+	bool waiting;
+
+	telem_encoder_init(&e, TELEM_KEY_INTERVAL);
+	for (x = 0; x < flight_len; ++x)
+		len[x] = telem_encode_next(&e, &flight[x], frame[x]);
+
+	for (lost = 0; lost < flight_len; lost += 1 + test_rand_below(7)) {
+		telem_decoder_init(&d);
+		waiting = false;
+		nr_lost = nr_good = 0;
+		for (x = 0; x < flight_len; ++x) {
+			if (x == lost) {
+				waiting = true;
+				continue;
+			}
+			if (waiting && !telem_is_delta(frame[x], len[x]))
+				waiting = false;
+			if (waiting) {
+				TEST_CHECK(!telem_decode(&d, frame[x],
+					len[x] - 1, &out));
+				++nr_lost;
+				continue;
+			}
+			TEST_CHECK(telem_decode(&d, frame[x], len[x] - 1,
+				&out));
+			TEST_CHECK(telem_equal(&out, &flight[x]));
+			++nr_good;
+		}
+		TEST_CHECK(d.nr_lost == nr_lost && d.nr_good == nr_good);
+		TEST_CHECK(d.nr_bad == 0);
+		TEST_CHECK(nr_lost < TELEM_KEY_INTERVAL);
+		nr_lost_all += nr_lost;
+	}
+	TEST_CHECK(nr_lost_all > 0);
+
+	/*
+	 * A record that did not go out, as Telem_Send() handles it: sent
+	 * again with the same seq, after a resync, and so as a keyframe
+	 */
+	telem_encoder_init(&e, TELEM_KEY_INTERVAL);
+	telem_decoder_init(&d);
+	for (x = 0; x < 64; ++x) {
+		len[0] = telem_encode_next(&e, &flight[x], frame[0]);
+		if (x % 7 == 3) {
+			telem_encoder_resync(&e);
+			len[0] = telem_encode_next(&e, &flight[x], frame[0]);
+			TEST_CHECK(!telem_is_delta(frame[0], len[0]));
+		}
+		TEST_CHECK(telem_decode(&d, frame[0], len[0] - 1, &out));
+		TEST_CHECK(telem_equal(&out, &flight[x]));
+	}
+	TEST_CHECK(d.nr_lost == 0 && d.nr_bad == 0);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+/// Inputs of the benchmarks, made once so that making them is not timed
+#define BENCH_NR_IN	256
+static telem_record_t bench_rec[BENCH_NR_IN];
+static uint8_t bench_frame[BENCH_NR_IN][TELEM_FRAME_MAX];
+static size_t bench_len[BENCH_NR_IN];
+
+static void bench_encode(void *arg, unsigned int n)
+{
+	uint8_t frame[TELEM_FRAME_MAX];
+
+	(void)arg;
+	while (n-- > 0)
+		test_sink += telem_encode(&bench_rec[n % BENCH_NR_IN], frame);
+}
+
+static void bench_decode(void *arg, unsigned int n)
+{
+	telem_decoder_t d;
+	telem_record_t out;
+
+	(void)arg;
+	telem_decoder_init(&d);
+	while (n-- > 0) {
+		test_sink += telem_decode(&d, bench_frame[n % BENCH_NR_IN],
+			bench_len[n % BENCH_NR_IN] - 1, &out);
+		test_sink += out.seq;
+	}
+}
+
+static void bench_encode_next(void *arg, unsigned int n)
+{
+	const uint8_t *key_interval = arg;
+	uint8_t frame[TELEM_FRAME_MAX];
+	telem_encoder_t e;
+	unsigned int x;
+
+	telem_encoder_init(&e, *key_interval);
+	while (n-- > 0) {
+		for (x = 0; x < flight_len; ++x)
+			test_sink += telem_encode_next(&e, &flight[x], frame);
+	}
+}
+
+static void bench_flight(void)
+{
+	static const uint8_t intervals[] = { 1, 4, TELEM_KEY_INTERVAL, 32, 255 };
+	size_t bytes;
+	unsigned int x;
+	double ns;
+
+	printf("flight of %u records, per record:\n", flight_len);
+	printf("  key interval   bytes   ratio  encode\n");
+	for (x = 0; x < sizeof(intervals); ++x) {
+		bytes = telem_check_deltas(flight, flight_len, intervals[x]);
+		ns = test_bench(bench_encode_next, (void *)&intervals[x], 20);
+		printf("  %12u %7.1f %6.2f %6.1f ns\n", intervals[x],
+			(double)bytes / flight_len,
+			(double)flight_len * (TELEM_RECORD_LEN + 4) / bytes,
+			ns / flight_len);
+	}
+}
+
+static void bench(void)
+{
+	size_t bytes = 0;
+	unsigned int x;
+
+	for (x = 0; x < BENCH_NR_IN; ++x) {
+		telem_rand_record(&bench_rec[x]);
+		bench_len[x] = telem_encode(&bench_rec[x], bench_frame[x]);
+		bytes += bench_len[x];
+	}
+	printf("keyframes: %.1f bytes per record on the wire, for %u of "
+		"data\n", (double)bytes / BENCH_NR_IN, TELEM_RECORD_LEN);
+	printf("per record:\n");
+	printf("  telem_encode                %6.1f ns\n",
+		test_bench(bench_encode, NULL, TELEM_NR_BENCH));
+	printf("  telem_decode                %6.1f ns\n",
+		test_bench(bench_decode, NULL, TELEM_NR_BENCH));
+	bench_flight();
+}
+
+int main(void)
+{
+	telem_test_roundtrip();
+	telem_test_corrupt();
+	telem_test_counters();
+	telem_test_msgs();
+	telem_test_raw();
+	telem_test_deltas();
+	telem_test_loss();
+	bench();
+	return test_done("telem");
+}
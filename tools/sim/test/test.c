@@ -0,0 +1,108 @@
+/**
+ * @file test.c
+ * @brief Checks and micro-benchmarks shared by the host tests
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "test.h"
+
+/// Failures printed in full; the rest are only counted
+#define TEST_NR_PRINTED	10
+
+/// Runs of a benchmark, of which the fastest is taken
+#define TEST_NR_RUNS	5
+
+/// Where test data is, relative to tools/sim
+#if !defined(TEST_DATA)
+#define TEST_DATA	"test/data"
+#endif
+
+static unsigned int test_nr_checks;
+static unsigned int test_nr_failed;
+static uint64_t test_seed = 0x9E3779B97F4A7C15ull;
+
+volatile uint64_t test_sink;
+
+bool test_check(bool ok, const char *what, const char *file, int line)
+{
+	++test_nr_checks;
+	if (ok)
+		return true;
+	if (test_nr_failed++ < TEST_NR_PRINTED)
+		fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what);
+	return false;
+}
+
+int test_done(const char *name)
+{
+	printf("%s: %u checks, %u failed\n", name, test_nr_checks,
+		test_nr_failed);
+	return (test_nr_checks == 0 || test_nr_failed != 0) ? 1 : 0;
+}
+
+uint64_t test_rand(void)
+{
+	test_seed ^= test_seed >> 12;
+	test_seed ^= test_seed << 25;
+	test_seed ^= test_seed >> 27;
+	return test_seed * 0x2545F4914F6CDD1Dull;
+}
+
+uint32_t test_rand_below(uint32_t n)
+{
+	return (uint32_t)((test_rand() >> 32) * n >> 32);
+}
+
+static int64_t test_host_ns(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (int64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+double test_bench(void (*fn)(void *arg, unsigned int n), void *arg,
+	unsigned int n)
+{
+	int64_t t, best = INT64_MAX;
+	unsigned int x;
+
+	for (x = 0; x < TEST_NR_RUNS; ++x) {
+		t = test_host_ns();
+		fn(arg, n);
+		t = test_host_ns() - t;
+		if (t < best)
+			best = t;
+	}
+	return (double)best / n;
+}
+
+uint8_t *test_load(const char *name, size_t *len)
+{
+	char path[256];
+	uint8_t *buf;
+	FILE *f;
+	long n;
+
+	snprintf(path, sizeof(path), "%s/%s", TEST_DATA, name);
+	f = fopen(path, "rb");
+	if (f == NULL || fseek(f, 0, SEEK_END) != 0 || (n = ftell(f)) < 0 ||
+	    fseek(f, 0, SEEK_SET) != 0) {
+		fprintf(stderr, "cannot read %s\n", path);
+		exit(2);
+	}
+	buf = malloc((size_t)n + 1);
+	if (buf == NULL || fread(buf, 1, (size_t)n, f) != (size_t)n) {
+		fprintf(stderr, "cannot read %s\n", path);
+		exit(2);
+	}
+	fclose(f);
+	buf[n] = '\0';
+	*len = (size_t)n;
+	return buf;
+}
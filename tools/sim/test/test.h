@@ -0,0 +1,75 @@
+/**
+ * @file test.h
+ * @brief Checks and micro-benchmarks shared by the host tests
+ *
+ * Each test is a program of its own, run by "make check": it makes its
+ * checks with TEST_CHECK(), prints what its benchmarks measured, and exits
+ * with test_done(), which fails if any check did. Benchmarks only report;
+ * host timings are too noisy to fail on.
+ */
+
+#if !defined(TEST_H_)
+#define TEST_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// C linkage should be maintained
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+
+/// Check that @p cond holds; the first few failures are printed
+#define TEST_CHECK(cond) \
+	test_check((cond) ? true : false, #cond, __FILE__, __LINE__)
+
+/// Record the outcome of a check; returns @p ok
+bool test_check(bool ok, const char *what, const char *file, int line);
+
+/**
+ * Print how many checks were made and failed, as "<name>: ..."
+ *
+ * @return	Exit status for main(): nonzero if any check failed, or if
+ *		none was made
+ */
+int test_done(const char *name);
+
+/// Next number of a fixed pseudo-random sequence (xorshift64*)
+uint64_t test_rand(void);
+
+/// Pseudo-random number on [0, @p n)
+uint32_t test_rand_below(uint32_t n);
+
+/**
+ * Time a piece of code
+ *
+ * @p fn is called with @p arg and @p n, and should do @p n iterations of
+ * whatever is measured. The best of a few runs is taken.
+ *
+ * @return	Host nanoseconds per iteration
+ */
+double test_bench(void (*fn)(void *arg, unsigned int n), void *arg,
+	unsigned int n);
+
+/// Somewhere for benchmarks to put their results, so they are not elided
+extern volatile uint64_t test_sink;
+
+/**
+ * Read a whole file from the test data directory (test/data)
+ *
+ * @param[out]	len	Bytes read
+ * @return	Contents, NUL-terminated, from malloc(); exits if the file
+ *		cannot be read
+ */
+uint8_t *test_load(const char *name, size_t *len);
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifdef __cplusplus
+}
+#endif	// __cplusplus
+
+#endif	// !defined(TEST_H_)
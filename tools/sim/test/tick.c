@@ -0,0 +1,262 @@
+/**
+ * @file tick.c
+ * @brief Host test of the 64-bit tick, and its cost against timespecs
+ *
+ * The tick is checked against the simulated time, reading it at random
+ * points, with interrupts masked across reloads as well.
+ *
+ * The benchmark times the two things the USART idle timeout does: stamp the
+ * last byte received, and check whether the timeout has passed since. With
+ * the tick, those are platform_tick_get() and platform_tick_expired(); the
+ * timespec versions they replaced are kept below, as they were. Stamping
+ * reads SysTick through the simulator, which costs the host far more than
+ * it does the target, so the report gives the register accesses per call
+ * as well, and what a bare access costs the host for comparison.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "platform.h"
+#include "sim.h"
+#include "test.h"
+
+/// Reload value of SysTick, as in platform/systick.c
+#define TICK_RELOAD	(PLATFORM_TICKS_US(PLATFORM_TICK_PERIOD_US) - 1)
+
+/// Iterations of each benchmark
+#define TICK_NR_BENCH	50000
+
+/////////////////////////////////////////////////////////////////////////////
+
+/*
+ * The timespec clock, as it was: SysTick_Handler() kept the time of the
+ * last reload in ts_wall. It is left at zero here, which costs the same.
+ */
+static volatile platform_timespec_t ts_wall;
+static volatile uint32_t ts_wall_cookie;
+
+static int old_timespec_compare(const platform_timespec_t *lhs,
+	const platform_timespec_t *rhs)
+{
+	if (lhs->nr_sec < rhs->nr_sec)
+		return -1;
+	else if (lhs->nr_sec > rhs->nr_sec)
+		return +1;
+	else if (lhs->nr_nsec < rhs->nr_nsec)
+		return -1;
+	else if (lhs->nr_nsec > rhs->nr_nsec)
+		return +1;
+	else
+		return 0;
+}
+
+static void old_tick_count(platform_timespec_t *tick)
+{
+	uint32_t cookie;
+
+	do {
+		cookie = ts_wall_cookie;
+		*tick = ts_wall;
+	} while (ts_wall_cookie != cookie);
+}
+
+static void old_tick_hrcount(platform_timespec_t *tick)
+{
+	platform_timespec_t t;
+	uint32_t s = TICK_RELOAD - SysTick->VAL;
+
+	old_tick_count(&t);
+	t.nr_nsec += (1000 * s) / 12;
+	while (t.nr_nsec >= 1000000000) {
+		t.nr_nsec -= 1000000000;
+		++t.nr_sec;
+	}
+	*tick = t;
+}
+
+static void old_tick_delta(platform_timespec_t *diff,
+	const platform_timespec_t *lhs, const platform_timespec_t *rhs)
+{
+	platform_timespec_t d = PLATFORM_TIMESPEC_ZERO;
+	uint32_t c = 0;
+
+	if (lhs->nr_sec < rhs->nr_sec)
+		d.nr_sec = (UINT32_MAX - rhs->nr_sec) + lhs->nr_sec + 1;
+	else
+		d.nr_sec = lhs->nr_sec - rhs->nr_sec;
+
+	if (lhs->nr_sec < rhs->nr_sec) {
+		c = rhs->nr_sec - lhs->nr_sec;
+		while (c >= 1000000000) {
+			c -= 1000000000;
+			if (d.nr_sec == 0)
+				d.nr_sec = UINT32_MAX;
+			else
+				--d.nr_sec;
+		}
+		if (d.nr_sec == 0)
+			d.nr_sec = UINT32_MAX;
+		else
+			--d.nr_sec;
+	} else {
+		d.nr_nsec = lhs->nr_nsec - rhs->nr_nsec;
+	}
+	*diff = d;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+// Let time pass by a number of register accesses
+static void tick_spin(unsigned int nr_clocks)
+{
+	while (nr_clocks-- > 0)
+		(void)SysTick->CTRL;
+}
+
+/*
+ * Check a tick read at the current time: it must fall within the call, in
+ * the firmware's time (counted from a clock after SysTick first loaded)
+ */
+static void tick_check_now(platform_tick_t *last)
+{
+	sim_stats_t st;
+	platform_tick_t before, after, t;
+
+	sim_stats(&st);
+	before = sim_now() - st.systick_zero;
+	t = platform_tick_get();
+	after = sim_now() - st.systick_zero;
+
+	TEST_CHECK(t > before && t <= after);
+	TEST_CHECK(t >= *last);
+	*last = t;
+}
+
+static void tick_test(void)
+{
+	platform_timespec_t ts, hr;
+	platform_tick_t last = 0, t;
+	uint32_t primask;
+	unsigned int x;
+
+	// Interrupts taken as they come, at random points
+	for (x = 0; x < 500; ++x) {
+		tick_spin(test_rand_below(3 * (TICK_RELOAD + 1) / 2));
+		tick_check_now(&last);
+	}
+
+	// Held off across a reload: the pending one must be accounted for
+	for (x = 0; x < 500; ++x) {
+		primask = __get_PRIMASK();
+		__disable_irq();
+		tick_spin(SysTick->VAL + test_rand_below(TICK_RELOAD / 2));
+		tick_check_now(&last);
+		__set_PRIMASK(primask);
+	}
+
+	// The timespec views are derived from the same count
+	for (x = 0; x < 500; ++x) {
+		tick_spin(test_rand_below(TICK_RELOAD + 1));
+		platform_tick_count(&ts);
+		t = platform_tick_get();
+		platform_tick_hrcount(&hr);
+		TEST_CHECK(platform_timespec_compare(&ts, &hr) <= 0);
+		TEST_CHECK((uint64_t)hr.nr_sec * 1000000000 + hr.nr_nsec >=
+			t / PLATFORM_TICKS_PER_US * 1000);
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+static void bench_access(void *arg, unsigned int n)
+{
+	(void)arg;
+	while (n-- > 0)
+		test_sink += SysTick->VAL;
+}
+
+static void bench_tick_stamp(void *arg, unsigned int n)
+{
+	(void)arg;
+	while (n-- > 0)
+		test_sink += platform_tick_get();
+}
+
+static void bench_tick_expired(void *arg, unsigned int n)
+{
+	platform_tick_t now = platform_tick_get();
+	platform_tick_t due = now + PLATFORM_TICKS_MS(5);
+
+	(void)arg;
+	while (n-- > 0) {
+		test_sink += platform_tick_expired(now, due);
+		now += 7;
+	}
+}
+
+static void bench_ts_stamp(void *arg, unsigned int n)
+{
+	platform_timespec_t t;
+
+	(void)arg;
+	while (n-- > 0) {
+		old_tick_hrcount(&t);
+		test_sink += t.nr_nsec;
+	}
+}
+
+static void bench_ts_expired(void *arg, unsigned int n)
+{
+	const platform_timespec_t timeout = { 0, 5000000 };
+	platform_timespec_t now = { 1, 0 }, idle = { 0, 999000000 }, d;
+
+	(void)arg;
+	while (n-- > 0) {
+		old_tick_delta(&d, &now, &idle);
+		test_sink += old_timespec_compare(&d, &timeout) >= 0;
+		now.nr_nsec += 7;
+	}
+}
+
+// Time a benchmark, and count the simulated clocks it took per iteration
+static void bench_run(const char *what, void (*fn)(void *, unsigned int))
+{
+	sim_time_t t0 = sim_now();
+	double ns, clocks;
+
+	fn(NULL, TICK_NR_BENCH);
+	clocks = (double)(sim_now() - t0) / TICK_NR_BENCH;
+	ns = test_bench(fn, NULL, TICK_NR_BENCH);
+
+	printf("  %-28s %8.1f ns %6.2f accesses\n", what, ns, clocks);
+}
+
+static void bench(void)
+{
+	printf("per call:\n");
+	bench_run("register access", bench_access);
+	bench_run("stamp: platform_tick_get", bench_tick_stamp);
+	bench_run("stamp: timespec hrcount", bench_ts_stamp);
+	bench_run("timeout: tick_expired", bench_tick_expired);
+	bench_run("timeout: timespec delta+cmp", bench_ts_expired);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+static void done(void)
+{
+	exit(2);
+}
+
+int main(void)
+{
+	sim_init(SIM_TIME_NEVER, 0, done);
+	platform_init();
+
+	tick_test();
+	bench();
+	return test_done("tick");
+}
@@ -0,0 +1,301 @@
+/**
+ * @file timespec.c
+ * @brief Host property tests of the timespec helpers, and their cost
+ *
+ * A normalized timespec stands for a count of nanoseconds modulo 2^32
+ * seconds, which fits in 64 bits; platform_tick_delta(),
+ * platform_timespec_add(), platform_timespec_compare() and
+ * platform_timespec_normalize() are checked against that arithmetic, over
+ * every pair of a set of edge values (around zero, 2^31 and the 2^32 wrap of
+ * the seconds, and the ends of the nanoseconds), a sweep across the wrap,
+ * and a few million random pairs.
+ *
+ * The benchmark times them against the versions they replaced, kept below
+ * as they were, on inputs that need no borrow, which those got right.
+ * Normalizing is timed on carries of up to a second, as an addition of two
+ * normalized values makes, and on raw counts of up to 2^32 nanoseconds,
+ * which the old loop took a pass per second over. Only the latter shows a
+ * clear gain; the others come out at parity, within host noise.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "platform.h"
+#include "test.h"
+
+#define NSEC_PER_SEC	1000000000ull
+
+/// Nanoseconds in the range of a timespec, 2^32 seconds
+#define TS_RANGE	((UINT32_MAX + 1ull) * NSEC_PER_SEC)
+
+/// Random pairs checked, and iterations of each benchmark
+#define TS_NR_RANDOM	4000000
+#define TS_NR_BENCH	2000000
+
+/////////////////////////////////////////////////////////////////////////////
+
+static int old_timespec_compare(const platform_timespec_t *lhs,
+	const platform_timespec_t *rhs)
+{
+	if (lhs->nr_sec < rhs->nr_sec)
+		return -1;
+	else if (lhs->nr_sec > rhs->nr_sec)
+		return +1;
+	else if (lhs->nr_nsec < rhs->nr_nsec)
+		return -1;
+	else if (lhs->nr_nsec > rhs->nr_nsec)
+		return +1;
+	else
+		return 0;
+}
+
+static void old_timespec_normalize(platform_timespec_t *ts)
+{
+	while (ts->nr_nsec >= 1000000000) {
+		ts->nr_nsec -= 1000000000;
+		if (ts->nr_sec < UINT32_MAX) {
+			++ts->nr_sec;
+		} else {
+			ts->nr_nsec = (1000000000 - 1);
+			break;
+		}
+	}
+}
+
+static void old_tick_delta(platform_timespec_t *diff,
+	const platform_timespec_t *lhs, const platform_timespec_t *rhs)
+{
+	platform_timespec_t d = PLATFORM_TIMESPEC_ZERO;
+	uint32_t c = 0;
+
+	if (lhs->nr_sec < rhs->nr_sec)
+		d.nr_sec = (UINT32_MAX - rhs->nr_sec) + lhs->nr_sec + 1;
+	else
+		d.nr_sec = lhs->nr_sec - rhs->nr_sec;
+
+	if (lhs->nr_sec < rhs->nr_sec) {
+		c = rhs->nr_sec - lhs->nr_sec;
+		while (c >= 1000000000) {
+			c -= 1000000000;
+			if (d.nr_sec == 0)
+				d.nr_sec = UINT32_MAX;
+			else
+				--d.nr_sec;
+		}
+		if (d.nr_sec == 0)
+			d.nr_sec = UINT32_MAX;
+		else
+			--d.nr_sec;
+	} else {
+		d.nr_nsec = lhs->nr_nsec - rhs->nr_nsec;
+	}
+	*diff = d;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+static uint64_t ts_value(const platform_timespec_t *ts)
+{
+	return ts->nr_sec * NSEC_PER_SEC + ts->nr_nsec;
+}
+
+static platform_timespec_t ts_make(uint32_t sec, uint32_t nsec)
+{
+	platform_timespec_t ts = { sec, nsec };
+
+	return ts;
+}
+
+static platform_timespec_t ts_random(void)
+{
+	return ts_make((uint32_t)test_rand(),
+		test_rand_below(NSEC_PER_SEC));
+}
+
+// Check all three operations on a pair of normalized timespecs
+static void ts_check_pair(platform_timespec_t l, platform_timespec_t r)
+{
+	uint64_t a = ts_value(&l), b = ts_value(&r);
+	platform_timespec_t d, s;
+	int c;
+
+	platform_tick_delta(&d, &l, &r);
+	TEST_CHECK(d.nr_nsec < NSEC_PER_SEC);
+	TEST_CHECK(ts_value(&d) == (a >= b ? a - b : a + TS_RANGE - b));
+
+	platform_timespec_add(&s, &l, &r);
+	TEST_CHECK(s.nr_nsec < NSEC_PER_SEC);
+	TEST_CHECK(ts_value(&s) == (a + b) % TS_RANGE);
+
+	c = platform_timespec_compare(&l, &r);
+	TEST_CHECK(c == (a > b) - (a < b));
+
+	// The result may alias either input
+	d = l;
+	platform_tick_delta(&d, &d, &r);
+	s = r;
+	platform_timespec_add(&s, &l, &s);
+	TEST_CHECK(ts_value(&d) == (a >= b ? a - b : a + TS_RANGE - b));
+	TEST_CHECK(ts_value(&s) == (a + b) % TS_RANGE);
+}
+
+static void ts_check_normalize(uint32_t sec, uint32_t nsec)
+{
+	platform_timespec_t ts = ts_make(sec, nsec);
+	uint64_t v = sec * NSEC_PER_SEC + nsec;
+
+	platform_timespec_normalize(&ts);
+	TEST_CHECK(ts.nr_nsec < NSEC_PER_SEC);
+	TEST_CHECK(ts_value(&ts) == (v < TS_RANGE ? v : TS_RANGE - 1));
+}
+
+static void ts_test(void)
+{
+	static const uint32_t secs[] = {
+		0, 1, 2, 0x7FFFFFFE, 0x7FFFFFFF, 0x80000000, 0x80000001,
+		UINT32_MAX - 2, UINT32_MAX - 1, UINT32_MAX,
+	};
+	static const uint32_t nsecs[] = {
+		0, 1, 2, 499999999, 500000000, 999999998, 999999999,
+	};
+	static const uint32_t raw_nsecs[] = {
+		1000000000, 1000000001, 1999999999, 2000000000, 3999999999u,
+		UINT32_MAX,
+	};
+#define NR(a)	(sizeof(a) / sizeof((a)[0]))
+	unsigned int x, y, i, j;
+	uint32_t s;
+
+	// Every pair of edge values
+	for (x = 0; x < NR(secs); ++x)
+		for (y = 0; y < NR(nsecs); ++y)
+			for (i = 0; i < NR(secs); ++i)
+				for (j = 0; j < NR(nsecs); ++j)
+					ts_check_pair(ts_make(secs[x], nsecs[y]),
+						ts_make(secs[i], nsecs[j]));
+
+	// Across the wrap, a second either side, a millisecond at a time
+	for (x = 0; x < 4000; ++x) {
+		s = (uint32_t)(UINT32_MAX - 1 + x / 1000);
+		ts_check_pair(ts_make(s, (x % 1000) * 1000000),
+			ts_make(UINT32_MAX, 999999999 - (x % 1000) * 999));
+		ts_check_pair(ts_make(UINT32_MAX, (x % 1000) * 1000000),
+			ts_make(s, 999999999 - (x % 1000) * 999));
+	}
+
+	for (x = 0; x < TS_NR_RANDOM; ++x)
+		ts_check_pair(ts_random(), ts_random());
+
+	// Carries out of nanoseconds, up to saturation
+	for (x = 0; x < NR(secs); ++x) {
+		for (y = 0; y < NR(nsecs); ++y)
+			ts_check_normalize(secs[x], nsecs[y]);
+		for (y = 0; y < NR(raw_nsecs); ++y)
+			ts_check_normalize(secs[x], raw_nsecs[y]);
+	}
+	for (x = 0; x < TS_NR_RANDOM / 16; ++x)
+		ts_check_normalize((uint32_t)test_rand(), (uint32_t)test_rand());
+#undef NR
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+/// Inputs of the benchmarks, drawn once so that drawing is not timed
+#define BENCH_NR_IN	1024
+static platform_timespec_t bench_in[BENCH_NR_IN][2];
+static uint32_t bench_raw[BENCH_NR_IN];
+
+static void bench_delta(void *arg, unsigned int n)
+{
+	void (*fn)(platform_timespec_t *, const platform_timespec_t *,
+		const platform_timespec_t *) = arg;
+	platform_timespec_t d;
+
+	while (n-- > 0) {
+		fn(&d, &bench_in[n % BENCH_NR_IN][0],
+			&bench_in[n % BENCH_NR_IN][1]);
+		test_sink += d.nr_nsec;
+	}
+}
+
+static void bench_compare(void *arg, unsigned int n)
+{
+	int (*fn)(const platform_timespec_t *,
+		const platform_timespec_t *) = arg;
+
+	while (n-- > 0)
+		test_sink += fn(&bench_in[n % BENCH_NR_IN][0],
+			&bench_in[n % BENCH_NR_IN][1]);
+}
+
+static void bench_normalize(void *arg, unsigned int n)
+{
+	void (*fn)(platform_timespec_t *) = arg;
+	platform_timespec_t ts;
+
+	while (n-- > 0) {
+		ts = bench_in[n % BENCH_NR_IN][0];
+		ts.nr_nsec += bench_in[n % BENCH_NR_IN][1].nr_nsec;
+		fn(&ts);
+		test_sink += ts.nr_nsec;
+	}
+}
+
+static void bench_normalize_raw(void *arg, unsigned int n)
+{
+	void (*fn)(platform_timespec_t *) = arg;
+	platform_timespec_t ts;
+
+	while (n-- > 0) {
+		ts = bench_in[n % BENCH_NR_IN][0];
+		ts.nr_nsec = bench_raw[n % BENCH_NR_IN];
+		fn(&ts);
+		test_sink += ts.nr_nsec;
+	}
+}
+
+static void bench(void)
+{
+	platform_timespec_t a, b;
+	unsigned int x;
+
+	// lhs later than rhs, without a nanosecond borrow
+	for (x = 0; x < BENCH_NR_IN; ++x) {
+		a = ts_random();
+		b = ts_make(a.nr_sec - test_rand_below(1000),
+			test_rand_below(a.nr_nsec + 1));
+		bench_in[x][0] = a;
+		bench_in[x][1] = b;
+		bench_raw[x] = (uint32_t)test_rand();
+	}
+
+	printf("per call, new and old:\n");
+	printf("  platform_tick_delta         %6.2f ns %6.2f ns\n",
+		test_bench(bench_delta, platform_tick_delta, TS_NR_BENCH),
+		test_bench(bench_delta, old_tick_delta, TS_NR_BENCH));
+	printf("  platform_timespec_compare   %6.2f ns %6.2f ns\n",
+		test_bench(bench_compare, platform_timespec_compare,
+			TS_NR_BENCH),
+		test_bench(bench_compare, old_timespec_compare, TS_NR_BENCH));
+	printf("  platform_timespec_normalize %6.2f ns %6.2f ns\n",
+		test_bench(bench_normalize, platform_timespec_normalize,
+			TS_NR_BENCH),
+		test_bench(bench_normalize, old_timespec_normalize,
+			TS_NR_BENCH));
+	printf("    of up to 4 s of nsec      %6.2f ns %6.2f ns\n",
+		test_bench(bench_normalize_raw, platform_timespec_normalize,
+			TS_NR_BENCH),
+		test_bench(bench_normalize_raw, old_timespec_normalize,
+			TS_NR_BENCH));
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+int main(void)
+{
+	ts_test();
+	bench();
+	return test_done("timespec");
+}
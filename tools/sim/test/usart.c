@@ -0,0 +1,569 @@
+/**
+ * @file usart.c
+ * @brief Host test of the interrupt-driven USART driver, on the simulated
+ *	  board
+ *
+ * Everything here runs with the main loop held up, as a blocking call in
+ * the application would hold it: the test never calls
+ * platform_do_loop_one(), only waits for interrupts, so bytes only move if
+ * the handlers move them.
+ *
+ * Bursts of random lengths are received on all four links at once, into
+ * buffers that some of them overflow: each must complete, on the idle
+ * timeout or on a full buffer, with exactly the bytes sent, and none lost in
+ * the receiver. The idle timeout must join bursts less than three character
+ * times apart and split those further apart, completing no sooner than
+ * three character times after the last byte, and within two jiffies of
+ * that. Lines matched on their terminator must come out whole, with the
+ * buffer re-armed from the polling loop in between. Descriptors hunting for
+ * sync bytes must be refused unless they give one or two. Fragments sent
+ * through the DRE handler must arrive back to back, whatever their sizes.
+ *
+ * The benchmark gives what a byte costs in the RXC and DRE handlers, in
+ * simulated time with what the tick costs over the same stretch taken off,
+ * and what is left of a second of traffic on all four links while the main
+ * loop is held up for that long.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "platform.h"
+#include "sim.h"
+#include "test.h"
+
+// Defined in platform/usart.c
+extern void platform_usart_pms_init(void);
+
+/// Channels, as numbered by platform_usart_ch_t, and their SERCOMs
+#define USART_NR_CH	4
+static const unsigned int usart_sercom[USART_NR_CH] = { 0, 1, 3, 5 };
+
+static bool (*const usart_rx_async[USART_NR_CH])(
+	platform_usart_rx_async_desc_t *desc) = {
+	platform_usart_esp_rx_async, platform_usart_co2_rx_async,
+	platform_usart_pms_rx_async, platform_usart_gps_rx_async
+};
+static void (*const usart_rx_abort[USART_NR_CH])(void) = {
+	platform_usart_esp_rx_abort, platform_usart_co2_rx_abort,
+	platform_usart_pms_rx_abort, platform_usart_gps_rx_abort
+};
+
+/// Line rate all channels come up at
+#define USART_BAUD	9600
+
+/// Character time on the line, 10 bits, in simulated clocks
+#define USART_CHAR(baud) \
+	((sim_time_t)(SIM_TICKS_US(1000000) * 10 / (baud)))
+
+/// Idle timeout, as in platform/usart.c
+#define USART_IDLE(baud)	(3 * USART_CHAR(baud))
+
+/// Jiffy length
+#define USART_JIFFY	SIM_TICKS_US(PLATFORM_TICK_PERIOD_US)
+
+/// Size of the receive buffers, and the longest burst sent into them
+#define USART_RX_LEN	128
+#define USART_BURST_MAX	160
+
+/// Rounds of each test
+#define USART_NR_ROUNDS	50
+
+/////////////////////////////////////////////////////////////////////////////
+
+// The far end of a SERCOM, taking whatever the firmware sends
+typedef struct line_type {
+	sim_dev_t	dev;
+	uint8_t		buf[4096];
+	size_t		len;
+} line_t;
+
+static void line_rx(sim_dev_t *dev, uint8_t c)
+{
+	line_t *l = (line_t *)dev;
+
+	if (l->len < sizeof(l->buf))
+		l->buf[l->len] = c;
+	++l->len;
+}
+
+static line_t usart_lines[USART_NR_CH] = {
+	{ .dev = { "esp", USART_BAUD, line_rx, NULL, SIM_TIME_NEVER } },
+	{ .dev = { "co2", USART_BAUD, line_rx, NULL, SIM_TIME_NEVER } },
+	{ .dev = { "pms", USART_BAUD, line_rx, NULL, SIM_TIME_NEVER } },
+	{ .dev = { "gps", USART_BAUD, line_rx, NULL, SIM_TIME_NEVER } },
+};
+
+// Hold up the main loop until a given time, as a blocking call would
+static void usart_block_until(sim_time_t t)
+{
+	while (sim_now() < t)
+		__WFI();
+}
+
+// Random bytes
+static void usart_make_bytes(uint8_t *buf, size_t len)
+{
+	while (len-- > 0)
+		*buf++ = (uint8_t)test_rand();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+// Bursts on all four links at once, some of them overflowing their buffers
+static void usart_test_blocked(void)
+{
+	static char buf[USART_NR_CH][USART_RX_LEN];
+	static uint8_t sent[USART_NR_CH][USART_BURST_MAX];
+	static platform_usart_rx_async_desc_t desc[USART_NR_CH];
+	platform_usart_stats_t ust0[USART_NR_CH], ust;
+	sim_usart_stats_t sst;
+	size_t len[USART_NR_CH], exp;
+	unsigned int n, ch;
+	sim_time_t end;
+
+	for (n = 0; n < USART_NR_ROUNDS; ++n) {
+		end = sim_now();
+		for (ch = 0; ch < USART_NR_CH; ++ch) {
+			memset(&desc[ch], 0, sizeof(desc[ch]));
+			desc[ch].buf = buf[ch];
+			desc[ch].max_len = USART_RX_LEN;
+			TEST_CHECK(usart_rx_async[ch](&desc[ch]));
+			platform_usart_stats(ch, &ust0[ch], false);
+
+			len[ch] = 1 + test_rand_below(USART_BURST_MAX);
+			usart_make_bytes(sent[ch], len[ch]);
+			sim_usart_send(usart_sercom[ch], sent[ch], len[ch]);
+			if (sim_now() + len[ch] * USART_CHAR(USART_BAUD) > end)
+				end = sim_now() + len[ch] *
+					USART_CHAR(USART_BAUD);
+		}
+
+		// All of it through, and the idle timeout run out
+		usart_block_until(end + USART_IDLE(USART_BAUD) +
+			2 * USART_JIFFY);
+
+		for (ch = 0; ch < USART_NR_CH; ++ch) {
+			exp = len[ch] < USART_RX_LEN ? len[ch] : USART_RX_LEN;
+			platform_usart_stats(ch, &ust, false);
+			TEST_CHECK(desc[ch].compl_type ==
+				PLATFORM_USART_RX_COMPL_DATA);
+			TEST_CHECK(desc[ch].compl_info.data_len == exp &&
+				memcmp(buf[ch], sent[ch], exp) == 0);
+			TEST_CHECK(ust.nr_rx_bytes - ust0[ch].nr_rx_bytes == exp);
+			TEST_CHECK(ust.nr_rx_dropped - ust0[ch].nr_rx_dropped ==
+				len[ch] - exp);
+			if (len[ch] >= USART_RX_LEN)
+				TEST_CHECK(ust.nr_compl_full ==
+					ust0[ch].nr_compl_full + 1);
+			else
+				TEST_CHECK(ust.nr_compl_idle ==
+					ust0[ch].nr_compl_idle + 1);
+			TEST_CHECK(ust.nr_err_overflow == 0);
+		}
+	}
+
+	for (ch = 0; ch < USART_NR_CH; ++ch) {
+		sim_usart_stats(usart_sercom[ch], &sst);
+		TEST_CHECK(sst.nr_overrun == 0 && sst.nr_garbled == 0);
+	}
+}
+
+/// Descriptor being polled for, and when it was first seen complete
+static volatile platform_usart_rx_async_desc_t *usart_polled;
+static sim_time_t usart_compl;
+
+// Hold up the main loop as usart_block_until() does, polling for completion
+static void usart_poll_until(sim_time_t t)
+{
+	while (sim_now() < t) {
+		__WFI();
+		if (usart_compl == 0 &&
+		    usart_polled->compl_type != PLATFORM_USART_RX_COMPL_NONE)
+			usart_compl = sim_now();
+	}
+}
+
+/*
+ * Two bursts, @p gap apart, into one buffer: joined if the gap is short
+ * enough, split otherwise, with the completion in time either way
+ */
+static void usart_check_gap(sim_time_t gap, bool joined)
+{
+	static char buf[USART_RX_LEN];
+	static uint8_t sent[40];
+	static platform_usart_rx_async_desc_t desc;
+	const sim_time_t ch_time = USART_CHAR(USART_BAUD);
+	sim_time_t t0, t1, last;
+
+	memset(&desc, 0, sizeof(desc));
+	desc.buf = buf;
+	desc.max_len = sizeof(buf);
+	TEST_CHECK(platform_usart_esp_rx_async(&desc));
+	usart_make_bytes(sent, sizeof(sent));
+	usart_polled = &desc;
+	usart_compl = 0;
+
+	t0 = sim_now();
+	sim_usart_send(0, sent, 20);
+	usart_poll_until(t0 + 20 * ch_time + gap);
+	t1 = sim_now();
+	sim_usart_send(0, &sent[20], 20);
+	last = joined ? t1 + 20 * ch_time : t0 + 20 * ch_time;
+	usart_poll_until(t1 + 20 * ch_time + USART_IDLE(USART_BAUD) +
+		3 * USART_JIFFY);
+
+	TEST_CHECK(desc.compl_type == PLATFORM_USART_RX_COMPL_DATA);
+	TEST_CHECK(desc.compl_info.data_len == (joined ? 40 : 20) &&
+		memcmp(buf, sent, desc.compl_info.data_len) == 0);
+	TEST_CHECK(usart_compl >= last + USART_IDLE(USART_BAUD));
+	TEST_CHECK(usart_compl <= last + USART_IDLE(USART_BAUD) +
+		2 * USART_JIFFY);
+	platform_usart_esp_rx_abort();
+}
+
+static void usart_test_idle(void)
+{
+	const sim_time_t ch_time = USART_CHAR(USART_BAUD);
+	unsigned int n;
+
+	for (n = 0; n < USART_NR_ROUNDS; ++n) {
+		// Back to back, or up to one and a half characters apart
+		usart_check_gap(test_rand_below((uint32_t)(ch_time * 3 / 2)),
+			true);
+
+		// Four characters apart, or more
+		usart_check_gap(4 * ch_time + test_rand_below((uint32_t)
+			(4 * ch_time)), false);
+	}
+}
+
+// NMEA sentences, matched on '\n' and re-armed for from a polling loop
+static void usart_test_match(void)
+{
+	static const char *const lines[] = {
+		"$GPRMC,123519,A,4807.038,N,01131.000,E,022.4,084.4,230394,"
+			"003.1,W*6A\r\n",
+		"$GPGGA,123519,4807.038,N,01131.000,E,1,08,0.9,545.4,M,46.9,"
+			"M,,*47\r\n",
+		"$GPGSA,A,3,04,05,,09,12,,,24,,,,,2.5,1.3,2.1*39\r\n",
+		"$GPVTG,054.7,T,034.4,M,005.5,N,010.2,K*48\r\n",
+	};
+	static char buf[USART_RX_LEN];
+	platform_usart_rx_async_desc_t desc;
+	unsigned int n, x, nr_lines = 0;
+	platform_tick_t last, now;
+	sim_time_t end;
+
+	memset(&desc, 0, sizeof(desc));
+	desc.buf = buf;
+	desc.max_len = sizeof(buf);
+	desc.mode = PLATFORM_USART_RX_MODE_MATCH;
+	desc.mode_cfg.match = '\n';
+	TEST_CHECK(platform_usart_gps_rx_async(&desc));
+
+	for (n = 0; n < USART_NR_ROUNDS; ++n) {
+		end = sim_now();
+		last = platform_tick_get();
+		for (x = 0; x < 4; ++x) {
+			sim_usart_send(5, lines[x], strlen(lines[x]));
+			end += strlen(lines[x]) * USART_CHAR(USART_BAUD);
+		}
+
+		for (x = 0; sim_now() < end + USART_JIFFY; ) {
+			__WFI();
+			if (desc.compl_type == PLATFORM_USART_RX_COMPL_NONE)
+				continue;
+
+			TEST_CHECK(desc.compl_type ==
+				PLATFORM_USART_RX_COMPL_MATCH);
+			TEST_CHECK(x < 4 &&
+				desc.compl_info.data_len == strlen(lines[x]) &&
+				memcmp(buf, lines[x], strlen(lines[x])) == 0);
+
+			// Stamped with the '\n', which woke us up just now
+			now = platform_tick_get();
+			TEST_CHECK(platform_tick_expired(desc.compl_tick, last) &&
+				desc.compl_tick != last);
+			TEST_CHECK(platform_tick_expired(now, desc.compl_tick) &&
+				now - desc.compl_tick <= PLATFORM_TICKS_US(
+					PLATFORM_TICK_PERIOD_US));
+			last = desc.compl_tick;
+			++x;
+			++nr_lines;
+			TEST_CHECK(platform_usart_gps_rx_async(&desc));
+		}
+	}
+	TEST_CHECK(nr_lines == 4 * USART_NR_ROUNDS);
+	platform_usart_gps_rx_abort();
+}
+
+// Sync-hunting descriptors with no sync bytes, or more than there is room for
+static void usart_test_refused(void)
+{
+	static const uint8_t modes[] = {
+		PLATFORM_USART_RX_MODE_HDRLEN, PLATFORM_USART_RX_MODE_FIXED
+	};
+	static char buf[USART_RX_LEN];
+	platform_usart_rx_async_desc_t desc;
+	unsigned int m, n;
+	bool ok;
+
+	for (m = 0; m < sizeof(modes); ++m) {
+		for (n = 0; n < 256; ++n) {
+			memset(&desc, 0, sizeof(desc));
+			desc.buf = buf;
+			desc.max_len = sizeof(buf);
+			desc.mode = modes[m];
+			desc.mode_cfg.nr_sync = (uint8_t)n;
+			desc.mode_cfg.len_ofs = 2;
+			ok = n >= 1 && n <= sizeof(desc.mode_cfg.sync);
+
+			TEST_CHECK(platform_usart_pms_rx_async(&desc) == ok);
+			platform_usart_pms_rx_abort();
+			TEST_CHECK(platform_usart_rx_queue(PLATFORM_USART_PMS,
+				&desc) == ok);
+			platform_usart_pms_rx_abort();
+		}
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+/// Messages a TX queue holds
+#define USART_TXQ_LEN	8
+
+/*
+ * Turn on the transmitter of the PMS5003T link, the one with no DMAC
+ * channel; set up afresh each time, as its queue is never handed back
+ */
+static void usart_pms_tx_on(void)
+{
+	sercom_usart_int_registers_t *r = &SERCOM3_REGS->USART_INT;
+
+	platform_usart_pms_init();
+	r->SERCOM_CTRLA &= ~(1 << 1);
+	r->SERCOM_CTRLB |= (1 << 16);
+	r->SERCOM_CTRLA |= (1 << 1);
+}
+
+// Random fragments through the DRE handler, a queue's worth at a time
+static void usart_test_dre(void)
+{
+	static platform_usart_tx_msg_t msg[USART_TXQ_LEN];
+	static platform_usart_tx_bufdesc_t desc[USART_TXQ_LEN][8];
+	static char pool[1024];
+	static uint8_t expect[USART_TXQ_LEN * 8 * 32];
+	line_t *l = &usart_lines[PLATFORM_USART_PMS];
+	unsigned int n, x, y;
+	size_t total;
+	uint16_t len;
+
+	usart_make_bytes((uint8_t *)pool, sizeof(pool));
+	for (n = 0; n < USART_NR_ROUNDS; ++n) {
+		usart_pms_tx_on();
+		memset(msg, 0, sizeof(msg));
+		l->len = 0;
+		total = 0;
+		for (x = 0; x < USART_TXQ_LEN; ++x) {
+			msg[x].desc = desc[x];
+			msg[x].nr_desc = 1 + test_rand_below(8);
+			for (y = 0; y < msg[x].nr_desc; ++y) {
+				len = (uint16_t)test_rand_below(33);
+				desc[x][y].buf = test_rand_below(8) == 0 ? NULL :
+					&pool[test_rand_below(
+						sizeof(pool) - len + 1)];
+				desc[x][y].len = len;
+				if (desc[x][y].buf == NULL)
+					continue;
+				memcpy(&expect[total], desc[x][y].buf, len);
+				total += len;
+			}
+			TEST_CHECK(platform_usart_tx_submit(
+				PLATFORM_USART_PMS, &msg[x]));
+		}
+
+		while (msg[USART_TXQ_LEN - 1].state ==
+		       PLATFORM_USART_TX_MSG_QUEUED)
+			__WFI();
+		usart_block_until(sim_now() + 2 * USART_CHAR(USART_BAUD));
+
+		for (x = 0; x < USART_TXQ_LEN; ++x)
+			TEST_CHECK(msg[x].state == PLATFORM_USART_TX_MSG_SENT);
+		TEST_CHECK(l->len == total &&
+			memcmp(l->buf, expect, total) == 0);
+	}
+	platform_usart_pms_init();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+// Time spent in handlers over a stretch of @p len, with the main loop held
+static sim_time_t bench_isr_time(sim_time_t len)
+{
+	sim_stats_t st0, st;
+
+	sim_stats(&st0);
+	usart_block_until(sim_now() + len);
+	sim_stats(&st);
+	return st.in_isr - st0.in_isr;
+}
+
+// What a received byte costs, on the ESP8266 link
+static void bench_rxc(void)
+{
+	static char buf[1024];
+	static uint8_t sent[1000];
+	const sim_time_t len = sizeof(sent) * USART_CHAR(USART_BAUD) +
+		USART_JIFFY;
+	platform_usart_rx_async_desc_t desc;
+	sim_usart_stats_t sst0, sst;
+	sim_time_t idle, busy;
+
+	idle = bench_isr_time(len);
+
+	memset(&desc, 0, sizeof(desc));
+	desc.buf = buf;
+	desc.max_len = sizeof(buf);
+	TEST_CHECK(platform_usart_esp_rx_async(&desc));
+	usart_make_bytes(sent, sizeof(sent));
+	sim_usart_stats(0, &sst0);
+	sim_usart_send(0, sent, sizeof(sent));
+	busy = bench_isr_time(len);
+	sim_usart_stats(0, &sst);
+	platform_usart_esp_rx_abort();
+
+	TEST_CHECK(sst.nr_rxc - sst0.nr_rxc == sizeof(sent));
+	printf("  RXC, per byte          %6.2f us\n",
+		(double)(busy - idle) / sizeof(sent) / SIM_TICKS_PER_US);
+}
+
+// What a transmitted byte costs, through the DRE handler
+static void bench_dre(void)
+{
+	static platform_usart_tx_msg_t msg;
+	static platform_usart_tx_bufdesc_t desc[4];
+	static char buf[1000];
+	const sim_time_t len = sizeof(buf) * USART_CHAR(USART_BAUD) +
+		USART_JIFFY;
+	sim_time_t idle, busy;
+	unsigned int x;
+
+	idle = bench_isr_time(len);
+
+	usart_pms_tx_on();
+	for (x = 0; x < 4; ++x) {
+		desc[x].buf = &buf[x * sizeof(buf) / 4];
+		desc[x].len = sizeof(buf) / 4;
+	}
+	memset(&msg, 0, sizeof(msg));
+	msg.desc = desc;
+	msg.nr_desc = 4;
+	TEST_CHECK(platform_usart_tx_submit(PLATFORM_USART_PMS, &msg));
+	busy = bench_isr_time(len);
+	platform_usart_pms_init();
+
+	printf("  DRE + TXC, per byte    %6.2f us\n",
+		(double)(busy - idle) / sizeof(buf) / SIM_TICKS_PER_US);
+}
+
+/// Stretches a second of traffic is sent in, so that it fits on the line
+#define BENCH_NR_SLICES	10
+
+/*
+ * A second of traffic on all four links, with the ESP8266 at @p esp_baud,
+ * and the main loop held up all along
+ */
+static void bench_held(uint32_t esp_baud)
+{
+	static char buf[USART_NR_CH][16384];
+	static uint8_t sent[16384];
+	const sim_time_t slice = SIM_TICKS_MS(1000) / BENCH_NR_SLICES;
+	static platform_usart_rx_async_desc_t desc[USART_NR_CH];
+	platform_usart_stats_t ust0[USART_NR_CH], ust;
+	sim_usart_stats_t sst0[USART_NR_CH], sst;
+	sim_stats_t st0, st;
+	unsigned int ch, n;
+	uint32_t baud;
+
+	TEST_CHECK(platform_usart_set_baud(PLATFORM_USART_ESP, esp_baud));
+	usart_lines[PLATFORM_USART_ESP].dev.baud = esp_baud;
+	usart_make_bytes(sent, sizeof(sent));
+
+	for (ch = 0; ch < USART_NR_CH; ++ch) {
+		memset(&desc[ch], 0, sizeof(desc[ch]));
+		desc[ch].buf = buf[ch];
+		desc[ch].max_len = sizeof(buf[ch]);
+		TEST_CHECK(usart_rx_async[ch](&desc[ch]));
+		platform_usart_stats(ch, &ust0[ch], false);
+		sim_usart_stats(usart_sercom[ch], &sst0[ch]);
+	}
+	sim_stats(&st0);
+	for (n = 0; n < BENCH_NR_SLICES; ++n) {
+		for (ch = 0; ch < USART_NR_CH; ++ch) {
+			baud = ch == PLATFORM_USART_ESP ? esp_baud : USART_BAUD;
+			sim_usart_send(usart_sercom[ch], sent,
+				baud / 10 / BENCH_NR_SLICES);
+		}
+		usart_block_until(sim_now() + slice);
+	}
+	usart_block_until(sim_now() + USART_JIFFY);
+	sim_stats(&st);
+
+	printf("  ESP8266 at %6u baud: %4.1f%% of the time in handlers\n",
+		esp_baud, 100.0 * (st.in_isr - st0.in_isr) /
+			(BENCH_NR_SLICES * slice + USART_JIFFY));
+	for (ch = 0; ch < USART_NR_CH; ++ch) {
+		usart_rx_abort[ch]();
+		platform_usart_stats(ch, &ust, false);
+		sim_usart_stats(usart_sercom[ch], &sst);
+		printf("    %s %6u B arrived, %6u received\n",
+			usart_lines[ch].dev.name,
+			sst.nr_arrived - sst0[ch].nr_arrived,
+			ust.nr_rx_bytes - ust0[ch].nr_rx_bytes);
+		TEST_CHECK(ust.nr_rx_bytes - ust0[ch].nr_rx_bytes ==
+			sst.nr_arrived - sst0[ch].nr_arrived);
+		TEST_CHECK(sst.nr_overrun == sst0[ch].nr_overrun);
+	}
+
+	TEST_CHECK(platform_usart_set_baud(PLATFORM_USART_ESP, USART_BAUD));
+	usart_lines[PLATFORM_USART_ESP].dev.baud = USART_BAUD;
+}
+
+static void bench(void)
+{
+	printf("handlers, at %u baud:\n", USART_BAUD);
+	bench_rxc();
+	bench_dre();
+	printf("a second of traffic, with the main loop held up:\n");
+	bench_held(USART_BAUD);
+	bench_held(115200);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+static void done(void)
+{
+	exit(2);
+}
+
+int main(void)
+{
+	unsigned int ch;
+
+	sim_init(SIM_TIME_NEVER, 0, done);
+	for (ch = 0; ch < USART_NR_CH; ++ch)
+		sim_usart_attach(usart_sercom[ch], &usart_lines[ch].dev);
+	platform_init();
+
+	usart_test_blocked();
+	usart_test_idle();
+	usart_test_match();
+	usart_test_refused();
+	usart_test_dre();
+	bench();
+	return test_done("usart");
+}
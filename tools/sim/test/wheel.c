@@ -0,0 +1,259 @@
+/**
+ * @file wheel.c
+ * @brief Host test of the timer wheel, on the simulated board
+ *
+ * A few thousand timers are armed with delays spread over all four levels
+ * of the wheel, with the main loop sleeping in between as the firmware's
+ * does (tickless, through platform_do_loop_one()). Some are cancelled from
+ * the main loop, some from the callbacks of others (which may sit on the
+ * same detached slot), and some re-arm themselves from their callback.
+ *
+ * Each timer must fire once per arming, in the SysTick handler of the jiffy
+ * it is due in: never before its delay has passed, and no later than the
+ * delay rounded up to whole jiffies, counted from the end of the jiffy in
+ * progress when it was armed. Some are armed with interrupts masked after
+ * SysTick has reloaded, as can happen from any handler. Timers must fire in
+ * the order they are due in, and cancelled ones not at all.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "platform.h"
+#include "sim.h"
+#include "test.h"
+
+/// Timers, and the bits of the wheel, as in platform/systick.c
+#define WHEEL_NR_TIMERS	4096
+#define WHEEL_BITS	6
+#define WHEEL_LEVELS	4
+
+/// Jiffy length
+#define WHEEL_JIFFY	PLATFORM_TICKS_US(PLATFORM_TICK_PERIOD_US)
+
+/*
+ * Delays on the top level are kept to its first few slots, or the test
+ * would run for hours of simulated time
+ */
+#define WHEEL_DELAY_MAX	(3u << (3 * WHEEL_BITS))
+
+/// Latest a callback may run into its jiffy: the handler's own latency
+#define WHEEL_LATENCY_MAX	PLATFORM_TICKS_US(100)
+
+typedef struct wheel_timer_type {
+	platform_timer_t	timer;
+
+	/// When armed, with what delay, and when to cancel it; 0 for never
+	platform_tick_t		armed_at;
+	platform_tick_t		delay;
+	platform_tick_t		cancel_at;
+
+	/// Another timer for the callback to cancel; -1 for none
+	int			victim;
+
+	/// Times left to re-arm from the callback
+	unsigned int		nr_rearms;
+
+	unsigned int		nr_fired;
+	bool			cancelled;
+	bool			done;
+} wheel_timer_t;
+
+static wheel_timer_t wheel_timers[WHEEL_NR_TIMERS];
+static unsigned int wheel_nr_pending;
+static platform_tick_t wheel_last_fired;
+static unsigned int wheel_nr_level[WHEEL_LEVELS];
+
+// A delay on a random level, not on a jiffy boundary
+static platform_tick_t wheel_delay(void)
+{
+	unsigned int level = test_rand_below(WHEEL_LEVELS);
+	uint32_t lo = (level == 0) ? 0 : 1u << (level * WHEEL_BITS);
+	uint32_t hi = (level == WHEEL_LEVELS - 1) ?
+		WHEEL_DELAY_MAX : 1u << ((level + 1) * WHEEL_BITS);
+
+	/*
+	 * Counted from the next jiffy, as the wheel does; a delay right at
+	 * the top of a level may end up on the next one up
+	 */
+	++wheel_nr_level[level];
+	return (platform_tick_t)(lo + test_rand_below(hi - lo - 1)) *
+		WHEEL_JIFFY + test_rand_below(WHEEL_JIFFY);
+}
+
+// Arm a timer, noting the time as of the arming itself
+static void wheel_arm(wheel_timer_t *w, platform_tick_t delay)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	w->armed_at = platform_tick_get();
+	w->delay = delay;
+	platform_timer_arm(&w->timer, delay);
+	__set_PRIMASK(primask);
+}
+
+static void wheel_finish(wheel_timer_t *w)
+{
+	if (!w->done) {
+		w->done = true;
+		--wheel_nr_pending;
+	}
+}
+
+static void wheel_cancel(wheel_timer_t *w)
+{
+	if (w->done)
+		return;
+	platform_timer_cancel(&w->timer);
+	TEST_CHECK(!platform_timer_armed(&w->timer));
+	w->cancelled = true;
+	wheel_finish(w);
+}
+
+// Timer callback, from SysTick_Handler()
+static void wheel_fired(platform_timer_t *timer, void *arg)
+{
+	wheel_timer_t *w = arg;
+	platform_tick_t now = platform_tick_get();
+
+	(void)timer;
+	++w->nr_fired;
+	TEST_CHECK(!w->cancelled && !w->done);
+	TEST_CHECK(!platform_timer_armed(&w->timer));
+
+	/*
+	 * On time: in the handler of the jiffy after the delay, rounded up
+	 * to whole jiffies, is over, counting from the one after the arming
+	 */
+	TEST_CHECK(now - w->armed_at >= w->delay);
+	TEST_CHECK(now / WHEEL_JIFFY == w->armed_at / WHEEL_JIFFY +
+		(w->delay + WHEEL_JIFFY - 1) / WHEEL_JIFFY + 1);
+	TEST_CHECK(now % WHEEL_JIFFY < WHEEL_LATENCY_MAX);
+
+	// In order
+	TEST_CHECK(now >= wheel_last_fired);
+	wheel_last_fired = now;
+
+	if (w->victim >= 0) {
+		wheel_cancel(&wheel_timers[w->victim]);
+		w->victim = -1;
+	}
+	if (w->nr_rearms > 0) {
+		--w->nr_rearms;
+		wheel_arm(w, wheel_delay());
+		TEST_CHECK(platform_timer_armed(&w->timer));
+		return;
+	}
+	wheel_finish(w);
+}
+
+static void wheel_test(void)
+{
+	wheel_timer_t *w;
+	platform_tick_t now;
+	unsigned int x;
+
+	for (x = 0; x < WHEEL_NR_TIMERS; ++x) {
+		w = &wheel_timers[x];
+		w->timer.fn = wheel_fired;
+		w->timer.arg = w;
+		w->victim = -1;
+		switch (test_rand_below(8)) {
+		case 0:
+		case 1:
+			// Cancelled from the main loop, before it is due
+			w->cancel_at = 1;
+			break;
+		case 2:
+			/*
+			 * Cancels another, armed before it; which may be due
+			 * at the same time
+			 */
+			if (x > 0)
+				w->victim = (int)test_rand_below(x);
+			break;
+		case 3:
+			w->nr_rearms = 1 + test_rand_below(3);
+			break;
+		}
+	}
+
+	/*
+	 * Armed in batches with interrupts masked, as from a handler; every
+	 * other batch, after SysTick has reloaded, with its handler yet to
+	 * count the jiffy
+	 */
+	wheel_nr_pending = WHEEL_NR_TIMERS;
+	for (x = 0; x < WHEEL_NR_TIMERS; ++x) {
+		w = &wheel_timers[x];
+		if ((x & 63) == 0)
+			__disable_irq();
+		if ((x & 127) == 0) {
+			while ((SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) == 0)
+				;
+		}
+		wheel_arm(w, wheel_delay());
+		TEST_CHECK(platform_timer_armed(&w->timer));
+		if (w->cancel_at != 0)
+			w->cancel_at = w->armed_at + 1 +
+				test_rand_below((uint32_t)w->delay);
+		if ((x & 63) == 63) {
+			__enable_irq();
+			platform_do_loop_one();
+		}
+	}
+
+	while (wheel_nr_pending > 0) {
+		platform_do_loop_one();
+		now = platform_tick_get();
+		for (x = 0; x < WHEEL_NR_TIMERS; ++x) {
+			w = &wheel_timers[x];
+			if (w->cancel_at != 0 && !w->done &&
+			    platform_tick_expired(now, w->cancel_at))
+				wheel_cancel(w);
+		}
+	}
+
+	// A sleep past the last of them, in case any is still armed
+	now = platform_tick_get();
+	while (platform_tick_get() - now < 4 * WHEEL_JIFFY)
+		platform_do_loop_one();
+
+	for (x = 0; x < WHEEL_NR_TIMERS; ++x) {
+		w = &wheel_timers[x];
+		TEST_CHECK(w->done);
+		TEST_CHECK(!platform_timer_armed(&w->timer));
+		TEST_CHECK(w->cancelled || w->nr_rearms == 0);
+	}
+	for (x = 0; x < WHEEL_LEVELS; ++x)
+		TEST_CHECK(wheel_nr_level[x] > 0);
+}
+
+static void done(void)
+{
+	exit(2);
+}
+
+int main(void)
+{
+	sim_stats_t st;
+	unsigned int x, nr_cancelled = 0, nr_fired = 0;
+
+	sim_init(SIM_TIME_NEVER, 0, done);
+	platform_init();
+
+	wheel_test();
+
+	for (x = 0; x < WHEEL_NR_TIMERS; ++x) {
+		nr_cancelled += wheel_timers[x].cancelled;
+		nr_fired += wheel_timers[x].nr_fired;
+	}
+	sim_stats(&st);
+	printf("%u timers fired, %u cancelled, over %.0f s simulated, "
+		"in %u sleeps\n", nr_fired, nr_cancelled,
+		sim_now() / (SIM_TICKS_PER_US * 1e6), st.nr_sleeps);
+	return test_done("wheel");
+}
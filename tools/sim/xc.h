@@ -0,0 +1,312 @@
+/**
+ * @file xc.h
+ * @brief Host stand-in for the XC32 device header (PIC32CM LS00 subset)
+ *
+ * Only what the firmware touches is declared, under the names of the device
+ * family pack; register offsets are not kept, as nothing on the host depends
+ * on them. The register blocks are plain memory owned by sim.c. Every
+ * *_REGS, @c SysTick and @c SCB expression goes through sim_regs(), so that
+ * the simulated peripherals pick up whatever was written since the previous
+ * access (and time moves on by one bus access) before the next one is made.
+ *
+ * A driver that keeps a pointer to its registers, as platform/usart.c does,
+ * bypasses sim_regs(); its writes are picked up at the next register access
+ * or intrinsic instead. See sim.c for how writes to registers with special
+ * write semantics are told apart from the values published there.
+ */
+
+#if !defined(SIM_XC_H_)
+#define SIM_XC_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// C linkage should be maintained
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+
+/*
+ * XC32 takes interrupt() to mean an exception handler, which on the M23 is a
+ * plain function anyway; the x86 meaning would change the calling convention.
+ */
+#define interrupt(...)
+
+/// Interrupt numbers; only their order matters here
+typedef enum IRQn {
+	SysTick_IRQn		= -1,
+	EIC_EXTINT_2_IRQn	= 5,
+	DMAC_0_IRQn		= 13,
+	DMAC_1_IRQn		= 14,
+	SERCOM0_0_IRQn		= 28,
+	SERCOM0_1_IRQn		= 29,
+	SERCOM0_2_IRQn		= 30,
+	SERCOM1_0_IRQn		= 32,
+	SERCOM1_1_IRQn		= 33,
+	SERCOM1_2_IRQn		= 34,
+	SERCOM3_0_IRQn		= 40,
+	SERCOM3_1_IRQn		= 41,
+	SERCOM3_2_IRQn		= 42,
+	SERCOM5_0_IRQn		= 48,
+	SERCOM5_1_IRQn		= 49,
+	SERCOM5_2_IRQn		= 50,
+	PERIPH_COUNT_IRQn	= 52
+} IRQn_Type;
+
+/// Core intrinsics; each is a point where pending interrupts may be taken
+uint32_t __get_PRIMASK(void);
+void __set_PRIMASK(uint32_t primask);
+void __disable_irq(void);
+void __enable_irq(void);
+void __DMB(void);
+void __DSB(void);
+void __ISB(void);
+void __WFI(void);
+
+void NVIC_SetPriority(IRQn_Type irq, uint32_t prio);
+void NVIC_EnableIRQ(IRQn_Type irq);
+void NVIC_DisableIRQ(IRQn_Type irq);
+
+//////////////////////////////////////////////////////////////////////////////
+
+/// SysTick, as in CMSIS
+typedef struct {
+	volatile uint32_t CTRL;
+	volatile uint32_t LOAD;
+	volatile uint32_t VAL;
+	volatile uint32_t CALIB;
+} SysTick_Type;
+
+/// System control block, as in CMSIS
+typedef struct {
+	volatile uint32_t CPUID;
+	volatile uint32_t ICSR;
+	volatile uint32_t VTOR;
+	volatile uint32_t AIRCR;
+	volatile uint32_t SCR;
+	volatile uint32_t CCR;
+	volatile uint32_t SHPR[2];
+	volatile uint32_t SHCSR;
+} SCB_Type;
+
+#define SCB_ICSR_PENDSTSET_Pos	26
+#define SCB_ICSR_PENDSTSET_Msk	(1UL << SCB_ICSR_PENDSTSET_Pos)
+#define SCB_ICSR_PENDSTCLR_Pos	25
+#define SCB_ICSR_PENDSTCLR_Msk	(1UL << SCB_ICSR_PENDSTCLR_Pos)
+
+typedef struct {
+	volatile uint32_t SERCOM_CTRLA;
+	volatile uint32_t SERCOM_CTRLB;
+	volatile uint32_t SERCOM_CTRLC;
+	volatile uint16_t SERCOM_BAUD;
+	volatile uint8_t  SERCOM_RXPL;
+	volatile uint8_t  SERCOM_INTENCLR;
+	volatile uint8_t  SERCOM_INTENSET;
+	volatile uint8_t  SERCOM_INTFLAG;
+	volatile uint16_t SERCOM_STATUS;
+	volatile uint32_t SERCOM_SYNCBUSY;
+	volatile uint8_t  SERCOM_RXERRCNT;
+	volatile uint32_t SERCOM_DATA;
+	volatile uint8_t  SERCOM_DBGCTRL;
+} sercom_usart_int_registers_t;
+
+typedef union {
+	sercom_usart_int_registers_t USART_INT;
+} sercom_registers_t;
+
+typedef struct {
+	volatile uint8_t  GCLK_CTRLA;
+	volatile uint32_t GCLK_SYNCBUSY;
+	volatile uint32_t GCLK_GENCTRL[5];
+	volatile uint32_t GCLK_PCHCTRL[41];
+} gclk_registers_t;
+
+typedef struct {
+	volatile uint8_t  MCLK_CTRLA;
+	volatile uint8_t  MCLK_INTENCLR;
+	volatile uint8_t  MCLK_INTENSET;
+	volatile uint8_t  MCLK_INTFLAG;
+	volatile uint8_t  MCLK_CPUDIV;
+	volatile uint32_t MCLK_AHBMASK;
+	volatile uint32_t MCLK_APBAMASK;
+	volatile uint32_t MCLK_APBBMASK;
+	volatile uint32_t MCLK_APBCMASK;
+} mclk_registers_t;
+
+typedef struct {
+	volatile uint32_t OSCCTRL_STATUS;
+	volatile uint8_t  OSCCTRL_OSC16MCTRL;
+	volatile uint16_t OSCCTRL_DFLLCTRL;
+	volatile uint32_t OSCCTRL_DFLLVAL;
+} oscctrl_registers_t;
+
+typedef struct {
+	volatile uint8_t  PM_SLEEPCFG;
+	volatile uint8_t  PM_PLCFG;
+	volatile uint8_t  PM_INTENCLR;
+	volatile uint8_t  PM_INTENSET;
+	volatile uint8_t  PM_INTFLAG;
+} pm_registers_t;
+
+typedef struct {
+	volatile uint32_t SUPC_STATUS;
+	volatile uint32_t SUPC_VREGPLL;
+} supc_registers_t;
+
+typedef struct {
+	volatile uint16_t NVMCTRL_CTRLA;
+	volatile uint32_t NVMCTRL_CTRLB;
+	volatile uint16_t NVMCTRL_INTENCLR;
+	volatile uint16_t NVMCTRL_INTENSET;
+	volatile uint16_t NVMCTRL_INTFLAG;
+	volatile uint16_t NVMCTRL_STATUS;
+	volatile uint32_t NVMCTRL_ADDR;
+} nvmctrl_registers_t;
+
+#define NVMCTRL_CTRLA_CMD_Pos		0
+#define NVMCTRL_CTRLA_CMD_Msk		(0x7FU << NVMCTRL_CTRLA_CMD_Pos)
+#define NVMCTRL_CTRLA_CMD_ER		(0x02U << NVMCTRL_CTRLA_CMD_Pos)
+#define NVMCTRL_CTRLA_CMD_WP		(0x04U << NVMCTRL_CTRLA_CMD_Pos)
+#define NVMCTRL_CTRLA_CMD_PBC		(0x44U << NVMCTRL_CTRLA_CMD_Pos)
+#define NVMCTRL_CTRLA_CMDEX_Pos		8
+#define NVMCTRL_CTRLA_CMDEX_KEY		(0xA5U << NVMCTRL_CTRLA_CMDEX_Pos)
+#define NVMCTRL_STATUS_LOAD_Msk		(0x1U << 1)
+#define NVMCTRL_STATUS_READY_Msk	(0x1U << 2)
+#define NVMCTRL_INTFLAG_DONE_Msk	(0x1U << 0)
+#define NVMCTRL_INTFLAG_PROGE_Msk	(0x1U << 1)
+#define NVMCTRL_INTFLAG_LOCKE_Msk	(0x1U << 2)
+#define NVMCTRL_INTFLAG_NVME_Msk	(0x1U << 3)
+#define NVMCTRL_INTFLAG_KEYE_Msk	(0x1U << 4)
+#define NVMCTRL_INTFLAG_NSCHK_Msk	(0x1U << 5)
+#define NVMCTRL_INTFLAG_Msk		0x3FU
+
+typedef struct {
+	volatile uint8_t  EIC_CTRLA;
+	volatile uint32_t EIC_SYNCBUSY;
+	volatile uint32_t EIC_DPRESCALER;
+} eic_registers_t;
+
+typedef struct {
+	volatile uint8_t  EVSYS_CTRLA;
+} evsys_registers_t;
+
+typedef struct {
+	volatile uint32_t PORT_DIR;
+	volatile uint32_t PORT_DIRCLR;
+	volatile uint32_t PORT_DIRSET;
+	volatile uint32_t PORT_DIRTGL;
+	volatile uint32_t PORT_OUT;
+	volatile uint32_t PORT_OUTCLR;
+	volatile uint32_t PORT_OUTSET;
+	volatile uint32_t PORT_OUTTGL;
+	volatile uint32_t PORT_IN;
+	volatile uint8_t  PORT_PMUX[16];
+	volatile uint8_t  PORT_PINCFG[32];
+} port_group_registers_t;
+
+typedef struct {
+	port_group_registers_t GROUP[2];
+} port_registers_t;
+
+typedef struct {
+	volatile uint32_t TCC_CTRLA;
+	volatile uint8_t  TCC_CTRLBCLR;
+	volatile uint8_t  TCC_CTRLBSET;
+	volatile uint32_t TCC_SYNCBUSY;
+	volatile uint32_t TCC_WEXCTRL;
+	volatile uint32_t TCC_INTENCLR;
+	volatile uint32_t TCC_INTENSET;
+	volatile uint32_t TCC_INTFLAG;
+	volatile uint32_t TCC_STATUS;
+	volatile uint32_t TCC_COUNT;
+	volatile uint32_t TCC_WAVE;
+	volatile uint32_t TCC_PER;
+	volatile uint32_t TCC_CC[4];
+} tcc_registers_t;
+
+#define TCC_WEXCTRL_OTMX(value)	((uint32_t)(value) & 0x3)
+
+/// DMAC transfer descriptor, as laid out in SRAM (16 bytes)
+typedef struct {
+	volatile uint16_t DMAC_BTCTRL;
+	volatile uint16_t DMAC_BTCNT;
+	volatile uint32_t DMAC_SRCADDR;
+	volatile uint32_t DMAC_DSTADDR;
+	volatile uint32_t DMAC_DESCADDR;
+} dmac_descriptor_registers_t;
+
+typedef struct {
+	volatile uint16_t DMAC_CTRL;
+	volatile uint32_t DMAC_BASEADDR;
+	volatile uint32_t DMAC_WRBADDR;
+	volatile uint8_t  DMAC_CHID;
+	volatile uint8_t  DMAC_CHCTRLA;
+	volatile uint32_t DMAC_CHCTRLB;
+	volatile uint8_t  DMAC_CHINTENCLR;
+	volatile uint8_t  DMAC_CHINTENSET;
+	volatile uint8_t  DMAC_CHINTFLAG;
+	volatile uint8_t  DMAC_CHSTATUS;
+} dmac_registers_t;
+
+//////////////////////////////////////////////////////////////////////////////
+
+/// Register blocks known to the simulator
+typedef enum sim_blk_type {
+	SIM_BLK_SYSTICK,
+	SIM_BLK_SCB,
+	SIM_BLK_SERCOM0,
+	SIM_BLK_SERCOM1,
+	SIM_BLK_SERCOM2,
+	SIM_BLK_SERCOM3,
+	SIM_BLK_SERCOM4,
+	SIM_BLK_SERCOM5,
+	SIM_BLK_GCLK,
+	SIM_BLK_MCLK,
+	SIM_BLK_OSCCTRL,
+	SIM_BLK_PM,
+	SIM_BLK_SUPC,
+	SIM_BLK_NVMCTRL,
+	SIM_BLK_EIC,
+	SIM_BLK_EVSYS,
+	SIM_BLK_PORT,
+	SIM_BLK_TCC0,
+	SIM_BLK_TCC1,
+	SIM_BLK_TCC2,
+	SIM_BLK_DMAC,
+
+	SIM_NR_BLK
+} sim_blk_t;
+
+/// Bring the peripherals up to date, and get a register block
+void *sim_regs(sim_blk_t blk);
+
+#define SysTick		((SysTick_Type *)sim_regs(SIM_BLK_SYSTICK))
+#define SCB		((SCB_Type *)sim_regs(SIM_BLK_SCB))
+#define SERCOM0_REGS	((sercom_registers_t *)sim_regs(SIM_BLK_SERCOM0))
+#define SERCOM1_REGS	((sercom_registers_t *)sim_regs(SIM_BLK_SERCOM1))
+#define SERCOM2_REGS	((sercom_registers_t *)sim_regs(SIM_BLK_SERCOM2))
+#define SERCOM3_REGS	((sercom_registers_t *)sim_regs(SIM_BLK_SERCOM3))
+#define SERCOM4_REGS	((sercom_registers_t *)sim_regs(SIM_BLK_SERCOM4))
+#define SERCOM5_REGS	((sercom_registers_t *)sim_regs(SIM_BLK_SERCOM5))
+#define GCLK_REGS	((gclk_registers_t *)sim_regs(SIM_BLK_GCLK))
+#define MCLK_REGS	((mclk_registers_t *)sim_regs(SIM_BLK_MCLK))
+#define OSCCTRL_REGS	((oscctrl_registers_t *)sim_regs(SIM_BLK_OSCCTRL))
+#define PM_REGS		((pm_registers_t *)sim_regs(SIM_BLK_PM))
+#define SUPC_REGS	((supc_registers_t *)sim_regs(SIM_BLK_SUPC))
+#define NVMCTRL_SEC_REGS ((nvmctrl_registers_t *)sim_regs(SIM_BLK_NVMCTRL))
+#define EIC_SEC_REGS	((eic_registers_t *)sim_regs(SIM_BLK_EIC))
+#define EVSYS_SEC_REGS	((evsys_registers_t *)sim_regs(SIM_BLK_EVSYS))
+#define PORT_SEC_REGS	((port_registers_t *)sim_regs(SIM_BLK_PORT))
+#define TCC0_REGS	((tcc_registers_t *)sim_regs(SIM_BLK_TCC0))
+#define TCC1_REGS	((tcc_registers_t *)sim_regs(SIM_BLK_TCC1))
+#define TCC2_REGS	((tcc_registers_t *)sim_regs(SIM_BLK_TCC2))
+#define DMAC_SEC_REGS	((dmac_registers_t *)sim_regs(SIM_BLK_DMAC))
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifdef __cplusplus
+}
+#endif	// __cplusplus
+#endif	// !defined(SIM_XC_H_)